@@ -10,6 +10,29 @@
 /*
 modification history
 --------------------
+01x,17oct26,sgu  published MSG_Q_SPIN_MAX
+01w,17oct26,sgu  told the units of a named queue kept under the mutex
+01v,16oct26,sgu  told the single reservation of MSG_Q_SPSC
+01u,16oct26,sgu  added the handle cache and msgQList
+01t,16oct26,sgu  added msgQWatch
+01s,16oct26,sgu  added MSG_Q_LATENCY and msgQLatency
+01r,16oct26,sgu  added the 64-bit statistics to MSG_Q_STAT
+01q,16oct26,sgu  documented the repair after the owner death
+01p,16oct26,sgu  added MSG_Q_DURABLE, msgQSetSync and msgQSync
+01o,16oct26,sgu  added MSG_Q_HUGEPAGE
+01n,16oct26,sgu  added msgQReceiveAny
+01m,16oct26,sgu  added msgQGetFd
+01l,16oct26,sgu  added msgQSetSpin
+01k,16oct26,sgu  implemented MSG_Q_PRIORITY
+01j,16oct26,sgu  added MSG_PRI_LEVEL
+01i,16oct26,sgu  added MSG_Q_VARLEN
+01h,16oct26,sgu  added msgQReceiveBatch
+01g,16oct26,sgu  added msgQSendBatch
+01f,16oct26,sgu  added msgQReceivePeek and msgQReceiveRelease
+01e,16oct26,sgu  added msgQSendReserve and msgQSendCommit
+01d,16oct26,sgu  added MSG_Q_MPMC
+01c,16oct26,sgu  added MSG_Q_SPSC
+01b,16oct26,sgu  added Linux support
 01a,11nov11,sgu  created
 */
 
@@ -34,6 +57,15 @@ me via e-mail: gushengyuan2002@163.com
 /* version string length */
 #define VERSION_LEN     8
 
+/* max message queues msgQReceiveAny waits for */
+#define MSG_Q_ANY_MAX   64
+
+/* max length of a queue name kept by the registry, with the terminator */
+#define MSG_Q_NAME_MAX  64
+
+/* max rounds msgQSetSpin lets the tasks spin */
+#define MSG_Q_SPIN_MAX  1000000
+
 /* create an inter-thread message queue */
 #define msgQCreate(maxMsgs, maxMsgLength, options) \
         msgQCreateEx(maxMsgs, maxMsgLength, options, NULL)
@@ -45,8 +77,14 @@ typedef void* MSG_Q_ID;    /* message queue identify */
 
 /* message queue options for task waiting for a message */
 enum MSG_Q_OPTION{
-    MSG_Q_FIFO     = 0x0000,
-    MSG_Q_PRIORITY = 0x0001
+    MSG_Q_FIFO     = 0x0000, /* pended tasks are served in FIFO order */
+    MSG_Q_PRIORITY = 0x0001, /* pended tasks are served by their priority */
+    MSG_Q_SPSC     = 0x0002, /* lock-free ring, one sender and one receiver */
+    MSG_Q_MPMC     = 0x0004, /* lock-free ring, many senders and receivers */
+    MSG_Q_VARLEN   = 0x0008, /* messages packed in a ring of maxMsgs bytes */
+    MSG_Q_HUGEPAGE = 0x0010, /* shared memory backed by huge pages */
+    MSG_Q_DURABLE  = 0x0020, /* messages kept in a file across crashes */
+    MSG_Q_LATENCY  = 0x0040  /* time the messages kept in the queue */
 };
 
 /* message sending options for sending a message */
@@ -55,6 +93,12 @@ enum MSG_Q_PRIORITY{
     MSG_PRI_URGENT = 0x0001  /* put the message at the frond of the queue */
 };
 
+/* number of message priority levels, 0 is the lowest */
+#define MSG_PRI_LEVELS  32
+
+/* send a message at the end of priority level n */
+#define MSG_PRI_LEVEL(n) (0x0100 | ((n) & (MSG_PRI_LEVELS - 1)))
+
 /* message queue status */
 typedef struct tagMSG_Q_STAT {
     char version[VERSION_LEN];  /* library version */
@@ -62,10 +106,39 @@ typedef struct tagMSG_Q_STAT {
     UINT maxMsgLength;          /* max bytes in a message */
     int options;                /* message queue options */
     int msgNum;                 /* message number in the queue */
-    int sendTimes;              /* number of sent */
-    int recvTimes;              /* number of received */
+    int sendTimes;              /* number of sent, the low bits of sends */
+    int recvTimes;              /* number of received, of receives */
+    UINT pageSize;              /* bytes of the pages backing the queue */
+    unsigned long long sends;           /* messages sent */
+    unsigned long long receives;        /* messages received */
+    unsigned long long bytesSent;       /* bytes of the messages sent */
+    unsigned long long bytesReceived;   /* bytes of the messages received */
+    unsigned long long sendFull;        /* sends which found the queue full */
+    unsigned long long receiveEmpty;    /* receives which found it empty */
+    unsigned long long sendTimeouts;    /* sends which timed out waiting */
+    unsigned long long receiveTimeouts; /* receives which timed out waiting */
+    int peakDepth;              /* most messages queued at a time */
 }MSG_Q_STAT;
 
+/* queueing latency of a MSG_Q_LATENCY message queue, in nanoseconds */
+typedef struct tagMSG_Q_LAT_STAT {
+    unsigned long long count;   /* messages timed */
+    unsigned long long p50;     /* median time a message is queued */
+    unsigned long long p99;     /* 99th percentile */
+    unsigned long long p999;    /* 99.9th percentile */
+    unsigned long long max;     /* longest time a message is queued */
+}MSG_Q_LAT_STAT;
+
+/* a named message queue of the registry */
+typedef struct tagMSG_Q_INFO {
+    char name[MSG_Q_NAME_MAX];  /* name, or path of a MSG_Q_DURABLE queue */
+    int maxMsgs;                /* max messages that can be queued */
+    int maxMsgLength;           /* max bytes in a message */
+    int options;                /* message queue options */
+    int pid;                    /* process which created the queue */
+    unsigned long long memSize; /* bytes of the shared memory */
+}MSG_Q_INFO;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -80,20 +153,86 @@ extern "C"
  * <name> message name, if name equals NULL, create an inter-thread message
  * queue, or create an inter-process message queue.
  *
+ * The option MSG_Q_PRIORITY queues the tasks pended for a message, or for a
+ * free slot, by their scheduling priority instead: a message, or a slot, is
+ * handed over to the highest priority task directly, and tasks of the same
+ * priority are served in FIFO order. The real-time tasks rank above all the
+ * others on Linux. Up to 64 tasks pend by priority at a time, any more of
+ * them pend in FIFO order behind. A sender pended for room in a MSG_Q_VARLEN
+ * queue always pends in FIFO order.
+ *
+ * The option MSG_Q_SPSC creates a lock-free ring for a queue which has exactly
+ * one sending task and one receiving task at a time, in which case a message
+ * is passed without taking any lock. The option MSG_Q_MPMC creates a
+ * lock-free ring for any number of sending and receiving tasks, where each
+ * message costs one compare-and-swap on each side. The messages of both rings
+ * are always delivered in FIFO order, the priority of a message is ignored,
+ * and so is MSG_Q_PRIORITY.
+ *
+ * The option MSG_Q_VARLEN packs the messages back to back in a byte ring with
+ * a small header each, instead of reserving <maxMsgLength> bytes for every
+ * message. <maxMsgs> is the number of bytes of the ring then, which must hold
+ * one message of <maxMsgLength> bytes at least, so the queue is bounded by the
+ * bytes queued rather than by the number of messages. The messages are
+ * delivered in FIFO order too, and msgQSendReserve and msgQReceivePeek are not
+ * supported.
+ *
+ * The option MSG_Q_HUGEPAGE backs the memory of the queue by huge pages, to
+ * save the TLB misses of copying the messages of a large queue. On Linux an
+ * inter-thread queue is mapped with MAP_HUGETLB, and a named queue is a file
+ * in the first mounted hugetlbfs; the system must have reserved enough huge
+ * pages, otherwise the queue falls back to the regular pages. msgQStat tells
+ * the page size the queue got. The option is ignored on Windows.
+ *
+ * A named queue survives a process killed while it holds the mutex of the
+ * queue: the tasks pended on the mutex notice the death within 100 ms, and
+ * the one which takes the mutex over rolls back the send or receive cut
+ * short, and gives the free slots and messages the dead task held, in a
+ * bounded time whatever the size of the queue. The free slots and messages
+ * of a named queue are only taken and given under the mutex, so a process
+ * killed anywhere else holds none of them, and the tasks pended in the wait
+ * list of MSG_Q_PRIORITY free the entries of the dead ones within 100 ms.
+ * The processes of a named queue must share a PID namespace.
+ *
+ * The option MSG_Q_DURABLE keeps the queue in the file <name>, which must be a
+ * path with a slash, so the queued messages outlive the processes and a
+ * restart of the host. The first process which attaches to the file after
+ * all the others have gone recovers the queue from the commit stamp and the
+ * checksum each message carries: the messages committed before a crash are
+ * delivered again in their order, a message being sent is dropped, and a
+ * message received by msgQReceivePeek but not released yet is kept. The file
+ * is written back by the kernel in its own time, or as set by msgQSetSync,
+ * and msgQDelete never removes it. Only the list mode is durable, not
+ * MSG_Q_SPSC, MSG_Q_MPMC or MSG_Q_VARLEN, and only on Linux.
+ *
+ * The option MSG_Q_LATENCY stamps each message with the time it is sent, and
+ * records the time it has been queued in a histogram of the queue when it is
+ * received, or peeked, to be read by msgQLatency. A stamp is a read of the
+ * time stamp counter on x86 CPUs with an invariant one, or of the monotonic
+ * clock otherwise. A message of a MSG_Q_VARLEN queue takes 8 bytes more in
+ * the ring. The option is not for MSG_Q_DURABLE, whose messages outlive the
+ * clock.
+ *
  * RETURNS: MSG_Q_ID when success or NULL otherwise.
  */
 MSG_Q_ID msgQCreateEx
     (
     int maxMsgs,     /* max messages that can be queued */
     int maxMsgLength,/* max bytes in a message */
-    int options,     /* message queue options, ignored on Windows platform */
+    int options,     /* MSG_Q_FIFO or MSG_Q_PRIORITY, and the mode */
     const char *name /* message name */
     );
 
 /*******************************************************************************
  * msgQOpen - open a message queue
  *
- * open a message queue.
+ * open a message queue. A <name> with a slash opens the file of a
+ * MSG_Q_DURABLE queue, recovering it if no other process is attached.
+ *
+ * The named queues opened or created by a process are kept in a cache of
+ * handles: a name already opened by the process gets the same handle back,
+ * without looking up the shared memory again, and the handle is closed when
+ * msgQDelete has been called once for each msgQOpen or msgQCreateEx of it.
  *
  * RETURNS: MSG_Q_ID when success or NULL otherwise.
  */
@@ -102,6 +241,39 @@ MSG_Q_ID msgQOpen
     const char * name   /* message name */
     );
 
+/*******************************************************************************
+ * msgQWatch - open a message queue read-only to watch its status
+ *
+ * map an existed named message queue read-only, for a monitor: the handle
+ * neither takes the mutex nor touches the semaphores, doesn't count as a
+ * handle of the queue and doesn't recover a MSG_Q_DURABLE queue. Only
+ * msgQStat, msgQLatency, msgQShow and msgQDelete, which only releases the
+ * handle, accept it.
+ *
+ * RETURNS: MSG_Q_ID when success or NULL otherwise.
+ */
+MSG_Q_ID msgQWatch
+    (
+    const char * name   /* message name */
+    );
+
+/*******************************************************************************
+ * msgQList - list the named message queues
+ *
+ * copy up to <maxInfo> queues of the registry shared by the processes into
+ * <pInfo>. A queue is listed from its creation until its last handle is
+ * deleted, if its name is shorter than MSG_Q_NAME_MAX; a queue of a process
+ * which crashed may stay listed until the name is created again.
+ *
+ * RETURNS: the number of queues listed, which may be more than <maxInfo>, or
+ * -1 otherwise.
+ */
+int msgQList
+    (
+    MSG_Q_INFO * pInfo, /* queues of the registry */
+    int maxInfo         /* max queues to copy */
+    );
+
 /*******************************************************************************
  * msgQDelete - delete a message queue
  *
@@ -114,6 +286,25 @@ int msgQDelete
     MSG_Q_ID msgQId /* message queue to delete */
     );
 
+/*******************************************************************************
+ * msgQGetFd - get a pollable descriptor of a message queue
+ *
+ * get a descriptor which select, poll or epoll report readable as long as
+ * the message queue has a message, so an event loop can wait for a message
+ * queue together with its sockets and receive with timeout 0 when it is ready.
+ * The readiness is level-triggered and another receiver may take the message
+ * first, so the receive must not block. The descriptor belongs to the handle
+ * and is closed by msgQDelete; it must only be polled, never read or written.
+ * Once a descriptor has been got, every send and receive on a MSG_Q_SPSC or
+ * MSG_Q_MPMC message queue also takes the mutex of the queue to signal it.
+ *
+ * RETURNS: the descriptor, or -1 otherwise or on Windows.
+ */
+int msgQGetFd
+    (
+    MSG_Q_ID msgQId /* message queue to poll */
+    );
+
 /*******************************************************************************
  * msgQReceive - receive a message from a message queue
  *
@@ -129,10 +320,90 @@ int msgQReceive
     int timeout       /* ticks to wait */
     );
 
+/*******************************************************************************
+ * msgQReceiveAny - receive a message from any of a set of message queues
+ *
+ * pend until any of the <count> message queues in <ids> has a message, then
+ * receive it into <buffer> and return the position of its queue in <ids> in
+ * <pIndex>. The queues are tried in turn from a position which rotates with
+ * every call, so a busy queue can't starve the others. The task pends on the
+ * descriptors of msgQGetFd, which are got for the queues at the first call,
+ * so it is only supported on Linux. Up to MSG_Q_ANY_MAX queues can be given.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQReceiveAny
+    (
+    MSG_Q_ID ids[],   /* message queues from which to receive */
+    int count,        /* number of message queues */
+    char * buffer,    /* buffer to receive message */
+    UINT maxNBytes,   /* length of buffer */
+    int timeout,      /* ticks to wait */
+    int * pIndex      /* where to return the index of the queue in <ids> */
+    );
+
+/*******************************************************************************
+ * msgQReceiveBatch - receive a batch of messages from a message queue
+ *
+ * receive up to <maxCount> messages from a message queue with one take of the
+ * mutex. The task pends until one message is available at least, then it
+ * receives the queued messages back to back into <buffer> as long as they fit
+ * and returns the length of each one in <lengths>. The first message is
+ * truncated to <bufSize> like msgQReceive does. On a MSG_Q_MPMC message queue
+ * a following message is only received if <maxMsgLength> bytes still fit.
+ *
+ * RETURNS: the number of messages received, or -1 otherwise.
+ */
+int msgQReceiveBatch
+    (
+    MSG_Q_ID msgQId,    /* message queue from which to receive */
+    char * buffer,      /* buffer to receive the messages */
+    UINT bufSize,       /* length of buffer */
+    UINT lengths[],     /* where to return the length of each message */
+    int maxCount,       /* max number of messages */
+    int timeout         /* ticks to wait */
+    );
+
+/*******************************************************************************
+ * msgQReceivePeek - receive a message from a message queue without copying
+ *
+ * wait for the oldest message of a message queue and return a pointer to its
+ * data in the shared memory and its length. The message is taken off the
+ * queue, but its slot can't be reused until the caller frees it with
+ * msgQReceiveRelease. On a MSG_Q_SPSC message queue a message must be
+ * released before the next one is peeked.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQReceivePeek
+    (
+    MSG_Q_ID msgQId,        /* message queue from which to receive */
+    const char ** ppBuffer, /* where to return the pointer to the message */
+    UINT * pNBytes,         /* where to return the length of the message */
+    int timeout             /* ticks to wait */
+    );
+
+/*******************************************************************************
+ * msgQReceiveRelease - free the slot of a peeked message
+ *
+ * free the slot of a message returned by msgQReceivePeek for the senders.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQReceiveRelease
+    (
+    MSG_Q_ID msgQId,        /* message queue from which to receive */
+    const char * pBuffer    /* message returned by msgQReceivePeek */
+    );
+
 /*******************************************************************************
  * msgQSend - send a message to a message queue
  *
- * send a message to a message queue.
+ * send a message to a message queue. The messages are received from the
+ * highest of MSG_PRI_LEVELS priority levels first, and in FIFO order within
+ * a level. MSG_PRI_NORMAL puts the message at the end of the lowest level,
+ * MSG_PRI_LEVEL(n) at the end of level n, and MSG_PRI_URGENT at the front of
+ * the highest level.
  *
  * RETURNS: 0 when success or -1 otherwise.
  */
@@ -142,7 +413,114 @@ int msgQSend
     char * buffer,   /* message to send */
     UINT nBytes,     /* length of message */
     int timeout,     /* ticks to wait */
-    int priority     /* MSG_PRI_NORMAL or MSG_PRI_URGENT */
+    int priority     /* MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+    );
+
+/*******************************************************************************
+ * msgQSendBatch - send a batch of messages to a message queue
+ *
+ * send up to <count> messages to a message queue with one take of the mutex.
+ * The task pends until there is room for one message at least, then it sends
+ * as many messages of the batch as fit into the queue, in the order of the
+ * batch. The urgent messages of a batch go ahead of the queued messages in
+ * the order of the batch too.
+ *
+ * RETURNS: the number of messages sent, or -1 otherwise.
+ */
+int msgQSendBatch
+    (
+    MSG_Q_ID msgQId,        /* message queue on which to send */
+    const char * buffers[], /* messages to send */
+    const UINT lengths[],   /* length of each message */
+    int count,              /* number of messages */
+    int timeout,            /* ticks to wait */
+    int priority            /* priority of the messages, see msgQSend */
+    );
+
+/*******************************************************************************
+ * msgQSendReserve - reserve a slot of a message queue for a message to send
+ *
+ * reserve a free slot of a message queue and return a pointer to its data in
+ * <ppBuffer>, the caller builds the message of up to <nBytes> bytes in place
+ * and then sends it with msgQSendCommit. The slot counts as a queued message
+ * for the senders until it is committed, but the receivers can't see it.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQSendReserve
+    (
+    MSG_Q_ID msgQId, /* message queue on which to send */
+    UINT nBytes,     /* max length of message to build */
+    int timeout,     /* ticks to wait */
+    char ** ppBuffer /* where to return the pointer to the slot */
+    );
+
+/*******************************************************************************
+ * msgQSendCommit - send a message built in a reserved slot
+ *
+ * send the message built in the slot which msgQSendReserve has returned.
+ * A MSG_Q_SPSC message queue has one reservation at a time: a slot must be
+ * committed before the next one is reserved, and msgQSendReserve fails
+ * meanwhile.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQSendCommit
+    (
+    MSG_Q_ID msgQId, /* message queue on which to send */
+    char * pBuffer,  /* slot returned by msgQSendReserve */
+    UINT nBytes,     /* length of message */
+    int priority     /* MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+    );
+
+/*******************************************************************************
+ * msgQSetSpin - set how long the tasks spin before they pend
+ *
+ * let the tasks which find a message queue empty, or full, spin up to
+ * <maxSpins> rounds of a CPU pause hint before they pend in the kernel. The
+ * budget of each kind of waiter adapts to the gap between the arrivals it
+ * has seen within that limit, and shrinks again when the queue goes idle.
+ * Spinning only pays off when the other side runs on another CPU. The
+ * setting is shared by all the handles of the queue, 0 (the default) pends
+ * at once, and <maxSpins> can't exceed MSG_Q_SPIN_MAX.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQSetSpin
+    (
+    MSG_Q_ID msgQId,    /* message queue to set */
+    int maxSpins        /* max rounds to spin, 0 to pend at once */
+    );
+
+/*******************************************************************************
+ * msgQSetSync - set how often a durable message queue is written to its file
+ *
+ * let the task which releases the mutex of a MSG_Q_DURABLE message queue
+ * write the queue to its file, and wait for the write, after every <msgs>
+ * messages sent or received, so a crash of the host loses the last <msgs>
+ * operations at most, or 1 for none. A batch spreads the cost of the write
+ * over the messages. The setting is shared by all the handles of the queue,
+ * 0 (the default) leaves the writing to the kernel.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQSetSync
+    (
+    MSG_Q_ID msgQId,    /* message queue to set */
+    int msgs            /* operations between writes, 0 for none */
+    );
+
+/*******************************************************************************
+ * msgQSync - write a durable message queue to its file
+ *
+ * write a MSG_Q_DURABLE message queue to its file and wait for the write,
+ * whatever set by msgQSetSync. Nothing is done for the other queues.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQSync
+    (
+    MSG_Q_ID msgQId     /* message queue to write */
     );
 
 /*******************************************************************************
@@ -150,6 +528,14 @@ int msgQSend
  *
  * get the detail status of a message queue.
  *
+ * The statistics count the operations of all the tasks and processes since
+ * the queue was created. A send of a MSG_Q_VARLEN queue is full when the
+ * message doesn't fit into the bytes left, and an operation with a timeout
+ * of 0 which finds the queue full or empty is not counted as a timeout. The
+ * counters are summed without stopping the other tasks, so they may be a few
+ * operations apart from each other, and from msgNum, on a busy queue. The
+ * peak depth of a MSG_Q_SPSC queue is sampled, and may miss short peaks.
+ *
  * RETURNS: 0 when success or -1 otherwise.
  */
 int msgQStat
@@ -158,6 +544,23 @@ int msgQStat
     MSG_Q_STAT * msgQStatus
     );
 
+/*******************************************************************************
+ * msgQLatency - get the queueing latency of a message queue
+ *
+ * get the percentiles of the times the messages received from a MSG_Q_LATENCY
+ * message queue had been queued, since the queue was created. The histogram
+ * is read while the other tasks go on sending and receiving; its buckets are
+ * 1/16 of a power of two wide, so a percentile is the top of its bucket, at
+ * most 6.25% above the time recorded, and the max is exact.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQLatency
+    (
+    MSG_Q_ID msgQId,                /* message queue to query */
+    MSG_Q_LAT_STAT * msgQLatStat    /* latency of the message queue */
+    );
+
 /*******************************************************************************
  * msgQShow - show the status of message queue
  *
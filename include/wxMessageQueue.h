@@ -18,7 +18,7 @@ public:
 	wxMessageQueue(
 	         int maxMsgs,      /** max messages that can be queued */
 	         int maxMsgLength, /** max bytes in a message */
-	         int options,      /** message queue options, ignored on Windows platform */
+	         int options,      /** MSG_Q_FIFO or MSG_Q_PRIORITY, and the mode */
 	         const char * pstrName = NULL  /** message name, NULL for inter-thread, or for inter-process */
 			);
 
@@ -41,19 +41,94 @@ public:
 	         int timeout       /** ticks to wait */
 	         );
 
+	/** receive a message from any of a set of message queues */
+	static int ReceiveAny(
+	         wxMessageQueue * queues[], /** message queues from which to receive */
+	         int count,        /** number of message queues */
+	         char * buffer,    /** buffer to receive message */
+	         UINT maxNBytes,   /** length of buffer */
+	         int timeout,      /** ticks to wait */
+	         int * pIndex      /** where to return the index of the queue */
+	         );
+
+	/** receive a batch of messages from a message queue */
+	int ReceiveBatch(
+	         char * buffer,    /** buffer to receive the messages */
+	         UINT bufSize,     /** length of buffer */
+	         UINT lengths[],   /** where to return the length of each message */
+	         int maxCount,     /** max number of messages */
+	         int timeout       /** ticks to wait */
+	         );
+
+	/** receive a message from a message queue without copying it */
+	int ReceivePeek(
+	         const char ** ppBuffer,  /** where to return the pointer to the message */
+	         UINT * pNBytes,          /** where to return the length of the message */
+	         int timeout              /** ticks to wait */
+	         );
+
+	/** free the slot of a message returned by ReceivePeek */
+	int ReceiveRelease(
+	         const char * pBuffer     /** message returned by ReceivePeek */
+	         );
+
 	/** send a message to a message queue */
 	int Send(
 	         char * buffer,   /** message to send */
 	         UINT nBytes,     /** length of message */
 	         int timeout,     /** ticks to wait */
-	         int priority     /** MSG_PRI_NORMAL or MSG_PRI_URGENT */
+	         int priority     /** MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+	         );
+
+	/** send a batch of messages to a message queue */
+	int SendBatch(
+	         const char * buffers[],  /** messages to send */
+	         const UINT lengths[],    /** length of each message */
+	         int count,               /** number of messages */
+	         int timeout,             /** ticks to wait */
+	         int priority             /** MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
 	         );
 
+	/** reserve a slot of a message queue to build a message in place */
+	int SendReserve(
+	         UINT nBytes,       /** max length of message to build */
+	         int timeout,       /** ticks to wait */
+	         char ** ppBuffer   /** where to return the pointer to the slot */
+	         );
+
+	/** send a message built in a slot returned by SendReserve */
+	int SendCommit(
+	         char * pBuffer,  /** slot returned by SendReserve */
+	         UINT nBytes,     /** length of message */
+	         int priority     /** MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+	         );
+
+	/** set how long the tasks spin before they pend */
+	int SetSpin(
+	         int maxSpins      /** max rounds to spin, 0 to pend at once */
+	         );
+
+	/** set how often a durable queue is written to its file */
+	int SetSync(
+	         int msgs          /** operations between writes, 0 for none */
+	         );
+
+	/** write a durable queue to its file */
+	int Sync();
+
+	/** get a descriptor readable while the queue has a message */
+	int GetFd();
+
 	/** get the status of message queue */
 	int Stat(
 	         MSG_Q_STAT * msgQStatus
 	         );
 
+	/** get the queueing latency of a MSG_Q_LATENCY queue */
+	int Latency(
+	         MSG_Q_LAT_STAT * msgQLatStat
+	         );
+
 	/** show the status of message queue */
 	int Show();
 
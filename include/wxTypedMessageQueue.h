@@ -0,0 +1,176 @@
+/*
+ * wxTypedMessageQueue.h
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * A message queue of the messages of a type T, N of them at most.
+ *
+ * The message is built in its slot with msgQSendReserve and msgQSendCommit,
+ * and taken from its slot with msgQReceivePeek and msgQReceiveRelease, so the
+ * copy of a message is a copy of sizeof(T) bytes known to the compiler,
+ * inlined to a few loads and stores, and the callers never pass a length.
+ * The slot size, its alignment and the ring mask are worked out at compile
+ * time as msgQCreateEx lays the queue out, and a named queue opened by
+ * another process is checked to hold the messages of the same size.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+ */
+
+#ifndef WXTYPEDMESSAGEQUEUE_H_
+#define WXTYPEDMESSAGEQUEUE_H_
+
+/* include */
+#include <string.h>
+#include <type_traits>
+#include "msgQueue.h"
+
+/** the power of two from n up, at least min */
+static inline constexpr UINT wxTypedRoundUp(UINT n, UINT min)
+{
+	return min >= n ? min : wxTypedRoundUp(n, min << 1);
+}
+
+template <typename T, int N>
+class wxTypedMessageQueue
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+		"the messages are copied as bytes between the processes");
+	static_assert(N > 0 && N <= 0x40000000,
+		"the capacity is 1 to 2^30 messages");
+
+public:
+	/** slots of a MSG_Q_SPSC or MSG_Q_MPMC ring, at least two */
+	static constexpr UINT SLOTS = wxTypedRoundUp((UINT)N, 2);
+
+	/** mask of a ring index */
+	static constexpr UINT MASK = SLOTS - 1;
+
+	/** bytes of a slot, a power of two up to a cache line, then lines */
+	static constexpr UINT SLOT_SIZE = sizeof(T) < 64 ?
+		wxTypedRoundUp((UINT)sizeof(T), 8) :
+		(UINT)(sizeof(T) + 63) / 64 * 64;
+
+	/** alignment of a slot in the shared memory */
+	static constexpr UINT SLOT_ALIGN = SLOT_SIZE < 64 ? SLOT_SIZE : 64;
+
+	static_assert(alignof(T) <= SLOT_ALIGN,
+		"a slot is not aligned enough for the messages");
+
+	/** constructor, MSG_Q_MPMC by default; MSG_Q_VARLEN is refused */
+	wxTypedMessageQueue(
+	         int options = MSG_Q_MPMC,     /** MSG_Q_FIFO or MSG_Q_PRIORITY, and the mode */
+	         const char * pstrName = NULL  /** message name, NULL for inter-thread, or for inter-process */
+			)
+	{
+		m_msgQId = (options & MSG_Q_VARLEN) ? NULL :
+			msgQCreateEx(N, (int)sizeof(T), options, pstrName);
+	}
+
+	/** destructor */
+	~wxTypedMessageQueue()
+	{
+		if (m_msgQId != NULL)
+			msgQDelete(m_msgQId);
+	}
+
+	/** open a named message queue of the same T and N, NULL if it isn't */
+	static wxTypedMessageQueue * Open(
+	         const char * pstrName   /** message name */
+	         )
+	{
+		MSG_Q_STAT stat;
+		MSG_Q_ID msgQId = msgQOpen(pstrName);
+
+		if (msgQId == NULL)
+			return NULL;
+
+		if (msgQStat(msgQId, &stat) != 0 || stat.maxMsgs != N ||
+			stat.maxMsgLength != sizeof(T) || (stat.options & MSG_Q_VARLEN)) {
+			msgQDelete(msgQId);
+			return NULL;
+		}
+
+		return new wxTypedMessageQueue(msgQId);
+	}
+
+	/** check if the message queue has been created or opened */
+	bool IsValid() const
+	{
+		return m_msgQId != NULL;
+	}
+
+	/** get the message queue id */
+	MSG_Q_ID GetId() const
+	{
+		return m_msgQId;
+	}
+
+	/** send a message to the message queue */
+	inline int Send(
+	         const T & msg,                  /** message to send */
+	         int timeout = WAIT_FOREVER,     /** ticks to wait */
+	         int priority = MSG_PRI_NORMAL   /** MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+	         )
+	{
+		char * pSlot = NULL;
+
+		if (msgQSendReserve(m_msgQId, sizeof(T), timeout, &pSlot) != 0)
+			return -1;
+
+		memcpy(pSlot, &msg, sizeof(T));
+
+		return msgQSendCommit(m_msgQId, pSlot, sizeof(T), priority);
+	}
+
+	/** receive a message from the message queue */
+	inline int Receive(
+	         T & msg,                        /** where to return the message */
+	         int timeout = WAIT_FOREVER      /** ticks to wait */
+	         )
+	{
+		const char * pSlot = NULL;
+		UINT nBytes = 0;
+
+		if (msgQReceivePeek(m_msgQId, &pSlot, &nBytes, timeout) != 0)
+			return -1;
+
+		memcpy(&msg, pSlot, sizeof(T));
+
+		return msgQReceiveRelease(m_msgQId, pSlot);
+	}
+
+	/** get the status of message queue */
+	int Stat(
+	         MSG_Q_STAT * msgQStatus
+	         )
+	{
+		return msgQStat(m_msgQId, msgQStatus);
+	}
+
+private:
+	wxTypedMessageQueue(
+			MSG_Q_ID msgQId    /** message queue id */
+			)
+	{
+		m_msgQId = msgQId;
+	}
+
+	/** the handle is deleted once, by its only owner */
+	wxTypedMessageQueue(const wxTypedMessageQueue &);
+	wxTypedMessageQueue & operator=(const wxTypedMessageQueue &);
+
+	MSG_Q_ID m_msgQId;
+};
+
+template <typename T, int N>
+constexpr UINT wxTypedMessageQueue<T, N>::SLOTS;
+template <typename T, int N>
+constexpr UINT wxTypedMessageQueue<T, N>::MASK;
+template <typename T, int N>
+constexpr UINT wxTypedMessageQueue<T, N>::SLOT_SIZE;
+template <typename T, int N>
+constexpr UINT wxTypedMessageQueue<T, N>::SLOT_ALIGN;
+
+#endif /* WXTYPEDMESSAGEQUEUE_H_ */
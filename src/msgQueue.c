@@ -10,6 +10,33 @@
 /*
 modification history
 --------------------
+02b,17oct26,sgu  showed the 64-bit counts of the sends and receives
+02a,17oct26,sgu  showed the latency of the timed queues only
+01z,17oct26,sgu  took and gave the units of a named queue under the mutex
+01y,16oct26,sgu  kept the order of a batch sent at a priority level
+01x,16oct26,sgu  removed the checks of the version and magic arrays
+01w,16oct26,sgu  cached the handles of the named queues, listed them
+01v,16oct26,sgu  added msgQWatch
+01u,16oct26,sgu  added the MSG_Q_LATENCY option and msgQLatency
+01t,16oct26,sgu  counted the 64-bit statistics in shards
+01s,16oct26,sgu  repaired the queue when the owner of the mutex dies
+01r,16oct26,sgu  added the MSG_Q_DURABLE option, msgQSetSync and msgQSync
+01q,16oct26,sgu  initialized a queue in O(1), the free link grows lazily
+01p,16oct26,sgu  added the MSG_Q_HUGEPAGE option
+01o,16oct26,sgu  aligned the message data to the cache lines
+01n,16oct26,sgu  added msgQReceiveAny
+01m,16oct26,sgu  added msgQGetFd
+01l,16oct26,sgu  added the adaptive spin and msgQSetSpin
+01k,16oct26,sgu  implemented the MSG_Q_PRIORITY option
+01j,16oct26,sgu  added the priority levels of messages
+01i,16oct26,sgu  added the MSG_Q_VARLEN option
+01h,16oct26,sgu  added msgQReceiveBatch
+01g,16oct26,sgu  added msgQSendBatch
+01f,16oct26,sgu  added msgQReceivePeek and msgQReceiveRelease
+01e,16oct26,sgu  added msgQSendReserve and msgQSendCommit
+01d,16oct26,sgu  added the MSG_Q_MPMC option
+01c,16oct26,sgu  added the MSG_Q_SPSC option
+01b,16oct26,sgu  moved the blocking state into shared memory, added Linux
 01a,11nov11,sgu  created
 */
 
@@ -49,7 +76,42 @@ The structure MSG_Q saves the kernel objects handlers and the shared memory
 address; MSG_SM saves the message queue attributes; MSG_NODE list saves all the
 nodes for the message queue, and each node saves all attribute of each message;
 the message queue data area saves all the data for all the message. All the
-structures defined below.
+structures defined in msgQueueLib.h.
+
+The mutex and the two counting semaphores of a message queue are words in
+MSG_SM too, so a message is sent or received with a few atomic operations and
+no kernel call when no task has to pend. The platform dependent parts, the
+shared memory mapping and pending on a word, are in msgQueueLinux.c and
+msgQueueWin32.c. The lock-free modes selected by the options of msgQCreateEx
+are in msgQueueRing.c, and the variable-length mode is in msgQueueVar.c.
+
+The shared memory is laid out by cache lines for tasks on different CPUs.
+MSG_SM keeps the attributes fixed at creation, the mutex with the state it
+protects, each semaphore and each side of the lock-free ring on cache lines
+of their own. The message nodes and the message data start on a cache line,
+and the data of a slot takes a power of two bytes up to a cache line, or
+whole cache lines beyond, so no message straddles a line it doesn't fill.
+
+The mutex word holds the process ID of its owner. A task pended on the mutex
+of a named queue checks every MSG_Q_OWNER_POLL milliseconds whether the owner
+is alive, and takes the mutex over from a dead one. The operations under the
+mutex save each word they write in the undo log of MSG_SM first, one step
+per message, so the new owner rolls back the step cut short and gives the
+semaphore units the dead task held, or owed, before it carries on.
+
+A MSG_Q_DURABLE queue is a list mode queue in a file. Its nodes carry commit
+stamps, set in msgQNodeLink and cleared in msgQNodeFree, from which the first
+process to attach rebuilds the queue; see msgQueueDurable.c.
+
+The statistics are counted with relaxed atomic adds in the shard of the
+calling thread, the same way in every mode, and msgQStat sums the shards. The
+peak depth is the only statistic shared by all the tasks, and it is written
+only when it grows. The statistics are not in the undo log, so a step cut
+short by the death of its task may be counted or not.
+
+A MSG_Q_LATENCY queue stamps a message in msgQNodeLink and records the time
+it has been queued in msgQNodeUnlink, the lock-free rings and the byte ring
+do the same at their own link and unlink; see msgQueueLatency.c.
 
 If you meet some problem with this module, please feel free to contact
 me via e-mail: gushengyuan2002@163.com
@@ -57,74 +119,22 @@ me via e-mail: gushengyuan2002@163.com
 
 /* includes */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <windows.h>
-#include "msgQueue.h"
-
-/* defines */
-
-/* invalid node index for message queue node */
-#define MSG_Q_INVALID_NODE -1
-
-/* objects name prefix */
-
-#define _MSG_Q_SEM_P_      "_MSG_Q_SEM_P_" /* prefix for pruducer semaphore */
-#define _MSG_Q_SEM_C_      "_MSG_Q_SEM_C_" /* prefix for consumer semaphore */
-#define _MSG_Q_MUTEX_      "_MSG_Q_MUTEX_" /* prefix for mutex */
-#define _MSG_Q_SHMEM_      "_MSG_Q_SHMEM_" /* prefix for shared memory */
-#define MSG_Q_PREFIX_LEN   16              /* max length of object prefix */
-
-/* version string */
-#define MSG_Q_VERSION      "0.01"
-
-/* magic string */
-#define MSG_Q_MAGIC        "\1\3\5\7\a\7\5\3\1"
-
-/* magic string length */
-#define MAGIC_LEN          12
-
-/* debug printable switch */
-#if defined(DEBUG) || defined(_DEBUG)
-#define PRINTF(fmt, ...) \
-        printf("FAIL - %s@%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
-#else
-#define PRINTF(fmt, ...)
-#endif
-
-/* typedefs */
-
-/* message node structure */
-typedef struct tagMSG_NODE {
-    unsigned long length;     /* message length */
-    int index;                /* node index */
-    int free;                 /* next free message index */
-    int used;                 /* next used message index */
-}MSG_NODE, *P_MSG_NODE;
-
-/* message queue attributes */
-typedef struct tagMSG_SM {
-    char version[VERSION_LEN];  /* library version */
-    char magic[MAGIC_LEN];      /* verify string */
-    int maxMsgs;                /* max messages that can be queued */
-    UINT maxMsgLength;          /* max bytes in a message */
-    int options;                /* message queue options */
-    int msgNum;                 /* message number in the queue */
-    int sendTimes;              /* number of sent */
-    int recvTimes;              /* number of received */
-    int head;                   /* head index of the queue */
-    int tail;                   /* tail index of the queue */
-    int free;                   /* next free index of the queue */
-}MSG_SM, *P_MSG_SM;
-
-/* objects handlers for message queue */
-typedef struct tagMSG_Q {
-    HANDLE semPId;    /* semaphore for producer */
-    HANDLE semCId;    /* semaphore for consumer */
-    HANDLE mutex;     /* mutex for shared data protecting */
-    HANDLE hFile;     /* file handle for the shared memory file mapping */
-    MSG_SM * psm;     /* shared memory */
-}MSG_Q, *P_MSG_Q;
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* locals */
+
+/* first queue msgQReceiveAny tries, rotated by every call */
+static volatile UINT msgQAnyTurn = 0;
+
+/* shard of the statistics the thread counts in plus one, 0 until picked */
+static __thread UINT msgQShard = 0;
+
+/* threads which have picked a shard, so those of a process spread out */
+static volatile UINT msgQShardTurn = 0;
 
 /* implementations */
 
@@ -157,12 +167,6 @@ static int msgQVerify
         return -1;
     }
 
-    /* check the version pointer */
-    if (psm->version == NULL) {
-        PRINTF("%s: version string is NULL.\n", pSource);
-        return -1;
-    }
-
     /* check the version string */
     if (strncmp(psm->version, MSG_Q_VERSION, VERSION_LEN) != 0) {
         PRINTF("%s: version string: %s, but expect: %s!\n",
@@ -170,12 +174,6 @@ static int msgQVerify
         return -1;
     }
 
-    /* check the magic pointer */
-    if (psm->magic == NULL) {
-        PRINTF("%s: magic string is NULL.\n", pSource);
-        return -1;
-    }
-
     /* check the magic string */
     if (strncmp(psm->magic, MSG_Q_MAGIC, MAGIC_LEN) != 0) {
         PRINTF("%s: magic string: %s, but expect: %s!\n",
@@ -183,527 +181,2437 @@ static int msgQVerify
         return -1;
     }
 
+    /* pairs with the release fence of the creator */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
     return 0;
 }
 
 /*
- * create and initialize a message queue, queue pended tasks in FIFO order
+ * message queue verification for the functions which change the queue.
  */
-MSG_Q_ID msgQCreateEx
+static int msgQVerifyWrite
     (
-    int maxMsgs,
-    int maxMsgLength,
-    int options,
-    const char * pstrName
+    MSG_Q_ID msgQId,
+    const char * pSource
     )
 {
-    P_MSG_Q qid = NULL;     /* message queue identify */
-    HANDLE semPId = NULL;   /* semaphore for producer */
-    HANDLE semCId = NULL;   /* semaphore for consumer */
-    HANDLE mutex = NULL;    /* mutex for protect accessing to shared data */
-    HANDLE hFile = NULL;
-    char * strName = NULL;
-    MSG_SM * psm = NULL;
-    MSG_NODE * pNode = NULL;
-    int index = 0;
-    int memSize = 0;
-
-    /* check the inputed parameters */
-
-    if (maxMsgs <= 0) {
-        PRINTF("invalid maxMsgs %d.\n", maxMsgs);
-        return NULL;
+    if (msgQVerify(msgQId, pSource) == -1) {
+        return -1;
     }
 
-    if (maxMsgLength <= 0) {
-        PRINTF("invalid maxMsgLength %d.\n", maxMsgLength);
-        return NULL;
+    /* the memory of a watching handle is mapped read-only */
+    if (((P_MSG_Q)msgQId)->watch) {
+        PRINTF("%s: message queue is watched only.\n", pSource);
+        return -1;
     }
 
-    if (options != MSG_Q_FIFO && options != MSG_Q_PRIORITY) {
-        PRINTF("invalid options %d.\n", options);
-        return NULL;
-    }
+    return 0;
+}
 
-    /* allocate the object name memory */
-    if (pstrName != NULL) {
-        int len = strlen(pstrName) + MSG_Q_PREFIX_LEN + 1;
-        strName = (char*)malloc(len);
-        if (strName == NULL) {
-            PRINTF("allocate memory failed with errno %d!\n", errno);
-            return NULL;
+/*
+ * wait until the creator has initialized the shared memory of a named queue
+ */
+static int msgQWaitReady
+    (
+    P_MSG_Q qid
+    )
+{
+    unsigned long start = msgQOsTime();
+    MSG_SM * psm = qid->psm;
+
+    while (strncmp(psm->magic, MSG_Q_MAGIC, MAGIC_LEN) != 0) {
+        if (msgQOsTime() - start > MSG_Q_READY_WAIT) {
+            break;
         }
-        memset(strName, 0, len);
+        msgQOsYield();
     }
 
-    /* create the producer semaphore */
+    return msgQVerify(qid, __func__);
+}
 
-    if (pstrName != NULL) {
-        sprintf(strName, "%s%s", _MSG_Q_SEM_P_, pstrName);
-    }
+/*
+ * cache the handle of a named queue just opened, the handle of another task
+ * which has cached the name meanwhile is used instead
+ */
+static P_MSG_Q msgQCacheAdd
+    (
+    P_MSG_Q qid,
+    const char * pstrName
+    )
+{
+    P_MSG_Q cached = msgQCachePut(qid, pstrName);
 
-    semPId = CreateSemaphore(NULL, 0, maxMsgs, strName);
-    if (semPId == NULL) {
-        PRINTF("create semaphore with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    if (cached != qid) {
+        MSG_Q_SUB(&qid->psm->refs, 1);
+        msgQOsUnmap(qid, 0);
+        free(qid);
     }
 
-    /* create the consumer semaphore */
+    return cached;
+}
 
-    if (pstrName != NULL) {
-        sprintf(strName, "%s%s", _MSG_Q_SEM_C_, pstrName);
-    }
+/*
+ * get the time left of a timeout
+ */
+int msgQTimeLeft
+    (
+    unsigned long start,
+    int timeout
+    )
+{
+    unsigned long elapsed = 0;
 
-    semCId = CreateSemaphore(NULL, maxMsgs, maxMsgs, strName);
-    if (semCId == NULL) {
-        PRINTF("create semaphore with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
-    }
+    if (timeout < 0)
+        return WAIT_FOREVER;
 
-    /* create the mutex */
+    elapsed = msgQOsTime() - start;
+    if (elapsed >= (unsigned long)timeout)
+        return 0;
 
-    if (pstrName != NULL) {
-        sprintf(strName, "%s%s", _MSG_Q_MUTEX_, pstrName);
-    }
+    return timeout - (int)elapsed;
+}
 
-    mutex = CreateMutex(NULL, FALSE, strName);
-    if (mutex == NULL) {
-        PRINTF("create mutex with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
-    }
+/*
+ * get the shard of the statistics of a side the calling thread counts in
+ */
+static MSG_SHARD * msgQStatShard
+    (
+    MSG_SM * psm,
+    int side
+    )
+{
+    /* the process ID spreads the first threads of the processes too */
+    if (msgQShard == 0)
+        msgQShard = (MSG_Q_ADD(&msgQShardTurn, 1) + msgQOsSelf()) %
+            MSG_Q_STAT_SHARDS + 1;
 
-    /* allocate the message queue control block memory */
+    return &psm->stat[side][msgQShard - 1];
+}
 
-    qid = (P_MSG_Q)malloc(sizeof(MSG_Q));
-    if (qid == NULL) {
-        PRINTF("allocate memory with errno %d!\n", errno);
-        goto FailedExit;
+/*
+ * count the messages passed by a side of a message queue
+ */
+void msgQStatCount
+    (
+    MSG_SM * psm,
+    int side,
+    UINT msgs,
+    UINT bytes
+    )
+{
+    MSG_SHARD * pShard = msgQStatShard(psm, side);
+
+    MSG_Q_COUNT(&pShard->msgs, msgs);
+    MSG_Q_COUNT(&pShard->bytes, bytes);
+}
+
+/*
+ * count a side finding a message queue full or empty, or giving up the wait
+ */
+void msgQStatWait
+    (
+    MSG_SM * psm,
+    int side,
+    int expired
+    )
+{
+    MSG_SHARD * pShard = msgQStatShard(psm, side);
+
+    if (expired)
+        MSG_Q_COUNT(&pShard->timeouts, 1);
+    else
+        MSG_Q_COUNT(&pShard->waits, 1);
+}
+
+/*
+ * raise the peak depth of a message queue, which is only written when the
+ * queue grows beyond it, so the senders mostly share its cache line
+ */
+void msgQStatDepth
+    (
+    MSG_SM * psm,
+    UINT depth
+    )
+{
+    UINT peak = MSG_Q_LOAD(&psm->peakDepth);
+
+    while (depth > peak) {
+        if (MSG_Q_CAS(&psm->peakDepth, &peak, depth))
+            break;
     }
-    memset(qid, 0, sizeof(MSG_Q));
+}
 
-    /* allocate the message queue memory */
+/*
+ * spin until a word of the shared memory moves
+ *
+ * the budget follows twice the rounds the word took to move when it moves in
+ * time, by an eighth of the difference each time, so it tracks the gap between
+ * the arrivals; it is halved when the word doesn't move in time, so a queue
+ * which goes idle soon pends at once again.
+ */
+int msgQSpin
+    (
+    MSG_SM * psm,
+    volatile UINT * pBudget,
+    volatile UINT * addr,
+    UINT expected
+    )
+{
+    UINT spinMax = psm->spinMax;
+    UINT budget = *pBudget;
+    UINT round = 0;
 
-    memSize = sizeof(MSG_SM) + maxMsgs * (sizeof(MSG_NODE) + maxMsgLength);
-    if (pstrName == NULL) {
-        /* allocate memory for inter-thread message queue */
-        psm = (MSG_SM*)malloc(memSize);
+    if (spinMax == 0)
+        return 0;
+
+    if (budget < MSG_Q_SPIN_MIN)
+        budget = MSG_Q_SPIN_MIN;
+
+    for (round = 0; round < budget; round++) {
+        if (MSG_Q_LOAD(addr) != expected) {
+            budget = (UINT)((int)budget + ((int)(round * 2) - (int)budget) / 8);
+            *pBudget = (budget > spinMax) ? spinMax : budget;
+            return 1;
+        }
+        MSG_Q_PAUSE();
     }
-    else {
-        /* allocate shared memory for inter-process message queue */
-        sprintf(strName, "%s%s", _MSG_Q_SHMEM_, pstrName);
-        hFile = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
-            0, memSize, strName);
-        if (hFile == NULL) {
-            PRINTF("CreateFileMapping with errno %d!\n", (int)GetLastError());
-            goto FailedExit;
+
+    *pBudget = budget / 2;
+
+    return 0;
+}
+
+/*
+ * hand the units of a semaphore of a MSG_Q_PRIORITY queue over to the tasks
+ * in the wait list, the mutex must be taken
+ *
+ * RETURNS: the number of tasks to wake up, their entries in <granted>.
+ */
+static int msgQWaitListGrant
+    (
+    MSG_SM * psm,
+    MSG_SEM * sem,
+    int chan,
+    MSG_WAIT ** granted
+    )
+{
+    MSG_WAIT * pBest = NULL;
+    MSG_WAIT * pWait = NULL;
+    int grants = 0;
+    int index = 0;
+    UINT count = 0;
+
+    while (MSG_Q_LOAD(&sem->pended) > 0) {
+        /* find the highest priority, then the earliest, task */
+        pBest = NULL;
+        for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+            pWait = &psm->waitList[index];
+            if (pWait->state != MSG_Q_WAIT_PENDED || pWait->chan != chan)
+                continue;
+            if (pBest == NULL || pWait->priority > pBest->priority ||
+                (pWait->priority == pBest->priority &&
+                (int)(pWait->order - pBest->order) < 0)) {
+                pBest = pWait;
+            }
         }
 
-        psm = (MSG_SM*)MapViewOfFile(hFile, FILE_MAP_ALL_ACCESS, 0, 0, 0);
-        if (psm == NULL) {
-            PRINTF("MapViewOfFile with errno %d!\n", (int)GetLastError());
-            goto FailedExit;
+        if (pBest == NULL)
+            break;
+
+        /* take a unit for the task */
+        count = MSG_Q_LOAD(&sem->count);
+        do {
+            if (count == 0)
+                return grants;
+        } while (!MSG_Q_CAS(&sem->count, &count, count - 1));
+
+        /* the task may have left the list on timeout meanwhile */
+        count = MSG_Q_WAIT_PENDED;
+        if (MSG_Q_CAS(&pBest->state, &count, MSG_Q_WAIT_GRANTED)) {
+            MSG_Q_SUB(&sem->pended, 1);
+            granted[grants++] = pBest;
+        }
+        else {
+            MSG_Q_ADD(&sem->count, 1);
         }
     }
 
+    return grants;
+}
+
+/*
+ * wake up the tasks of a MSG_Q_PRIORITY queue which have been granted a unit
+ */
+static void msgQWaitListWake
+    (
+    P_MSG_Q qid,
+    int chan,
+    MSG_WAIT ** granted,
+    int grants
+    )
+{
+    int index = 0;
+
     /*
-     * NOTES: check the magic string of the shared memory to see if the message
-     * queue was created before. the same object can be create more than one
-     * time if the object name is not null -- the object reference is returned
-     * when the same object is created. In order to avoid overwrite the shared
-     * memory when get the same object reference, must check the magic string
-     * of the shared memory.
+     * NOTES: on Windows all the tasks of a channel pend on one kernel
+     * semaphore, so all of them are woken up for a grant to make sure the
+     * granted one is among them; the others just pend again.
      */
 
-    if (strcmp(psm->magic, MSG_Q_MAGIC) != 0 || pstrName == NULL) {
-        /* clear all the shared memory */
-        memset(psm, 0, memSize);
+    for (index = 0; index < grants; index++) {
+        msgQOsWake(qid, chan, &granted[index]->state, MSG_Q_WAIT_MAX);
+    }
+}
 
-        /* set message queue attributes in shared memory */
-        strcpy(psm->version, MSG_Q_VERSION);
-        strcpy(psm->magic, MSG_Q_MAGIC);
-        psm->maxMsgs = maxMsgs;
-        psm->maxMsgLength = maxMsgLength;
-        psm->options = options;
-        psm->msgNum = 0;
-        psm->sendTimes = 0;
-        psm->recvTimes = 0;
-        psm->head = MSG_Q_INVALID_NODE;
-        psm->tail = MSG_Q_INVALID_NODE;
-        psm->free = 0;
+/*
+ * count the tasks of the wait list of a named queue ranked before an entry,
+ * the mutex must be taken
+ */
+static UINT msgQWaitListRank
+    (
+    MSG_SM * psm,
+    MSG_WAIT * pWait
+    )
+{
+    MSG_WAIT * pOther = NULL;
+    UINT rank = 0;
+    int index = 0;
 
-        /* set the message queue nodes links */
-        pNode = (MSG_NODE*)((char*)psm + sizeof(MSG_SM));
-        for(index = 0; index < psm->maxMsgs; index++) {
-            pNode->length = 0;
-            pNode->index = index;
-            pNode->free = index + 1;
-            pNode->used = MSG_Q_INVALID_NODE;
-            pNode++;
+    for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+        pOther = &psm->waitList[index];
+        if (pOther->state == MSG_Q_WAIT_FREE || pOther->chan != pWait->chan)
+            continue;
+        if (pOther->priority > pWait->priority ||
+            (pOther->priority == pWait->priority &&
+            (int)(pOther->order - pWait->order) < 0)) {
+            rank++;
         }
-
-        /* set the next free pointer as INVALID for the last Node */
-        pNode--;
-        pNode->free = MSG_Q_INVALID_NODE;
     }
 
-    /* set the message queue objects handlers */
+    return rank;
+}
+
+/*
+ * call the tasks of the wait list of a named queue which rank within the
+ * units of a semaphore to take them, the mutex must be taken
+ *
+ * the units stay in the semaphore: a called task takes its unit when it has
+ * taken the mutex in turn, if it still ranks within the units by then.
+ *
+ * RETURNS: the number of tasks to wake up, their entries in <granted>.
+ */
+static int msgQWaitListCall
+    (
+    MSG_SM * psm,
+    MSG_SEM * sem,
+    int chan,
+    MSG_WAIT ** granted
+    )
+{
+    MSG_WAIT * pWait = NULL;
+    UINT count = sem->count;
+    int grants = 0;
+    int index = 0;
 
-    qid->semPId = semPId;
-    qid->semCId = semCId;
-    qid->mutex = mutex;
-    qid->hFile = hFile;
-    qid->psm = psm;
+    if (count == 0)
+        return 0;
 
-    if (strName != NULL)
-        free(strName);
+    for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+        pWait = &psm->waitList[index];
+        if (pWait->state != MSG_Q_WAIT_PENDED || pWait->chan != chan)
+            continue;
+        if (msgQWaitListRank(psm, pWait) < count) {
+            MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_GRANTED);
+            granted[grants++] = pWait;
+        }
+    }
 
-    return (MSG_Q_ID)qid;
+    return grants;
+}
 
-FailedExit:
-    if (hFile != NULL && psm != NULL)
-        UnmapViewOfFile(psm);
-    if (hFile == NULL && psm != NULL)
-        free(psm);
-    if (hFile != NULL)
-        CloseHandle(hFile);
-    if (semPId != NULL)
-        CloseHandle(semPId);
-    if (semCId != NULL)
-        CloseHandle(semCId);
-    if (mutex != NULL)
-        CloseHandle(mutex);
-    if (strName != NULL)
-        free(strName);
-    if (qid != NULL)
-        free(qid);
+/*
+ * put the calling task into the wait list of a named queue, the mutex must
+ * be taken
+ *
+ * RETURNS: the entry of the task, or NULL if the wait list is full.
+ */
+static MSG_WAIT * msgQWaitListJoin
+    (
+    MSG_SM * psm,
+    MSG_SEM * sem,
+    int chan
+    )
+{
+    MSG_WAIT * pWait = NULL;
+    int index = 0;
+
+    for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+        pWait = &psm->waitList[index];
+        if (pWait->state != MSG_Q_WAIT_FREE)
+            continue;
+
+        pWait->chan = chan;
+        pWait->priority = msgQOsPriority();
+        pWait->order = psm->waitOrder++;
+        pWait->pid = msgQOsSelf();
+        MSG_Q_LOG(psm, &pWait->state);
+        MSG_Q_LOG(psm, &sem->pended);
+        MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_PENDED);
+        MSG_Q_STORE(&sem->pended, sem->pended + 1);
+        return pWait;
+    }
 
     return NULL;
 }
 
 /*
- * open an existed message queue -- inter-process message queue
+ * take the calling task out of the wait list of a named queue, the mutex must
+ * be taken
  */
-MSG_Q_ID msgQOpen
+static void msgQWaitListLeave
     (
-    const char * pstrName
+    MSG_SM * psm,
+    MSG_SEM * sem,
+    MSG_WAIT * pWait
     )
 {
-    P_MSG_Q qid = NULL;     /* message queue identify */
-    HANDLE semPId = NULL;   /* semaphore for producer */
-    HANDLE semCId = NULL;   /* semaphore for consumer */
-    HANDLE mutex = NULL;    /* mutex for protect accessing to shared data */
-    HANDLE hFile = NULL;
-    char * strName = NULL;
-    MSG_SM * psm = NULL;
+    MSG_Q_LOG(psm, &pWait->state);
+    MSG_Q_LOG(psm, &sem->pended);
+    MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_FREE);
+    MSG_Q_STORE(&sem->pended, sem->pended - 1);
+}
 
-    if (pstrName == NULL) {
-        PRINTF("input NULL parameter.\n");
-        return NULL;
-    }
-    else {
-        /* allocate the object name memory */
-        int len = strlen(pstrName) + MSG_Q_PREFIX_LEN + 1;
-        strName = (char*)malloc(len);
-        if (strName == NULL) {
-            PRINTF("allocate memory failed with errno %d!\n", errno);
-            return NULL;
+/*
+ * free the entries the dead tasks have left in the wait list of a named
+ * queue, the mutex must be taken
+ *
+ * the pended counts are counted again from the entries, so a purge cut short
+ * by the death of its own task is completed by the next one.
+ */
+static void msgQWaitListPurge
+    (
+    MSG_SM * psm
+    )
+{
+    MSG_WAIT * pWait = NULL;
+    UINT pended[MSG_Q_CHAN_NUM] = {0};
+    int index = 0;
+
+    for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+        pWait = &psm->waitList[index];
+        if (pWait->state == MSG_Q_WAIT_FREE)
+            continue;
+
+        if (!msgQOsAlive(pWait->pid)) {
+            PRINTF("task of process %u died in the wait list.\n", pWait->pid);
+            MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_FREE);
+        }
+        else if (pWait->chan > 0 && pWait->chan < MSG_Q_CHAN_NUM) {
+            pended[pWait->chan]++;
         }
-        memset(strName, 0, len);
     }
 
-    /* allocate the message queue control block memory */
+    MSG_Q_STORE(&psm->semP.pended, pended[MSG_Q_CHAN_SEM_P]);
+    MSG_Q_STORE(&psm->semC.pended, pended[MSG_Q_CHAN_SEM_C]);
+}
 
-    qid = (P_MSG_Q)malloc(sizeof(MSG_Q));
-    if (qid == NULL) {
-        PRINTF("allocate memory failed with errno %d!\n", errno);
-        goto FailedExit;
+/*
+ * give the units a dead owner of the mutex held or owed, the mutex must be
+ * taken
+ */
+static void msgQLogGive
+    (
+    P_MSG_Q qid,
+    int chan,
+    UINT units
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_SEM * sem = NULL;
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    int grants = 0;
+
+    if (chan < 0 || units == 0)
+        return;
+
+    sem = (chan == MSG_Q_CHAN_SEM_P) ? &psm->semP : &psm->semC;
+
+    /* the bytes freed in the byte ring are an event for the senders */
+    if (chan == MSG_Q_CHAN_SEM_C && (psm->options & MSG_Q_VARLEN)) {
+        MSG_Q_ADD(&sem->count, 1);
+        msgQOsWake(qid, chan, &sem->count, (int)MSG_Q_LOAD(&sem->waiters));
+        return;
+    }
+
+    /* the repair is repeated after the death of the repairing task too */
+    MSG_Q_LOG(psm, &sem->count);
+    MSG_Q_ADD(&sem->count, units);
+
+    if (MSG_Q_LOAD(&sem->pended) > 0) {
+        grants = msgQWaitListCall(psm, sem, chan, granted);
+        msgQWaitListWake(qid, chan, granted, grants);
+    }
+
+    if (MSG_Q_LOAD(&sem->waiters) > 0)
+        msgQOsWake(qid, chan, &sem->count, (int)units);
+}
+
+/*
+ * repair a queue whose mutex has been taken over from a dead owner, the
+ * mutex must be taken
+ *
+ * the words of the step cut short are restored, the latest first, which
+ * leaves the links, the free link and the counts as they were before the
+ * step. A task which dies before its first step done has its semaphore units
+ * restored with the words; after it, the units the dead task took beyond its
+ * steps done are given back, and each step done gives the unit the task
+ * would have given before it released the mutex.
+ *
+ * The units are given with the log kept, and saved in it, so a repair cut
+ * short by the death of the repairing task is rolled back and done again by
+ * the next one.
+ */
+static void msgQLogRepair
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_LOG * pLog = &psm->log;
+    UINT state = MSG_Q_LOAD(&pLog->state);
+    UINT words = state & MSG_Q_LOG_WORDS;
+    UINT steps = state / MSG_Q_LOG_STEP;
+    UINT back = (steps > 0 && pLog->taken > steps) ? pLog->taken - steps : 0;
+
+    if (words > MSG_Q_LOG_MAX)
+        words = MSG_Q_LOG_MAX;
+
+    while (words-- > 0) {
+        *(volatile UINT*)((char*)psm + pLog->offset[words]) =
+            pLog->value[words];
+    }
+
+    MSG_Q_BARRIER();
+    MSG_Q_STORE(&pLog->state, steps * MSG_Q_LOG_STEP);
+    MSG_Q_BARRIER();
+
+    /* the readiness is signaled again from the repaired state */
+    psm->pollLevel = ~0U;
+    msgQPollUpdate(qid);
+
+    msgQLogGive(qid, pLog->takenChan, back);
+    msgQLogGive(qid, pLog->giveChan, steps);
+
+    MSG_Q_BARRIER();
+    MSG_Q_STORE(&pLog->state, 0);
+    pLog->taken = 0;
+}
+
+/*
+ * take the mutex for shared memory protecting
+ *
+ * the mutex word is 0 when unlocked, or the process ID of the owner, with
+ * MSG_Q_MUTEX_WAITERS set when tasks are pended on it, so the owner only calls
+ * into the kernel for a wake up if somebody is waiting. A pended task checks
+ * the owner of the mutex of a named queue from time to time, and takes over
+ * the mutex of a dead one.
+ */
+int msgQLock
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT self = msgQOsSelf();
+    UINT state = 0;
+    unsigned long start = 0;
+
+    if (MSG_Q_CAS(&psm->mutex, &state, self))
+        return 0;
+
+    start = msgQOsTime();
+
+    for (;;) {
+        /* the other tasks may still pend, so they are woken up at unlock */
+        if (state == 0) {
+            if (MSG_Q_CAS(&psm->mutex, &state, self | MSG_Q_MUTEX_WAITERS))
+                return 0;
+            continue;
+        }
+
+        if (!(state & MSG_Q_MUTEX_WAITERS)) {
+            if (!MSG_Q_CAS(&psm->mutex, &state,
+                state | MSG_Q_MUTEX_WAITERS))
+                continue;
+            state |= MSG_Q_MUTEX_WAITERS;
+        }
+
+        if (msgQOsWait(qid, MSG_Q_CHAN_MUTEX, &psm->mutex, state,
+            psm->logged ? MSG_Q_OWNER_POLL : WAIT_FOREVER)) {
+            return -1;
+        }
+
+        /* the owner of the mutex of a named queue may have died with it */
+        if (psm->logged && msgQOsTime() - start >= MSG_Q_OWNER_POLL) {
+            start = msgQOsTime();
+            if (MSG_Q_LOAD(&psm->mutex) == state &&
+                !msgQOsAlive(state & ~MSG_Q_MUTEX_WAITERS) &&
+                MSG_Q_CAS(&psm->mutex, &state,
+                self | MSG_Q_MUTEX_WAITERS)) {
+                PRINTF("owner %u of the mutex died, repairing.\n",
+                    state & ~MSG_Q_MUTEX_WAITERS);
+                msgQLogRepair(qid);
+                return 0;
+            }
+        }
+
+        state = MSG_Q_LOAD(&psm->mutex);
+    }
+}
+
+/*
+ * release the mutex for shared memory protecting
+ */
+void msgQUnlock
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT syncEvery = psm->syncEvery;
+    UINT state = msgQOsSelf();
+    int sync = 0;
+
+    /* the batch of a durable queue is written out of the mutex */
+    if (syncEvery != 0 && psm->syncCount >= syncEvery) {
+        psm->syncCount = 0;
+        sync = 1;
+    }
+
+    /* the units have been given, the steps done go before the units taken */
+    if (psm->logged) {
+        MSG_Q_BARRIER();
+        MSG_Q_STORE(&psm->log.state, 0);
+        MSG_Q_BARRIER();
+        psm->log.taken = 0;
+    }
+
+    if (!MSG_Q_CAS(&psm->mutex, &state, 0)) {
+        MSG_Q_STORE(&psm->mutex, 0);
+        msgQOsWake(qid, MSG_Q_CHAN_MUTEX, &psm->mutex, 1);
+    }
+
+    if (sync)
+        msgQOsSync(qid);
+}
+
+/*
+ * start the undo log of an operation under the mutex
+ */
+void msgQLogBegin
+    (
+    MSG_SM * psm,
+    int takenChan,
+    UINT taken,
+    int giveChan
+    )
+{
+    if (!psm->logged)
+        return;
+
+    psm->log.takenChan = takenChan;
+    psm->log.giveChan = giveChan;
+    MSG_Q_BARRIER();
+    psm->log.taken = taken;
+    MSG_Q_BARRIER();
+}
+
+/*
+ * save a word in the undo log before it is written, the mutex must be taken
+ */
+void msgQLogSave
+    (
+    MSG_SM * psm,
+    volatile void * addr
+    )
+{
+    MSG_LOG * pLog = &psm->log;
+    UINT state = pLog->state;
+    UINT words = state & MSG_Q_LOG_WORDS;
+
+    if (words >= MSG_Q_LOG_MAX) {
+        PRINTF("undo log overflows.\n");
+        return;
+    }
+
+    pLog->offset[words] = (UINT)((volatile char*)addr - (char*)psm);
+    pLog->value[words] = *(volatile UINT*)addr;
+    MSG_Q_BARRIER();
+    pLog->state = state + 1;
+    MSG_Q_BARRIER();
+}
+
+/*
+ * mark a step of the undo log done, its words are not restored any more
+ */
+void msgQLogStep
+    (
+    MSG_SM * psm
+    )
+{
+    if (!psm->logged)
+        return;
+
+    MSG_Q_BARRIER();
+    psm->log.state = (psm->log.state & ~MSG_Q_LOG_WORDS) + MSG_Q_LOG_STEP;
+    MSG_Q_BARRIER();
+}
+
+/*
+ * signal a change of readiness on the pollable descriptor, the mutex must be
+ * taken
+ */
+void msgQPollUpdate
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT level = 0;
+    UINT pos = 0;
+
+    if (MSG_Q_LOAD(&psm->pollable) == 0)
+        return;
+
+    /* a ring is ready when the consumer would find a filled slot */
+    if (psm->options & MSG_Q_MPMC) {
+        pos = MSG_Q_LOAD(&psm->cons.index);
+        level = (MSG_Q_SEQ(psm, pos & (psm->slots - 1)) == pos + 1);
+    }
+    else if (psm->options & MSG_Q_SPSC) {
+        level = (MSG_Q_LOAD(&psm->prod.index) !=
+            MSG_Q_LOAD(&psm->cons.index));
+    }
+    else {
+        level = (psm->msgNum > 0);
+    }
+
+    if (level != psm->pollLevel) {
+        psm->pollLevel = level;
+        msgQOsEventSet(qid, level);
+    }
+}
+
+/*
+ * signal the readiness of a lock-free ring on the pollable descriptor
+ */
+void msgQPollSync
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+
+    /* the ring has been changed before the flag is read */
+    MSG_Q_FENCE();
+    if (MSG_Q_LOAD(&psm->pollable) == 0)
+        return;
+
+    if (msgQLock(qid) != 0)
+        return;
+
+    msgQPollUpdate(qid);
+    msgQUnlock(qid);
+}
+
+/*
+ * take a unit of a semaphore of a MSG_Q_PRIORITY queue in the wait list
+ *
+ * a task which finds the semaphore exhausted puts itself into the wait list
+ * in MSG_SM with its priority and pends on the state of its own entry. The
+ * giver hands a unit over to the highest priority task of the list directly,
+ * so the unit can't be taken by any other task meanwhile.
+ *
+ * RETURNS: the number of units taken, -1 if timeout, or 0 if the wait list
+ * is full.
+ */
+static int msgQWaitListTake
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    UINT max,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    MSG_WAIT * pWait = NULL;
+    unsigned long start = msgQOsTime();
+    int priority = msgQOsPriority();
+    int grants = 0;
+    int index = 0;
+    UINT count = 0;
+    UINT state = 0;
+
+    /* take the mutex for the wait list */
+    if (msgQLock(qid) != 0) {
+        return -1;
+    }
+
+    for (index = 0; index < MSG_Q_WAIT_MAX; index++) {
+        if (psm->waitList[index].state == MSG_Q_WAIT_FREE) {
+            pWait = &psm->waitList[index];
+            pWait->chan = chan;
+            pWait->priority = priority;
+            pWait->order = psm->waitOrder++;
+            MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_PENDED);
+            MSG_Q_ADD(&sem->pended, 1);
+            break;
+        }
+    }
+
+    if (pWait == NULL) {
+        msgQUnlock(qid);
+        return 0;
+    }
+
+    /* a unit given before the giver could see the task is granted now */
+    grants = msgQWaitListGrant(psm, sem, chan, granted);
+
+    /* release the mutex */
+    msgQUnlock(qid);
+
+    msgQWaitListWake(qid, chan, granted, grants);
+
+    while (MSG_Q_LOAD(&pWait->state) != MSG_Q_WAIT_GRANTED) {
+        timeout = msgQTimeLeft(start, timeout);
+        if (timeout == 0 || msgQOsWait(qid, chan, &pWait->state,
+            MSG_Q_WAIT_PENDED, timeout) != 0) {
+            /* leave the list, unless the unit has just been handed over */
+            state = MSG_Q_WAIT_PENDED;
+            if (MSG_Q_CAS(&pWait->state, &state, MSG_Q_WAIT_FREE)) {
+                MSG_Q_SUB(&sem->pended, 1);
+                return -1;
+            }
+        }
+    }
+
+    MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_FREE);
+
+    /* take the units given beyond the one handed over, if any */
+    count = 1;
+    if (max > 1 && MSG_Q_LOAD(&sem->pended) == 0) {
+        state = MSG_Q_LOAD(&sem->count);
+        while (state > 0) {
+            UINT more = (state > max - 1) ? max - 1 : state;
+            if (MSG_Q_CAS(&sem->count, &state, state - more)) {
+                count += more;
+                break;
+            }
+        }
+    }
+
+    return (int)count;
+}
+
+/*
+ * take up to <max> units of a shared memory semaphore
+ *
+ * the units are taken with an atomic operation if they are available, and
+ * the task only pends in the kernel when the semaphore is exhausted.
+ *
+ * RETURNS: the number of units taken, at least one, or -1 if timeout.
+ */
+static int msgQSemTakeSome
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    UINT max,
+    int timeout
+    )
+{
+    int side = (chan == MSG_Q_CHAN_SEM_C) ? MSG_Q_SIDE_SEND : MSG_Q_SIDE_RECV;
+    unsigned long start = 0;
+    int timeLimit = 0;
+    int status = 0;
+    int spun = 0;
+    int waited = 0;
+    UINT count = 0;
+    UINT taken = 0;
+
+    if (timeout > 0)
+        start = msgQOsTime();
+
+    for (;;) {
+        /* the tasks in the wait list of MSG_Q_PRIORITY come first */
+        count = MSG_Q_LOAD(&sem->pended) ? 0 : MSG_Q_LOAD(&sem->count);
+        while (count > 0) {
+            taken = (count > max) ? max : count;
+            if (MSG_Q_CAS(&sem->count, &count, count - taken))
+                return (int)taken;
+        }
+
+        /* the queue is full, or empty, for the side of the semaphore */
+        if (!waited) {
+            waited = 1;
+            msgQStatWait(qid->psm, side, 0);
+        }
+
+        /* calculate the time left, a timeout counts if the task could wait */
+        timeLimit = msgQTimeLeft(start, timeout);
+        if (timeLimit == 0) {
+            if (timeout != 0)
+                msgQStatWait(qid->psm, side, 1);
+            return -1;
+        }
+
+        /* a unit may come soon, spin once before pending */
+        if (!spun && MSG_Q_LOAD(&sem->pended) == 0) {
+            spun = 1;
+            if (msgQSpin(qid->psm, &sem->spin, &sem->count, 0))
+                continue;
+        }
+
+        /* pend in the wait list by priority, unless it is full */
+        if (qid->psm->options & MSG_Q_PRIORITY) {
+            status = msgQWaitListTake(qid, sem, chan, max, timeLimit);
+            if (status == -1)
+                msgQStatWait(qid->psm, side, 1);
+            if (status != 0)
+                return status;
+        }
+
+        /* the giver only wakes up tasks it can see in the waiters */
+        MSG_Q_ADD(&sem->waiters, 1);
+        status = msgQOsWait(qid, chan, &sem->count, 0, timeLimit);
+        MSG_Q_SUB(&sem->waiters, 1);
+
+        if (status != 0)
+            return -1;
+    }
+}
+
+/*
+ * give units to a shared memory semaphore
+ */
+static void msgQSemGive
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    int count
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    int grants = 0;
+
+    MSG_Q_ADD(&sem->count, count);
+
+    /* hand the units over to the tasks in the wait list of MSG_Q_PRIORITY */
+    if (MSG_Q_LOAD(&sem->pended) > 0 && msgQLock(qid) == 0) {
+        grants = msgQWaitListGrant(psm, sem, chan, granted);
+        msgQUnlock(qid);
+        msgQWaitListWake(qid, chan, granted, grants);
+    }
+
+    if (MSG_Q_LOAD(&sem->waiters) > 0)
+        msgQOsWake(qid, chan, &sem->count, count);
+}
+
+/*
+ * take up to <max> units of a semaphore of a named queue under the mutex
+ *
+ * the units never leave the semaphore but under the mutex, saved in the undo
+ * log, so a task which dies at any point leaves the count of the units right.
+ * A task which finds no unit for it pends with the mutex released, on the
+ * semaphore, or on its entry of the wait list of MSG_Q_PRIORITY. The tasks
+ * of the wait list are not handed the units but called to take them: a task
+ * takes a unit when fewer tasks of the list rank before it than there are
+ * units, and the tasks out of the list only take the units beyond the tasks
+ * in it. The pended tasks wake up from time to time to free the entries of
+ * the dead tasks, which would hold up the tasks ranked behind them.
+ *
+ * RETURNS: the number of units taken, at least one, with the mutex taken, or
+ * -1 if timeout.
+ */
+static int msgQSemTakeLogged
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    UINT max,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    MSG_WAIT * pWait = NULL;
+    int side = (chan == MSG_Q_CHAN_SEM_C) ? MSG_Q_SIDE_SEND : MSG_Q_SIDE_RECV;
+    unsigned long start = msgQOsTime();
+    unsigned long polled = start;
+    int timeLimit = 0;
+    int grants = 0;
+    int spun = 0;
+    int waited = 0;
+    int purged = 0;
+    int status = 0;
+    UINT count = 0;
+    UINT taken = 0;
+
+    for (;;) {
+        /* take the mutex for the semaphore */
+        if (msgQLock(qid) != 0) {
+            return -1;
+        }
+
+        /* the units may be left to the list by dead tasks only */
+        count = sem->count;
+        if (sem->pended > 0 && ((!purged && count > 0 &&
+            count <= sem->pended) ||
+            msgQOsTime() - polled >= MSG_Q_OWNER_POLL)) {
+            purged = 1;
+            polled = msgQOsTime();
+            msgQWaitListPurge(psm);
+        }
+
+        /* a task which has to wait ranks in the wait list of MSG_Q_PRIORITY */
+        if (pWait == NULL && (psm->options & MSG_Q_PRIORITY) &&
+            timeout != 0 && count <= sem->pended &&
+            (spun || sem->pended > 0)) {
+            pWait = msgQWaitListJoin(psm, sem, chan);
+        }
+
+        if (pWait != NULL) {
+            taken = (msgQWaitListRank(psm, pWait) < count) ? 1 : 0;
+            if (taken > 0 && sem->pended == 1)
+                taken = (count > max) ? max : count;
+        }
+        else {
+            taken = (count > sem->pended) ? count - sem->pended : 0;
+            taken = (taken > max) ? max : taken;
+        }
+
+        if (taken > 0) {
+            if (pWait != NULL)
+                msgQWaitListLeave(psm, sem, pWait);
+            MSG_Q_LOG(psm, &sem->count);
+            MSG_Q_STORE(&sem->count, count - taken);
+            return (int)taken;
+        }
+
+        /* the queue is full, or empty, for the side of the semaphore */
+        if (!waited) {
+            waited = 1;
+            msgQStatWait(psm, side, 0);
+        }
+
+        /* the units a task leaves go to the next tasks of the list */
+        timeLimit = msgQTimeLeft(start, timeout);
+        if (timeLimit == 0) {
+            if (pWait != NULL) {
+                msgQWaitListLeave(psm, sem, pWait);
+                grants = msgQWaitListCall(psm, sem, chan, granted);
+            }
+            msgQUnlock(qid);
+            msgQWaitListWake(qid, chan, granted, grants);
+            if (timeout != 0)
+                msgQStatWait(psm, side, 1);
+            return -1;
+        }
+
+        /* a unit may come soon, spin once before pending */
+        if (!spun && count == 0 && sem->pended == 0) {
+            spun = 1;
+            msgQUnlock(qid);
+            msgQSpin(psm, &sem->spin, &sem->count, 0);
+            continue;
+        }
+
+        if (timeLimit == WAIT_FOREVER || timeLimit > MSG_Q_OWNER_POLL)
+            timeLimit = MSG_Q_OWNER_POLL;
+
+        if (pWait != NULL) {
+            MSG_Q_STORE(&pWait->state, MSG_Q_WAIT_PENDED);
+            msgQUnlock(qid);
+            status = msgQOsWait(qid, chan, &pWait->state, MSG_Q_WAIT_PENDED,
+                timeLimit);
+        }
+        else {
+            /* the giver only wakes up tasks it can see in the waiters */
+            MSG_Q_ADD(&sem->waiters, 1);
+            msgQUnlock(qid);
+            status = msgQOsWait(qid, chan, &sem->count, count, timeLimit);
+            MSG_Q_SUB(&sem->waiters, 1);
+        }
+
+        if (status != 0) {
+            if (pWait != NULL && msgQLock(qid) == 0) {
+                msgQWaitListLeave(psm, sem, pWait);
+                msgQUnlock(qid);
+            }
+            return -1;
+        }
+    }
+}
+
+/*
+ * take up to <max> units of a shared memory semaphore and the mutex
+ */
+int msgQSemTakeLock
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    UINT max,
+    int timeout
+    )
+{
+    int taken = 0;
+
+    if (qid->psm->logged)
+        return msgQSemTakeLogged(qid, sem, chan, max, timeout);
+
+    taken = msgQSemTakeSome(qid, sem, chan, max, timeout);
+    if (taken < 0) {
+        /* timeout */
+        return -1;
+    }
+
+    /* take the mutex for shared memory protecting */
+    if (msgQLock(qid) != 0) {
+        /* release the semaphore if failed to take the mutex */
+        msgQSemGive(qid, sem, chan, taken);
+        return -1;
+    }
+
+    return taken;
+}
+
+/*
+ * give units to a shared memory semaphore under the mutex, the mutex must be
+ * taken
+ *
+ * RETURNS: the number of tasks of the wait list to wake up, their entries in
+ * <granted>.
+ */
+static int msgQSemPut
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    int count,
+    MSG_WAIT ** granted
+    )
+{
+    MSG_SM * psm = qid->psm;
+
+    if (count <= 0)
+        return 0;
+
+    MSG_Q_LOG(psm, &sem->count);
+    MSG_Q_ADD(&sem->count, (UINT)count);
+
+    if (MSG_Q_LOAD(&sem->pended) == 0)
+        return 0;
+
+    /* hand the units over to the tasks in the wait list of MSG_Q_PRIORITY */
+    if (psm->logged)
+        return msgQWaitListCall(psm, sem, chan, granted);
+
+    return msgQWaitListGrant(psm, sem, chan, granted);
+}
+
+/*
+ * give units to a shared memory semaphore and release the mutex
+ */
+void msgQSemGiveUnlock
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    int count
+    )
+{
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    int grants = 0;
+
+    grants = msgQSemPut(qid, sem, chan, count, granted);
+
+    /* release the mutex */
+    msgQUnlock(qid);
+
+    msgQWaitListWake(qid, chan, granted, grants);
+
+    if (count > 0 && MSG_Q_LOAD(&sem->waiters) > 0)
+        msgQOsWake(qid, chan, &sem->count, count);
+}
+
+/*
+ * give back the units taken by msgQSemTakeLock and not used, the mutex must
+ * be taken
+ */
+void msgQSemGiveBack
+    (
+    P_MSG_Q qid,
+    MSG_SEM * sem,
+    int chan,
+    int count
+    )
+{
+    MSG_WAIT * granted[MSG_Q_WAIT_MAX];
+    int grants = 0;
+
+    grants = msgQSemPut(qid, sem, chan, count, granted);
+    msgQWaitListWake(qid, chan, granted, grants);
+
+    if (count > 0 && MSG_Q_LOAD(&sem->waiters) > 0)
+        msgQOsWake(qid, chan, &sem->count, count);
+}
+
+/*
+ * create and initialize a message queue, queue pended tasks in FIFO order
+ */
+MSG_Q_ID msgQCreateEx
+    (
+    int maxMsgs,
+    int maxMsgLength,
+    int options,
+    const char * pstrName
+    )
+{
+    P_MSG_Q qid = NULL;     /* message queue identify */
+    MSG_SM * psm = NULL;
+    int index = 0;
+    int created = 0;
+    UINT slots = 0;
+    UINT slotSize = 0;
+    UINT dataSize = 0;
+    size_t memSize = 0;
+
+    /* check the inputed parameters */
+
+    if (maxMsgs <= 0) {
+        PRINTF("invalid maxMsgs %d.\n", maxMsgs);
+        return NULL;
+    }
+
+    if (maxMsgLength <= 0) {
+        PRINTF("invalid maxMsgLength %d.\n", maxMsgLength);
+        return NULL;
+    }
+
+    if ((options & ~(MSG_Q_PRIORITY | MSG_Q_RING_MODES | MSG_Q_VARLEN |
+        MSG_Q_HUGEPAGE | MSG_Q_DURABLE | MSG_Q_LATENCY)) != 0 ||
+        (options & MSG_Q_RING_MODES) == MSG_Q_RING_MODES ||
+        ((options & MSG_Q_VARLEN) && (options & MSG_Q_RING_MODES)) ||
+        ((options & MSG_Q_DURABLE) &&
+        (options & (MSG_Q_RING_MODES | MSG_Q_VARLEN | MSG_Q_LATENCY)))) {
+        PRINTF("invalid options %d.\n", options);
+        return NULL;
+    }
+
+    /* a durable queue is named by the path of its file, and only it is */
+    if ((options & MSG_Q_DURABLE) ? (pstrName == NULL ||
+        strchr(pstrName, '/') == NULL) :
+        (pstrName != NULL && strchr(pstrName, '/') != NULL)) {
+        PRINTF("invalid name for options %d.\n", options);
+        return NULL;
+    }
+
+    /* the byte ring holds maxMsgs bytes and a message of maxMsgLength */
+    if (options & MSG_Q_VARLEN) {
+        if (maxMsgs > 0x7ffffff0 ||
+            MSG_Q_REC_SIZE(options, (UINT)maxMsgLength) > (UINT)maxMsgs) {
+            PRINTF("invalid maxMsgs %d.\n", maxMsgs);
+            return NULL;
+        }
+        dataSize = ((UINT)maxMsgs + MSG_Q_REC_HDR - 1) & ~(MSG_Q_REC_HDR - 1);
+    }
+
+    /* the lock-free ring has a power of two number of slots */
+    slots = (options & MSG_Q_VARLEN) ? 0 : (UINT)maxMsgs;
+    if (options & MSG_Q_RING_MODES) {
+        if (maxMsgs > 0x40000000) {
+            PRINTF("invalid maxMsgs %d.\n", maxMsgs);
+            return NULL;
+        }
+        /* at least two slots to tell a filled slot from a free one */
+        for (slots = 2; slots < (UINT)maxMsgs; slots <<= 1)
+            ;
+    }
+
+    /*
+     * NOTES: the data of a slot never straddles a cache line it doesn't
+     * fill, a short message takes a power of two bytes and a long one whole
+     * cache lines, so a task only touches the lines of its own message.
+     */
+
+    for (slotSize = MSG_Q_REC_HDR; slotSize < (UINT)maxMsgLength &&
+        slotSize < MSG_Q_CACHE_LINE; slotSize <<= 1)
+        ;
+    if (slotSize < (UINT)maxMsgLength)
+        slotSize = (UINT)MSG_Q_ROUND((UINT)maxMsgLength, MSG_Q_CACHE_LINE);
+
+    /* a name opened by the process gets its handle */
+    if (pstrName != NULL) {
+        qid = msgQCacheGet(pstrName);
+        if (qid != NULL)
+            return (MSG_Q_ID)qid;
+    }
+
+    /* allocate the message queue control block memory */
+
+    qid = (P_MSG_Q)malloc(sizeof(MSG_Q));
+    if (qid == NULL) {
+        PRINTF("allocate memory with errno %d!\n", errno);
+        return NULL;
+    }
+    memset(qid, 0, sizeof(MSG_Q));
+
+    /* allocate the message queue memory */
+
+    memSize = sizeof(MSG_SM) + dataSize +
+        MSG_Q_ROUND(slots * sizeof(MSG_NODE), MSG_Q_CACHE_LINE) +
+        (size_t)slots * slotSize;
+    created = msgQOsMap(qid, pstrName, memSize, 1,
+        (options & MSG_Q_HUGEPAGE) != 0);
+    if (created == -1) {
+        free(qid);
+        return NULL;
+    }
+    psm = qid->psm;
+
+    /*
+     * NOTES: the same object can be create more than one time if the object
+     * name is not null -- the object reference is returned when the same
+     * object is created. In order to avoid overwrite the shared memory when
+     * get the same object reference, only the creator of the shared memory
+     * initializes it, and the others wait for the magic string.
+     */
+
+    /*
+     * NOTES: the memory of a new queue reads as zero and gets its pages at
+     * the first touch, so only MSG_SM is set up here: the message nodes join
+     * the free link when they are handed out first, and the zeroed nodes are
+     * free for the first lap of the MPMC ring, so creating a queue takes the
+     * same time whatever its size, and the pages of a slot are only touched
+     * when a message uses it.
+     */
+
+    if (created == 1) {
+        /* clear the attributes */
+        memset(psm, 0, sizeof(MSG_SM));
+
+        /* set message queue attributes in shared memory */
+        strcpy(psm->version, MSG_Q_VERSION);
+        psm->maxMsgs = maxMsgs;
+        psm->maxMsgLength = maxMsgLength;
+        psm->options = options;
+        psm->msgNum = 0;
+        psm->head = MSG_Q_INVALID_NODE;
+        psm->tail = MSG_Q_INVALID_NODE;
+        psm->levelMap = 0;
+        for (index = 0; index < MSG_PRI_LEVELS; index++) {
+            psm->levelHead[index] = MSG_Q_INVALID_NODE;
+            psm->levelTail[index] = MSG_Q_INVALID_NODE;
+        }
+        psm->free = MSG_Q_INVALID_NODE;
+        psm->freeMark = 0;
+        psm->slots = slots;
+        psm->slotSize = slotSize;
+        psm->pageSize = (UINT)qid->pageSize;
+        psm->logged = (pstrName != NULL);
+        psm->log.takenChan = -1;
+        psm->log.giveChan = -1;
+        psm->dataSize = dataSize;
+        psm->dataUsed = 0;
+        msgQRingInit(psm);
+
+        /* the byte ring keeps the offsets of its records */
+        if (options & MSG_Q_VARLEN) {
+            psm->head = 0;
+            psm->tail = 0;
+        }
+
+        /* no message is available and all the slots are free */
+        psm->mutex = 0;
+        psm->semP.count = 0;
+        psm->semC.count = (options & MSG_Q_VARLEN) ? 0 : maxMsgs;
+
+        /* publish the attributes before the magic string */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        strcpy(psm->magic, MSG_Q_MAGIC);
+    }
+    else if (msgQWaitReady(qid) == -1 ||
+        (created == 2 && msgQDurableRecover(qid) == -1)) {
+        msgQOsUnmap(qid, 0);
+        free(qid);
+        return NULL;
+    }
+
+    MSG_Q_ADD(&psm->refs, 1);
+    msgQOsReady(qid);
+
+    /* calibrate the stamps before the first message */
+    if (psm->options & MSG_Q_LATENCY)
+        msgQOsStamp();
+
+    /* the creator lists the queue for the other processes */
+    if (pstrName != NULL) {
+        if (created)
+            msgQRegAdd(qid, pstrName);
+        qid = msgQCacheAdd(qid, pstrName);
+    }
+
+    return (MSG_Q_ID)qid;
+}
+
+/*
+ * open an existed message queue -- inter-process message queue
+ */
+MSG_Q_ID msgQOpen
+    (
+    const char * pstrName
+    )
+{
+    P_MSG_Q qid = NULL;     /* message queue identify */
+    int status = 0;
+
+    if (pstrName == NULL) {
+        PRINTF("input NULL parameter.\n");
+        return NULL;
+    }
+
+    /* a name opened by the process gets its handle */
+    qid = msgQCacheGet(pstrName);
+    if (qid != NULL) {
+        return qid;
+    }
+
+    /* allocate the message queue control block memory */
+
+    qid = (P_MSG_Q)malloc(sizeof(MSG_Q));
+    if (qid == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return NULL;
+    }
+    memset(qid, 0, sizeof(MSG_Q));
+
+    /* open the message queue share data */
+
+    status = msgQOsMap(qid, pstrName, 0, 0, 0);
+    if (status == -1) {
+        free(qid);
+        return NULL;
+    }
+
+    /* valid verification, and recovery of a durable queue left alone */
+
+    if (msgQWaitReady(qid) == -1 ||
+        (status == 2 && msgQDurableRecover(qid) == -1)) {
+        msgQOsUnmap(qid, 0);
+        free(qid);
+        return NULL;
+    }
+
+    MSG_Q_ADD(&qid->psm->refs, 1);
+    msgQOsReady(qid);
+
+    /* calibrate the stamps before the first message */
+    if (qid->psm->options & MSG_Q_LATENCY)
+        msgQOsStamp();
+
+    /* a durable queue recovered is listed again */
+    if (status == 2)
+        msgQRegAdd(qid, pstrName);
+
+    return msgQCacheAdd(qid, pstrName);
+}
+
+/*
+ * watch an existed message queue without changing it
+ */
+MSG_Q_ID msgQWatch
+    (
+    const char * pstrName
+    )
+{
+    P_MSG_Q qid = NULL;     /* message queue identify */
+
+    if (pstrName == NULL) {
+        PRINTF("input NULL parameter.\n");
+        return NULL;
+    }
+
+    /* allocate the message queue control block memory */
+
+    qid = (P_MSG_Q)malloc(sizeof(MSG_Q));
+    if (qid == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return NULL;
+    }
+    memset(qid, 0, sizeof(MSG_Q));
+
+    /* map the message queue share data read-only */
+
+    if (msgQOsWatch(qid, pstrName) == -1) {
+        free(qid);
+        return NULL;
+    }
+    qid->watch = 1;
+
+    /*
+     * NOTES: a queue being created is not waited for and a durable queue
+     * left alone is not recovered, both need to write the shared memory.
+     */
+
+    if (msgQVerify(qid, __func__) == -1) {
+        msgQOsUnmap(qid, 0);
+        free(qid);
+        return NULL;
+    }
+
+    return qid;
+}
+
+/*
+ * delete a message queue
+ */
+int msgQDelete
+    (
+    MSG_Q_ID msgQId
+    )
+{
+    int status = 0;
+    int destroy = 0;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+
+    /* verify if the message queue is valid */
+    if (msgQVerify(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /*
+     * NOTES: the shared memory must not be cleared when delete this message
+     * queue. the close operation in this routine only reduce the reference
+     * count for the objects, and the objects will be destroyed when the
+     * objects reference count equal to zero. the objects can be reused if
+     * the objects reference count is not zero. In order to protect the
+     * shared memory, avoid to call memset(qid->psm, 0x0, sizeof(MSG_SM));
+     * or any other clear operation.
+     */
+
+    /* the handle of a name opened more than once stays open */
+    if (msgQCacheRelease(qid)) {
+        return 0;
+    }
+
+    /* a watching handle is not counted */
+    if (!qid->watch) {
+        destroy = (MSG_Q_SUB(&qid->psm->refs, 1) == 0);
+    }
+
+    /* the last handle takes the queue off the registry */
+    if (destroy && qid->cacheName != NULL) {
+        msgQRegRemove(qid->cacheName);
+    }
+
+    status = msgQOsUnmap(qid, destroy);
+    free(qid->cacheName);
+    free((void*)qid);
+
+    return status;
+}
+
+/*
+ * get a pollable descriptor of a message queue
+ */
+int msgQGetFd
+    (
+    MSG_Q_ID msgQId
+    )
+{
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+    int fd = -1;
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    fd = msgQOsEventFd(qid);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* take the mutex for shared memory protecting */
+    if (msgQLock(qid) != 0) {
+        return -1;
+    }
+
+    /*
+     * NOTES: the descriptor may be left ready by a queue of the same name
+     * which has gone, so it is drained and set again from the queue.
+     */
+
+    MSG_Q_STORE(&psm->pollable, 1);
+    msgQOsEventSet(qid, 0);
+    psm->pollLevel = 0;
+    msgQPollUpdate(qid);
+
+    /* release mutex */
+    msgQUnlock(qid);
+
+    return fd;
+}
+
+/*
+ * get a free message node, the mutex must be taken
+ */
+static MSG_NODE * msgQNodeAlloc
+    (
+    MSG_SM * psm
+    )
+{
+    MSG_NODE * pNode = NULL;
+
+    /* a recycled node is reused first, its pages are touched already */
+    if (psm->free != MSG_Q_INVALID_NODE) {
+        pNode = MSG_Q_NODE(psm, psm->free);
+        MSG_Q_LOG(psm, &psm->free);
+        psm->free = pNode->free;
+    }
+    else {
+        pNode = MSG_Q_NODE(psm, psm->freeMark);
+        MSG_Q_LOG(psm, &psm->freeMark);
+        MSG_Q_LOG(psm, &pNode->index);
+        pNode->index = (int)psm->freeMark++;
+    }
+
+    /* set the node attributes */
+    MSG_Q_LOG(psm, &pNode->free);
+    MSG_Q_LOG(psm, &pNode->used);
+    pNode->free = MSG_Q_RESERVED_NODE;
+    pNode->used = MSG_Q_INVALID_NODE;
+
+    return pNode;
+}
+
+/*
+ * check the priority of a message to send
+ */
+static int msgQPriorityValid
+    (
+    int priority
+    )
+{
+    return priority == MSG_PRI_NORMAL || priority == MSG_PRI_URGENT ||
+        (priority & ~(MSG_PRI_LEVELS - 1)) == MSG_PRI_LEVEL(0);
+}
+
+/*
+ * link a filled message node into the used message link of its priority
+ * level, the mutex must be taken
+ *
+ * each priority level keeps its own used message link from its tail, the
+ * oldest message, to its head, the newest one, and the level bitmap has a bit
+ * set for each level which is not empty. A normal message goes to the head of
+ * the lowest level, an urgent message goes to the tail of the highest level.
+ */
+static void msgQNodeLink
+    (
+    MSG_SM * psm,
+    MSG_NODE * pNode,
+    int priority
+    )
+{
+    int level = 0;
+
+    if (priority == MSG_PRI_URGENT)
+        level = MSG_PRI_LEVELS - 1;
+    else if (priority != MSG_PRI_NORMAL)
+        level = priority & (MSG_PRI_LEVELS - 1);
+
+    MSG_Q_LOG(psm, &pNode->free);
+    pNode->free = MSG_Q_INVALID_NODE;
+
+    /* a durable node is stamped against the level before it is linked */
+    if (psm->options & MSG_Q_DURABLE)
+        msgQDurableStamp(psm, pNode, level, priority == MSG_PRI_URGENT);
+    else if (psm->options & MSG_Q_LATENCY)
+        MSG_Q_STAMP_SET(pNode, msgQOsStamp());
+
+    /* both the head and tail pointer to this node if it's the first message */
+    if (psm->levelHead[level] == MSG_Q_INVALID_NODE) {
+        MSG_Q_LOG(psm, &psm->levelHead[level]);
+        MSG_Q_LOG(psm, &psm->levelTail[level]);
+        MSG_Q_LOG(psm, &psm->levelMap);
+        psm->levelHead[level] = pNode->index;
+        psm->levelTail[level] = pNode->index;
+        psm->levelMap |= 1U << level;
+    }
+    else if (priority != MSG_PRI_URGENT) {
+        /* append the new message node to the head message node */
+        MSG_Q_LOG(psm, &MSG_Q_NODE(psm, psm->levelHead[level])->used);
+        MSG_Q_LOG(psm, &psm->levelHead[level]);
+        MSG_Q_NODE(psm, psm->levelHead[level])->used = pNode->index;
+        psm->levelHead[level] = pNode->index;
+    }
+    else {
+        /* put the new message node before the tail message node */
+        MSG_Q_LOG(psm, &pNode->used);
+        MSG_Q_LOG(psm, &psm->levelTail[level]);
+        pNode->used = psm->levelTail[level];
+        psm->levelTail[level] = pNode->index;
+    }
+
+    /* update the message counting attributes */
+    MSG_Q_LOG(psm, &psm->msgNum);
+    psm->msgNum++;
+    msgQStatCount(psm, MSG_Q_SIDE_SEND, 1, pNode->length);
+    msgQStatDepth(psm, (UINT)psm->msgNum);
+}
+
+/*
+ * get the oldest message node of the highest priority level, the mutex must
+ * be taken and the queue must not be empty
+ */
+static MSG_NODE * msgQNodeFirst
+    (
+    MSG_SM * psm
+    )
+{
+    return MSG_Q_NODE(psm, psm->levelTail[MSG_Q_TOP_LEVEL(psm->levelMap)]);
+}
+
+/*
+ * unlink the oldest message node of the highest priority level, the mutex
+ * must be taken and the queue must not be empty
+ */
+static MSG_NODE * msgQNodeUnlink
+    (
+    MSG_SM * psm
+    )
+{
+    /* find the highest level which has a message */
+    int level = MSG_Q_TOP_LEVEL(psm->levelMap);
+
+    /* get the message node we want to process */
+    MSG_NODE * pNode = MSG_Q_NODE(psm, psm->levelTail[level]);
+
+    /* update the tail of the used message link */
+    MSG_Q_LOG(psm, &psm->levelTail[level]);
+    MSG_Q_LOG(psm, &pNode->used);
+    psm->levelTail[level] = pNode->used;
+    pNode->used = MSG_Q_INVALID_NODE;
+
+    /* the level is empty if the tail equals to MSG_Q_INVALID_NODE */
+    if (psm->levelTail[level] == MSG_Q_INVALID_NODE) {
+        MSG_Q_LOG(psm, &psm->levelHead[level]);
+        MSG_Q_LOG(psm, &psm->levelMap);
+        psm->levelHead[level] = MSG_Q_INVALID_NODE;
+        psm->levelMap &= ~(1U << level);
+    }
+
+    /* update the message counting attributes */
+    MSG_Q_LOG(psm, &psm->msgNum);
+    psm->msgNum--;
+    msgQStatCount(psm, MSG_Q_SIDE_RECV, 1, pNode->length);
+
+    if (psm->options & MSG_Q_LATENCY)
+        msgQLatRecord(psm, MSG_Q_STAMP_GET(pNode));
+
+    return pNode;
+}
+
+/*
+ * free and append a message node to the free message link, the mutex must
+ * be taken
+ */
+static void msgQNodeFree
+    (
+    MSG_SM * psm,
+    MSG_NODE * pNode
+    )
+{
+    /* a durable node loses its stamp, its message is gone */
+    if (psm->options & MSG_Q_DURABLE) {
+        MSG_Q_LOG(psm, &pNode->commit);
+        MSG_Q_STORE(&pNode->commit, 0);
+        psm->syncCount++;
+    }
+
+    MSG_Q_LOG(psm, &pNode->used);
+    MSG_Q_LOG(psm, &pNode->free);
+    MSG_Q_LOG(psm, &psm->free);
+    pNode->used = MSG_Q_INVALID_NODE;
+    pNode->free = psm->free;
+    psm->free = pNode->index;
+}
+
+/*
+ * get the slot of the message data pointed by a buffer
+ */
+int msgQDataSlot
+    (
+    MSG_SM * psm,
+    const char * pBuffer
+    )
+{
+    const char * pData = MSG_Q_DATA(psm, 0);
+    size_t offset = 0;
+
+    if (pBuffer < pData) {
+        return -1;
+    }
+
+    offset = (size_t)(pBuffer - pData);
+    if (offset % psm->slotSize != 0 ||
+        offset / psm->slotSize >= psm->slots) {
+        return -1;
+    }
+
+    return (int)(offset / psm->slotSize);
+}
+
+/*
+ * receive a message from a message queue
+ */
+int msgQReceive
+    (
+    MSG_Q_ID msgQId,
+    char * buffer,
+    UINT maxNBytes,
+    int timeout
+    )
+{
+    MSG_NODE * pNode = NULL;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+
+    if(buffer == NULL) {
+        PRINTF("input buffer equals NULL.\n");
+        return -1;
+    }
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingReceive(qid, buffer, maxNBytes, timeout);
+    }
+
+    if (psm->options & MSG_Q_VARLEN) {
+        return msgQVarReceiveBatch(qid, buffer, maxNBytes, &maxNBytes, 1,
+            timeout) == 1 ? 0 : -1;
+    }
+
+    /*
+     * message is available if the producer semaphore can be taken, then
+     * take the mutex for shared memory protecting
+     */
+    if (msgQSemTakeLock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, 1, timeout) < 0) {
+        /* timeout */
+        return -1;
+    }
+
+    /* the message taken gives a free slot back */
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_P, 1, MSG_Q_CHAN_SEM_C);
+
+    /* get the message node we want to process */
+    pNode = msgQNodeUnlink(psm);
+
+    /* calculate the message length */
+    maxNBytes = (maxNBytes > pNode->length) ? pNode->length : maxNBytes;
+
+    /* copy the message to buffer */
+    memcpy(buffer, MSG_Q_DATA(psm, pNode->index), maxNBytes);
+
+    /* free and append the message node to the free message link */
+    msgQNodeFree(psm, pNode);
+    msgQLogStep(psm);
+
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* release the consumer semaphore and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, 1);
+
+    return 0;
+}
+
+/*
+ * receive a message from any of a set of message queues
+ */
+int msgQReceiveAny
+    (
+    MSG_Q_ID ids[],
+    int count,
+    char * buffer,
+    UINT maxNBytes,
+    int timeout,
+    int * pIndex
+    )
+{
+    P_MSG_Q qids[MSG_Q_ANY_MAX];
+    unsigned long start = 0;
+    int timeLimit = 0;
+    int index = 0;
+    int round = 0;
+    int pos = 0;
+    UINT turn = 0;
+
+    if (ids == NULL || buffer == NULL || pIndex == NULL) {
+        PRINTF("input NULL parameter.\n");
+        return -1;
+    }
+
+    if (count < 1 || count > MSG_Q_ANY_MAX) {
+        PRINTF("invalid count %d.\n", count);
+        return -1;
+    }
+
+    /* the queues are polled on their descriptors, got once for all */
+    for (index = 0; index < count; index++) {
+        qids[index] = (P_MSG_Q)ids[index];
+        if (msgQVerifyWrite(qids[index], __func__) == -1) {
+            return -1;
+        }
+        if (msgQOsEventFd(qids[index]) < 0 ||
+            (MSG_Q_LOAD(&qids[index]->psm->pollable) == 0 &&
+            msgQGetFd(ids[index]) < 0)) {
+            return -1;
+        }
+    }
+
+    if (timeout > 0)
+        start = msgQOsTime();
+
+    turn = MSG_Q_ADD(&msgQAnyTurn, 1);
+
+    for (round = 0; ; round++) {
+        for (index = 0; index < count; index++) {
+            pos = (int)((turn + (UINT)index) % (UINT)count);
+            if (msgQReceive(ids[pos], buffer, maxNBytes, 0) == 0) {
+                *pIndex = pos;
+                return 0;
+            }
+        }
+
+        timeLimit = msgQTimeLeft(start, timeout);
+        if (timeLimit == 0)
+            return -1;
+
+        /*
+         * NOTES: a queue is ready as soon as its message is linked, a little
+         * before the message can be taken, so a task which has found nothing
+         * in a ready queue lets the sender finish.
+         */
+
+        if (round > 0)
+            msgQOsYield();
+
+        if (msgQOsEventWait(qids, count, timeLimit) != 0)
+            return -1;
+    }
+}
+
+/*
+ * receive a batch of messages from a message queue
+ */
+int msgQReceiveBatch
+    (
+    MSG_Q_ID msgQId,
+    char * buffer,
+    UINT bufSize,
+    UINT lengths[],
+    int maxCount,
+    int timeout
+    )
+{
+    MSG_NODE * pNode = NULL;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+    UINT offset = 0;
+    UINT nBytes = 0;
+    int taken = 0;
+    int index = 0;
+
+    if(buffer == NULL || lengths == NULL || maxCount <= 0) {
+        PRINTF("invalid batch of %d messages.\n", maxCount);
+        return -1;
+    }
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingReceiveBatch(qid, buffer, bufSize, lengths, maxCount,
+            timeout);
+    }
+
+    if (psm->options & MSG_Q_VARLEN) {
+        return msgQVarReceiveBatch(qid, buffer, bufSize, lengths, maxCount,
+            timeout);
+    }
+
+    /* take as many messages as are there, up to the whole batch */
+    taken = msgQSemTakeLock(qid, &psm->semP, MSG_Q_CHAN_SEM_P,
+        (UINT)maxCount, timeout);
+    if (taken < 0) {
+        /* timeout */
+        return -1;
+    }
+
+    /*
+     * NOTES: the first message is truncated to the buffer like msgQReceive
+     * does, the following ones are only drained if they fit entirely.
+     */
+
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_P, (UINT)taken, MSG_Q_CHAN_SEM_C);
+
+    for (index = 0; index < taken; index++) {
+        nBytes = msgQNodeFirst(psm)->length;
+        if (index > 0 && nBytes > bufSize - offset)
+            break;
+
+        pNode = msgQNodeUnlink(psm);
+        nBytes = (nBytes > bufSize - offset) ? bufSize - offset : nBytes;
+        memcpy(buffer + offset, MSG_Q_DATA(psm, pNode->index), nBytes);
+        msgQNodeFree(psm, pNode);
+        msgQLogStep(psm);
+
+        lengths[index] = nBytes;
+        offset += nBytes;
+    }
+
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* give back the messages which don't fit into the buffer */
+    if (index < taken)
+        msgQSemGiveBack(qid, &psm->semP, MSG_Q_CHAN_SEM_P, taken - index);
+
+    /* release the consumer semaphore once for the whole batch, and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, index);
+
+    return index;
+}
+
+/*
+ * wait for the oldest message of a message queue and keep it in its slot
+ */
+int msgQReceivePeek
+    (
+    MSG_Q_ID msgQId,
+    const char ** ppBuffer,
+    UINT * pNBytes,
+    int timeout
+    )
+{
+    MSG_NODE * pNode = NULL;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+    UINT slot = 0;
+
+    if(ppBuffer == NULL || pNBytes == NULL) {
+        PRINTF("input buffer equals NULL.\n");
+        return -1;
+    }
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    /* the records of the byte ring move, they can't be held */
+    if (psm->options & MSG_Q_VARLEN) {
+        PRINTF("not supported by MSG_Q_VARLEN.\n");
+        return -1;
+    }
+
+    if (psm->options & MSG_Q_RING_MODES) {
+        if (msgQRingPeek(qid, timeout, &slot) != 0)
+            return -1;
+
+        *ppBuffer = MSG_Q_DATA(psm, slot);
+        *pNBytes = MSG_Q_NODE(psm, slot)->length;
+        return 0;
+    }
+
+    /*
+     * message is available if the producer semaphore can be taken, then
+     * take the mutex for shared memory protecting
+     */
+    if (msgQSemTakeLock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, 1, timeout) < 0) {
+        /* timeout */
+        return -1;
+    }
+
+    /* the node stays out of both links until it is released */
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_P, 1, -1);
+    pNode = msgQNodeUnlink(psm);
+    MSG_Q_LOG(psm, &pNode->free);
+    pNode->free = MSG_Q_PEEKED_NODE;
+    msgQLogStep(psm);
+
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* release mutex */
+    msgQUnlock(qid);
+
+    *ppBuffer = MSG_Q_DATA(psm, pNode->index);
+    *pNBytes = pNode->length;
+
+    return 0;
+}
+
+/*
+ * free the slot of a message returned by msgQReceivePeek
+ */
+int msgQReceiveRelease
+    (
+    MSG_Q_ID msgQId,
+    const char * pBuffer
+    )
+{
+    MSG_NODE * pNode = NULL;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+    int slot = 0;
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    /* the buffer must be the start of a slot */
+    slot = msgQDataSlot(psm, pBuffer);
+    if (slot == -1) {
+        PRINTF("buffer %p is not a peeked slot.\n", pBuffer);
+        return -1;
     }
-    memset(qid, 0, sizeof(MSG_Q));
 
-    /* open the message queue share data */
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingRelease(qid, (UINT)slot);
+    }
 
-    sprintf(strName, "%s%s", _MSG_Q_SHMEM_, pstrName);
-    hFile = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, strName);
-    if (hFile == NULL) {
-        PRINTF("OpenFileMapping with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    /* take the mutex for shared memory protecting */
+    if (msgQLock(qid) != 0) {
+        return -1;
     }
 
-    psm = (MSG_SM*)MapViewOfFile(hFile, FILE_MAP_ALL_ACCESS, 0, 0, 0);
-    if (psm == NULL) {
-        PRINTF("MapViewOfFile with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    pNode = MSG_Q_NODE(psm, slot);
+    if (pNode->free != MSG_Q_PEEKED_NODE) {
+        msgQUnlock(qid);
+        PRINTF("buffer %p is not a peeked slot.\n", pBuffer);
+        return -1;
     }
 
-    qid->psm = psm;
+    /* free and append the message node to the free message link */
+    msgQLogBegin(psm, -1, 0, MSG_Q_CHAN_SEM_C);
+    msgQNodeFree(psm, pNode);
+    msgQLogStep(psm);
+
+    /* release the consumer semaphore and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, 1);
 
-    /* valid verification */
+    return 0;
+}
 
-    if (msgQVerify(qid, __func__) == -1) {
-        goto FailedExit;
+/*
+ * send a message to a message queue
+ */
+int msgQSend
+    (
+    MSG_Q_ID msgQId,
+    char * buffer,
+    UINT nBytes,
+    int timeout,
+    int priority
+    )
+{
+    MSG_NODE * pNode = NULL;
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+
+    if(buffer == NULL) {
+        PRINTF("input buffer equals NULL.\n");
+        return -1;
     }
 
-    /* open the producer semaphore */
+    if(!msgQPriorityValid(priority)) {
+        PRINTF("invalid priority %d.\n", priority);
+        return -1;
+    }
 
-    sprintf(strName, "%s%s", _MSG_Q_SEM_P_, pstrName);
-    semPId = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE, strName);
-    if (semPId == NULL) {
-        PRINTF("open semaphore with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
     }
 
-    /* open the consumer semaphore */
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    /* check the message length */
+    if(nBytes > psm->maxMsgLength) {
+        PRINTF("nBytes %d exceed the maxMsgLength %d.\n",
+            nBytes, psm->maxMsgLength);
+        return -1;
+    }
 
-    sprintf(strName, "%s%s", _MSG_Q_SEM_C_, pstrName);
-    semCId = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE, strName);
-    if (semCId == NULL) {
-        PRINTF("open semaphore with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingSend(qid, buffer, nBytes, timeout);
     }
 
-    /* open the protecting mutex */
+    if (psm->options & MSG_Q_VARLEN) {
+        return msgQVarSendBatch(qid, (const char **)&buffer, &nBytes, 1,
+            timeout) == 1 ? 0 : -1;
+    }
 
-    sprintf(strName, "%s%s", _MSG_Q_MUTEX_, pstrName);
-    mutex = OpenMutex(MUTEX_ALL_ACCESS, FALSE, strName);
-    if (mutex == NULL) {
-        PRINTF("open mutex with errno %d!\n", (int)GetLastError());
-        goto FailedExit;
+    /*
+     * there is free slot in queue if the consumer semaphore can be taken,
+     * then take the mutex for shared memory protecting
+     */
+    if (msgQSemTakeLock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, 1, timeout) < 0) {
+        /* timeout */
+        return -1;
     }
 
-    /* set the message queue attributes */
+    /* the free slot taken gives a message */
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_C, 1, MSG_Q_CHAN_SEM_P);
+
+    /* get a free message node we want to use */
+    pNode = msgQNodeAlloc(psm);
+    pNode->length = nBytes;
 
-    qid->semPId = semPId;
-    qid->semCId = semCId;
-    qid->mutex = mutex;
-    qid->hFile = hFile;
-    qid->psm = psm;
+    /* copy the buffer to the message node */
+    memcpy(MSG_Q_DATA(psm, pNode->index), buffer, nBytes);
 
-    if (strName != NULL)
-        free(strName);
+    /* link the message node by the priority */
+    msgQNodeLink(psm, pNode, priority);
+    msgQLogStep(psm);
 
-    return qid;
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
 
-FailedExit:
-    if (psm != NULL)
-        UnmapViewOfFile(psm);
-    if (hFile != NULL)
-        CloseHandle(hFile);
-    if (semPId != NULL)
-        CloseHandle(semPId);
-    if (semCId != NULL)
-        CloseHandle(semCId);
-    if (mutex != NULL)
-        CloseHandle(mutex);
-    if (strName != NULL)
-        free(strName);
-    if (qid != NULL)
-        free(qid);
+    /* release the producer semaphore and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, 1);
 
-    return NULL;
+    return 0;
 }
 
 /*
- * delete a message queue
+ * send a batch of messages to a message queue
  */
-int msgQDelete
+int msgQSendBatch
     (
-    MSG_Q_ID msgQId
+    MSG_Q_ID msgQId,
+    const char * buffers[],
+    const UINT lengths[],
+    int count,
+    int timeout,
+    int priority
     )
 {
-    int status = 0;
-    int failed = 0;
+    MSG_NODE * pNode = NULL;
     P_MSG_Q qid = (P_MSG_Q)msgQId;
+    MSG_SM * psm = NULL;
+    int taken = 0;
+    int index = 0;
 
-    /* verify if the message queue is valid */
-    if (msgQVerify(qid, __func__) == -1) {
+    if(buffers == NULL || lengths == NULL || count < 0) {
+        PRINTF("invalid batch of %d messages.\n", count);
         return -1;
     }
 
-    status = CloseHandle(qid->semPId);
-    if(status == 0) {
-        PRINTF("close semaphore with errno %d!\n", (int)GetLastError());
-        failed++;
+    if(!msgQPriorityValid(priority)) {
+        PRINTF("invalid priority %d.\n", priority);
+        return -1;
     }
 
-    status = CloseHandle(qid->semCId);
-    if(status == 0) {
-        PRINTF("close semaphore with errno %d!\n", (int)GetLastError());
-        failed++;
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
     }
 
-    status = CloseHandle(qid->mutex);
-    if(status == 0) {
-        PRINTF("close mutex with errno %d!\n", (int)GetLastError());
-        failed++;
+    /* get the shared memory pointer */
+    psm = qid->psm;
+
+    /* check all the messages before any of them is sent */
+    for (index = 0; index < count; index++) {
+        if (buffers[index] == NULL) {
+            PRINTF("input buffer %d equals NULL.\n", index);
+            return -1;
+        }
+        if(lengths[index] > psm->maxMsgLength) {
+            PRINTF("nBytes %d exceed the maxMsgLength %d.\n",
+                lengths[index], psm->maxMsgLength);
+            return -1;
+        }
     }
 
-    if (qid->hFile != NULL) {
+    if (count == 0) {
+        return 0;
+    }
 
-        /*
-         * NOTES: the shared memory must not be cleared when delete this message
-         * queue. the close operation in this routine only reduce the reference
-         * count for the objects, and the objects will be destroyed when the
-         * objects reference count equal to zero. the objects can be reused if
-         * the objects reference count is not zero. In order to protect the
-         * shared memory, avoid to call memset(qid->psm, 0x0, sizeof(MSG_SM));
-         * or any other clear operation.
-         */
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingSendBatch(qid, buffers, lengths, count, timeout);
+    }
 
-        status = UnmapViewOfFile(qid->psm);
-        if(status == 0) {
-            PRINTF("UnmapViewOfFile with errno %d!\n", (int)GetLastError());
-            failed++;
-        }
+    if (psm->options & MSG_Q_VARLEN) {
+        return msgQVarSendBatch(qid, buffers, lengths, count, timeout);
+    }
 
-        status = CloseHandle(qid->hFile);
-        if(status == 0) {
-            PRINTF("close mapped file with errno %d!\n", (int)GetLastError());
-            failed++;
-        }
+    /* take as many free slots as are there, up to the whole batch */
+    taken = msgQSemTakeLock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, (UINT)count,
+        timeout);
+    if (taken < 0) {
+        /* timeout */
+        return -1;
     }
-    else {
-        free((void*)qid->psm);
+
+    /*
+     * NOTES: the urgent messages are linked in the reverse order, so the
+     * receivers get the batch in its own order ahead of the queued ones.
+     */
+
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_C, (UINT)taken, MSG_Q_CHAN_SEM_P);
+
+    for (index = 0; index < taken; index++) {
+        int msg = (priority == MSG_PRI_URGENT) ? taken - 1 - index : index;
+
+        pNode = msgQNodeAlloc(psm);
+        pNode->length = lengths[msg];
+        memcpy(MSG_Q_DATA(psm, pNode->index), buffers[msg], lengths[msg]);
+        msgQNodeLink(psm, pNode, priority);
+        msgQLogStep(psm);
     }
-    free((void*)qid);
 
-    return failed == 0 ? 0 : -1;
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* release the producer semaphore once for the whole batch, and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, taken);
+
+    return taken;
 }
 
 /*
- * receive a message from a message queue
+ * reserve a slot of a message queue for a message to send
  */
-int msgQReceive
+int msgQSendReserve
     (
     MSG_Q_ID msgQId,
-    char * buffer,
-    UINT maxNBytes,
-    int timeout
+    UINT nBytes,
+    int timeout,
+    char ** ppBuffer
     )
 {
-    unsigned long status = 0;
-    unsigned long timeLimit = 0;
     MSG_NODE * pNode = NULL;
     P_MSG_Q qid = (P_MSG_Q)msgQId;
     MSG_SM * psm = NULL;
 
-    if(buffer == NULL) {
+    if(ppBuffer == NULL) {
         PRINTF("input buffer equals NULL.\n");
         return -1;
     }
 
     /* verify if the message queue is valid */
-    if (msgQVerify(qid, __func__) == -1) {
+    if (msgQVerifyWrite(qid, __func__) == -1) {
         return -1;
     }
 
     /* get the shared memory pointer */
     psm = qid->psm;
 
-    /* timeout conversion */
-    if(timeout <= -1) timeLimit = INFINITE; /* wait forever */
-    else timeLimit = (unsigned long)timeout;
-
-    /* message is available if the producer semaphore can be taken */
-    status = WaitForSingleObject(qid->semPId, timeLimit);
-    if(status != WAIT_OBJECT_0) {
-        if(status == WAIT_FAILED) {
-            PRINTF("wait for semaphore with errno:%d!\n", (int)GetLastError());
-        }
-        /* WAIT_TIMEOUT */
+    /* check the message length */
+    if(nBytes > psm->maxMsgLength) {
+        PRINTF("nBytes %d exceed the maxMsgLength %d.\n",
+            nBytes, psm->maxMsgLength);
         return -1;
     }
 
-    /* take the mutex for shared memory protecting */
-    status = WaitForSingleObject(qid->mutex, INFINITE);
-    if(status != WAIT_OBJECT_0) {
-        /* release the producer semaphore if failed to take the mutex */        
-        if(0 == ReleaseSemaphore(qid->semPId, 1, NULL)) {
-            PRINTF("release semaphore with errno:%d!\n", (int)GetLastError());
-            return -1;
-        }
-
-        if(status == WAIT_ABANDONED || status == WAIT_FAILED) {
-            PRINTF("wait for mutex with errno:%d!\n", (int)GetLastError());
-        }
-        /* WAIT_TIMEOUT */
-        return -1;
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingReserve(qid, timeout, ppBuffer);
     }
 
-    /* get the message node we want to process */
-    pNode = (MSG_NODE*)((char*)psm + sizeof(MSG_SM) + \
-        psm->tail * sizeof(MSG_NODE));
-
-    /* calculate the message length */
-    maxNBytes = (maxNBytes > pNode->length) ? pNode->length : maxNBytes;
-
-    /* copy the message to buffer */
-    memcpy(buffer, (char*)psm + sizeof(MSG_SM) + \
-        psm->maxMsgs * sizeof(MSG_NODE) + \
-        psm->maxMsgLength * pNode->index, maxNBytes);
-
-    /* update the tail of the used message link */
-    psm->tail = pNode->used;
-
-    /* free and append the message node to the free message link */
-    pNode->used = MSG_Q_INVALID_NODE;
-    pNode->free = psm->free;
-    psm->free = pNode->index;
-
-    /* there is no message if the tail equals to MSG_Q_INVALID_NODE */
-    if (psm->tail == MSG_Q_INVALID_NODE)
-        psm->head = MSG_Q_INVALID_NODE;
-
-    /* update the message counting attributes */
-    psm->msgNum--;
-    psm->recvTimes++;
-
-    /* release mutex */
-    status = ReleaseMutex(qid->mutex);
-    if(status == 0) {
-        PRINTF(" release mutex with errno:%d!\n", (int)GetLastError());
+    /* the records of the byte ring move, they can't be held */
+    if (psm->options & MSG_Q_VARLEN) {
+        PRINTF("not supported by MSG_Q_VARLEN.\n");
         return -1;
     }
 
-    /* release the consumer semaphore */
-    status = ReleaseSemaphore(qid->semCId, 1, NULL);
-    if(status == 0) {
-        PRINTF("release semaphore with errno:%d!\n", (int)GetLastError());
+    /*
+     * there is free slot in queue if the consumer semaphore can be taken,
+     * then take the mutex for shared memory protecting
+     */
+    if (msgQSemTakeLock(qid, &psm->semC, MSG_Q_CHAN_SEM_C, 1, timeout) < 0) {
+        /* timeout */
         return -1;
     }
 
+    /* the node stays out of both links until it is committed */
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_C, 1, -1);
+    pNode = msgQNodeAlloc(psm);
+    msgQLogStep(psm);
+
+    /* release the mutex */
+    msgQUnlock(qid);
+
+    *ppBuffer = MSG_Q_DATA(psm, pNode->index);
+
     return 0;
 }
 
 /*
- * send a message to a message queue
+ * send a message built in a slot reserved by msgQSendReserve
  */
-int msgQSend
+int msgQSendCommit
     (
     MSG_Q_ID msgQId,
-    char * buffer,
+    char * pBuffer,
     UINT nBytes,
-    int timeout,
     int priority
     )
 {
-    int status = 0;
-    unsigned long timeLimit = 0;
     MSG_NODE * pNode = NULL;
     P_MSG_Q qid = (P_MSG_Q)msgQId;
     MSG_SM * psm = NULL;
+    int slot = 0;
 
-    if(buffer == NULL) {
-        PRINTF("input buffer equals NULL.\n");
-        return -1;
-    }
-
-    if(priority != MSG_PRI_NORMAL && priority != MSG_PRI_URGENT) {
+    if(!msgQPriorityValid(priority)) {
         PRINTF("invalid priority %d.\n", priority);
         return -1;
     }
 
     /* verify if the message queue is valid */
-    if (msgQVerify(qid, __func__) == -1) {
+    if (msgQVerifyWrite(qid, __func__) == -1) {
         return -1;
     }
 
@@ -717,97 +2625,119 @@ int msgQSend
         return -1;
     }
 
-    /* timeout conversion */
-    if(timeout <= -1) timeLimit = INFINITE; /* wait forever */
-    else timeLimit = (unsigned long)timeout;
-
-    /* there is free slot in queue if the consumer semaphore can be taken */
-    status = WaitForSingleObject(qid->semCId, timeLimit);
-    if(status != WAIT_OBJECT_0) { /* failed */
-        if(status == WAIT_FAILED) {
-            PRINTF("wait for semaphore with errno:%d!\n", (int)GetLastError());
-        }
-        /* WAIT_TIMEOUT */
+    /* the buffer must be the start of a slot */
+    slot = msgQDataSlot(psm, pBuffer);
+    if (slot == -1) {
+        PRINTF("buffer %p is not a reserved slot.\n", pBuffer);
         return -1;
     }
 
+    if (psm->options & MSG_Q_RING_MODES) {
+        return msgQRingCommit(qid, (UINT)slot, nBytes);
+    }
+
     /* take the mutex for shared memory protecting */
-    status = WaitForSingleObject(qid->mutex, INFINITE);
-    if(status != WAIT_OBJECT_0) {
-        /* release the consumer semaphore if failed to take the mutex */
-        if(0 == ReleaseSemaphore(qid->semCId, 1, NULL)) {
-            PRINTF("release semaphore with errno:%d!\n", (int)GetLastError());
-            return -1;
-        }
+    if (msgQLock(qid) != 0) {
+        return -1;
+    }
 
-        if(status == WAIT_ABANDONED || status == WAIT_FAILED) {
-            PRINTF("wait for mutex with errno:%d!\n", (int)GetLastError());
-        }
-        /* WAIT_TIMEOUT */
+    pNode = MSG_Q_NODE(psm, slot);
+    if (pNode->free != MSG_Q_RESERVED_NODE) {
+        msgQUnlock(qid);
+        PRINTF("buffer %p is not a reserved slot.\n", pBuffer);
         return -1;
     }
 
-    /* get a free message node we want to use */
-    pNode = (MSG_NODE*)((char*)psm + sizeof(MSG_SM) + \
-        psm->free * sizeof(MSG_NODE));
+    /* link the message node by the priority */
+    msgQLogBegin(psm, -1, 0, MSG_Q_CHAN_SEM_P);
+    pNode->length = nBytes;
+    msgQNodeLink(psm, pNode, priority);
+    msgQLogStep(psm);
 
-    /* update the next free message node number */
-    psm->free = pNode->free;
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
 
-    /* set the node attributes */
-    pNode->free = MSG_Q_INVALID_NODE;
-    pNode->used = MSG_Q_INVALID_NODE;
-    pNode->length = nBytes;
+    /* release the producer semaphore and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, 1);
 
-    /* copy the buffer to the message node */
-    memcpy((char*)psm + sizeof(MSG_SM) + \
-        psm->maxMsgs * sizeof(MSG_NODE) + \
-        psm->maxMsgLength * pNode->index, buffer, nBytes);
+    return 0;
+}
 
-    /* both the head and tail pointer to this node if it's the first message */
-    if (psm->head == MSG_Q_INVALID_NODE) {
-        psm->head = pNode->index;
-        psm->tail = pNode->index;
+/*
+ * set the max spin budget of the tasks before they pend
+ */
+int msgQSetSpin
+    (
+    MSG_Q_ID msgQId,
+    int maxSpins
+    )
+{
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+
+    if (maxSpins < 0 || maxSpins > MSG_Q_SPIN_MAX) {
+        PRINTF("invalid maxSpins %d.\n", maxSpins);
+        return -1;
     }
-    else {
-        /* or send a normal message or urgent message */
-        if (priority == MSG_PRI_NORMAL) {
-            /* get the head message node */
-            MSG_NODE * temp = (MSG_NODE*)((char*)psm + sizeof(MSG_SM) + \
-                psm->head * sizeof(MSG_NODE));
 
-            /* append the new message node to the head message node */
-            temp->used = pNode->index;
-            psm->head = pNode->index;
-        }
-        else {
-            /* append the new message node to the tail message node */
-            pNode->used = psm->tail;
-            psm->tail = pNode->index;
-        }
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
     }
 
-    /* update the message counting attributes */
-    psm->msgNum++;
-    psm->sendTimes++;
+    MSG_Q_STORE(&qid->psm->spinMax, (UINT)maxSpins);
 
-    /* release the mutex */
-    status = ReleaseMutex(qid->mutex);
-    if(status == 0) {
-        PRINTF("release mutex with errno:%d!\n", (int)GetLastError());
+    return 0;
+}
+
+/*
+ * set the operations between the writes of a durable queue to its file
+ */
+int msgQSetSync
+    (
+    MSG_Q_ID msgQId,
+    int msgs
+    )
+{
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+
+    if (msgs < 0) {
+        PRINTF("invalid msgs %d.\n", msgs);
+        return -1;
+    }
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
         return -1;
     }
 
-    /* release the producer semaphore */
-    status = ReleaseSemaphore(qid->semPId, 1, NULL);
-    if(status == 0) {
-        PRINTF("release semaphore with errno:%d!\n", (int)GetLastError());
+    if (!(qid->psm->options & MSG_Q_DURABLE)) {
+        PRINTF("not a durable message queue.\n");
         return -1;
     }
 
+    MSG_Q_STORE(&qid->psm->syncEvery, (UINT)msgs);
+
     return 0;
 }
 
+/*
+ * write a durable message queue to its file
+ */
+int msgQSync
+    (
+    MSG_Q_ID msgQId
+    )
+{
+    P_MSG_Q qid = (P_MSG_Q)msgQId;
+
+    /* verify if the message queue is valid */
+    if (msgQVerifyWrite(qid, __func__) == -1) {
+        return -1;
+    }
+
+    return msgQOsSync(qid);
+}
+
 /*
  * get the status of message queue
  */
@@ -819,6 +2749,9 @@ int msgQStat
 {
     P_MSG_Q qid = (P_MSG_Q)msgQId;
     MSG_SM * psm = NULL;
+    MSG_SHARD * pSend = NULL;
+    MSG_SHARD * pRecv = NULL;
+    int index = 0;
 
     /* verify if the message queue is valid */
     if (msgQVerify(qid, __func__) == -1) {
@@ -832,42 +2765,123 @@ int msgQStat
     msgQStatus->maxMsgLength = psm->maxMsgLength;
     msgQStatus->msgNum = psm->msgNum;
     msgQStatus->options = psm->options;
-    msgQStatus->recvTimes = psm->recvTimes;
-    msgQStatus->sendTimes = psm->sendTimes;
+    msgQStatus->pageSize = psm->pageSize;
+    msgQStatus->peakDepth = (int)MSG_Q_LOAD(&psm->peakDepth);
     strncpy(msgQStatus->version, psm->version, VERSION_LEN);
 
+    /* the lock-free ring counts the messages with its indexes */
+    if (psm->options & MSG_Q_RING_MODES) {
+        UINT head = MSG_Q_LOAD(&psm->prod.index);
+        UINT tail = MSG_Q_LOAD(&psm->cons.index);
+
+        msgQStatus->msgNum = (int)(head - tail);
+    }
+
+    /* sum the shards of the statistics */
+    msgQStatus->sends = 0;
+    msgQStatus->receives = 0;
+    msgQStatus->bytesSent = 0;
+    msgQStatus->bytesReceived = 0;
+    msgQStatus->sendFull = 0;
+    msgQStatus->receiveEmpty = 0;
+    msgQStatus->sendTimeouts = 0;
+    msgQStatus->receiveTimeouts = 0;
+    for (index = 0; index < MSG_Q_STAT_SHARDS; index++) {
+        pSend = &psm->stat[MSG_Q_SIDE_SEND][index];
+        pRecv = &psm->stat[MSG_Q_SIDE_RECV][index];
+        msgQStatus->sends += __atomic_load_n(&pSend->msgs, __ATOMIC_RELAXED);
+        msgQStatus->receives +=
+            __atomic_load_n(&pRecv->msgs, __ATOMIC_RELAXED);
+        msgQStatus->bytesSent +=
+            __atomic_load_n(&pSend->bytes, __ATOMIC_RELAXED);
+        msgQStatus->bytesReceived +=
+            __atomic_load_n(&pRecv->bytes, __ATOMIC_RELAXED);
+        msgQStatus->sendFull +=
+            __atomic_load_n(&pSend->waits, __ATOMIC_RELAXED);
+        msgQStatus->receiveEmpty +=
+            __atomic_load_n(&pRecv->waits, __ATOMIC_RELAXED);
+        msgQStatus->sendTimeouts +=
+            __atomic_load_n(&pSend->timeouts, __ATOMIC_RELAXED);
+        msgQStatus->receiveTimeouts +=
+            __atomic_load_n(&pRecv->timeouts, __ATOMIC_RELAXED);
+    }
+
+    msgQStatus->sendTimes = (int)msgQStatus->sends;
+    msgQStatus->recvTimes = (int)msgQStatus->receives;
+
     return 0;
 }
 
 /*
- * show the status of message queue
+ * get the queueing latency of a message queue
  */
-int msgQShow
+int msgQLatency
     (
-    MSG_Q_ID msgQId
+    MSG_Q_ID msgQId,
+    MSG_Q_LAT_STAT * msgQLatStat
     )
 {
     P_MSG_Q qid = (P_MSG_Q)msgQId;
-    MSG_SM * psm = NULL;
 
     /* verify if the message queue is valid */
     if (msgQVerify(qid, __func__) == -1) {
         return -1;
     }
 
+    if (!(qid->psm->options & MSG_Q_LATENCY)) {
+        PRINTF("message queue is not timed.\n");
+        return -1;
+    }
+
+    msgQLatRead(qid->psm, msgQLatStat);
+
+    return 0;
+}
+
+/*
+ * show the status of message queue
+ */
+int msgQShow
+    (
+    MSG_Q_ID msgQId
+    )
+{
+    MSG_Q_STAT stat;
+    MSG_Q_LAT_STAT lat;
+
+    /* get the attributes in the same way as msgQStat */
+    if (msgQStat(msgQId, &stat) == -1) {
+        return -1;
+    }
+
     /*
      * show all the message queue attributes,
      * the private attributes like magic, free, head and tail won't be show.
      */
 
-    psm = qid->psm;
-    printf("msgQueue.version      = %s\n", psm->version);
-    printf("msgQueue.maxMsg       = %d\n", psm->maxMsgs);
-    printf("msgQueue.maxMsgLength = %d\n", psm->maxMsgLength);
-    printf("msgQueue.msgNum       = %d\n", psm->msgNum);
-    printf("msgQueue.options      = %d\n", psm->options);
-    printf("msgQueue.recvTimes    = %d\n", psm->recvTimes);
-    printf("msgQueue.sendTimes    = %d\n", psm->sendTimes);
+    printf("msgQueue.version      = %.*s\n", VERSION_LEN, stat.version);
+    printf("msgQueue.maxMsg       = %d\n", stat.maxMsgs);
+    printf("msgQueue.maxMsgLength = %d\n", stat.maxMsgLength);
+    printf("msgQueue.msgNum       = %d\n", stat.msgNum);
+    printf("msgQueue.options      = %d\n", stat.options);
+    printf("msgQueue.recvTimes    = %llu\n", stat.receives);
+    printf("msgQueue.sendTimes    = %llu\n", stat.sends);
+    printf("msgQueue.pageSize     = %u\n", stat.pageSize);
+    printf("msgQueue.bytesSent    = %llu\n", stat.bytesSent);
+    printf("msgQueue.bytesRecv    = %llu\n", stat.bytesReceived);
+    printf("msgQueue.peakDepth    = %d\n", stat.peakDepth);
+    printf("msgQueue.sendFull     = %llu\n", stat.sendFull);
+    printf("msgQueue.recvEmpty    = %llu\n", stat.receiveEmpty);
+    printf("msgQueue.sendTimeouts = %llu\n", stat.sendTimeouts);
+    printf("msgQueue.recvTimeouts = %llu\n", stat.receiveTimeouts);
+
+    /* the latency in nanoseconds, if the queue is timed */
+    if ((stat.options & MSG_Q_LATENCY) && msgQLatency(msgQId, &lat) == 0) {
+        printf("msgQueue.latencyP50   = %llu\n", lat.p50);
+        printf("msgQueue.latencyP99   = %llu\n", lat.p99);
+        printf("msgQueue.latencyP999  = %llu\n", lat.p999);
+        printf("msgQueue.latencyMax   = %llu\n", lat.max);
+    }
 
     return 0;
 }
@@ -0,0 +1,273 @@
+/* msgQueueDurable.c - durable mode of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01b,16oct26,sgu  logged the stamp for the repair after owner death
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module implements the commit protocol and the recovery of the message
+queue of the option MSG_Q_DURABLE, whose shared memory is a file mapped by
+the operating system layer. The protocol needs no redo log: the node of a
+message is the record of its commit.
+
+When a message is linked, its node gets a stamp of three words, written
+after the message data and the length:
+
+    order               the position of the message in its priority level
+    sum                 the FNV-1a checksum of the message data
+    commit              MSG_Q_COMMIT_MARK and the priority level, written last
+
+and the commit word is cleared when the node is freed. A message taken by
+msgQReceivePeek keeps its stamp until it is released. A reserved node has no
+stamp, so a message being sent at a crash is dropped.
+
+The orders of a level only grow at its head and shrink at its tail, so the
+stamped nodes of a level span less than 2^31 orders and sort by their signed
+distance to any of them. The recovery, run by the only process attached to
+the file, trusts none of the links, counts or blocking words of MSG_SM: it
+scans the nodes, drops those whose checksum doesn't match, which were torn by
+a crash of the host, and rebuilds the levels, the free link and the counts
+from the rest.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+/* includes */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* defines */
+
+/* parameters of the 32-bit FNV-1a hash */
+#define MSG_Q_FNV_BASIS    2166136261U
+#define MSG_Q_FNV_PRIME    16777619U
+
+/* typedefs */
+
+/* a stamped node found by the recovery */
+typedef struct tagMSG_LIVE {
+    int level;      /* priority level */
+    int distance;   /* order relative to the first node found in the level */
+    int index;      /* node index */
+}MSG_LIVE;
+
+/* implementations */
+
+/*
+ * get the checksum of the data of a message node
+ */
+static UINT msgQDurableSum
+    (
+    MSG_SM * psm,
+    MSG_NODE * pNode
+    )
+{
+    const unsigned char * pData =
+        (const unsigned char*)MSG_Q_DATA(psm, pNode->index);
+    UINT sum = MSG_Q_FNV_BASIS;
+    UINT index = 0;
+
+    for (index = 0; index < pNode->length; index++) {
+        sum ^= pData[index];
+        sum *= MSG_Q_FNV_PRIME;
+    }
+
+    return sum;
+}
+
+/*
+ * sort the stamped nodes by level and by order in the level
+ */
+static int msgQDurableCompare
+    (
+    const void * p1,
+    const void * p2
+    )
+{
+    const MSG_LIVE * pLive1 = (const MSG_LIVE*)p1;
+    const MSG_LIVE * pLive2 = (const MSG_LIVE*)p2;
+
+    if (pLive1->level != pLive2->level)
+        return pLive1->level < pLive2->level ? -1 : 1;
+
+    if (pLive1->distance != pLive2->distance)
+        return pLive1->distance < pLive2->distance ? -1 : 1;
+
+    return 0;
+}
+
+/*
+ * stamp a message node of a MSG_Q_DURABLE queue, the mutex must be taken
+ */
+void msgQDurableStamp
+    (
+    MSG_SM * psm,
+    MSG_NODE * pNode,
+    int level,
+    int urgent
+    )
+{
+    int tail = psm->levelTail[level];
+
+    if (urgent && tail != MSG_Q_INVALID_NODE) {
+        pNode->order = MSG_Q_NODE(psm, tail)->order - 1;
+    }
+    else {
+        MSG_Q_LOG(psm, &psm->levelOrder[level]);
+        pNode->order = psm->levelOrder[level]++;
+    }
+
+    pNode->sum = msgQDurableSum(psm, pNode);
+
+    /* the stamp is set after the data, the length and the order */
+    MSG_Q_LOG(psm, &pNode->commit);
+    MSG_Q_STORE(&pNode->commit, MSG_Q_COMMIT_MARK | (UINT)level);
+    psm->syncCount++;
+}
+
+/*
+ * recover a MSG_Q_DURABLE queue after a crash
+ */
+int msgQDurableRecover
+    (
+    P_MSG_Q qid
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_NODE * pNode = NULL;
+    MSG_LIVE * pLive = NULL;
+    UINT first[MSG_PRI_LEVELS];
+    UINT commit = 0;
+    UINT seen = 0;
+    UINT mark = 0;
+    UINT slot = 0;
+    int level = 0;
+    int live = 0;
+    int index = 0;
+
+    /* the attributes fixed at creation must describe the file */
+    if (!(psm->options & MSG_Q_DURABLE) || psm->maxMsgs <= 0 ||
+        psm->slots != (UINT)psm->maxMsgs ||
+        psm->slotSize < psm->maxMsgLength ||
+        qid->memSize < sizeof(MSG_SM) +
+        MSG_Q_ROUND((size_t)psm->slots * sizeof(MSG_NODE), MSG_Q_CACHE_LINE) +
+        (size_t)psm->slots * psm->slotSize) {
+        PRINTF("invalid attributes of durable message queue.\n");
+        return -1;
+    }
+
+    pLive = (MSG_LIVE*)malloc(psm->slots * sizeof(MSG_LIVE));
+    if (pLive == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return -1;
+    }
+
+    /* the tasks pended or holding the mutex have gone with their processes */
+    psm->mutex = 0;
+    memset(&psm->log, 0, sizeof(MSG_LOG));
+    psm->log.takenChan = -1;
+    psm->log.giveChan = -1;
+    memset((void*)&psm->semP, 0, sizeof(MSG_SEM));
+    memset((void*)&psm->semC, 0, sizeof(MSG_SEM));
+    memset(psm->waitList, 0, sizeof(psm->waitList));
+    psm->waitOrder = 0;
+    psm->pollable = 0;
+    psm->pollLevel = 0;
+    psm->syncCount = 0;
+    psm->refs = 0;
+
+    /* collect the nodes with a valid stamp, clear the others */
+    for (slot = 0; slot < psm->slots; slot++) {
+        pNode = MSG_Q_NODE(psm, slot);
+        commit = pNode->commit;
+        if (commit == 0)
+            continue;
+
+        level = (int)(commit & ~MSG_Q_COMMIT_MASK);
+        pNode->index = (int)slot;
+        if ((commit & MSG_Q_COMMIT_MASK) != MSG_Q_COMMIT_MARK ||
+            level >= MSG_PRI_LEVELS || pNode->length > psm->maxMsgLength ||
+            pNode->sum != msgQDurableSum(psm, pNode)) {
+            pNode->commit = 0;
+            continue;
+        }
+
+        if (!(seen & (1U << level))) {
+            seen |= 1U << level;
+            first[level] = pNode->order;
+        }
+
+        pLive[live].level = level;
+        pLive[live].distance = (int)(pNode->order - first[level]);
+        pLive[live].index = (int)slot;
+        live++;
+        mark = slot + 1;
+    }
+
+    qsort(pLive, (size_t)live, sizeof(MSG_LIVE), msgQDurableCompare);
+
+    /* link the stamped nodes from the oldest to the newest of each level */
+    psm->levelMap = 0;
+    for (level = 0; level < MSG_PRI_LEVELS; level++) {
+        psm->levelHead[level] = MSG_Q_INVALID_NODE;
+        psm->levelTail[level] = MSG_Q_INVALID_NODE;
+    }
+
+    for (index = 0; index < live; index++) {
+        level = pLive[index].level;
+        pNode = MSG_Q_NODE(psm, pLive[index].index);
+        pNode->free = MSG_Q_INVALID_NODE;
+        pNode->used = MSG_Q_INVALID_NODE;
+
+        if (psm->levelHead[level] == MSG_Q_INVALID_NODE) {
+            psm->levelTail[level] = pNode->index;
+            psm->levelMap |= 1U << level;
+        }
+        else {
+            MSG_Q_NODE(psm, psm->levelHead[level])->used = pNode->index;
+        }
+        psm->levelHead[level] = pNode->index;
+        psm->levelOrder[level] = pNode->order + 1;
+    }
+
+    free(pLive);
+
+    /* the nodes handed out once and not stamped are free */
+    if (psm->freeMark > mark && psm->freeMark <= psm->slots)
+        mark = psm->freeMark;
+
+    psm->free = MSG_Q_INVALID_NODE;
+    for (slot = mark; slot-- > 0; ) {
+        pNode = MSG_Q_NODE(psm, slot);
+        if (pNode->commit != 0)
+            continue;
+        pNode->index = (int)slot;
+        pNode->used = MSG_Q_INVALID_NODE;
+        pNode->free = psm->free;
+        psm->free = (int)slot;
+    }
+    psm->freeMark = mark;
+
+    /* the counts follow the messages recovered */
+    psm->msgNum = live;
+    psm->semP.count = (UINT)live;
+    psm->semC.count = (UINT)(psm->maxMsgs - live);
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+/* msgQueueLatency.c - latency histogram of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01b,17oct26,sgu  kept the last bucket for the times beyond 2^MSG_Q_LAT_BITS
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module keeps the histogram of the times the messages of a MSG_Q_LATENCY
+queue have been queued. The histogram is log-linear: a time below
+2^MSG_Q_LAT_SUB_BITS nanoseconds has a bucket of its own, and each power of
+two above is split into 2^MSG_Q_LAT_SUB_BITS buckets, so the width of a
+bucket is at most 1/16 of the times it holds:
+
+    time < 16           bucket = time
+    2^e <= time         bucket = (e - 3) * 16 + (time >> (e - 4)) - 16
+
+and the times of 2^MSG_Q_LAT_BITS nanoseconds and beyond share one more
+bucket, whose percentiles are reported as the max.
+
+A message is recorded with a relaxed atomic add to its bucket, and the max
+with a compare-and-swap only when it grows, so the receivers never take a
+lock and the histogram can be read at any time. A reader sums the buckets
+while they are counted, so the percentiles of a busy queue are those of a
+moment within the read.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+/* includes */
+
+#include <stdio.h>
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* defines */
+
+/* buckets of each power of two */
+#define MSG_Q_LAT_SUB      (1 << MSG_Q_LAT_SUB_BITS)
+
+/* implementations */
+
+/*
+ * get the bucket of a time
+ */
+static int msgQLatBucket
+    (
+    unsigned long long ns
+    )
+{
+    int exp = 0;
+
+    if (ns < MSG_Q_LAT_SUB)
+        return (int)ns;
+
+    if (ns >> MSG_Q_LAT_BITS)
+        return MSG_Q_LAT_BUCKETS - 1;
+
+    exp = 63 - __builtin_clzll(ns);
+
+    return (exp - MSG_Q_LAT_SUB_BITS + 1) * MSG_Q_LAT_SUB +
+        (int)(ns >> (exp - MSG_Q_LAT_SUB_BITS)) - MSG_Q_LAT_SUB;
+}
+
+/*
+ * get the highest time of a bucket
+ */
+static unsigned long long msgQLatTop
+    (
+    int bucket
+    )
+{
+    int shift = 0;
+
+    if (bucket < MSG_Q_LAT_SUB)
+        return (unsigned long long)bucket;
+
+    shift = bucket / MSG_Q_LAT_SUB - 1;
+
+    return ((unsigned long long)(MSG_Q_LAT_SUB + bucket % MSG_Q_LAT_SUB + 1)
+        << shift) - 1;
+}
+
+/*
+ * record the latency of a message of a MSG_Q_LATENCY queue
+ */
+void msgQLatRecord
+    (
+    MSG_SM * psm,
+    unsigned long long stamp
+    )
+{
+    unsigned long long ns = msgQOsStampNs(msgQOsStamp() - stamp);
+    unsigned long long max = __atomic_load_n(&psm->lat.max, __ATOMIC_RELAXED);
+
+    MSG_Q_COUNT(&psm->lat.bucket[msgQLatBucket(ns)], 1);
+
+    while (ns > max) {
+        if (__atomic_compare_exchange_n(&psm->lat.max, &max, ns, 1,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
+/*
+ * read the latency histogram of a message queue
+ */
+void msgQLatRead
+    (
+    MSG_SM * psm,
+    MSG_Q_LAT_STAT * pStat
+    )
+{
+    unsigned long long count[MSG_Q_LAT_BUCKETS];
+    unsigned long long * pValue[3];
+    unsigned long long rank[3];
+    unsigned long long total = 0;
+    unsigned long long seen = 0;
+    int bucket = 0;
+    int index = 0;
+
+    /* take a copy, so the ranks and the walk see the same counts */
+    for (bucket = 0; bucket < MSG_Q_LAT_BUCKETS; bucket++) {
+        count[bucket] = __atomic_load_n(&psm->lat.bucket[bucket],
+            __ATOMIC_RELAXED);
+        total += count[bucket];
+    }
+
+    memset(pStat, 0, sizeof(MSG_Q_LAT_STAT));
+    pStat->count = total;
+    pStat->max = __atomic_load_n(&psm->lat.max, __ATOMIC_RELAXED);
+    if (total == 0)
+        return;
+
+    /* the rank of a percentile is rounded up, to the first message at least */
+    pValue[0] = &pStat->p50;
+    pValue[1] = &pStat->p99;
+    pValue[2] = &pStat->p999;
+    rank[0] = (total * 500 + 999) / 1000;
+    rank[1] = (total * 990 + 999) / 1000;
+    rank[2] = (total * 999 + 999) / 1000;
+
+    for (bucket = 0; bucket < MSG_Q_LAT_BUCKETS && index < 3; bucket++) {
+        seen += count[bucket];
+        while (index < 3 && seen >= rank[index]) {
+            /* the last bucket has no top, the times beyond share it */
+            *pValue[index] = msgQLatTop(bucket);
+            if (*pValue[index] > pStat->max ||
+                bucket == MSG_Q_LAT_BUCKETS - 1)
+                *pValue[index] = pStat->max;
+            index++;
+        }
+    }
+}
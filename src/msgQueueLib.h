@@ -0,0 +1,1141 @@
+/* msgQueueLib.h - private definitions of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01z,17oct26,sgu  moved MSG_Q_SPIN_MAX to msgQueue.h
+01y,17oct26,sgu  kept the last latency bucket for the overflow
+01x,17oct26,sgu  added the process of a wait list entry, took the units of a
+                 named queue under the mutex
+01w,16oct26,sgu  flagged the reservation of MSG_Q_SPSC
+01v,16oct26,sgu  added the handle cache and the registry
+01u,16oct26,sgu  added msgQOsWatch and the watching handle
+01t,16oct26,sgu  added the latency histogram of MSG_Q_LATENCY
+01s,16oct26,sgu  added the sharded statistics
+01r,16oct26,sgu  added the owner of the mutex and the undo log
+01q,16oct26,sgu  added the commit stamps of MSG_Q_DURABLE
+01p,16oct26,sgu  made the free link and the sequences lazy
+01o,16oct26,sgu  added the page size of MSG_Q_HUGEPAGE
+01n,16oct26,sgu  laid out MSG_SM and MSG_NODE by cache lines
+01m,16oct26,sgu  added msgQOsEventWait for msgQReceiveAny
+01l,16oct26,sgu  added the pollable descriptor of msgQGetFd
+01k,16oct26,sgu  added the adaptive spin before pending
+01j,16oct26,sgu  added the wait list of MSG_Q_PRIORITY
+01i,16oct26,sgu  added the priority levels of the used message link
+01h,16oct26,sgu  added the byte ring of MSG_Q_VARLEN
+01g,16oct26,sgu  added msgQRingReceiveBatch
+01f,16oct26,sgu  added msgQRingSendBatch
+01e,16oct26,sgu  added the peeked node for msgQReceivePeek
+01d,16oct26,sgu  added the reserved node for msgQSendReserve
+01c,16oct26,sgu  added the sequenced ring of MSG_Q_MPMC
+01b,16oct26,sgu  added the lock-free ring of MSG_Q_SPSC
+01a,16oct26,sgu  created, split from msgQueue.c for the Linux backend
+*/
+
+/*
+DESCRIPTION
+This module defines the private types shared by the message queue library and
+its operating system layers. The structures MSG_SM and MSG_NODE describe the
+shared memory of a message queue, so every process attached to the same named
+queue must be built against the same version of this file.
+
+The blocking state of a queue is kept as 32-bit words inside MSG_SM -- a mutex
+word and two counting semaphores. The words are manipulated with atomic
+operations, so a message can be sent or received without a kernel call as
+long as no task needs to pend. The operating system layer only supplies the
+shared memory mapping and a way to pend on, and wake up, one of these words:
+futex on Linux, and one kernel semaphore per wait channel on Windows.
+
+The mutex word holds the process ID of its owner, so the tasks pended on the
+mutex of a named queue can tell when the owner has died with it. The owner
+saves each word it is about to write under the mutex in the undo log of
+MSG_SM, a step at a time, and the next task to take the mutex rolls back the
+step which was cut short and settles the semaphore units of the dead task:
+a repair of a few dozen words whatever the size of the queue. The units of a
+named queue are only taken and given under the mutex, so they are never held
+by a task out of the log, and a task which dies pended in the wait list of
+MSG_Q_PRIORITY only holds an entry, which the other pended tasks free.
+
+The node of a message in a MSG_Q_DURABLE queue carries a commit stamp: its
+priority level, its order in the level and a checksum of its data. The stamp
+is the only state the recovery trusts, so the links in MSG_SM may be lost or
+torn in a crash and are rebuilt from the stamps of the nodes.
+
+The statistics of msgQStat are 64-bit counters kept in shards of a cache line
+each, one set for the senders and one for the receivers. A task counts in the
+shard picked by its thread and its process with a relaxed atomic add, so the
+tasks of a busy queue don't bounce a line of counters between them, and the
+shards are only summed when the statistics are read.
+
+A MSG_Q_LATENCY queue stamps each message with a tick of msgQOsStamp when it
+is linked, in the node of the message, or behind the header of its record in
+the byte ring, and adds the time it has been queued to a log-linear
+histogram of MSG_SM when it is taken off the queue.
+
+The named queues of a process are kept in a hash table of their handles, so a
+name opened again gets its handle without a lookup of the shared memory. The
+named queues of all the processes are listed in the registry, a shared memory
+object of its own holding the attributes of each queue. An entry is guarded
+by a sequence, odd while it is written, so the registry is read without a
+lock and a writer only claims the entry it changes.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+#ifndef _MSG_QUEUE_LIB_H_
+#define _MSG_QUEUE_LIB_H_
+
+/* includes */
+
+#include <stddef.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "msgQueue.h"
+
+/* defines */
+
+/* invalid node index for message queue node */
+#define MSG_Q_INVALID_NODE -1
+
+/* link index of a node which is out of the links, reserved by a task */
+#define MSG_Q_RESERVED_NODE -2
+
+/* link index of a node which is out of the links, peeked by a task */
+#define MSG_Q_PEEKED_NODE   -3
+
+/* objects name prefix */
+
+#define _MSG_Q_SEM_P_      "_MSG_Q_SEM_P_" /* prefix for pruducer semaphore */
+#define _MSG_Q_SEM_C_      "_MSG_Q_SEM_C_" /* prefix for consumer semaphore */
+#define _MSG_Q_MUTEX_      "_MSG_Q_MUTEX_" /* prefix for mutex */
+#define _MSG_Q_SHMEM_      "_MSG_Q_SHMEM_" /* prefix for shared memory */
+#define _MSG_Q_EVENT_      "_MSG_Q_EVENT_" /* prefix for pollable event */
+#define _MSG_Q_REGISTRY_   "_MSG_Q_REGISTRY_" MSG_Q_VERSION /* queue registry */
+#define MSG_Q_PREFIX_LEN   16              /* max length of object prefix */
+
+/* version string */
+#define MSG_Q_VERSION      "0.09"
+
+/* magic string */
+#define MSG_Q_MAGIC        "\1\3\5\7\a\7\5\3\1"
+
+/* magic string length */
+#define MAGIC_LEN          12
+
+/* wait channels, one for each blocking word in MSG_SM */
+#define MSG_Q_CHAN_MUTEX   0   /* tasks pended on the mutex */
+#define MSG_Q_CHAN_SEM_P   1   /* tasks pended for a message */
+#define MSG_Q_CHAN_SEM_C   2   /* tasks pended for a free slot */
+#define MSG_Q_CHAN_NUM     3
+
+/* options served by the lock-free rings */
+#define MSG_Q_RING_MODES   (MSG_Q_SPSC | MSG_Q_MPMC)
+
+/* entries of the wait list of a MSG_Q_PRIORITY queue */
+#define MSG_Q_WAIT_MAX     64
+
+/* states of a wait list entry */
+#define MSG_Q_WAIT_FREE    0   /* not used */
+#define MSG_Q_WAIT_PENDED  1   /* a task pends on the entry */
+#define MSG_Q_WAIT_GRANTED 2   /* a unit is handed, or called, to the task */
+
+/* highest priority level which has a message in a level bitmap */
+#define MSG_Q_TOP_LEVEL(map)  (31 - __builtin_clz(map))
+
+/* header of a message record in the byte ring of MSG_Q_VARLEN */
+#define MSG_Q_REC_HDR      8
+#define MSG_Q_REC_STAMP    8           /* stamp behind it, MSG_Q_LATENCY */
+#define MSG_Q_REC_WRAP     0xffffffff  /* length of the record at the end */
+
+/* size of a cache line, the words written by different tasks are kept apart */
+#define MSG_Q_CACHE_LINE   64
+#define MSG_Q_ALIGNED      __attribute__((aligned(MSG_Q_CACHE_LINE)))
+
+/* a message node takes a power of two bytes, so it stays in a cache line */
+#define MSG_Q_NODE_ALIGNED __attribute__((aligned(32)))
+
+/* round a size up to a multiple of a power of two */
+#define MSG_Q_ROUND(size, align) \
+        (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+/* least learned spin budget, in rounds of MSG_Q_PAUSE, see MSG_Q_SPIN_MAX */
+#define MSG_Q_SPIN_MIN     64
+
+/* hint the CPU that the task is spinning */
+#if defined(__i386__) || defined(__x86_64__)
+#define MSG_Q_PAUSE()      __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define MSG_Q_PAUSE()      __asm__ __volatile__("yield")
+#else
+#define MSG_Q_PAUSE()      __asm__ __volatile__("" ::: "memory")
+#endif
+
+/* the mutex word is the owner process ID and this bit if tasks pend on it */
+#define MSG_Q_MUTEX_WAITERS 0x80000000
+
+/* milliseconds between the checks whether the owner of the mutex is alive */
+#define MSG_Q_OWNER_POLL   100
+
+/* words a step under the mutex writes at most, and the state of the log */
+#define MSG_Q_LOG_MAX      16
+#define MSG_Q_LOG_WORDS    0xff    /* words saved in the step */
+#define MSG_Q_LOG_STEP     0x100   /* one step done */
+
+/* milliseconds to wait for the creator to initialize a named queue */
+#define MSG_Q_READY_WAIT   1000
+
+/* commit stamp of a node linked in a MSG_Q_DURABLE queue, with its level */
+#define MSG_Q_COMMIT_MARK  0x4d510000
+#define MSG_Q_COMMIT_MASK  0xffff0000
+
+/* shards of the statistics of each side, a power of two */
+#define MSG_Q_STAT_SHARDS  16
+
+/* sides of the statistics */
+#define MSG_Q_SIDE_SEND    0   /* senders */
+#define MSG_Q_SIDE_RECV    1   /* receivers */
+
+/*
+ * buckets of the latency histogram: the values below 2^MSG_Q_LAT_SUB_BITS
+ * nanoseconds have a bucket each, and each power of two above has as many
+ * buckets, up to 2^MSG_Q_LAT_BITS nanoseconds, beyond which the values share
+ * the last bucket, which is kept for them alone
+ */
+#define MSG_Q_LAT_SUB_BITS 4
+#define MSG_Q_LAT_BITS     36
+#define MSG_Q_LAT_BUCKETS  \
+        (((MSG_Q_LAT_BITS - MSG_Q_LAT_SUB_BITS + 1) << MSG_Q_LAT_SUB_BITS) + 1)
+
+/* entries of the registry, and buckets of the handle cache */
+#define MSG_Q_REG_ENTRIES  1024
+#define MSG_Q_CACHE_BUCKETS 256
+
+/* atomic operations on the shared memory words */
+#define MSG_Q_LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MSG_Q_STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define MSG_Q_XCHG(p, v)      __atomic_exchange_n((p), (v), __ATOMIC_ACQUIRE)
+#define MSG_Q_ADD(p, v)       __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define MSG_Q_SUB(p, v)       __atomic_sub_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define MSG_Q_CAS(p, pOld, v) __atomic_compare_exchange_n((p), (pOld), (v), \
+                              0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)
+#define MSG_Q_FENCE()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+/* count a statistic, which orders nothing and is only summed when read */
+#define MSG_Q_COUNT(p, v)     __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+
+/*
+ * keep the compiler from moving the writes across the undo log, which is
+ * read only after its task has died, so the CPU needs no fence
+ */
+#define MSG_Q_BARRIER()       __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+/* save a word in the undo log before it is written under the mutex */
+#define MSG_Q_LOG(psm, addr) \
+        do { \
+            if ((psm)->logged) \
+                msgQLogSave((psm), (volatile void*)(addr)); \
+        } while (0)
+
+/* get the message node and the message data of a slot */
+#define MSG_Q_NODE(psm, index) \
+        ((MSG_NODE*)((char*)(psm) + sizeof(MSG_SM)) + (index))
+#define MSG_Q_DATA(psm, index) \
+        ((char*)(psm) + sizeof(MSG_SM) + \
+        MSG_Q_ROUND((psm)->slots * sizeof(MSG_NODE), MSG_Q_CACHE_LINE) + \
+        (size_t)(psm)->slotSize * (index))
+
+/* get the sequence of a slot, which the node keeps less the slot index */
+#define MSG_Q_SEQ(psm, slot) \
+        (MSG_Q_LOAD(&MSG_Q_NODE(psm, slot)->seq) + (slot))
+
+/* get the bytes at an offset of the byte ring, and the size of a record */
+#define MSG_Q_BYTES(psm, offset) \
+        ((char*)(psm) + sizeof(MSG_SM) + (offset))
+#define MSG_Q_REC_HEAD(options) \
+        (MSG_Q_REC_HDR + (((options) & MSG_Q_LATENCY) ? MSG_Q_REC_STAMP : 0))
+#define MSG_Q_REC_SIZE(options, nBytes) \
+        (MSG_Q_REC_HEAD(options) + \
+        (((nBytes) + MSG_Q_REC_HDR - 1) & ~(MSG_Q_REC_HDR - 1)))
+
+/* set and get the stamp of a node, in the words only MSG_Q_DURABLE uses */
+#define MSG_Q_STAMP_SET(pNode, stamp) \
+        ((pNode)->order = (UINT)(stamp), \
+        (pNode)->sum = (UINT)((stamp) >> 32))
+#define MSG_Q_STAMP_GET(pNode) \
+        ((unsigned long long)(pNode)->sum << 32 | (pNode)->order)
+
+/* debug printable switch */
+#if defined(DEBUG) || defined(_DEBUG)
+#define PRINTF(fmt, ...) \
+        printf("FAIL - %s@%d: " fmt, __func__, __LINE__, ##__VA_ARGS__)
+#else
+#define PRINTF(fmt, ...)
+#endif
+
+/* typedefs */
+
+/* counting semaphore kept in shared memory */
+typedef struct tagMSG_SEM {
+    volatile UINT count;      /* available units, the futex word */
+    volatile UINT waiters;    /* tasks pended on the semaphore */
+    volatile UINT pended;     /* tasks in the wait list, MSG_Q_PRIORITY */
+    volatile UINT spin;       /* learned spin budget of the takers */
+}MSG_SEM, *P_MSG_SEM;
+
+/* a task pended on a semaphore of a MSG_Q_PRIORITY queue */
+typedef struct tagMSG_WAIT {
+    volatile UINT state;      /* MSG_Q_WAIT_xxx, the futex word of the task */
+    int chan;                 /* wait channel of the semaphore */
+    int priority;             /* priority of the task */
+    UINT order;               /* arrival order among the same priority */
+    UINT pid;                 /* process of the task, a named queue */
+}MSG_WAIT, *P_MSG_WAIT;
+
+/* one side of the lock-free ring of a MSG_Q_SPSC or MSG_Q_MPMC queue */
+typedef struct tagMSG_RING {
+    volatile UINT index;        /* next position of this side */
+    volatile UINT waiters;      /* tasks of the other side pended on it */
+    volatile UINT event;        /* bumped to wake up the waiters, MSG_Q_MPMC */
+    UINT peerIndex;             /* last seen index of the other side */
+    volatile UINT spin;         /* learned spin budget of this side */
+    UINT reserved;              /* a slot is reserved, MSG_Q_SPSC producer */
+}MSG_RING, *P_MSG_RING;
+
+/*
+ * undo log of the task which holds the mutex of a named queue: the words of
+ * the step in progress before it has written them, and the semaphore units
+ * the task has taken under the mutex. Each step done gives a unit to the
+ * semaphore <giveChan>, the units taken beyond the steps done are given back.
+ */
+typedef struct tagMSG_LOG {
+    volatile UINT state;        /* steps done * MSG_Q_LOG_STEP + words saved */
+    int takenChan;              /* wait channel of the units taken, or -1 */
+    UINT taken;                 /* units taken for the operation */
+    int giveChan;               /* wait channel a step done gives to, or -1 */
+    UINT offset[MSG_Q_LOG_MAX]; /* offset of each word saved from MSG_SM */
+    UINT value[MSG_Q_LOG_MAX];  /* value of each word saved */
+}MSG_LOG, *P_MSG_LOG;
+
+/* statistics of one side of a queue counted by a shard of the tasks */
+typedef struct tagMSG_SHARD {
+    unsigned long long msgs;    /* messages passed */
+    unsigned long long bytes;   /* bytes of the messages passed */
+    unsigned long long waits;   /* queue found full, or empty */
+    unsigned long long timeouts;/* waits given up */
+}MSG_Q_ALIGNED MSG_SHARD, *P_MSG_SHARD;
+
+/* histogram of the times the messages have been queued, MSG_Q_LATENCY */
+typedef struct tagMSG_LAT {
+    volatile unsigned long long max;    /* longest time, in nanoseconds */
+    unsigned long long bucket[MSG_Q_LAT_BUCKETS]; /* messages of each bucket */
+}MSG_Q_ALIGNED MSG_LAT, *P_MSG_LAT;
+
+/* message node structure, never straddles a cache line */
+typedef struct tagMSG_NODE {
+    UINT length;              /* message length */
+    int index;                /* node index */
+    int free;                 /* next free message index */
+    int used;                 /* next used message index */
+    volatile UINT seq;        /* sequence of the slot, MSG_Q_MPMC */
+    UINT order;               /* order in its level, MSG_Q_DURABLE */
+    UINT sum;                 /* checksum of the data, MSG_Q_DURABLE */
+    volatile UINT commit;     /* commit stamp and level, MSG_Q_DURABLE */
+}MSG_Q_NODE_ALIGNED MSG_NODE, *P_MSG_NODE;
+
+/*
+ * message queue attributes, grouped by the tasks which write them: the
+ * attributes fixed at creation are only read after it, the mutex shares its
+ * cache line with the state it protects, so an uncontended send or receive
+ * moves one line for both, and each semaphore and each side of the ring has
+ * a cache line of its own.
+ */
+typedef struct tagMSG_SM {
+    /* read-mostly attributes */
+    char version[VERSION_LEN];  /* library version */
+    char magic[MAGIC_LEN];      /* verify string */
+    int maxMsgs;                /* max messages that can be queued */
+    UINT maxMsgLength;          /* max bytes in a message */
+    int options;                /* message queue options */
+    UINT slots;                 /* number of message nodes */
+    UINT slotSize;              /* bytes between the data of two slots */
+    UINT dataSize;              /* bytes of the byte ring, MSG_Q_VARLEN */
+    UINT pageSize;              /* bytes of the pages backing the queue */
+    volatile UINT spinMax;      /* max spin budget, 0 to pend at once */
+    volatile UINT syncEvery;    /* operations between msync, MSG_Q_DURABLE */
+    volatile UINT pollable;     /* set once a descriptor has been got */
+    UINT logged;                /* the steps are logged, a named queue */
+    volatile int refs;          /* handles attached to the queue */
+    volatile UINT peakDepth;    /* most messages queued, rarely raised */
+
+    /* the mutex and the state it protects */
+    volatile UINT mutex MSG_Q_ALIGNED; /* mutex for shared data protecting */
+    int msgNum;                 /* message number in the queue */
+    int head;                   /* head offset of the MSG_Q_VARLEN ring */
+    int tail;                   /* tail offset of the MSG_Q_VARLEN ring */
+    int free;                   /* first recycled node of the free link */
+    UINT freeMark;              /* nodes below have been handed out once */
+    UINT levelMap;              /* bit n is set if level n has a message */
+    UINT dataUsed;              /* bytes taken in the byte ring */
+    UINT waitOrder;             /* next arrival order of the wait list */
+    UINT pollLevel;             /* readiness signaled on the descriptor */
+    UINT syncCount;             /* operations since the last msync */
+    MSG_LOG log;                /* undo log of the owner of the mutex */
+    int levelHead[MSG_PRI_LEVELS]; /* head index of each priority level */
+    int levelTail[MSG_PRI_LEVELS]; /* tail index of each priority level */
+    UINT levelOrder[MSG_PRI_LEVELS]; /* next order of each level, durable */
+    MSG_WAIT waitList[MSG_Q_WAIT_MAX]; /* pended tasks, MSG_Q_PRIORITY */
+
+    /* the words the senders and the receivers meet at */
+    MSG_SEM semP MSG_Q_ALIGNED; /* semaphore for producer, counts messages */
+    MSG_SEM semC MSG_Q_ALIGNED; /* semaphore for consumer, counts free slots */
+    MSG_RING prod MSG_Q_ALIGNED;/* producer side of the lock-free ring */
+    MSG_RING cons MSG_Q_ALIGNED;/* consumer side of the lock-free ring */
+
+    /* the statistics of the senders and of the receivers */
+    MSG_SHARD stat[2][MSG_Q_STAT_SHARDS];
+    MSG_LAT lat;                /* latency histogram, MSG_Q_LATENCY */
+}MSG_SM, *P_MSG_SM;
+
+/* objects handlers for message queue */
+typedef struct tagMSG_Q {
+#ifdef _WIN32
+    HANDLE chan[MSG_Q_CHAN_NUM]; /* wakeup semaphores for the wait channels */
+    HANDLE hFile;     /* file handle for the shared memory file mapping */
+#else
+    int fd;           /* shared memory object, -1 for inter-thread queue */
+    int eventFd;      /* pollable descriptor, -1 if not opened yet */
+    char * strName;   /* shared memory object name */
+    char * strPath;   /* hugetlbfs file, NULL for shared memory object */
+#endif
+    size_t memSize;   /* size of the shared memory */
+    size_t pageSize;  /* size of the pages mapping the shared memory */
+    int watch;        /* mapped read-only by msgQWatch */
+    char * cacheName; /* name in the handle cache, NULL if not cached */
+    int cacheOpens;   /* opens of the cached handle not deleted yet */
+    struct tagMSG_Q * cacheNext; /* next handle of the cache bucket */
+    MSG_SM * psm;     /* shared memory */
+}MSG_Q, *P_MSG_Q;
+
+/* an entry of the registry of the named queues */
+typedef struct tagMSG_REG_ENTRY {
+    volatile UINT seq;  /* odd while the entry is written */
+    int live;           /* the entry lists a queue */
+    MSG_Q_INFO info;    /* the queue */
+}MSG_REG_ENTRY;
+
+/* the registry of the named queues, zeroed when created */
+typedef struct tagMSG_REG {
+    MSG_REG_ENTRY entry[MSG_Q_REG_ENTRIES];
+}MSG_REG;
+
+/* declarations of the operating system layer */
+
+/*******************************************************************************
+ * msgQOsMap - map the shared memory of a message queue
+ *
+ * map <memSize> bytes of shared memory for the message queue <pstrName> and
+ * set up the wait channels. If <pstrName> is NULL, private memory is allocated
+ * for an inter-thread message queue. If <create> is 0, only an existed named
+ * queue is opened and qid->memSize is set to the size of its shared memory.
+ * If <hugePage> is not 0, a new queue is backed by huge pages when there are
+ * any left; qid->pageSize is set to the page size in use either way. The
+ * memory of a new queue reads as zero and gets its pages at the first touch.
+ * A <pstrName> with a slash is the path of the file of a durable queue; the
+ * others can't attach to it until msgQOsReady is called.
+ *
+ * RETURNS: 1 when the memory is newly created, 0 when an existed one is
+ * mapped, 2 when an existed durable queue is mapped and no other process is
+ * attached to it, or -1 otherwise.
+ */
+int msgQOsMap
+    (
+    P_MSG_Q qid,            /* message queue to set up */
+    const char * pstrName,  /* message name */
+    size_t memSize,         /* size of the shared memory */
+    int create,             /* create the queue if it doesn't exist */
+    int hugePage            /* back a new queue by huge pages */
+    );
+
+/*******************************************************************************
+ * msgQOsUnmap - unmap the shared memory of a message queue
+ *
+ * unmap the shared memory and release the wait channels. The named objects
+ * are removed from the system too if <destroy> is not 0.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQOsUnmap
+    (
+    P_MSG_Q qid,    /* message queue to tear down */
+    int destroy     /* last handle of the queue */
+    );
+
+/*******************************************************************************
+ * msgQOsWatch - map the shared memory of a named message queue read-only
+ *
+ * map the shared memory of the existed queue <pstrName>, or the file of a
+ * durable queue, read-only and without any wait channel, so the caller can
+ * read MSG_SM and can't change any word of it.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQOsWatch
+    (
+    P_MSG_Q qid,            /* message queue to set up */
+    const char * pstrName   /* message name */
+    );
+
+/*******************************************************************************
+ * msgQOsReady - let the other processes attach to a durable message queue
+ *
+ * called when a durable queue is initialized or recovered.
+ *
+ * RETURNS: N/A
+ */
+void msgQOsReady
+    (
+    P_MSG_Q qid     /* message queue */
+    );
+
+/*******************************************************************************
+ * msgQOsSync - write the shared memory of a durable message queue to its file
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQOsSync
+    (
+    P_MSG_Q qid     /* message queue */
+    );
+
+/*******************************************************************************
+ * msgQOsSelf - get the ID of the calling process
+ *
+ * RETURNS: the process ID, which is not 0 and has the top bit clear.
+ */
+UINT msgQOsSelf(void);
+
+/*******************************************************************************
+ * msgQOsAlive - check if a process is alive
+ *
+ * RETURNS: 0 if the process <pid> has gone, or 1 otherwise.
+ */
+int msgQOsAlive
+    (
+    UINT pid        /* process ID */
+    );
+
+/*******************************************************************************
+ * msgQOsWait - pend on a word of the shared memory
+ *
+ * pend the calling task on the channel <chan> as long as <*addr> equals
+ * <expected>, until it is woken up or <timeout> milliseconds elapse. The
+ * routine may return early, so the caller must check the word again.
+ *
+ * RETURNS: 0 when woken up, timed out or interrupted, or -1 on failure.
+ */
+int msgQOsWait
+    (
+    P_MSG_Q qid,            /* message queue */
+    int chan,               /* wait channel */
+    volatile UINT * addr,   /* word to pend on */
+    UINT expected,          /* pend while the word equals this value */
+    int timeout             /* milliseconds to wait, -1 for forever */
+    );
+
+/*******************************************************************************
+ * msgQOsWake - wake up tasks pended on a word of the shared memory
+ *
+ * wake up to <count> tasks pended on the channel <chan>.
+ *
+ * RETURNS: N/A
+ */
+void msgQOsWake
+    (
+    P_MSG_Q qid,            /* message queue */
+    int chan,               /* wait channel */
+    volatile UINT * addr,   /* word the tasks pend on */
+    int count               /* number of tasks to wake up */
+    );
+
+/*******************************************************************************
+ * msgQOsTime - get the monotonic time
+ *
+ * RETURNS: the monotonic time in milliseconds.
+ */
+unsigned long msgQOsTime(void);
+
+/*******************************************************************************
+ * msgQOsStamp - get a time stamp for the latency of the messages
+ *
+ * read a counter of ticks which runs at the same rate in all the processes
+ * and on all the CPUs of the host.
+ *
+ * RETURNS: the ticks counted.
+ */
+unsigned long long msgQOsStamp(void);
+
+/*******************************************************************************
+ * msgQOsStampNs - convert ticks of msgQOsStamp to nanoseconds
+ *
+ * RETURNS: the nanoseconds <ticks> take.
+ */
+unsigned long long msgQOsStampNs
+    (
+    unsigned long long ticks    /* ticks between two stamps */
+    );
+
+/*******************************************************************************
+ * msgQOsPriority - get the scheduling priority of the calling task
+ *
+ * RETURNS: the priority of the calling task, a greater value for a task which
+ * should be served earlier.
+ */
+int msgQOsPriority(void);
+
+/*******************************************************************************
+ * msgQOsEventFd - get the pollable descriptor of a message queue
+ *
+ * get the descriptor which is readable while the message queue has a message,
+ * creating it at the first call.
+ *
+ * RETURNS: the descriptor, or -1 if failed or not supported.
+ */
+int msgQOsEventFd
+    (
+    P_MSG_Q qid     /* message queue */
+    );
+
+/*******************************************************************************
+ * msgQOsEventSet - signal the readiness on the pollable descriptor
+ *
+ * make the descriptor of the message queue readable if <level> is not 0, or
+ * drain it otherwise. The mutex of the message queue must be taken.
+ *
+ * RETURNS: N/A
+ */
+void msgQOsEventSet
+    (
+    P_MSG_Q qid,    /* message queue */
+    UINT level      /* 1 if the message queue has a message */
+    );
+
+/*******************************************************************************
+ * msgQOsEventWait - wait until a message queue of a set is ready
+ *
+ * pend on the pollable descriptors of the message queues <qids> until one of
+ * them is readable or <timeout> milliseconds elapse. The descriptors must
+ * have been got with msgQGetFd.
+ *
+ * RETURNS: 0 when a descriptor is readable, timed out or interrupted, or -1
+ * on failure.
+ */
+int msgQOsEventWait
+    (
+    P_MSG_Q qids[],     /* message queues to wait for */
+    int count,          /* number of message queues */
+    int timeout         /* milliseconds to wait, -1 for forever */
+    );
+
+/*******************************************************************************
+ * msgQOsRegistry - map the registry of the named message queues
+ *
+ * map the shared memory object of the registry, creating it zeroed if it
+ * doesn't exist. The mapping is kept until the process exits.
+ *
+ * RETURNS: the registry, or NULL otherwise.
+ */
+MSG_REG * msgQOsRegistry(void);
+
+/*******************************************************************************
+ * msgQOsYield - relinquish the CPU
+ *
+ * RETURNS: N/A
+ */
+void msgQOsYield(void);
+
+/* declarations of the message queue modes */
+
+/*******************************************************************************
+ * msgQTimeLeft - get the time left of a timeout
+ *
+ * RETURNS: milliseconds left of <timeout> since <start>, 0 if expired, or
+ * WAIT_FOREVER if <timeout> is negative.
+ */
+int msgQTimeLeft
+    (
+    unsigned long start,    /* time the wait started at */
+    int timeout             /* milliseconds to wait */
+    );
+
+/*******************************************************************************
+ * msgQLock - take the mutex for shared memory protecting
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQLock
+    (
+    P_MSG_Q qid     /* message queue to lock */
+    );
+
+/*******************************************************************************
+ * msgQUnlock - release the mutex for shared memory protecting
+ *
+ * RETURNS: N/A
+ */
+void msgQUnlock
+    (
+    P_MSG_Q qid     /* message queue to unlock */
+    );
+
+/*******************************************************************************
+ * msgQLogBegin - start the undo log of an operation under the mutex
+ *
+ * record that the calling task has taken <taken> units of the semaphore of
+ * the wait channel <takenChan> for the operation, and that each step of the
+ * operation gives a unit to the semaphore of <giveChan>; either channel is
+ * -1 for none. The log is cleared by msgQUnlock.
+ *
+ * RETURNS: N/A
+ */
+void msgQLogBegin
+    (
+    MSG_SM * psm,   /* shared memory of the message queue */
+    int takenChan,  /* wait channel of the units taken, or -1 */
+    UINT taken,     /* units taken for the operation */
+    int giveChan    /* wait channel each step gives a unit to, or -1 */
+    );
+
+/*******************************************************************************
+ * msgQLogSave - save a word in the undo log before it is written
+ *
+ * called through MSG_Q_LOG, the mutex must be taken.
+ *
+ * RETURNS: N/A
+ */
+void msgQLogSave
+    (
+    MSG_SM * psm,           /* shared memory of the message queue */
+    volatile void * addr    /* word of MSG_SM or of a node to be written */
+    );
+
+/*******************************************************************************
+ * msgQLogStep - mark a step of the undo log done
+ *
+ * RETURNS: N/A
+ */
+void msgQLogStep
+    (
+    MSG_SM * psm    /* shared memory of the message queue */
+    );
+
+/*******************************************************************************
+ * msgQPollUpdate - signal a change of readiness on the pollable descriptor
+ *
+ * the mutex of the message queue must be taken.
+ *
+ * RETURNS: N/A
+ */
+void msgQPollUpdate
+    (
+    P_MSG_Q qid     /* message queue */
+    );
+
+/*******************************************************************************
+ * msgQPollSync - signal the readiness of a lock-free ring message queue
+ *
+ * take the mutex and call msgQPollUpdate if a descriptor has been got.
+ *
+ * RETURNS: N/A
+ */
+void msgQPollSync
+    (
+    P_MSG_Q qid     /* message queue */
+    );
+
+/*******************************************************************************
+ * msgQSemTakeLock - take up to <max> units of a shared memory semaphore and
+ * the mutex
+ *
+ * the units of a named queue are taken under the mutex, and saved in the undo
+ * log, the units of the other queues before it.
+ *
+ * RETURNS: the number of units taken, at least one, with the mutex taken, or
+ * -1 if timeout.
+ */
+int msgQSemTakeLock
+    (
+    P_MSG_Q qid,    /* message queue of the semaphore */
+    MSG_SEM * sem,  /* semaphore to take */
+    int chan,       /* wait channel of the semaphore */
+    UINT max,       /* max units to take */
+    int timeout     /* ticks to wait */
+    );
+
+/*******************************************************************************
+ * msgQSemGiveUnlock - give units to a shared memory semaphore and release the
+ * mutex
+ *
+ * the units are given under the mutex, and saved in the undo log of a named
+ * queue, the pended tasks are woken up after it.
+ *
+ * RETURNS: N/A
+ */
+void msgQSemGiveUnlock
+    (
+    P_MSG_Q qid,    /* message queue of the semaphore */
+    MSG_SEM * sem,  /* semaphore to give */
+    int chan,       /* wait channel of the semaphore */
+    int count       /* units to give */
+    );
+
+/*******************************************************************************
+ * msgQSemGiveBack - give back the units taken by msgQSemTakeLock and not used
+ *
+ * the mutex must be taken, and stays taken.
+ *
+ * RETURNS: N/A
+ */
+void msgQSemGiveBack
+    (
+    P_MSG_Q qid,    /* message queue of the semaphore */
+    MSG_SEM * sem,  /* semaphore to give */
+    int chan,       /* wait channel of the semaphore */
+    int count       /* units to give */
+    );
+
+/*******************************************************************************
+ * msgQSpin - spin until a word of the shared memory moves
+ *
+ * spin while *<addr> equals <expected> for the learned budget <pBudget>, and
+ * adapt the budget to the number of rounds the word took to move.
+ *
+ * RETURNS: 1 if the word has moved, or 0 if the caller has to pend.
+ */
+int msgQSpin
+    (
+    MSG_SM * psm,               /* shared memory of the message queue */
+    volatile UINT * pBudget,    /* learned spin budget of the waiter */
+    volatile UINT * addr,       /* word to watch */
+    UINT expected               /* value the word moves away from */
+    );
+
+/*******************************************************************************
+ * msgQStatCount - count the messages passed by a side of a message queue
+ *
+ * RETURNS: N/A
+ */
+void msgQStatCount
+    (
+    MSG_SM * psm,   /* shared memory of the message queue */
+    int side,       /* MSG_Q_SIDE_SEND or MSG_Q_SIDE_RECV */
+    UINT msgs,      /* messages passed */
+    UINT bytes      /* bytes of the messages */
+    );
+
+/*******************************************************************************
+ * msgQStatWait - count a side finding the message queue full or empty
+ *
+ * count a task of the side <side> finding the message queue full or empty,
+ * or giving up its wait with a timeout if <expired> is not 0.
+ *
+ * RETURNS: N/A
+ */
+void msgQStatWait
+    (
+    MSG_SM * psm,   /* shared memory of the message queue */
+    int side,       /* MSG_Q_SIDE_SEND or MSG_Q_SIDE_RECV */
+    int expired     /* the wait has timed out */
+    );
+
+/*******************************************************************************
+ * msgQStatDepth - raise the peak depth of a message queue
+ *
+ * RETURNS: N/A
+ */
+void msgQStatDepth
+    (
+    MSG_SM * psm,   /* shared memory of the message queue */
+    UINT depth      /* messages queued */
+    );
+
+/*******************************************************************************
+ * msgQDataSlot - get the slot of the message data pointed by a buffer
+ *
+ * RETURNS: the slot index, or -1 if <pBuffer> is not the start of a slot.
+ */
+int msgQDataSlot
+    (
+    MSG_SM * psm,           /* shared memory of the message queue */
+    const char * pBuffer    /* pointer into the message data */
+    );
+
+/*******************************************************************************
+ * msgQRingInit - initialize the lock-free ring of a message queue
+ *
+ * RETURNS: N/A
+ */
+void msgQRingInit
+    (
+    MSG_SM * psm    /* shared memory of the message queue */
+    );
+
+/*******************************************************************************
+ * msgQRingSend - send a message to a lock-free ring message queue
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingSend
+    (
+    P_MSG_Q qid,            /* message queue on which to send */
+    const char * buffer,    /* message to send */
+    UINT nBytes,            /* length of message */
+    int timeout             /* ticks to wait */
+    );
+
+/*******************************************************************************
+ * msgQRingSendBatch - send a batch of messages to a lock-free ring
+ *
+ * RETURNS: the number of messages sent, at least one, or -1 otherwise.
+ */
+int msgQRingSendBatch
+    (
+    P_MSG_Q qid,                /* message queue on which to send */
+    const char * buffers[],     /* messages to send */
+    const UINT lengths[],       /* length of each message */
+    int count,                  /* number of messages, at least one */
+    int timeout                 /* ticks to wait for the first one */
+    );
+
+/*******************************************************************************
+ * msgQRingReceive - receive a message from a lock-free ring message queue
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingReceive
+    (
+    P_MSG_Q qid,    /* message queue from which to receive */
+    char * buffer,  /* buffer to receive message */
+    UINT maxNBytes, /* length of buffer */
+    int timeout     /* ticks to wait */
+    );
+
+/*******************************************************************************
+ * msgQRingReserve - reserve a slot of a lock-free ring message queue
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingReserve
+    (
+    P_MSG_Q qid,        /* message queue on which to send */
+    int timeout,        /* ticks to wait */
+    char ** ppBuffer    /* where to return the message data of the slot */
+    );
+
+/*******************************************************************************
+ * msgQRingCommit - send the message of a reserved slot of a lock-free ring
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingCommit
+    (
+    P_MSG_Q qid,    /* message queue on which to send */
+    UINT slot,      /* slot returned by msgQRingReserve */
+    UINT nBytes     /* length of message */
+    );
+
+/*******************************************************************************
+ * msgQRingReceiveBatch - receive a batch of messages from a lock-free ring
+ *
+ * RETURNS: the number of messages received, at least one, or -1 otherwise.
+ */
+int msgQRingReceiveBatch
+    (
+    P_MSG_Q qid,        /* message queue from which to receive */
+    char * buffer,      /* buffer to receive the messages back to back */
+    UINT bufSize,       /* length of buffer */
+    UINT lengths[],     /* where to return the length of each message */
+    int maxCount,       /* max number of messages, at least one */
+    int timeout         /* ticks to wait for the first one */
+    );
+
+/*******************************************************************************
+ * msgQRingPeek - wait for the oldest message of a lock-free ring and keep it
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingPeek
+    (
+    P_MSG_Q qid,    /* message queue from which to receive */
+    int timeout,    /* ticks to wait */
+    UINT * pSlot    /* where to return the slot of the message */
+    );
+
+/*******************************************************************************
+ * msgQRingRelease - free a slot returned by msgQRingPeek
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQRingRelease
+    (
+    P_MSG_Q qid,    /* message queue from which to receive */
+    UINT slot       /* slot returned by msgQRingPeek */
+    );
+
+/*******************************************************************************
+ * msgQVarSendBatch - send a batch of messages to a MSG_Q_VARLEN byte ring
+ *
+ * RETURNS: the number of messages sent, at least one, or -1 otherwise.
+ */
+int msgQVarSendBatch
+    (
+    P_MSG_Q qid,                /* message queue on which to send */
+    const char * buffers[],     /* messages to send */
+    const UINT lengths[],       /* length of each message */
+    int count,                  /* number of messages, at least one */
+    int timeout                 /* ticks to wait for the first one */
+    );
+
+/*******************************************************************************
+ * msgQVarReceiveBatch - receive a batch of messages from a MSG_Q_VARLEN ring
+ *
+ * RETURNS: the number of messages received, at least one, or -1 otherwise.
+ */
+int msgQVarReceiveBatch
+    (
+    P_MSG_Q qid,        /* message queue from which to receive */
+    char * buffer,      /* buffer to receive the messages back to back */
+    UINT bufSize,       /* length of buffer */
+    UINT lengths[],     /* where to return the length of each message */
+    int maxCount,       /* max number of messages, at least one */
+    int timeout         /* ticks to wait for the first one */
+    );
+
+/*******************************************************************************
+ * msgQDurableStamp - stamp a message node of a MSG_Q_DURABLE queue
+ *
+ * give the node the next order of the priority level <level>, at the front of
+ * the level if <urgent> is not 0, and the checksum of its data, then set its
+ * commit stamp. It is called before the node is linked, the mutex must be
+ * taken.
+ *
+ * RETURNS: N/A
+ */
+void msgQDurableStamp
+    (
+    MSG_SM * psm,       /* shared memory of the message queue */
+    MSG_NODE * pNode,   /* node to stamp */
+    int level,          /* priority level of the message */
+    int urgent          /* 1 to go before the oldest message of the level */
+    );
+
+/*******************************************************************************
+ * msgQDurableRecover - recover a MSG_Q_DURABLE queue after a crash
+ *
+ * rebuild the links, the counts and the blocking state of the queue from the
+ * commit stamps of its nodes. The caller must be the only process attached.
+ *
+ * RETURNS: 0 when success or -1 otherwise.
+ */
+int msgQDurableRecover
+    (
+    P_MSG_Q qid     /* message queue to recover */
+    );
+
+/*******************************************************************************
+ * msgQLatRecord - record the latency of a message of a MSG_Q_LATENCY queue
+ *
+ * add the time since <stamp>, got from msgQOsStamp when the message was
+ * sent, to the latency histogram of the queue.
+ *
+ * RETURNS: N/A
+ */
+void msgQLatRecord
+    (
+    MSG_SM * psm,               /* shared memory of the message queue */
+    unsigned long long stamp    /* stamp of the message */
+    );
+
+/*******************************************************************************
+ * msgQLatRead - read the latency histogram of a message queue
+ *
+ * RETURNS: N/A
+ */
+void msgQLatRead
+    (
+    MSG_SM * psm,               /* shared memory of the message queue */
+    MSG_Q_LAT_STAT * pStat      /* where to return the percentiles */
+    );
+
+/*******************************************************************************
+ * msgQCacheGet - get the cached handle of a named message queue
+ *
+ * look up <pstrName> in the handle cache of the process and count an open of
+ * the handle found.
+ *
+ * RETURNS: the handle, or NULL if the name is not cached.
+ */
+P_MSG_Q msgQCacheGet
+    (
+    const char * pstrName   /* message name */
+    );
+
+/*******************************************************************************
+ * msgQCachePut - add a handle of a named message queue to the handle cache
+ *
+ * add <qid>, just opened, to the handle cache as <pstrName>. If another task
+ * of the process has cached the name meanwhile, an open of its handle is
+ * counted instead and the caller must close <qid>.
+ *
+ * RETURNS: the cached handle, <qid> or another one.
+ */
+P_MSG_Q msgQCachePut
+    (
+    P_MSG_Q qid,            /* message queue opened */
+    const char * pstrName   /* message name */
+    );
+
+/*******************************************************************************
+ * msgQCacheRelease - release an open of a handle
+ *
+ * count a delete of <qid> and remove it from the handle cache with its last
+ * open, leaving qid->cacheName to be freed with the handle. A handle which
+ * isn't cached has only one open.
+ *
+ * RETURNS: 1 if the handle is still open, or 0 if it must be closed.
+ */
+int msgQCacheRelease
+    (
+    P_MSG_Q qid             /* message queue deleted */
+    );
+
+/*******************************************************************************
+ * msgQRegAdd - list a named message queue in the registry
+ *
+ * RETURNS: N/A
+ */
+void msgQRegAdd
+    (
+    P_MSG_Q qid,            /* message queue created */
+    const char * pstrName   /* message name */
+    );
+
+/*******************************************************************************
+ * msgQRegRemove - remove a named message queue from the registry
+ *
+ * RETURNS: N/A
+ */
+void msgQRegRemove
+    (
+    const char * pstrName   /* message name */
+    );
+
+#endif
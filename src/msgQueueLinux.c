@@ -0,0 +1,1138 @@
+/* msgQueueLinux.c - Linux layer of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01l,16oct26,sgu  claimed the name of a hugetlbfs queue by its object
+01k,16oct26,sgu  added msgQOsRegistry
+01j,16oct26,sgu  added msgQOsWatch
+01i,16oct26,sgu  added msgQOsStamp on the invariant TSC
+01h,16oct26,sgu  added msgQOsSelf and msgQOsAlive for the owner of the mutex
+01g,16oct26,sgu  added the durable files of MSG_Q_DURABLE
+01f,16oct26,sgu  mapped inter-thread queues for zeroed lazy pages
+01e,16oct26,sgu  added the huge pages of MSG_Q_HUGEPAGE
+01d,16oct26,sgu  added msgQOsEventWait
+01c,16oct26,sgu  added the pollable descriptor of msgQGetFd
+01b,16oct26,sgu  added msgQOsPriority
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module implements the operating system layer of the message queue on
+Linux. The shared memory of a named message queue is a POSIX shared memory
+object created with shm_open and mapped with mmap; an inter-thread message
+queue lives in a private anonymous mapping. Either reads as zero when new and
+gets its pages at the first touch. Tasks pend on the words in MSG_SM with futex,
+the private futex operations are used for inter-thread message queues.
+
+With MSG_Q_HUGEPAGE an inter-thread message queue is mapped with MAP_HUGETLB,
+and a named one is a file in the first mounted hugetlbfs. The shared memory
+object of the name is still created, as a marker of a byte which sends the
+other processes to the file, so the name belongs to one queue whichever way
+it was created. Either falls back to the regular pages if the system has no
+huge page left.
+
+The pollable descriptor of an inter-thread message queue is an eventfd. A
+named message queue is shared by processes which can't pass an eventfd to
+each other, so its descriptor is a FIFO in /dev/shm, next to the shared
+memory object, which every process opens for reading and writing. Either one
+holds a byte, or a count, while the queue has a message.
+
+A MSG_Q_DURABLE message queue is named by the path of a regular file, which is
+mapped shared and outlives the processes and the host. Each process holds a
+shared flock on the file while it is attached; the process which gets the
+lock exclusively finds no other process attached, so it recovers the queue
+before it downgrades the lock. Its FIFO is the path with ".event" appended.
+
+The stamps of MSG_Q_LATENCY are read from the time stamp counter on an x86
+CPU which has an invariant one, which ticks at the same rate on all the CPUs
+and is shared by all the processes; each process calibrates its rate against
+the monotonic clock at its first stamp. The monotonic clock in nanoseconds is
+the stamp otherwise.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+#ifdef __linux__
+
+/* includes */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <linux/futex.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "msgQueueLib.h"
+
+/* defines */
+
+/* access permission of the shared memory object */
+#define MSG_Q_SHM_MODE     0666
+
+/* directory of the FIFO of a named message queue */
+#define MSG_Q_EVENT_DIR    "/dev/shm/"
+
+/* suffix of the FIFO of a durable message queue */
+#define MSG_Q_EVENT_EXT    ".event"
+
+/* bytes of the object which marks a queue backed by a hugetlbfs file */
+#define MSG_Q_HUGE_MARK    1
+
+/* a durable message queue is a file, its object name is not set */
+#define MSG_Q_IS_FILE(qid) ((qid)->fd >= 0 && (qid)->strName == NULL)
+
+/* nanoseconds the rate of the time stamp counter is calibrated over */
+#define MSG_Q_STAMP_CALIBRATE 2000000
+
+/* bits of the fraction of the nanoseconds per tick */
+#define MSG_Q_STAMP_SHIFT  24
+
+/* locals */
+
+/* ID of the calling process, cleared in a child after fork */
+static volatile UINT msgQSelf = 0;
+static volatile UINT msgQSelfHooked = 0;
+
+/* nanoseconds per tick of the stamps, in 1/2^MSG_Q_STAMP_SHIFT, 0 if unknown */
+static volatile unsigned long long msgQStampScale = 0;
+
+/* the stamps are read from the time stamp counter */
+static volatile int msgQStampTsc = 0;
+
+/* implementations */
+
+/*
+ * forget the process ID in a child after fork
+ */
+static void msgQOsForked(void)
+{
+    msgQSelf = 0;
+}
+
+/*
+ * get the path of the FIFO of a named message queue
+ *
+ * RETURNS: the allocated path, or NULL if failed.
+ */
+static char * msgQOsEventPath
+    (
+    P_MSG_Q qid
+    )
+{
+    const char * pstrName = NULL;
+    char * strPath = NULL;
+
+    if (MSG_Q_IS_FILE(qid)) {
+        strPath = (char*)malloc(strlen(qid->strPath) +
+            strlen(MSG_Q_EVENT_EXT) + 1);
+        if (strPath == NULL) {
+            PRINTF("allocate memory failed with errno %d!\n", errno);
+            return NULL;
+        }
+        sprintf(strPath, "%s%s", qid->strPath, MSG_Q_EVENT_EXT);
+        return strPath;
+    }
+
+    pstrName = qid->strName + 1 + strlen(_MSG_Q_SHMEM_);
+    strPath = (char*)malloc(strlen(MSG_Q_EVENT_DIR) + MSG_Q_PREFIX_LEN +
+        strlen(pstrName) + 1);
+    if (strPath == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return NULL;
+    }
+    sprintf(strPath, "%s%s%s", MSG_Q_EVENT_DIR, _MSG_Q_EVENT_, pstrName);
+
+    return strPath;
+}
+
+/*
+ * get the size of the huge pages of the system
+ *
+ * RETURNS: the default huge page size in bytes, or 0 if there is none.
+ */
+static size_t msgQOsHugeSize(void)
+{
+    char line[128];
+    unsigned long kBytes = 0;
+    FILE * fp = fopen("/proc/meminfo", "r");
+
+    if (fp == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kBytes) == 1)
+            break;
+    }
+    fclose(fp);
+
+    return (size_t)kBytes * 1024;
+}
+
+/*
+ * get the path of the hugetlbfs file of a named message queue
+ *
+ * RETURNS: the allocated path, or NULL if no hugetlbfs is mounted.
+ */
+static char * msgQOsHugePath
+    (
+    const char * pstrName
+    )
+{
+    char line[512];
+    char dir[256];
+    char type[64];
+    char * strPath = NULL;
+    FILE * fp = fopen("/proc/mounts", "r");
+
+    if (fp == NULL)
+        return NULL;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%*s %255s %63s", dir, type) != 2 ||
+            strcmp(type, "hugetlbfs") != 0)
+            continue;
+
+        strPath = (char*)malloc(strlen(dir) + MSG_Q_PREFIX_LEN +
+            strlen(pstrName) + 2);
+        if (strPath == NULL) {
+            PRINTF("allocate memory failed with errno %d!\n", errno);
+            break;
+        }
+        sprintf(strPath, "%s/%s%s", dir, _MSG_Q_SHMEM_, pstrName);
+        break;
+    }
+    fclose(fp);
+
+    return strPath;
+}
+
+/*
+ * create the hugetlbfs file of a named message queue and map it
+ *
+ * RETURNS: the descriptor of the file, or -1 if no huge page is left.
+ */
+static int msgQOsHugeCreate
+    (
+    const char * strPath,
+    size_t memSize,
+    size_t hugeSize,
+    void ** ppsm
+    )
+{
+    size_t mapSize = MSG_Q_ROUND(memSize, hugeSize);
+    int fd = -1;
+    void * psm = NULL;
+
+    /* the caller owns the name, a file left by a crashed creator is stale */
+    unlink(strPath);
+    fd = open(strPath, O_RDWR | O_CREAT | O_EXCL, MSG_Q_SHM_MODE);
+    if (fd < 0)
+        return -1;
+
+    psm = (ftruncate(fd, (off_t)mapSize) == -1) ? MAP_FAILED :
+        mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (psm == MAP_FAILED) {
+        close(fd);
+        unlink(strPath);
+        return -1;
+    }
+
+    *ppsm = psm;
+
+    return fd;
+}
+
+/*
+ * wait until the creator has sized the shared memory of a named queue
+ *
+ * RETURNS: the size of the shared memory, or 0 if failed.
+ */
+static size_t msgQOsSized
+    (
+    int fd
+    )
+{
+    struct stat st;
+    int retry = 0;
+
+    for (retry = 0; ; retry++) {
+        if (fstat(fd, &st) == -1) {
+            PRINTF("fstat with errno %d!\n", errno);
+            return 0;
+        }
+        if ((size_t)st.st_size >= sizeof(MSG_SM) ||
+            st.st_size == MSG_Q_HUGE_MARK)
+            return (size_t)st.st_size;
+        if (retry >= MSG_Q_READY_WAIT) {
+            PRINTF("shared memory is not sized.\n");
+            return 0;
+        }
+        usleep(1000);
+    }
+}
+
+/*
+ * check if a file holds an initialized message queue
+ *
+ * RETURNS: 1 if the file is sized and has the magic string, or 0 otherwise.
+ */
+static int msgQOsFileReady
+    (
+    int fd
+    )
+{
+    char magic[MAGIC_LEN];
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(MSG_SM))
+        return 0;
+
+    if (pread(fd, magic, MAGIC_LEN, offsetof(MSG_SM, magic)) != MAGIC_LEN)
+        return 0;
+
+    return strncmp(magic, MSG_Q_MAGIC, MAGIC_LEN) == 0;
+}
+
+/*
+ * map the file of a durable message queue
+ *
+ * the creator holds an exclusive flock from the creation until msgQOsReady,
+ * and so does the first process which attaches to an existed file, so the
+ * others wait in a shared flock until the queue is initialized or recovered.
+ * A file whose creator died before the magic string was set is created again
+ * if <create> is set.
+ *
+ * RETURNS: 1 when the file is newly created, 2 when an existed file is mapped
+ * by its only process, 0 when it is mapped by another one too, or -1 if
+ * failed.
+ */
+static int msgQOsMapFile
+    (
+    P_MSG_Q qid,
+    const char * pstrPath,
+    size_t memSize,
+    int create
+    )
+{
+    int status = -1;
+    int retry = 0;
+    int fd = -1;
+    char * strPath = NULL;
+    void * psm = NULL;
+
+    strPath = (char*)malloc(strlen(pstrPath) + 1);
+    if (strPath == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return -1;
+    }
+    strcpy(strPath, pstrPath);
+
+    if (create) {
+        fd = open(strPath, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+            MSG_Q_SHM_MODE);
+        if (fd >= 0) {
+            status = 1;
+            if (flock(fd, LOCK_EX) == -1) {
+                PRINTF("flock with errno %d!\n", errno);
+                unlink(strPath);
+                goto FailedExit;
+            }
+        }
+        else if (errno != EEXIST) {
+            PRINTF("open with errno %d!\n", errno);
+            goto FailedExit;
+        }
+    }
+
+    if (fd < 0) {
+        fd = open(strPath, O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            PRINTF("open with errno %d!\n", errno);
+            goto FailedExit;
+        }
+    }
+
+    /* the only process attached recovers the queue, the others wait for it */
+    for (retry = 0; status == -1; retry++) {
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            if (msgQOsFileReady(fd)) {
+                status = 2;
+                break;
+            }
+            if (create && retry >= MSG_Q_READY_WAIT) {
+                status = 1;
+                break;
+            }
+        }
+        else if (flock(fd, LOCK_SH) == 0 && msgQOsFileReady(fd)) {
+            status = 0;
+            break;
+        }
+        flock(fd, LOCK_UN);
+
+        if (retry >= MSG_Q_READY_WAIT) {
+            PRINTF("%s is not a message queue.\n", strPath);
+            goto FailedExit;
+        }
+        usleep(1000);
+    }
+
+    if (status == 1) {
+        if (ftruncate(fd, 0) == -1 || ftruncate(fd, (off_t)memSize) == -1) {
+            PRINTF("ftruncate with errno %d!\n", errno);
+            goto FailedExit;
+        }
+    }
+    else {
+        memSize = msgQOsSized(fd);
+        if (memSize == 0)
+            goto FailedExit;
+    }
+
+    psm = mmap(NULL, memSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (psm == MAP_FAILED) {
+        PRINTF("mmap with errno %d!\n", errno);
+        goto FailedExit;
+    }
+
+    qid->fd = fd;
+    qid->strPath = strPath;
+    qid->memSize = memSize;
+    qid->psm = (MSG_SM*)psm;
+
+    return status;
+
+FailedExit:
+    if (fd >= 0)
+        close(fd);
+    free(strPath);
+
+    return -1;
+}
+
+/*
+ * map the shared memory of a message queue
+ */
+int msgQOsMap
+    (
+    P_MSG_Q qid,
+    const char * pstrName,
+    size_t memSize,
+    int create,
+    int hugePage
+    )
+{
+    size_t hugeSize = hugePage ? msgQOsHugeSize() : 0;
+    size_t mapSize = 0;
+    int created = 0;
+    int hugeFd = -1;
+    int fd = -1;
+    char * strName = NULL;
+    char * strPath = NULL;
+    void * psm = NULL;
+
+    qid->fd = -1;
+    qid->eventFd = -1;
+    qid->strName = NULL;
+    qid->strPath = NULL;
+    qid->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    /* allocate memory for inter-thread message queue */
+    if (pstrName == NULL) {
+        if (hugeSize != 0) {
+            mapSize = MSG_Q_ROUND(memSize, hugeSize);
+            psm = mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (psm != MAP_FAILED) {
+                qid->psm = (MSG_SM*)psm;
+                qid->memSize = mapSize;
+                qid->pageSize = hugeSize;
+                return 1;
+            }
+        }
+        psm = mmap(NULL, memSize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (psm == MAP_FAILED) {
+            PRINTF("mmap with errno %d!\n", errno);
+            return -1;
+        }
+        qid->psm = (MSG_SM*)psm;
+        qid->memSize = memSize;
+        return 1;
+    }
+
+    /* a path names the file of a durable message queue */
+    if (strchr(pstrName, '/') != NULL)
+        return msgQOsMapFile(qid, pstrName, memSize, create);
+
+    /* the object name of the shared memory starts with a slash */
+    strName = (char*)malloc(strlen(pstrName) + MSG_Q_PREFIX_LEN + 2);
+    if (strName == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return -1;
+    }
+    sprintf(strName, "/%s%s", _MSG_Q_SHMEM_, pstrName);
+
+    /*
+     * NOTES: the shared memory object owns the name of a queue, whether the
+     * queue is in the object or in a hugetlbfs file. The creator of a queue
+     * backed by huge pages creates the object exclusively, then the file, and
+     * at last sizes the object to MSG_Q_HUGE_MARK bytes, which tells the
+     * other processes to map the file. So two creators can't make two queues
+     * of one name, and a queue which gets no huge pages falls back to the
+     * object with the regular pages.
+     *
+     * Only the task which creates the shared memory object exclusively sizes
+     * it, the others open the existed one and wait until the creator has
+     * sized it.
+     */
+
+    if (create) {
+        fd = shm_open(strName, O_RDWR | O_CREAT | O_EXCL, MSG_Q_SHM_MODE);
+        if (fd >= 0) {
+            created = 1;
+            strPath = (hugeSize == 0) ? NULL : msgQOsHugePath(pstrName);
+            hugeFd = (strPath == NULL) ? -1 :
+                msgQOsHugeCreate(strPath, memSize, hugeSize, &psm);
+            if (hugeFd >= 0) {
+                if (ftruncate(fd, MSG_Q_HUGE_MARK) == 0) {
+                    close(fd);
+                    fd = hugeFd;
+                    mapSize = MSG_Q_ROUND(memSize, hugeSize);
+                    goto MappedExit;
+                }
+                munmap(psm, MSG_Q_ROUND(memSize, hugeSize));
+                close(hugeFd);
+                unlink(strPath);
+            }
+            free(strPath);
+            strPath = NULL;
+
+            if (ftruncate(fd, (off_t)memSize) == -1) {
+                PRINTF("ftruncate with errno %d!\n", errno);
+                shm_unlink(strName);
+                goto FailedExit;
+            }
+        }
+        else if (errno != EEXIST) {
+            PRINTF("shm_open with errno %d!\n", errno);
+            goto FailedExit;
+        }
+    }
+
+    if (fd < 0) {
+        fd = shm_open(strName, O_RDWR, 0);
+        if (fd < 0) {
+            PRINTF("shm_open with errno %d!\n", errno);
+            goto FailedExit;
+        }
+    }
+
+    if (!created) {
+        memSize = msgQOsSized(fd);
+        if (memSize == 0)
+            goto FailedExit;
+
+        /* the object of a queue backed by huge pages only marks the name */
+        if (memSize == MSG_Q_HUGE_MARK) {
+            close(fd);
+            strPath = msgQOsHugePath(pstrName);
+            fd = (strPath == NULL) ? -1 : open(strPath, O_RDWR);
+            if (fd < 0) {
+                PRINTF("open %s with errno %d!\n", pstrName, errno);
+                goto FailedExit;
+            }
+            memSize = msgQOsSized(fd);
+            if (memSize == 0)
+                goto FailedExit;
+            hugeSize = msgQOsHugeSize();
+        }
+    }
+
+    mapSize = memSize;
+    psm = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (psm == MAP_FAILED) {
+        PRINTF("mmap with errno %d!\n", errno);
+        if (created)
+            shm_unlink(strName);
+        goto FailedExit;
+    }
+
+MappedExit:
+    qid->fd = fd;
+    qid->strName = strName;
+    qid->strPath = strPath;
+    qid->memSize = mapSize;
+    qid->psm = (MSG_SM*)psm;
+    if (strPath != NULL)
+        qid->pageSize = hugeSize;
+
+    return created;
+
+FailedExit:
+    if (fd >= 0)
+        close(fd);
+    free(strName);
+    free(strPath);
+
+    return -1;
+}
+
+/*
+ * map the shared memory of a named message queue read-only
+ */
+int msgQOsWatch
+    (
+    P_MSG_Q qid,
+    const char * pstrName
+    )
+{
+    struct stat st;
+    int fd = -1;
+    char * strName = NULL;
+    char * strPath = NULL;
+    void * psm = NULL;
+
+    qid->fd = -1;
+    qid->eventFd = -1;
+    qid->strName = NULL;
+    qid->strPath = NULL;
+    qid->pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    /* the file of a durable queue is read without its flock */
+    if (strchr(pstrName, '/') != NULL) {
+        strPath = (char*)malloc(strlen(pstrName) + 1);
+        if (strPath == NULL) {
+            PRINTF("allocate memory failed with errno %d!\n", errno);
+            return -1;
+        }
+        strcpy(strPath, pstrName);
+        fd = open(strPath, O_RDONLY | O_CLOEXEC);
+    }
+    else {
+        strName = (char*)malloc(strlen(pstrName) + MSG_Q_PREFIX_LEN + 2);
+        if (strName == NULL) {
+            PRINTF("allocate memory failed with errno %d!\n", errno);
+            return -1;
+        }
+        sprintf(strName, "/%s%s", _MSG_Q_SHMEM_, pstrName);
+
+        /* the object of a queue backed by huge pages marks its file */
+        fd = shm_open(strName, O_RDONLY, 0);
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size == MSG_Q_HUGE_MARK) {
+            close(fd);
+            strPath = msgQOsHugePath(pstrName);
+            fd = (strPath == NULL) ? -1 :
+                open(strPath, O_RDONLY | O_CLOEXEC);
+            qid->pageSize = msgQOsHugeSize();
+        }
+    }
+
+    if (fd < 0) {
+        PRINTF("open %s with errno %d!\n", pstrName, errno);
+        goto FailedExit;
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(MSG_SM)) {
+        PRINTF("%s is not a message queue.\n", pstrName);
+        goto FailedExit;
+    }
+
+    psm = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (psm == MAP_FAILED) {
+        PRINTF("mmap with errno %d!\n", errno);
+        goto FailedExit;
+    }
+
+    qid->fd = fd;
+    qid->strName = strName;
+    qid->strPath = strPath;
+    qid->memSize = (size_t)st.st_size;
+    qid->psm = (MSG_SM*)psm;
+
+    return 0;
+
+FailedExit:
+    if (fd >= 0)
+        close(fd);
+    free(strName);
+    free(strPath);
+
+    return -1;
+}
+
+/*
+ * unmap the shared memory of a message queue
+ */
+int msgQOsUnmap
+    (
+    P_MSG_Q qid,
+    int destroy
+    )
+{
+    int failed = 0;
+    char * strPath = NULL;
+
+    if (qid->eventFd >= 0 && close(qid->eventFd) == -1) {
+        PRINTF("close event with errno %d!\n", errno);
+        failed++;
+    }
+
+    if (munmap((void*)qid->psm, qid->memSize) == -1) {
+        PRINTF("munmap with errno %d!\n", errno);
+        failed++;
+    }
+
+    if (qid->fd < 0)
+        return failed == 0 ? 0 : -1;
+
+    if (close(qid->fd) == -1) {
+        PRINTF("close shared memory with errno %d!\n", errno);
+        failed++;
+    }
+
+    /*
+     * the object is removed by the last handle, like a Windows object, but
+     * the file of a durable message queue is kept
+     */
+    if (!destroy || MSG_Q_IS_FILE(qid))
+        ;
+    else {
+        /* the name is given up last, so no creator reuses the file path */
+        if (qid->strPath != NULL && unlink(qid->strPath) == -1 &&
+            errno != ENOENT) {
+            PRINTF("unlink with errno %d!\n", errno);
+            failed++;
+        }
+        if (shm_unlink(qid->strName) == -1 && errno != ENOENT) {
+            PRINTF("shm_unlink with errno %d!\n", errno);
+            failed++;
+        }
+    }
+
+    /* the FIFO only exists if a descriptor has been got */
+    if (destroy) {
+        strPath = msgQOsEventPath(qid);
+        if (strPath != NULL && unlink(strPath) == -1 && errno != ENOENT) {
+            PRINTF("unlink event with errno %d!\n", errno);
+            failed++;
+        }
+        free(strPath);
+    }
+
+    free(qid->strName);
+    free(qid->strPath);
+
+    return failed == 0 ? 0 : -1;
+}
+
+/*
+ * let the other processes attach to a durable message queue
+ */
+void msgQOsReady
+    (
+    P_MSG_Q qid
+    )
+{
+    if (MSG_Q_IS_FILE(qid) && flock(qid->fd, LOCK_SH) == -1) {
+        PRINTF("flock with errno %d!\n", errno);
+    }
+}
+
+/*
+ * write the shared memory of a durable message queue to its file
+ */
+int msgQOsSync
+    (
+    P_MSG_Q qid
+    )
+{
+    if (!MSG_Q_IS_FILE(qid))
+        return 0;
+
+    if (msync((void*)qid->psm, qid->memSize, MS_SYNC) == -1) {
+        PRINTF("msync with errno %d!\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * pend on a word of the shared memory
+ */
+int msgQOsWait
+    (
+    P_MSG_Q qid,
+    int chan,
+    volatile UINT * addr,
+    UINT expected,
+    int timeout
+    )
+{
+    struct timespec ts;
+    struct timespec * pts = NULL;
+    int op = FUTEX_WAIT;
+
+    (void)chan;
+
+    if (qid->fd < 0)
+        op |= FUTEX_PRIVATE_FLAG;
+
+    /* FUTEX_WAIT takes a relative timeout */
+    if (timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        pts = &ts;
+    }
+
+    if (syscall(SYS_futex, addr, op, expected, pts, NULL, 0) == -1) {
+        if (errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT)
+            return 0;
+        PRINTF("futex wait with errno %d!\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * wake up tasks pended on a word of the shared memory
+ */
+void msgQOsWake
+    (
+    P_MSG_Q qid,
+    int chan,
+    volatile UINT * addr,
+    int count
+    )
+{
+    int op = FUTEX_WAKE;
+
+    (void)chan;
+
+    if (qid->fd < 0)
+        op |= FUTEX_PRIVATE_FLAG;
+
+    if (syscall(SYS_futex, addr, op, count, NULL, NULL, 0) == -1) {
+        PRINTF("futex wake with errno %d!\n", errno);
+    }
+}
+
+/*
+ * get the ID of the calling process
+ *
+ * getpid is a system call, so the ID is kept for the fast path of the mutex.
+ */
+UINT msgQOsSelf(void)
+{
+    UINT hooked = 0;
+
+    if (msgQSelf != 0)
+        return msgQSelf;
+
+    if (MSG_Q_CAS(&msgQSelfHooked, &hooked, 1))
+        pthread_atfork(NULL, NULL, msgQOsForked);
+
+    msgQSelf = (UINT)getpid();
+
+    return msgQSelf;
+}
+
+/*
+ * check if a process is alive
+ *
+ * a process of another user can't be signaled but is alive. The processes of
+ * a named queue must share a PID namespace.
+ */
+int msgQOsAlive
+    (
+    UINT pid
+    )
+{
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+/*
+ * get the monotonic time in milliseconds
+ */
+unsigned long msgQOsTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * get the monotonic time in nanoseconds
+ */
+static unsigned long long msgQOsClockNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * choose the counter of the stamps, and calibrate the time stamp counter
+ */
+static void msgQOsStampInit(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+    unsigned long long start = 0;
+    unsigned long long ns = 0;
+    unsigned long long ticks = 0;
+
+    /* bit 8 of EDX of the leaf 0x80000007 tells an invariant counter */
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+        (edx & (1U << 8))) {
+        start = msgQOsClockNs();
+        ticks = __builtin_ia32_rdtsc();
+        do {
+            ns = msgQOsClockNs() - start;
+        } while (ns < MSG_Q_STAMP_CALIBRATE);
+        ticks = __builtin_ia32_rdtsc() - ticks;
+
+        msgQStampTsc = 1;
+        MSG_Q_STORE(&msgQStampScale, (ns << MSG_Q_STAMP_SHIFT) / ticks);
+        return;
+    }
+#endif
+
+    MSG_Q_STORE(&msgQStampScale, 1ULL << MSG_Q_STAMP_SHIFT);
+}
+
+/*
+ * get a time stamp for the latency of the messages
+ */
+unsigned long long msgQOsStamp(void)
+{
+    if (MSG_Q_LOAD(&msgQStampScale) == 0)
+        msgQOsStampInit();
+
+#if defined(__i386__) || defined(__x86_64__)
+    if (msgQStampTsc)
+        return __builtin_ia32_rdtsc();
+#endif
+
+    return msgQOsClockNs();
+}
+
+/*
+ * convert ticks of msgQOsStamp to nanoseconds
+ */
+unsigned long long msgQOsStampNs
+    (
+    unsigned long long ticks
+    )
+{
+    unsigned long long scale = MSG_Q_LOAD(&msgQStampScale);
+    unsigned long long low = ticks & ((1ULL << MSG_Q_STAMP_SHIFT) - 1);
+
+    if (scale == 0) {
+        msgQOsStampInit();
+        scale = MSG_Q_LOAD(&msgQStampScale);
+    }
+
+    /* split the ticks, so the product doesn't overflow */
+    return (ticks >> MSG_Q_STAMP_SHIFT) * scale +
+        ((low * scale) >> MSG_Q_STAMP_SHIFT);
+}
+
+/*
+ * get the scheduling priority of the calling task
+ *
+ * the real-time tasks rank by their static priority, 1 to 99, above all the
+ * others, which rank by their nice value, 0 for nice -20 down to -39.
+ */
+int msgQOsPriority(void)
+{
+    struct sched_param param;
+    int policy = sched_getscheduler(0);
+
+    if ((policy == SCHED_FIFO || policy == SCHED_RR) &&
+        sched_getparam(0, &param) == 0) {
+        return param.sched_priority;
+    }
+
+    /* the nice value of the calling thread */
+    return -(getpriority(PRIO_PROCESS, 0) + 20);
+}
+
+/*
+ * get the pollable descriptor of a message queue
+ */
+int msgQOsEventFd
+    (
+    P_MSG_Q qid
+    )
+{
+    char * strPath = NULL;
+    int fd = -1;
+
+    if (qid->eventFd >= 0)
+        return qid->eventFd;
+
+    if (qid->fd < 0) {
+        fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) {
+            PRINTF("eventfd with errno %d!\n", errno);
+            return -1;
+        }
+        qid->eventFd = fd;
+        return fd;
+    }
+
+    strPath = msgQOsEventPath(qid);
+    if (strPath == NULL)
+        return -1;
+
+    /* the FIFO is opened for writing too, so open never blocks */
+    if (mkfifo(strPath, MSG_Q_SHM_MODE) == -1 && errno != EEXIST) {
+        PRINTF("mkfifo with errno %d!\n", errno);
+    }
+    else {
+        fd = open(strPath, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            PRINTF("open event with errno %d!\n", errno);
+        }
+    }
+    free(strPath);
+
+    qid->eventFd = fd;
+
+    return fd;
+}
+
+/*
+ * signal the readiness on the pollable descriptor
+ */
+void msgQOsEventSet
+    (
+    P_MSG_Q qid,
+    UINT level
+    )
+{
+    unsigned long long value = 1;
+    char drain[64];
+    int fd = msgQOsEventFd(qid);
+
+    if (fd < 0)
+        return;
+
+    if (level == 0) {
+        /* the eventfd is reset by one read, the FIFO holds a byte at most */
+        while (read(fd, drain, sizeof(drain)) > 0)
+            ;
+        return;
+    }
+
+    /* the eventfd takes a counter of 8 bytes, the FIFO any byte */
+    if (write(fd, &value, qid->fd < 0 ? sizeof(value) : 1) == -1) {
+        PRINTF("write event with errno %d!\n", errno);
+    }
+}
+
+/*
+ * wait until a message queue of a set is ready
+ */
+int msgQOsEventWait
+    (
+    P_MSG_Q qids[],
+    int count,
+    int timeout
+    )
+{
+    struct pollfd fds[MSG_Q_ANY_MAX];
+    int index = 0;
+
+    for (index = 0; index < count; index++) {
+        fds[index].fd = qids[index]->eventFd;
+        fds[index].events = POLLIN;
+        fds[index].revents = 0;
+    }
+
+    if (poll(fds, (nfds_t)count, timeout) == -1 && errno != EINTR) {
+        PRINTF("poll with errno %d!\n", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * map the registry of the named message queues
+ */
+MSG_REG * msgQOsRegistry(void)
+{
+    struct stat st;
+    void * pReg = MAP_FAILED;
+    int fd = -1;
+
+    fd = shm_open("/" _MSG_Q_REGISTRY_, O_RDWR | O_CREAT | O_CLOEXEC,
+        MSG_Q_SHM_MODE);
+    if (fd < 0) {
+        PRINTF("shm_open with errno %d!\n", errno);
+        return NULL;
+    }
+
+    /* every process sizes it alike, and the new bytes read as zero */
+    if (fstat(fd, &st) == -1 || ((size_t)st.st_size < sizeof(MSG_REG) &&
+        ftruncate(fd, (off_t)sizeof(MSG_REG)) == -1)) {
+        PRINTF("size the registry with errno %d!\n", errno);
+    }
+    else {
+        pReg = mmap(NULL, sizeof(MSG_REG), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        if (pReg == MAP_FAILED)
+            PRINTF("mmap with errno %d!\n", errno);
+    }
+
+    close(fd);
+
+    return (pReg == MAP_FAILED) ? NULL : (MSG_REG*)pReg;
+}
+
+/*
+ * relinquish the CPU
+ */
+void msgQOsYield(void)
+{
+    sched_yield();
+}
+
+#endif /* __linux__ */
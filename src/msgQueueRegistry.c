@@ -0,0 +1,418 @@
+/* msgQueueRegistry.c - named queues of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module keeps track of the named message queues, in a process and across
+the processes.
+
+The handle cache of a process is a hash table of the handles of its named
+queues, chained in the handles themselves. A name opened again is found in
+the cache and gets the same handle with one more open counted, so the shared
+memory, the wait channels and the name of the objects are only looked up
+once per process; the handle is closed when the last open is deleted. The
+table is guarded by a spin lock held for a lookup or a link, never across a
+call to the operating system.
+
+The registry is a shared memory object of MSG_Q_REG_ENTRIES entries, each
+listing a named queue with its attributes. An entry has a sequence, even when
+the entry is stable and odd while it is written: a writer claims an entry by
+making its sequence odd with a compare-and-swap, and a reader copies an entry
+and keeps the copy if the sequence was even and hasn't changed meanwhile. A
+queue is added by its creator and removed with its last handle, so a queue
+of a process which crashed stays listed until its name is created again.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+/* includes */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* defines */
+
+/* parameters of the 32-bit FNV-1a hash */
+#define MSG_Q_FNV_BASIS    2166136261U
+#define MSG_Q_FNV_PRIME    16777619U
+
+/* locals */
+
+/* the handle cache of the process */
+static P_MSG_Q msgQCache[MSG_Q_CACHE_BUCKETS];
+static volatile int msgQCacheLock = 0;
+
+/* the registry, mapped at the first use */
+static MSG_REG * volatile msgQReg = NULL;
+
+/* implementations */
+
+/*
+ * get the bucket of a name in the handle cache
+ */
+static UINT msgQCacheHash
+    (
+    const char * pstrName
+    )
+{
+    UINT hash = MSG_Q_FNV_BASIS;
+
+    while (*pstrName != '\0') {
+        hash ^= (unsigned char)*pstrName++;
+        hash *= MSG_Q_FNV_PRIME;
+    }
+
+    return hash % MSG_Q_CACHE_BUCKETS;
+}
+
+/*
+ * take the lock of the handle cache
+ */
+static void msgQCacheTake(void)
+{
+    while (MSG_Q_XCHG(&msgQCacheLock, 1) != 0) {
+        while (__atomic_load_n(&msgQCacheLock, __ATOMIC_RELAXED) != 0)
+            msgQOsYield();
+    }
+}
+
+/*
+ * give the lock of the handle cache
+ */
+static void msgQCacheGive(void)
+{
+    MSG_Q_STORE(&msgQCacheLock, 0);
+}
+
+/*
+ * find a name in the handle cache, the lock must be taken
+ */
+static P_MSG_Q msgQCacheFind
+    (
+    const char * pstrName,
+    UINT bucket
+    )
+{
+    P_MSG_Q qid = msgQCache[bucket];
+
+    while (qid != NULL && strcmp(qid->cacheName, pstrName) != 0)
+        qid = qid->cacheNext;
+
+    return qid;
+}
+
+/*
+ * get the cached handle of a named message queue
+ */
+P_MSG_Q msgQCacheGet
+    (
+    const char * pstrName
+    )
+{
+    UINT bucket = msgQCacheHash(pstrName);
+    P_MSG_Q qid = NULL;
+
+    msgQCacheTake();
+    qid = msgQCacheFind(pstrName, bucket);
+    if (qid != NULL)
+        qid->cacheOpens++;
+    msgQCacheGive();
+
+    return qid;
+}
+
+/*
+ * add a handle of a named message queue to the handle cache
+ */
+P_MSG_Q msgQCachePut
+    (
+    P_MSG_Q qid,
+    const char * pstrName
+    )
+{
+    UINT bucket = msgQCacheHash(pstrName);
+    P_MSG_Q cached = NULL;
+    char * cacheName = NULL;
+
+    /* a handle which can't be cached is used on its own */
+    cacheName = (char*)malloc(strlen(pstrName) + 1);
+    if (cacheName == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return qid;
+    }
+    strcpy(cacheName, pstrName);
+
+    msgQCacheTake();
+    cached = msgQCacheFind(pstrName, bucket);
+    if (cached != NULL) {
+        cached->cacheOpens++;
+    }
+    else {
+        qid->cacheName = cacheName;
+        qid->cacheOpens = 1;
+        qid->cacheNext = msgQCache[bucket];
+        msgQCache[bucket] = qid;
+    }
+    msgQCacheGive();
+
+    if (cached != NULL) {
+        free(cacheName);
+        return cached;
+    }
+
+    return qid;
+}
+
+/*
+ * release an open of a handle
+ */
+int msgQCacheRelease
+    (
+    P_MSG_Q qid
+    )
+{
+    P_MSG_Q * pLink = NULL;
+
+    if (qid->cacheName == NULL)
+        return 0;
+
+    msgQCacheTake();
+    if (--qid->cacheOpens > 0) {
+        msgQCacheGive();
+        return 1;
+    }
+
+    pLink = &msgQCache[msgQCacheHash(qid->cacheName)];
+    while (*pLink != qid)
+        pLink = &(*pLink)->cacheNext;
+    *pLink = qid->cacheNext;
+    msgQCacheGive();
+
+    return 0;
+}
+
+/*
+ * get the registry, mapping it at the first use
+ */
+static MSG_REG * msgQRegGet(void)
+{
+    MSG_REG * pReg = msgQReg;
+
+    /* two tasks mapping it at once both get a valid mapping */
+    if (pReg == NULL) {
+        pReg = msgQOsRegistry();
+        if (pReg != NULL)
+            msgQReg = pReg;
+    }
+
+    return pReg;
+}
+
+/*
+ * claim an entry of the registry, waiting while another task writes it
+ */
+static UINT msgQRegClaim
+    (
+    MSG_REG_ENTRY * pEntry
+    )
+{
+    unsigned long start = msgQOsTime();
+    UINT seq = MSG_Q_LOAD(&pEntry->seq);
+
+    for (;;) {
+        if ((seq & 1) == 0 && MSG_Q_CAS(&pEntry->seq, &seq, seq + 1))
+            return seq + 1;
+
+        /* the writer has died in the entry, which is taken over */
+        if ((seq & 1) && msgQOsTime() - start > MSG_Q_READY_WAIT &&
+            MSG_Q_CAS(&pEntry->seq, &seq, seq + 2))
+            return seq + 2;
+
+        msgQOsYield();
+        seq = MSG_Q_LOAD(&pEntry->seq);
+    }
+}
+
+/*
+ * copy an entry of the registry without a lock
+ */
+static int msgQRegRead
+    (
+    MSG_REG_ENTRY * pEntry,
+    MSG_Q_INFO * pInfo
+    )
+{
+    unsigned long start = 0;
+    UINT seq = 0;
+    int live = 0;
+
+    do {
+        seq = MSG_Q_LOAD(&pEntry->seq);
+        if (seq & 1) {
+            /* an entry whose writer has died lists nothing */
+            if (start == 0)
+                start = msgQOsTime() | 1;
+            else if (msgQOsTime() - start > MSG_Q_READY_WAIT)
+                return 0;
+            msgQOsYield();
+            continue;
+        }
+        live = pEntry->live;
+        if (live)
+            memcpy(pInfo, &pEntry->info, sizeof(MSG_Q_INFO));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&pEntry->seq,
+        __ATOMIC_RELAXED));
+
+    return live;
+}
+
+/*
+ * list a named message queue in the registry
+ */
+void msgQRegAdd
+    (
+    P_MSG_Q qid,
+    const char * pstrName
+    )
+{
+    MSG_REG * pReg = NULL;
+    MSG_REG_ENTRY * pEntry = NULL;
+    MSG_Q_INFO info;
+    UINT seq = 0;
+    int index = 0;
+    int found = -1;
+
+    /* a name too long to be kept is not listed */
+    if (strlen(pstrName) >= MSG_Q_NAME_MAX)
+        return;
+
+    pReg = msgQRegGet();
+    if (pReg == NULL)
+        return;
+
+    /* the entry left by a queue of the same name is taken over */
+    for (index = 0; index < MSG_Q_REG_ENTRIES; index++) {
+        if (msgQRegRead(&pReg->entry[index], &info)) {
+            if (strcmp(info.name, pstrName) == 0) {
+                found = index;
+                break;
+            }
+        }
+        else if (found == -1) {
+            found = index;
+        }
+    }
+
+    while (found != -1) {
+        pEntry = &pReg->entry[found];
+        seq = msgQRegClaim(pEntry);
+
+        /* the entry may have been taken by another name meanwhile */
+        if (!pEntry->live || strcmp(pEntry->info.name, pstrName) == 0) {
+            memset(&pEntry->info, 0, sizeof(MSG_Q_INFO));
+            strcpy(pEntry->info.name, pstrName);
+            pEntry->info.maxMsgs = qid->psm->maxMsgs;
+            pEntry->info.maxMsgLength = (int)qid->psm->maxMsgLength;
+            pEntry->info.options = qid->psm->options;
+            pEntry->info.pid = (int)msgQOsSelf();
+            pEntry->info.memSize = qid->memSize;
+            pEntry->live = 1;
+            MSG_Q_STORE(&pEntry->seq, seq + 1);
+            return;
+        }
+        MSG_Q_STORE(&pEntry->seq, seq + 1);
+
+        /* look for another free entry */
+        for (found++; found < MSG_Q_REG_ENTRIES &&
+            msgQRegRead(&pReg->entry[found], &info); found++)
+            ;
+        if (found == MSG_Q_REG_ENTRIES)
+            found = -1;
+    }
+
+    PRINTF("registry is full, %s is not listed.\n", pstrName);
+}
+
+/*
+ * remove a named message queue from the registry
+ */
+void msgQRegRemove
+    (
+    const char * pstrName
+    )
+{
+    MSG_REG * pReg = NULL;
+    MSG_REG_ENTRY * pEntry = NULL;
+    MSG_Q_INFO info;
+    UINT seq = 0;
+    int index = 0;
+
+    if (strlen(pstrName) >= MSG_Q_NAME_MAX)
+        return;
+
+    pReg = msgQRegGet();
+    if (pReg == NULL)
+        return;
+
+    for (index = 0; index < MSG_Q_REG_ENTRIES; index++) {
+        pEntry = &pReg->entry[index];
+        if (!msgQRegRead(pEntry, &info) || strcmp(info.name, pstrName) != 0)
+            continue;
+
+        seq = msgQRegClaim(pEntry);
+        if (pEntry->live && strcmp(pEntry->info.name, pstrName) == 0)
+            pEntry->live = 0;
+        MSG_Q_STORE(&pEntry->seq, seq + 1);
+    }
+}
+
+/*
+ * list the named message queues
+ */
+int msgQList
+    (
+    MSG_Q_INFO * pInfo,
+    int maxInfo
+    )
+{
+    MSG_REG * pReg = NULL;
+    MSG_Q_INFO info;
+    int index = 0;
+    int count = 0;
+
+    if (pInfo == NULL && maxInfo > 0) {
+        PRINTF("input NULL parameter.\n");
+        return -1;
+    }
+
+    pReg = msgQRegGet();
+    if (pReg == NULL)
+        return -1;
+
+    for (index = 0; index < MSG_Q_REG_ENTRIES; index++) {
+        if (!msgQRegRead(&pReg->entry[index], &info))
+            continue;
+        if (count < maxInfo)
+            pInfo[count] = info;
+        count++;
+    }
+
+    return count;
+}
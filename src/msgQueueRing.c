@@ -0,0 +1,857 @@
+/* msgQueueRing.c - lock-free ring modes of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01m,16oct26,sgu  refused a second reservation of MSG_Q_SPSC
+01l,16oct26,sgu  stamped the messages of MSG_Q_LATENCY
+01k,16oct26,sgu  counted the sharded statistics
+01j,16oct26,sgu  biased the sequences by the slot for an O(1) init
+01i,16oct26,sgu  stepped the message data by the slot size
+01h,16oct26,sgu  signaled the pollable descriptor
+01g,16oct26,sgu  added the adaptive spin before pending
+01f,16oct26,sgu  added msgQRingReceiveBatch
+01e,16oct26,sgu  added msgQRingSendBatch
+01d,16oct26,sgu  split the receive into peek and release
+01c,16oct26,sgu  split the send into reserve and commit
+01b,16oct26,sgu  added MSG_Q_MPMC
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module implements the message queues which pass messages without taking
+the mutex of the queue. Both kinds use a ring with a power of two number of
+slots, and each slot owns the message node and the message data with the same
+index as in the other message queues. The producer index and the consumer
+index run freely and wrap around, each on its own cache line:
+
+    slot = index & (slots - 1)
+    msgNum = prod.index - cons.index
+
+MSG_Q_SPSC is the ring for exactly one sending task and one receiving task.
+Each index is written by its owner only: the producer fills the slot of its
+index and then publishes it with a release store of the index, the consumer
+drains the slot of its index and then frees it with a release store of its
+own index. Each side keeps the last index it has seen from the other side, so
+it only reads the peer's cache line when the ring looks full, or empty. A side
+which has to pend raises the waiters flag on the cache line of the other side
+and pends on the index of the other side, which is the word the other side
+changes when it makes progress.
+
+MSG_Q_MPMC is the ring for any number of sending and receiving tasks. Every
+slot carries a sequence number in its message node which tells the position
+the slot is ready for:
+
+    seq == pos              free for the producer of position pos
+    seq == pos + 1          filled for the consumer of position pos
+    seq == pos + slots      freed for the producer of the next lap
+
+The node keeps the sequence less the index of its slot, so the zeroed nodes
+of a new queue are free for the first lap without being touched.
+
+A task claims its position with a single compare-and-swap of the index of its
+side, copies the message, and then hands the slot over with a release store of
+the sequence number. Tasks only pend when the ring is full or empty: they
+count themselves in the waiters of the other side and pend on its event word,
+which the other side bumps after a hand over if it sees a waiter.
+
+The rings don't take the mutex of the queue, except to signal the pollable
+descriptor of msgQGetFd once one has been got: after its step, a task takes
+the mutex and sets the descriptor to the readiness it finds then.
+
+The statistics are counted in the shards of the calling thread as in the
+other modes. The peak depth of MSG_Q_SPSC is only sampled when a side loads
+the index of the other side anyway, so it may miss a peak between two loads.
+A message of a MSG_Q_LATENCY queue is stamped before it is handed over to the
+consumer, and timed when it is peeked.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+/* includes */
+
+#include <stdio.h>
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* implementations */
+
+/*
+ * initialize the lock-free ring of a message queue
+ */
+void msgQRingInit
+    (
+    MSG_SM * psm
+    )
+{
+    memset((void*)&psm->prod, 0, sizeof(MSG_RING));
+    memset((void*)&psm->cons, 0, sizeof(MSG_RING));
+}
+
+/*
+ * pend until the index of the peer moves away from <expected>, MSG_Q_SPSC
+ */
+static int msgQSpscPend
+    (
+    P_MSG_Q qid,
+    MSG_RING * peer,
+    int chan,
+    UINT expected,
+    unsigned long start,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * self = (peer == &psm->prod) ? &psm->cons : &psm->prod;
+    int timeLimit = msgQTimeLeft(start, timeout);
+    int status = 0;
+
+    if (timeLimit == 0)
+        return -1;
+
+    /* the peer may move soon, spin before pending */
+    if (msgQSpin(psm, &self->spin, &peer->index, expected))
+        return 0;
+
+    /* the peer checks the flag after it has published its index */
+    MSG_Q_STORE(&peer->waiters, 1);
+    MSG_Q_FENCE();
+
+    if (MSG_Q_LOAD(&peer->index) == expected)
+        status = msgQOsWait(qid, chan, &peer->index, expected, timeLimit);
+
+    MSG_Q_STORE(&peer->waiters, 0);
+
+    return status;
+}
+
+/*
+ * publish the index of one side and wake up the peer pended on it, MSG_Q_SPSC
+ */
+static void msgQSpscPublish
+    (
+    P_MSG_Q qid,
+    MSG_RING * self,
+    int chan,
+    UINT index
+    )
+{
+    MSG_Q_STORE(&self->index, index);
+    MSG_Q_FENCE();
+
+    if (self->waiters)
+        msgQOsWake(qid, chan, &self->index, 1);
+}
+
+/*
+ * reserve the next slot of a MSG_Q_SPSC message queue
+ */
+static int msgQSpscReserve
+    (
+    P_MSG_Q qid,
+    int timeout,
+    UINT * pSlot
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * prod = &psm->prod;
+    unsigned long start = 0;
+    int waited = 0;
+    UINT head = prod->index;
+
+    /* the producer index only moves at the commit of the reserved slot */
+    if (prod->reserved) {
+        PRINTF("slot %u is already reserved.\n", head & (psm->slots - 1));
+        return -1;
+    }
+
+    /* check the cached consumer index first, the ring is full rarely */
+    if (head - prod->peerIndex >= (UINT)psm->maxMsgs) {
+        if (timeout > 0)
+            start = msgQOsTime();
+
+        for (;;) {
+            /* the depth is only known when the consumer index is loaded */
+            prod->peerIndex = MSG_Q_LOAD(&psm->cons.index);
+            msgQStatDepth(psm, head - prod->peerIndex);
+            if (head - prod->peerIndex < (UINT)psm->maxMsgs)
+                break;
+
+            if (!waited) {
+                waited = 1;
+                msgQStatWait(psm, MSG_Q_SIDE_SEND, 0);
+            }
+
+            if (msgQSpscPend(qid, &psm->cons, MSG_Q_CHAN_SEM_C,
+                prod->peerIndex, start, timeout) != 0) {
+                /* timeout */
+                if (timeout != 0)
+                    msgQStatWait(psm, MSG_Q_SIDE_SEND, 1);
+                return -1;
+            }
+        }
+    }
+
+    *pSlot = head & (psm->slots - 1);
+    prod->reserved = 1;
+
+    return 0;
+}
+
+/*
+ * publish the filled slot of a MSG_Q_SPSC message queue to the consumer
+ */
+static int msgQSpscCommit
+    (
+    P_MSG_Q qid,
+    UINT slot,
+    UINT nBytes
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT head = psm->prod.index;
+
+    /* only the slot of the producer index can be reserved */
+    if (!psm->prod.reserved || slot != (head & (psm->slots - 1))) {
+        PRINTF("slot %u is not reserved.\n", slot);
+        return -1;
+    }
+    psm->prod.reserved = 0;
+
+    MSG_Q_NODE(psm, slot)->length = nBytes;
+    if (psm->options & MSG_Q_LATENCY)
+        MSG_Q_STAMP_SET(MSG_Q_NODE(psm, slot), msgQOsStamp());
+    msgQSpscPublish(qid, &psm->prod, MSG_Q_CHAN_SEM_P, head + 1);
+    msgQStatCount(psm, MSG_Q_SIDE_SEND, 1, nBytes);
+
+    return 0;
+}
+
+/*
+ * wait for the next filled slot of a MSG_Q_SPSC message queue
+ */
+static int msgQSpscPeek
+    (
+    P_MSG_Q qid,
+    int timeout,
+    UINT * pSlot
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * cons = &psm->cons;
+    unsigned long start = 0;
+    int waited = 0;
+    UINT tail = cons->index;
+
+    /* check the cached producer index first */
+    if (tail == cons->peerIndex) {
+        if (timeout > 0)
+            start = msgQOsTime();
+
+        for (;;) {
+            /* the messages sent since the producer index was loaded last */
+            cons->peerIndex = MSG_Q_LOAD(&psm->prod.index);
+            msgQStatDepth(psm, cons->peerIndex - tail);
+            if (tail != cons->peerIndex)
+                break;
+
+            if (!waited) {
+                waited = 1;
+                msgQStatWait(psm, MSG_Q_SIDE_RECV, 0);
+            }
+
+            if (msgQSpscPend(qid, &psm->prod, MSG_Q_CHAN_SEM_P,
+                tail, start, timeout) != 0) {
+                /* timeout */
+                if (timeout != 0)
+                    msgQStatWait(psm, MSG_Q_SIDE_RECV, 1);
+                return -1;
+            }
+        }
+    }
+
+    *pSlot = tail & (psm->slots - 1);
+
+    return 0;
+}
+
+/*
+ * free the drained slot of a MSG_Q_SPSC message queue to the producer
+ */
+static int msgQSpscRelease
+    (
+    P_MSG_Q qid,
+    UINT slot
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT tail = psm->cons.index;
+
+    /* only the slot of the consumer index can be peeked */
+    if (slot != (tail & (psm->slots - 1)) ||
+        tail == MSG_Q_LOAD(&psm->prod.index)) {
+        PRINTF("slot %u is not peeked.\n", slot);
+        return -1;
+    }
+
+    msgQStatCount(psm, MSG_Q_SIDE_RECV, 1, MSG_Q_NODE(psm, slot)->length);
+    msgQSpscPublish(qid, &psm->cons, MSG_Q_CHAN_SEM_C, tail + 1);
+
+    return 0;
+}
+
+/*
+ * claim the next free slot of a MSG_Q_MPMC message queue without pending
+ *
+ * RETURNS: the position claimed in <pPos>, 0 when success or -1 if full.
+ */
+static int msgQMpmcClaimFree
+    (
+    MSG_SM * psm,
+    UINT * pPos
+    )
+{
+    UINT mask = psm->slots - 1;
+    UINT pos = __atomic_load_n(&psm->prod.index, __ATOMIC_RELAXED);
+    UINT seq = 0;
+    int dif = 0;
+
+    for (;;) {
+        seq = MSG_Q_SEQ(psm, pos & mask);
+        dif = (int)(seq - pos);
+
+        if (dif == 0) {
+            /*
+             * a ring of more slots than maxMsgs is full when the position
+             * maxMsgs before is not drained yet, which is the same check on
+             * the slot of that position.
+             */
+            if ((UINT)psm->maxMsgs != psm->slots) {
+                UINT prev = pos - (UINT)psm->maxMsgs;
+                seq = MSG_Q_SEQ(psm, prev & mask);
+                if ((int)(seq - (prev + psm->slots)) < 0)
+                    return -1;
+            }
+
+            if (__atomic_compare_exchange_n(&psm->prod.index, &pos, pos + 1,
+                1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pPos = pos;
+                return 0;
+            }
+        }
+        else if (dif < 0) {
+            /* the slot of the last lap is not drained yet */
+            return -1;
+        }
+        else {
+            /* another producer has claimed the position */
+            pos = __atomic_load_n(&psm->prod.index, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * claim the next filled slot of a MSG_Q_MPMC message queue without pending
+ *
+ * RETURNS: the position claimed in <pPos>, 0 when success or -1 if empty.
+ */
+static int msgQMpmcClaimFilled
+    (
+    MSG_SM * psm,
+    UINT * pPos
+    )
+{
+    UINT mask = psm->slots - 1;
+    UINT pos = __atomic_load_n(&psm->cons.index, __ATOMIC_RELAXED);
+    UINT seq = 0;
+    int dif = 0;
+
+    for (;;) {
+        seq = MSG_Q_SEQ(psm, pos & mask);
+        dif = (int)(seq - (pos + 1));
+
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&psm->cons.index, &pos, pos + 1,
+                1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pPos = pos;
+                return 0;
+            }
+        }
+        else if (dif < 0) {
+            /* the slot is not filled yet */
+            return -1;
+        }
+        else {
+            /* another consumer has claimed the position */
+            pos = __atomic_load_n(&psm->cons.index, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/*
+ * hand a slot over to the other side and wake up a task pended for it
+ */
+static void msgQMpmcHandOver
+    (
+    P_MSG_Q qid,
+    MSG_RING * self,
+    int chan,
+    UINT slot,
+    UINT seq
+    )
+{
+    MSG_Q_STORE(&MSG_Q_NODE(qid->psm, slot)->seq, seq - slot);
+    MSG_Q_FENCE();
+
+    if (MSG_Q_LOAD(&self->waiters) > 0) {
+        MSG_Q_ADD(&self->event, 1);
+        msgQOsWake(qid, chan, &self->event, 1);
+    }
+}
+
+/*
+ * claim a slot of a MSG_Q_MPMC message queue, pend if there is none
+ */
+static int msgQMpmcClaim
+    (
+    P_MSG_Q qid,
+    int filled,
+    int timeout,
+    UINT * pPos
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * peer = filled ? &psm->prod : &psm->cons;
+    int chan = filled ? MSG_Q_CHAN_SEM_P : MSG_Q_CHAN_SEM_C;
+    int side = filled ? MSG_Q_SIDE_RECV : MSG_Q_SIDE_SEND;
+    unsigned long start = 0;
+    int timeLimit = 0;
+    int status = 0;
+    UINT event = 0;
+    volatile UINT * addr = NULL;
+
+    if (filled ? msgQMpmcClaimFilled(psm, pPos) == 0 :
+        msgQMpmcClaimFree(psm, pPos) == 0)
+        return 0;
+
+    msgQStatWait(psm, side, 0);
+
+    /*
+     * a slot may be handed over soon, spin before pending: a receiver
+     * watches the sequence of the slot it would claim next, a sender watches
+     * the consumer index.
+     */
+
+    if (timeout != 0) {
+        addr = filled ? &MSG_Q_NODE(psm, MSG_Q_LOAD(&psm->cons.index) &
+            (psm->slots - 1))->seq : &psm->cons.index;
+        if (msgQSpin(psm, filled ? &psm->cons.spin : &psm->prod.spin, addr,
+            MSG_Q_LOAD(addr)) && (filled ? msgQMpmcClaimFilled(psm, pPos) == 0 :
+            msgQMpmcClaimFree(psm, pPos) == 0))
+            return 0;
+    }
+
+    if (timeout > 0)
+        start = msgQOsTime();
+
+    for (;;) {
+        timeLimit = msgQTimeLeft(start, timeout);
+        if (timeLimit == 0) {
+            if (timeout != 0)
+                msgQStatWait(psm, side, 1);
+            return -1;
+        }
+
+        /* the peer checks the waiters after it has handed a slot over */
+        MSG_Q_ADD(&peer->waiters, 1);
+        event = MSG_Q_LOAD(&peer->event);
+
+        if (filled ? msgQMpmcClaimFilled(psm, pPos) == 0 :
+            msgQMpmcClaimFree(psm, pPos) == 0) {
+            MSG_Q_SUB(&peer->waiters, 1);
+            return 0;
+        }
+
+        status = msgQOsWait(qid, chan, &peer->event, event, timeLimit);
+        MSG_Q_SUB(&peer->waiters, 1);
+
+        if (status != 0) {
+            msgQStatWait(psm, side, 1);
+            return -1;
+        }
+    }
+}
+
+/*
+ * publish the filled slot of a MSG_Q_MPMC message queue to the consumer
+ */
+static int msgQMpmcCommit
+    (
+    P_MSG_Q qid,
+    UINT slot,
+    UINT nBytes
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_NODE * pNode = MSG_Q_NODE(psm, slot);
+    UINT pos = MSG_Q_SEQ(psm, slot);
+
+    /* a claimed slot keeps the sequence of a position before the index */
+    if ((pos & (psm->slots - 1)) != slot ||
+        (int)(MSG_Q_LOAD(&psm->prod.index) - pos) <= 0) {
+        PRINTF("slot %u is not reserved.\n", slot);
+        return -1;
+    }
+
+    pNode->length = nBytes;
+    if (psm->options & MSG_Q_LATENCY)
+        MSG_Q_STAMP_SET(pNode, msgQOsStamp());
+    msgQStatCount(psm, MSG_Q_SIDE_SEND, 1, nBytes);
+    msgQStatDepth(psm, pos + 1 -
+        __atomic_load_n(&psm->cons.index, __ATOMIC_RELAXED));
+    msgQMpmcHandOver(qid, &psm->prod, MSG_Q_CHAN_SEM_P, slot, pos + 1);
+
+    return 0;
+}
+
+/*
+ * free the drained slot of a MSG_Q_MPMC message queue to the producer
+ */
+static int msgQMpmcRelease
+    (
+    P_MSG_Q qid,
+    UINT slot
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT pos = MSG_Q_SEQ(psm, slot) - 1;
+
+    /* a claimed slot keeps the sequence of a position before the index */
+    if ((pos & (psm->slots - 1)) != slot ||
+        (int)(MSG_Q_LOAD(&psm->cons.index) - pos) <= 0) {
+        PRINTF("slot %u is not peeked.\n", slot);
+        return -1;
+    }
+
+    msgQStatCount(psm, MSG_Q_SIDE_RECV, 1, MSG_Q_NODE(psm, slot)->length);
+
+    /* hand it over to the producer of the next lap */
+    msgQMpmcHandOver(qid, &psm->cons, MSG_Q_CHAN_SEM_C, slot,
+        pos + psm->slots);
+
+    return 0;
+}
+
+/*
+ * reserve a slot of a lock-free ring message queue
+ */
+int msgQRingReserve
+    (
+    P_MSG_Q qid,
+    int timeout,
+    char ** ppBuffer
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT slot = 0;
+    UINT pos = 0;
+
+    if (psm->options & MSG_Q_MPMC) {
+        if (msgQMpmcClaim(qid, 0, timeout, &pos) != 0)
+            return -1;
+        slot = pos & (psm->slots - 1);
+    }
+    else if (msgQSpscReserve(qid, timeout, &slot) != 0) {
+        return -1;
+    }
+
+    *ppBuffer = MSG_Q_DATA(psm, slot);
+
+    return 0;
+}
+
+/*
+ * send the message of a reserved slot of a lock-free ring message queue
+ */
+int msgQRingCommit
+    (
+    P_MSG_Q qid,
+    UINT slot,
+    UINT nBytes
+    )
+{
+    int status = 0;
+
+    if (qid->psm->options & MSG_Q_MPMC)
+        status = msgQMpmcCommit(qid, slot, nBytes);
+    else
+        status = msgQSpscCommit(qid, slot, nBytes);
+
+    if (status == 0)
+        msgQPollSync(qid);
+
+    return status;
+}
+
+/*
+ * send a message to a lock-free ring message queue
+ */
+int msgQRingSend
+    (
+    P_MSG_Q qid,
+    const char * buffer,
+    UINT nBytes,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    char * pData = NULL;
+
+    /* a send is a reservation filled from the buffer */
+    if (msgQRingReserve(qid, timeout, &pData) != 0) {
+        /* timeout */
+        return -1;
+    }
+
+    memcpy(pData, buffer, nBytes);
+
+    return msgQRingCommit(qid, (UINT)((pData - MSG_Q_DATA(psm, 0)) /
+        psm->slotSize), nBytes);
+}
+
+/*
+ * send a batch of messages to a lock-free ring message queue
+ */
+int msgQRingSendBatch
+    (
+    P_MSG_Q qid,
+    const char * buffers[],
+    const UINT lengths[],
+    int count,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * prod = &psm->prod;
+    unsigned long long stamp = 0;
+    UINT bytes = 0;
+    UINT head = 0;
+    UINT slot = 0;
+    UINT room = 0;
+    int index = 0;
+
+    if (psm->options & MSG_Q_MPMC) {
+        /* every message claims its own position, only the first one pends */
+        for (index = 0; index < count; index++) {
+            if (msgQRingSend(qid, buffers[index], lengths[index],
+                index == 0 ? timeout : 0) != 0)
+                break;
+        }
+        return index == 0 ? -1 : index;
+    }
+
+    /* wait for the first free slot, then fill all the room in one go */
+    if (msgQSpscReserve(qid, timeout, &slot) != 0) {
+        /* timeout */
+        return -1;
+    }
+
+    head = prod->index;
+    prod->reserved = 0;
+    prod->peerIndex = MSG_Q_LOAD(&psm->cons.index);
+    room = (UINT)psm->maxMsgs - (head - prod->peerIndex);
+
+    /* the messages of a batch are sent at the same time */
+    if (psm->options & MSG_Q_LATENCY)
+        stamp = msgQOsStamp();
+
+    for (index = 0; index < count && (UINT)index < room; index++) {
+        slot = (head + index) & (psm->slots - 1);
+        MSG_Q_NODE(psm, slot)->length = lengths[index];
+        MSG_Q_STAMP_SET(MSG_Q_NODE(psm, slot), stamp);
+        memcpy(MSG_Q_DATA(psm, slot), buffers[index], lengths[index]);
+        bytes += lengths[index];
+    }
+
+    /* the consumer sees the whole batch with a single publish */
+    msgQSpscPublish(qid, prod, MSG_Q_CHAN_SEM_P, head + index);
+    msgQStatCount(psm, MSG_Q_SIDE_SEND, (UINT)index, bytes);
+    msgQStatDepth(psm, head + index - prod->peerIndex);
+    msgQPollSync(qid);
+
+    return index;
+}
+
+/*
+ * wait for the oldest message of a lock-free ring message queue and keep it
+ * in its slot
+ */
+int msgQRingPeek
+    (
+    P_MSG_Q qid,
+    int timeout,
+    UINT * pSlot
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT pos = 0;
+
+    if ((psm->options & MSG_Q_MPMC) == 0) {
+        if (msgQSpscPeek(qid, timeout, pSlot) != 0)
+            return -1;
+    }
+    else {
+        if (msgQMpmcClaim(qid, 1, timeout, &pos) != 0)
+            return -1;
+
+        /* the claim takes the message off the ring */
+        msgQPollSync(qid);
+
+        *pSlot = pos & (psm->slots - 1);
+    }
+
+    if (psm->options & MSG_Q_LATENCY)
+        msgQLatRecord(psm, MSG_Q_STAMP_GET(MSG_Q_NODE(psm, *pSlot)));
+
+    return 0;
+}
+
+/*
+ * free a slot returned by msgQRingPeek
+ */
+int msgQRingRelease
+    (
+    P_MSG_Q qid,
+    UINT slot
+    )
+{
+    int status = 0;
+
+    if (qid->psm->options & MSG_Q_MPMC)
+        status = msgQMpmcRelease(qid, slot);
+    else
+        status = msgQSpscRelease(qid, slot);
+
+    if (status == 0)
+        msgQPollSync(qid);
+
+    return status;
+}
+
+/*
+ * receive a batch of messages from a lock-free ring message queue
+ */
+int msgQRingReceiveBatch
+    (
+    P_MSG_Q qid,
+    char * buffer,
+    UINT bufSize,
+    UINT lengths[],
+    int maxCount,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_RING * cons = &psm->cons;
+    UINT offset = 0;
+    UINT nBytes = 0;
+    UINT bytes = 0;
+    UINT tail = 0;
+    UINT slot = 0;
+    int index = 0;
+
+    if (psm->options & MSG_Q_MPMC) {
+        /*
+         * NOTES: a claimed message can't be put back, so the following
+         * messages are only claimed while any message would fit.
+         */
+
+        for (index = 0; index < maxCount; index++) {
+            if (index > 0 && psm->maxMsgLength > bufSize - offset)
+                break;
+            if (msgQRingPeek(qid, index == 0 ? timeout : 0, &slot) != 0)
+                break;
+
+            nBytes = MSG_Q_NODE(psm, slot)->length;
+            nBytes = (nBytes > bufSize - offset) ? bufSize - offset : nBytes;
+            memcpy(buffer + offset, MSG_Q_DATA(psm, slot), nBytes);
+            msgQRingRelease(qid, slot);
+
+            lengths[index] = nBytes;
+            offset += nBytes;
+        }
+        return index == 0 ? -1 : index;
+    }
+
+    /* wait for the first message, then drain all the fitting ones */
+    if (msgQSpscPeek(qid, timeout, &slot) != 0) {
+        /* timeout */
+        return -1;
+    }
+
+    tail = cons->index;
+    cons->peerIndex = MSG_Q_LOAD(&psm->prod.index);
+
+    for (index = 0; index < maxCount && tail + index != cons->peerIndex;
+        index++) {
+        slot = (tail + index) & (psm->slots - 1);
+        nBytes = MSG_Q_NODE(psm, slot)->length;
+        if (index > 0 && nBytes > bufSize - offset)
+            break;
+
+        bytes += nBytes;
+        if (psm->options & MSG_Q_LATENCY)
+            msgQLatRecord(psm, MSG_Q_STAMP_GET(MSG_Q_NODE(psm, slot)));
+
+        nBytes = (nBytes > bufSize - offset) ? bufSize - offset : nBytes;
+        memcpy(buffer + offset, MSG_Q_DATA(psm, slot), nBytes);
+
+        lengths[index] = nBytes;
+        offset += nBytes;
+    }
+
+    /* the producer gets all the drained slots with a single publish */
+    msgQStatCount(psm, MSG_Q_SIDE_RECV, (UINT)index, bytes);
+    msgQStatDepth(psm, cons->peerIndex - tail);
+    msgQSpscPublish(qid, cons, MSG_Q_CHAN_SEM_C, tail + index);
+    msgQPollSync(qid);
+
+    return index;
+}
+
+/*
+ * receive a message from a lock-free ring message queue
+ */
+int msgQRingReceive
+    (
+    P_MSG_Q qid,
+    char * buffer,
+    UINT maxNBytes,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    MSG_NODE * pNode = NULL;
+    UINT slot = 0;
+
+    /* a receive is a peek drained into the buffer */
+    if (msgQRingPeek(qid, timeout, &slot) != 0) {
+        /* timeout */
+        return -1;
+    }
+
+    pNode = MSG_Q_NODE(psm, slot);
+    maxNBytes = (maxNBytes > pNode->length) ? pNode->length : maxNBytes;
+    memcpy(buffer, MSG_Q_DATA(psm, slot), maxNBytes);
+
+    return msgQRingRelease(qid, slot);
+}
@@ -0,0 +1,322 @@
+/* msgQueueVar.c - variable-length mode of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01f,17oct26,sgu  took and gave the units of a named queue under the mutex
+01e,16oct26,sgu  stamped the records of MSG_Q_LATENCY
+01d,16oct26,sgu  counted the sharded statistics
+01c,16oct26,sgu  logged the steps for the repair after owner death
+01b,16oct26,sgu  signaled the pollable descriptor
+01a,16oct26,sgu  created
+*/
+
+/*
+DESCRIPTION
+This module implements the message queue of the option MSG_Q_VARLEN, which
+keeps its messages back to back in a byte ring instead of in fixed slots of
+<maxMsgLength> bytes. The capacity of the queue is the size of the byte ring,
+so a queue of mostly small messages with rare large ones only needs memory
+for the bytes really queued.
+
+Each message is a record of a MSG_Q_REC_HDR bytes header, which holds the
+length of the message, followed by the message data padded to the size of
+the header. The header of a MSG_Q_LATENCY queue is followed by the stamp of
+the message. A record never wraps around the end of the ring: if it doesn't
+fit into the bytes left at the end, the sender marks them with a record of
+length MSG_Q_REC_WRAP and the record starts at the beginning of the ring. The
+marked bytes count as taken until the receiver skips them.
+
+    head                the offset the next record is written at
+    tail                the offset of the oldest record
+    dataUsed            the bytes taken by records and by the wrap marker
+
+The ring is protected by the mutex of the queue. The producer semaphore counts
+the messages as for the other message queues, but the free space is counted
+in bytes under the mutex, so a sender which finds too little space pends on
+the word of the consumer semaphore, which the receivers bump as an event after
+they have freed some bytes.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+/* includes */
+
+#include <stdio.h>
+#include <string.h>
+#include "msgQueueLib.h"
+
+/* implementations */
+
+/*
+ * get the bytes a record takes at the head of the byte ring, the mutex must
+ * be taken
+ *
+ * RETURNS: the bytes taken including the wrap marker, the offset of the
+ * record in <pOffset>.
+ */
+static UINT msgQVarNeed
+    (
+    MSG_SM * psm,
+    UINT nBytes,
+    UINT * pOffset
+    )
+{
+    UINT size = MSG_Q_REC_SIZE(psm->options, nBytes);
+    UINT head = (UINT)psm->head;
+
+    if (psm->dataSize - head >= size) {
+        *pOffset = head;
+        return size;
+    }
+
+    /* skip the bytes left at the end of the ring */
+    *pOffset = 0;
+    return psm->dataSize - head + size;
+}
+
+/*
+ * append a record to the byte ring, the mutex must be taken
+ */
+static void msgQVarPut
+    (
+    MSG_SM * psm,
+    const char * buffer,
+    UINT nBytes
+    )
+{
+    UINT offset = 0;
+    UINT need = msgQVarNeed(psm, nBytes, &offset);
+
+    if (offset != (UINT)psm->head)
+        *(UINT*)MSG_Q_BYTES(psm, psm->head) = MSG_Q_REC_WRAP;
+
+    *(UINT*)MSG_Q_BYTES(psm, offset) = nBytes;
+    memcpy(MSG_Q_BYTES(psm, offset + MSG_Q_REC_HEAD(psm->options)), buffer,
+        nBytes);
+
+    /* the stamp of a timed queue follows the header */
+    if (psm->options & MSG_Q_LATENCY)
+        *(unsigned long long*)MSG_Q_BYTES(psm, offset + MSG_Q_REC_HDR) =
+            msgQOsStamp();
+
+    /* the records beyond the head are not read, only the offsets are logged */
+    offset += MSG_Q_REC_SIZE(psm->options, nBytes);
+    MSG_Q_LOG(psm, &psm->head);
+    MSG_Q_LOG(psm, &psm->dataUsed);
+    psm->head = (offset == psm->dataSize) ? 0 : (int)offset;
+    psm->dataUsed += need;
+
+    /* update the message counting attributes */
+    MSG_Q_LOG(psm, &psm->msgNum);
+    psm->msgNum++;
+    msgQStatCount(psm, MSG_Q_SIDE_SEND, 1, nBytes);
+    msgQStatDepth(psm, (UINT)psm->msgNum);
+}
+
+/*
+ * get the oldest record of the byte ring, the mutex must be taken
+ *
+ * RETURNS: the offset of the message data, its length in <pNBytes>.
+ */
+static UINT msgQVarFirst
+    (
+    MSG_SM * psm,
+    UINT * pNBytes
+    )
+{
+    /* skip the wrap marker at the end of the ring */
+    if (*(UINT*)MSG_Q_BYTES(psm, psm->tail) == MSG_Q_REC_WRAP) {
+        MSG_Q_LOG(psm, &psm->dataUsed);
+        MSG_Q_LOG(psm, &psm->tail);
+        psm->dataUsed -= psm->dataSize - (UINT)psm->tail;
+        psm->tail = 0;
+    }
+
+    *pNBytes = *(UINT*)MSG_Q_BYTES(psm, psm->tail);
+
+    return (UINT)psm->tail + MSG_Q_REC_HEAD(psm->options);
+}
+
+/*
+ * remove the oldest record of the byte ring, the mutex must be taken
+ */
+static void msgQVarDrop
+    (
+    MSG_SM * psm,
+    UINT nBytes
+    )
+{
+    UINT size = MSG_Q_REC_SIZE(psm->options, nBytes);
+    UINT tail = (UINT)psm->tail + size;
+
+    if (psm->options & MSG_Q_LATENCY)
+        msgQLatRecord(psm, *(unsigned long long*)MSG_Q_BYTES(psm,
+            (UINT)psm->tail + MSG_Q_REC_HDR));
+
+    MSG_Q_LOG(psm, &psm->tail);
+    MSG_Q_LOG(psm, &psm->dataUsed);
+    psm->tail = (tail == psm->dataSize) ? 0 : (int)tail;
+    psm->dataUsed -= size;
+
+    /* an empty ring starts over, so no record has to wrap */
+    if (psm->dataUsed == 0) {
+        MSG_Q_LOG(psm, &psm->head);
+        psm->head = 0;
+        psm->tail = 0;
+    }
+
+    /* update the message counting attributes */
+    MSG_Q_LOG(psm, &psm->msgNum);
+    psm->msgNum--;
+    msgQStatCount(psm, MSG_Q_SIDE_RECV, 1, nBytes);
+}
+
+/*
+ * send a batch of messages to a MSG_Q_VARLEN byte ring
+ */
+int msgQVarSendBatch
+    (
+    P_MSG_Q qid,
+    const char * buffers[],
+    const UINT lengths[],
+    int count,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    unsigned long start = 0;
+    int timeLimit = 0;
+    int status = 0;
+    int waited = 0;
+    int index = 0;
+    UINT offset = 0;
+    UINT event = 0;
+
+    if (timeout > 0)
+        start = msgQOsTime();
+
+    for (;;) {
+        /* take the mutex for shared memory protecting */
+        if (msgQLock(qid) != 0) {
+            return -1;
+        }
+
+        if (psm->dataSize - psm->dataUsed >=
+            msgQVarNeed(psm, lengths[0], &offset))
+            break;
+
+        /* the receivers bump the event after they have freed some bytes */
+        event = MSG_Q_LOAD(&psm->semC.count);
+        MSG_Q_ADD(&psm->semC.waiters, 1);
+        msgQUnlock(qid);
+
+        if (!waited) {
+            waited = 1;
+            msgQStatWait(psm, MSG_Q_SIDE_SEND, 0);
+        }
+
+        timeLimit = msgQTimeLeft(start, timeout);
+        status = (timeLimit == 0) ? -1 :
+            msgQOsWait(qid, MSG_Q_CHAN_SEM_C, &psm->semC.count, event,
+            timeLimit);
+        MSG_Q_SUB(&psm->semC.waiters, 1);
+
+        if (status != 0) {
+            if (timeout != 0)
+                msgQStatWait(psm, MSG_Q_SIDE_SEND, 1);
+            return -1;
+        }
+    }
+
+    /* append all the messages which fit */
+    msgQLogBegin(psm, -1, 0, MSG_Q_CHAN_SEM_P);
+    for (index = 0; index < count; index++) {
+        if (index > 0 && psm->dataSize - psm->dataUsed <
+            msgQVarNeed(psm, lengths[index], &offset))
+            break;
+        msgQVarPut(psm, buffers[index], lengths[index]);
+        msgQLogStep(psm);
+    }
+
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* release the producer semaphore once for the whole batch, and the mutex */
+    msgQSemGiveUnlock(qid, &psm->semP, MSG_Q_CHAN_SEM_P, index);
+
+    return index;
+}
+
+/*
+ * receive a batch of messages from a MSG_Q_VARLEN byte ring
+ */
+int msgQVarReceiveBatch
+    (
+    P_MSG_Q qid,
+    char * buffer,
+    UINT bufSize,
+    UINT lengths[],
+    int maxCount,
+    int timeout
+    )
+{
+    MSG_SM * psm = qid->psm;
+    UINT offset = 0;
+    UINT data = 0;
+    UINT nBytes = 0;
+    UINT waiters = 0;
+    int taken = 0;
+    int index = 0;
+
+    /* take as many messages as are there, up to the whole batch */
+    taken = msgQSemTakeLock(qid, &psm->semP, MSG_Q_CHAN_SEM_P,
+        (UINT)maxCount, timeout);
+    if (taken < 0) {
+        /* timeout */
+        return -1;
+    }
+
+    /* the first message is truncated, the following ones must fit */
+    msgQLogBegin(psm, MSG_Q_CHAN_SEM_P, (UINT)taken, MSG_Q_CHAN_SEM_C);
+    for (index = 0; index < taken; index++) {
+        data = msgQVarFirst(psm, &nBytes);
+        if (index > 0 && nBytes > bufSize - offset)
+            break;
+
+        lengths[index] = (nBytes > bufSize - offset) ? bufSize - offset :
+            nBytes;
+        memcpy(buffer + offset, MSG_Q_BYTES(psm, data), lengths[index]);
+        offset += lengths[index];
+
+        msgQVarDrop(psm, nBytes);
+        msgQLogStep(psm);
+    }
+
+    /* signal the readiness on the pollable descriptor */
+    msgQPollUpdate(qid);
+
+    /* give back the messages which don't fit into the buffer */
+    if (index < taken)
+        msgQSemGiveBack(qid, &psm->semP, MSG_Q_CHAN_SEM_P, taken - index);
+
+    /* release mutex */
+    msgQUnlock(qid);
+
+    /* the freed bytes may fit the message of any pended sender */
+    waiters = MSG_Q_LOAD(&psm->semC.waiters);
+    if (waiters > 0) {
+        MSG_Q_ADD(&psm->semC.count, 1);
+        msgQOsWake(qid, MSG_Q_CHAN_SEM_C, &psm->semC.count, (int)waiters);
+    }
+
+    return index;
+}
@@ -0,0 +1,524 @@
+/* msgQueueWin32.c - Windows layer of VxWorks-like message queue */
+
+/*
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ */
+
+/*
+modification history
+--------------------
+01k,16oct26,sgu  added msgQOsRegistry
+01j,16oct26,sgu  added msgQOsWatch
+01i,16oct26,sgu  added msgQOsStamp on the performance counter
+01h,16oct26,sgu  added msgQOsSelf and msgQOsAlive for the owner of the mutex
+01g,16oct26,sgu  refused the durable files of MSG_Q_DURABLE
+01f,16oct26,sgu  allocated inter-thread queues with VirtualAlloc
+01e,16oct26,sgu  reported the page size, MSG_Q_HUGEPAGE is ignored
+01d,16oct26,sgu  added the stub of msgQOsEventWait
+01c,16oct26,sgu  added the stubs of the pollable descriptor
+01b,16oct26,sgu  added msgQOsPriority
+01a,16oct26,sgu  created, split from msgQueue.c
+*/
+
+/*
+DESCRIPTION
+This module implements the operating system layer of the message queue on
+Windows. The shared memory of a named message queue is a file mapping backed
+by the paging file; an inter-thread message queue lives in private pages.
+Windows has no primitive to pend on a word shared between processes, so each
+wait channel of a message queue owns a kernel semaphore which is released by
+the waker. A release that nobody takes just causes a spurious wake up later,
+which the callers tolerate.
+
+The durable message queues of MSG_Q_DURABLE are not supported yet: their
+recovery relies on a lock which tells whether any other process is attached
+to the file, and so a name with a slash is refused.
+
+If you meet some problem with this module, please feel free to contact
+me via e-mail: gushengyuan2002@163.com
+*/
+
+#ifdef _WIN32
+
+/* includes */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "msgQueueLib.h"
+
+/* defines */
+
+/* max count of a wakeup semaphore */
+#define MSG_Q_SEM_MAX      0x7fffffff
+
+/* locals */
+
+/* objects name prefix for the wait channels */
+static const char * chanPrefix[MSG_Q_CHAN_NUM] = {
+    _MSG_Q_MUTEX_,
+    _MSG_Q_SEM_P_,
+    _MSG_Q_SEM_C_
+};
+
+/* implementations */
+
+/*
+ * map the shared memory of a message queue
+ */
+int msgQOsMap
+    (
+    P_MSG_Q qid,
+    const char * pstrName,
+    size_t memSize,
+    int create,
+    int hugePage
+    )
+{
+    MEMORY_BASIC_INFORMATION info;
+    SYSTEM_INFO sysInfo;
+    char * strName = NULL;
+    int created = 1;
+    int chan = 0;
+
+    memset(qid->chan, 0, sizeof(qid->chan));
+    qid->hFile = NULL;
+    qid->psm = NULL;
+
+    /* large pages need a privilege the tasks seldom have, regular ones only */
+    (void)hugePage;
+    GetSystemInfo(&sysInfo);
+    qid->pageSize = sysInfo.dwPageSize;
+
+    /* a path names the file of a durable message queue */
+    if (pstrName != NULL && strchr(pstrName, '/') != NULL) {
+        PRINTF("durable message queue is not supported.\n");
+        return -1;
+    }
+
+    /* allocate the object name memory */
+    if (pstrName != NULL) {
+        int len = strlen(pstrName) + MSG_Q_PREFIX_LEN + 1;
+        strName = (char*)malloc(len);
+        if (strName == NULL) {
+            PRINTF("allocate memory failed with errno %d!\n", errno);
+            return -1;
+        }
+        memset(strName, 0, len);
+    }
+
+    /* create or open the wakeup semaphores */
+
+    for (chan = 0; chan < MSG_Q_CHAN_NUM; chan++) {
+        if (pstrName != NULL) {
+            sprintf(strName, "%s%s", chanPrefix[chan], pstrName);
+        }
+
+        if (create) {
+            qid->chan[chan] = CreateSemaphore(NULL, 0, MSG_Q_SEM_MAX, strName);
+        }
+        else {
+            qid->chan[chan] = OpenSemaphore(SEMAPHORE_ALL_ACCESS, FALSE,
+                strName);
+        }
+
+        if (qid->chan[chan] == NULL) {
+            PRINTF("create semaphore with errno %d!\n", (int)GetLastError());
+            goto FailedExit;
+        }
+    }
+
+    if (pstrName == NULL) {
+        /* allocate memory for inter-thread message queue */
+        /* zeroed pages which are only backed at the first touch */
+        qid->psm = (MSG_SM*)VirtualAlloc(NULL, memSize,
+            MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (qid->psm == NULL) {
+            PRINTF("VirtualAlloc with errno %d!\n", (int)GetLastError());
+            goto FailedExit;
+        }
+        qid->memSize = memSize;
+        return 1;
+    }
+
+    /* allocate shared memory for inter-process message queue */
+
+    sprintf(strName, "%s%s", _MSG_Q_SHMEM_, pstrName);
+    if (create) {
+        qid->hFile = CreateFileMapping(INVALID_HANDLE_VALUE, NULL,
+            PAGE_READWRITE, 0, (DWORD)memSize, strName);
+        if (qid->hFile != NULL && GetLastError() == ERROR_ALREADY_EXISTS)
+            created = 0;
+    }
+    else {
+        qid->hFile = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, strName);
+        created = 0;
+    }
+
+    if (qid->hFile == NULL) {
+        PRINTF("CreateFileMapping with errno %d!\n", (int)GetLastError());
+        goto FailedExit;
+    }
+
+    qid->psm = (MSG_SM*)MapViewOfFile(qid->hFile, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (qid->psm == NULL) {
+        PRINTF("MapViewOfFile with errno %d!\n", (int)GetLastError());
+        goto FailedExit;
+    }
+
+    /* the view of an existed mapping covers the whole section */
+    if (created == 0 &&
+        VirtualQuery(qid->psm, &info, sizeof(info)) == sizeof(info)) {
+        memSize = info.RegionSize;
+    }
+    qid->memSize = memSize;
+
+    free(strName);
+
+    return created;
+
+FailedExit:
+    if (qid->psm != NULL && qid->hFile != NULL)
+        UnmapViewOfFile(qid->psm);
+    if (qid->psm != NULL && qid->hFile == NULL)
+        VirtualFree(qid->psm, 0, MEM_RELEASE);
+    if (qid->hFile != NULL)
+        CloseHandle(qid->hFile);
+    for (chan = 0; chan < MSG_Q_CHAN_NUM; chan++) {
+        if (qid->chan[chan] != NULL)
+            CloseHandle(qid->chan[chan]);
+    }
+    if (strName != NULL)
+        free(strName);
+
+    return -1;
+}
+
+/*
+ * map the shared memory of a named message queue read-only
+ */
+int msgQOsWatch
+    (
+    P_MSG_Q qid,
+    const char * pstrName
+    )
+{
+    MEMORY_BASIC_INFORMATION info;
+    SYSTEM_INFO sysInfo;
+    char * strName = NULL;
+
+    memset(qid->chan, 0, sizeof(qid->chan));
+    qid->hFile = NULL;
+    qid->psm = NULL;
+
+    GetSystemInfo(&sysInfo);
+    qid->pageSize = sysInfo.dwPageSize;
+
+    strName = (char*)malloc(strlen(pstrName) + MSG_Q_PREFIX_LEN + 1);
+    if (strName == NULL) {
+        PRINTF("allocate memory failed with errno %d!\n", errno);
+        return -1;
+    }
+    sprintf(strName, "%s%s", _MSG_Q_SHMEM_, pstrName);
+
+    /* no wait channel is opened, the handle never pends nor wakes up */
+    qid->hFile = OpenFileMapping(FILE_MAP_READ, FALSE, strName);
+    free(strName);
+    if (qid->hFile == NULL) {
+        PRINTF("OpenFileMapping with errno %d!\n", (int)GetLastError());
+        return -1;
+    }
+
+    qid->psm = (MSG_SM*)MapViewOfFile(qid->hFile, FILE_MAP_READ, 0, 0, 0);
+    if (qid->psm == NULL) {
+        PRINTF("MapViewOfFile with errno %d!\n", (int)GetLastError());
+        CloseHandle(qid->hFile);
+        qid->hFile = NULL;
+        return -1;
+    }
+
+    qid->memSize = 0;
+    if (VirtualQuery(qid->psm, &info, sizeof(info)) == sizeof(info))
+        qid->memSize = info.RegionSize;
+
+    return 0;
+}
+
+/*
+ * unmap the shared memory of a message queue
+ */
+int msgQOsUnmap
+    (
+    P_MSG_Q qid,
+    int destroy
+    )
+{
+    int status = 0;
+    int failed = 0;
+    int chan = 0;
+
+    /* the kernel objects are destroyed with the last reference */
+    (void)destroy;
+
+    for (chan = 0; chan < MSG_Q_CHAN_NUM; chan++) {
+        /* a handle of msgQWatch has no wait channel */
+        if (qid->chan[chan] == NULL)
+            continue;
+
+        status = CloseHandle(qid->chan[chan]);
+        if(status == 0) {
+            PRINTF("close semaphore with errno %d!\n", (int)GetLastError());
+            failed++;
+        }
+    }
+
+    if (qid->hFile != NULL) {
+        status = UnmapViewOfFile(qid->psm);
+        if(status == 0) {
+            PRINTF("UnmapViewOfFile with errno %d!\n", (int)GetLastError());
+            failed++;
+        }
+
+        status = CloseHandle(qid->hFile);
+        if(status == 0) {
+            PRINTF("close mapped file with errno %d!\n", (int)GetLastError());
+            failed++;
+        }
+    }
+    else {
+        VirtualFree((void*)qid->psm, 0, MEM_RELEASE);
+    }
+
+    return failed == 0 ? 0 : -1;
+}
+
+/*
+ * let the other processes attach to a durable message queue
+ */
+void msgQOsReady
+    (
+    P_MSG_Q qid
+    )
+{
+    (void)qid;
+}
+
+/*
+ * write the shared memory of a durable message queue to its file
+ */
+int msgQOsSync
+    (
+    P_MSG_Q qid
+    )
+{
+    (void)qid;
+
+    return 0;
+}
+
+/*
+ * get the ID of the calling process
+ */
+UINT msgQOsSelf(void)
+{
+    return (UINT)GetCurrentProcessId();
+}
+
+/*
+ * check if a process is alive
+ */
+int msgQOsAlive
+    (
+    UINT pid
+    )
+{
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    DWORD status = 0;
+
+    /* a process which can't be opened for another reason is alive */
+    if (hProcess == NULL)
+        return GetLastError() != ERROR_INVALID_PARAMETER;
+
+    status = WaitForSingleObject(hProcess, 0);
+    CloseHandle(hProcess);
+
+    return status != WAIT_OBJECT_0;
+}
+
+/*
+ * pend on a word of the shared memory
+ */
+int msgQOsWait
+    (
+    P_MSG_Q qid,
+    int chan,
+    volatile UINT * addr,
+    UINT expected,
+    int timeout
+    )
+{
+    unsigned long status = 0;
+
+    /* the word has changed since the caller checked it */
+    if (MSG_Q_LOAD(addr) != expected)
+        return 0;
+
+    status = WaitForSingleObject(qid->chan[chan],
+        timeout < 0 ? INFINITE : (unsigned long)timeout);
+    if (status == WAIT_FAILED) {
+        PRINTF("wait for semaphore with errno:%d!\n", (int)GetLastError());
+        return -1;
+    }
+
+    /* WAIT_OBJECT_0 or WAIT_TIMEOUT */
+    return 0;
+}
+
+/*
+ * wake up tasks pended on a word of the shared memory
+ */
+void msgQOsWake
+    (
+    P_MSG_Q qid,
+    int chan,
+    volatile UINT * addr,
+    int count
+    )
+{
+    (void)addr;
+
+    /* the release fails only if the semaphore is saturated, ignore it */
+    ReleaseSemaphore(qid->chan[chan], count, NULL);
+}
+
+/*
+ * get the monotonic time in milliseconds
+ */
+unsigned long msgQOsTime(void)
+{
+    return GetTickCount();
+}
+
+/*
+ * get a time stamp for the latency of the messages
+ */
+unsigned long long msgQOsStamp(void)
+{
+    LARGE_INTEGER count;
+
+    QueryPerformanceCounter(&count);
+
+    return (unsigned long long)count.QuadPart;
+}
+
+/*
+ * convert ticks of msgQOsStamp to nanoseconds
+ */
+unsigned long long msgQOsStampNs
+    (
+    unsigned long long ticks
+    )
+{
+    LARGE_INTEGER freq;
+
+    QueryPerformanceFrequency(&freq);
+
+    /* split the ticks, so the product doesn't overflow */
+    return ticks / (unsigned long long)freq.QuadPart * 1000000000 +
+        ticks % (unsigned long long)freq.QuadPart * 1000000000 /
+        (unsigned long long)freq.QuadPart;
+}
+
+/*
+ * get the scheduling priority of the calling task
+ */
+int msgQOsPriority(void)
+{
+    return GetThreadPriority(GetCurrentThread());
+}
+
+/*
+ * get the pollable descriptor of a message queue, not supported on Windows
+ */
+int msgQOsEventFd
+    (
+    P_MSG_Q qid
+    )
+{
+    (void)qid;
+
+    PRINTF("pollable descriptor is not supported.\n");
+
+    return -1;
+}
+
+/*
+ * signal the readiness on the pollable descriptor, not supported on Windows
+ */
+void msgQOsEventSet
+    (
+    P_MSG_Q qid,
+    UINT level
+    )
+{
+    (void)qid;
+    (void)level;
+}
+
+/*
+ * wait until a message queue of a set is ready, not supported on Windows
+ */
+int msgQOsEventWait
+    (
+    P_MSG_Q qids[],
+    int count,
+    int timeout
+    )
+{
+    (void)qids;
+    (void)count;
+    (void)timeout;
+
+    return -1;
+}
+
+/*
+ * map the registry of the named message queues
+ */
+MSG_REG * msgQOsRegistry(void)
+{
+    HANDLE hFile = NULL;
+    MSG_REG * pReg = NULL;
+
+    /* the handle is kept open with the mapping, until the process exits */
+    hFile = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+        sizeof(MSG_REG), _MSG_Q_REGISTRY_);
+    if (hFile == NULL) {
+        PRINTF("CreateFileMapping with errno %d!\n", (int)GetLastError());
+        return NULL;
+    }
+
+    pReg = (MSG_REG*)MapViewOfFile(hFile, FILE_MAP_ALL_ACCESS, 0, 0,
+        sizeof(MSG_REG));
+    if (pReg == NULL) {
+        PRINTF("MapViewOfFile with errno %d!\n", (int)GetLastError());
+        CloseHandle(hFile);
+    }
+
+    return pReg;
+}
+
+/*
+ * relinquish the CPU
+ */
+void msgQOsYield(void)
+{
+    SwitchToThread();
+}
+
+#endif /* _WIN32 */
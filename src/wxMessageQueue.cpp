@@ -57,21 +57,127 @@ int wxMessageQueue::Receive(
 	return msgQReceive(m_msgQId, buffer, maxNBytes, timeout);
 }
 
+int wxMessageQueue::ReceiveAny(
+         wxMessageQueue * queues[], /* message queues from which to receive */
+         int count,        /* number of message queues */
+         char * buffer,    /* buffer to receive message */
+         UINT maxNBytes,   /* length of buffer */
+         int timeout,      /* ticks to wait */
+         int * pIndex      /* where to return the index of the queue */
+         )
+{
+	MSG_Q_ID ids[MSG_Q_ANY_MAX];
+	int index;
+
+	if (queues == NULL || count < 1 || count > MSG_Q_ANY_MAX)
+		return -1;
+
+	for (index = 0; index < count; index++)
+		ids[index] = queues[index]->m_msgQId;
+
+	return msgQReceiveAny(ids, count, buffer, maxNBytes, timeout, pIndex);
+}
+
+int wxMessageQueue::ReceiveBatch(
+         char * buffer,    /* buffer to receive the messages */
+         UINT bufSize,     /* length of buffer */
+         UINT lengths[],   /* where to return the length of each message */
+         int maxCount,     /* max number of messages */
+         int timeout       /* ticks to wait */
+         )
+{
+	return msgQReceiveBatch(m_msgQId, buffer, bufSize, lengths, maxCount, timeout);
+}
+
+int wxMessageQueue::ReceivePeek(
+         const char ** ppBuffer,  /* where to return the pointer to the message */
+         UINT * pNBytes,          /* where to return the length of the message */
+         int timeout              /* ticks to wait */
+         )
+{
+	return msgQReceivePeek(m_msgQId, ppBuffer, pNBytes, timeout);
+}
+
+int wxMessageQueue::ReceiveRelease(
+         const char * pBuffer     /* message returned by ReceivePeek */
+         )
+{
+	return msgQReceiveRelease(m_msgQId, pBuffer);
+}
+
 int wxMessageQueue::Send(
          char * buffer,   /* message to send */
          UINT nBytes,     /* length of message */
          int timeout,     /* ticks to wait */
-         int priority     /* MSG_PRI_NORMAL or MSG_PRI_URGENT */
+         int priority     /* MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
          )
 {
 	return msgQSend(m_msgQId, buffer, nBytes, timeout, priority);
 }
 
+int wxMessageQueue::SendBatch(
+         const char * buffers[],  /* messages to send */
+         const UINT lengths[],    /* length of each message */
+         int count,               /* number of messages */
+         int timeout,             /* ticks to wait */
+         int priority             /* MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+         )
+{
+	return msgQSendBatch(m_msgQId, buffers, lengths, count, timeout, priority);
+}
+
+int wxMessageQueue::SendReserve(
+         UINT nBytes,       /* max length of message to build */
+         int timeout,       /* ticks to wait */
+         char ** ppBuffer   /* where to return the pointer to the slot */
+         )
+{
+	return msgQSendReserve(m_msgQId, nBytes, timeout, ppBuffer);
+}
+
+int wxMessageQueue::SendCommit(
+         char * pBuffer,  /* slot returned by SendReserve */
+         UINT nBytes,     /* length of message */
+         int priority     /* MSG_PRI_NORMAL, MSG_PRI_URGENT or MSG_PRI_LEVEL(n) */
+         )
+{
+	return msgQSendCommit(m_msgQId, pBuffer, nBytes, priority);
+}
+
+int wxMessageQueue::SetSpin(
+         int maxSpins      /* max rounds to spin, 0 to pend at once */
+         )
+{
+	return msgQSetSpin(m_msgQId, maxSpins);
+}
+
+int wxMessageQueue::SetSync(
+         int msgs          /* operations between writes, 0 for none */
+         )
+{
+	return msgQSetSync(m_msgQId, msgs);
+}
+
+int wxMessageQueue::Sync()
+{
+	return msgQSync(m_msgQId);
+}
+
+int wxMessageQueue::GetFd()
+{
+	return msgQGetFd(m_msgQId);
+}
+
 int wxMessageQueue::Stat(MSG_Q_STAT * msgQStatus)
 {
 	return msgQStat(m_msgQId, msgQStatus);
 }
 
+int wxMessageQueue::Latency(MSG_Q_LAT_STAT * msgQLatStat)
+{
+	return msgQLatency(m_msgQId, msgQLatStat);
+}
+
 int wxMessageQueue::Show()
 {
 	return msgQShow(m_msgQId);
@@ -0,0 +1,254 @@
+/**
+ * testTyped.cpp
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Test cases and examples for the typed message queue wxTypedMessageQueue.
+ *
+ * A sender thread passes the points of a 16-byte structure to a receiver
+ * thread through an inter-thread queue of each mode, and through a named
+ * queue opened a second time by its name; a name opened with another type
+ * must be refused. The slots, the mask, the slot size and the alignment the
+ * template works out at compile time must match the slots the library hands
+ * out for a ring of messages of several sizes.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#include "wxTypedMessageQueue.h"
+#include "../tcCheck.h"
+
+#define TC_DEPTH    64
+#define TC_COUNT    100000
+
+typedef struct tagTC_POINT {
+    long long seq;
+    long long check;
+}TC_POINT;
+
+typedef wxTypedMessageQueue<TC_POINT, TC_DEPTH> TC_QUEUE;
+
+/* a message smaller than the least slot */
+typedef struct tagTC_SMALL {
+    char bytes[3];
+}TC_SMALL;
+
+/* a message of several cache lines */
+typedef struct tagTC_LARGE {
+    long long values[20];
+}TC_LARGE;
+
+typedef struct tagMSG_Q_TEST {
+    TC_QUEUE * queue;
+    int count;
+    int errors;
+}MSG_Q_TEST;
+
+#ifdef _WIN32
+typedef HANDLE TEST_THREAD;
+#else
+typedef pthread_t TEST_THREAD;
+#endif
+
+/* milliseconds since an arbitrary point */
+static long long tc_now(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* spawn a test thread running entry(param) */
+static TEST_THREAD testThreadSpawn(unsigned int (*entry)(void *), void *param) {
+#ifdef _WIN32
+    unsigned int tid = 0;
+
+    return (HANDLE)CreateThread(NULL, 0,
+            (LPTHREAD_START_ROUTINE)entry, param, 0, (DWORD*)&tid);
+#else
+    pthread_t tid;
+
+    pthread_create(&tid, NULL, (void *(*)(void *))entry, param);
+    return tid;
+#endif
+}
+
+/* wait for a test thread to exit and release it */
+static void testThreadClose(TEST_THREAD thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+unsigned int msgQSender(void *param) {
+    MSG_Q_TEST * msgQTest = (MSG_Q_TEST*)param;
+    TC_POINT point;
+    int i = 0;
+
+    for (i = 0; i < msgQTest->count; i++) {
+        point.seq = i;
+        point.check = ~(long long)i;
+        if (msgQTest->queue->Send(point) != 0) {
+            printf("send message failed in %s.\n", __func__);
+            msgQTest->errors++;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+unsigned int msgQReceiver(void *param) {
+    MSG_Q_TEST * msgQTest = (MSG_Q_TEST*)param;
+    TC_POINT point;
+    int i = 0;
+
+    for (i = 0; i < msgQTest->count; i++) {
+        if (msgQTest->queue->Receive(point) != 0) {
+            printf("receive message failed in %s.\n", __func__);
+            msgQTest->errors++;
+            break;
+        }
+        if (point.seq != i || point.check != ~(long long)i) {
+            printf("message %d is %lld in %s.\n", i, point.seq, __func__);
+            msgQTest->errors++;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void tc_send_recv(TC_QUEUE * sendQueue, TC_QUEUE * recvQueue,
+    const char * mode, int count) {
+    TEST_THREAD hSender;
+    TEST_THREAD hReceiver;
+    MSG_Q_TEST sender = {sendQueue, count, 0};
+    MSG_Q_TEST receiver = {recvQueue, count, 0};
+    long long slice = 0;
+
+    TC_CHECK(sendQueue->IsValid() && recvQueue->IsValid());
+    if (!sendQueue->IsValid() || !recvQueue->IsValid())
+        return;
+
+    slice = tc_now();
+    hSender = testThreadSpawn(msgQSender, &sender);
+    hReceiver = testThreadSpawn(msgQReceiver, &receiver);
+    testThreadClose(hSender);
+    testThreadClose(hReceiver);
+    slice = tc_now() - slice;
+
+    printf("%s: %d messages of %u bytes in %lld ms.\n", mode, count,
+        (UINT)sizeof(TC_POINT), slice);
+    TC_CHECK(sender.errors == 0 && receiver.errors == 0);
+}
+
+/* the layout worked out by the template is the one of the library */
+template <typename T, int N>
+void tc_layout(int options) {
+    typedef wxTypedMessageQueue<T, N> Queue;
+    Queue queue(options);
+    MSG_Q_ID msgQId = queue.GetId();
+    char * base = NULL;
+    char * pSlot = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    UINT index = 0;
+    int bad = 0;
+
+    printf("%u bytes: slots %u, mask 0x%x, slot size %u, slot alignment %u.\n",
+        (UINT)sizeof(T), Queue::SLOTS, Queue::MASK, Queue::SLOT_SIZE,
+        Queue::SLOT_ALIGN);
+
+    TC_CHECK(queue.IsValid());
+    if (!queue.IsValid())
+        return;
+
+    /* twice round the ring, a message at a time, the slots come in turn */
+    for (index = 0; index < 2 * Queue::SLOTS; index++) {
+        if (msgQSendReserve(msgQId, sizeof(T), 0, &pSlot) != 0) {
+            bad++;
+            break;
+        }
+        if (index == 0)
+            base = pSlot;
+        if (pSlot != base + (index & Queue::MASK) * Queue::SLOT_SIZE ||
+            (uintptr_t)pSlot % Queue::SLOT_ALIGN != 0)
+            bad++;
+
+        if (msgQSendCommit(msgQId, pSlot, sizeof(T), MSG_PRI_NORMAL) != 0 ||
+            msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) != 0 ||
+            pMsg != pSlot || nBytes != sizeof(T) ||
+            msgQReceiveRelease(msgQId, pMsg) != 0)
+            bad++;
+    }
+    TC_CHECK(bad == 0);
+}
+
+int main(int argc, char **argv) {
+    TC_QUEUE * opened = NULL;
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < TC_MODES; index++) {
+        TC_QUEUE queue(tc_modes[index].options);
+
+        /* the messages of a type can't share a byte ring */
+        if (tc_modes[index].options & MSG_Q_VARLEN) {
+            TC_CHECK(!queue.IsValid());
+            continue;
+        }
+
+        tc_send_recv(&queue, &queue, tc_modes[index].name, TC_COUNT);
+    }
+
+    /* the named queue is opened again as a peer process would */
+    {
+        TC_QUEUE queue(MSG_Q_SPSC, "typed");
+
+        opened = TC_QUEUE::Open("typed");
+        TC_CHECK(opened != NULL);
+        if (opened != NULL) {
+            tc_send_recv(&queue, opened, "named", TC_COUNT);
+            delete opened;
+        }
+
+        /* a queue of another type is refused */
+        wxTypedMessageQueue<long long, TC_DEPTH> * other =
+            wxTypedMessageQueue<long long, TC_DEPTH>::Open("typed");
+        TC_CHECK(other == NULL);
+        if (other != NULL)
+            delete other;
+    }
+
+    /* the rings of a few sizes of messages and of depths */
+    tc_layout<TC_POINT, TC_DEPTH>(MSG_Q_SPSC);
+    tc_layout<TC_POINT, TC_DEPTH>(MSG_Q_MPMC);
+    tc_layout<TC_SMALL, 5>(MSG_Q_SPSC);
+    tc_layout<TC_SMALL, 5>(MSG_Q_MPMC);
+    tc_layout<TC_LARGE, 3>(MSG_Q_SPSC);
+    tc_layout<TC_LARGE, 3>(MSG_Q_MPMC);
+
+    return tc_report("Typed");
+}
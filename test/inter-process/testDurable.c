@@ -0,0 +1,389 @@
+/**
+ * testDurable.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the recovery of a MSG_Q_DURABLE message queue on Linux.
+ *
+ * The messages of a durable queue must outlive the processes which had its
+ * file open. A process which reopens the file after all the others have gone
+ * must find the messages committed before, in their order and intact, the
+ * message it had peeked but not released yet, and none it had only reserved;
+ * a message torn in the file is dropped. A sending process is then killed at
+ * random points, and each time the file must give back an unbroken run of
+ * its messages and take as many messages as the queue has slots.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     32
+#define TC_MSG_LENGTH   48
+#define TC_ROUNDS       40
+#define TC_BATCH        4
+
+static char tc_path[64];
+
+/* fill a message with its sequence, so a torn message shows */
+static void tc_fill(char * msg, unsigned int seq) {
+    memcpy(msg, &seq, sizeof(seq));
+    memset(msg + sizeof(seq), (int)(seq & 0xff), TC_MSG_LENGTH - sizeof(seq));
+}
+
+/* check a message filled by tc_fill and return its sequence */
+static int tc_intact(const char * msg, UINT nBytes, unsigned int * pSeq) {
+    unsigned int seq = 0;
+    UINT index = 0;
+
+    if (nBytes != TC_MSG_LENGTH)
+        return 0;
+
+    memcpy(&seq, msg, sizeof(seq));
+    for (index = sizeof(seq); index < TC_MSG_LENGTH; index++) {
+        if ((unsigned char)msg[index] != (seq & 0xff))
+            return 0;
+    }
+
+    *pSeq = seq;
+    return 1;
+}
+
+/* send a message of a sequence */
+static int tc_send(MSG_Q_ID msgQId, unsigned int seq, int priority) {
+    char msg[TC_MSG_LENGTH];
+
+    tc_fill(msg, seq);
+    return msgQSend(msgQId, msg, TC_MSG_LENGTH, 0, priority);
+}
+
+/* receive a message, which must be of the sequence */
+static void tc_receive(MSG_Q_ID msgQId, unsigned int seq) {
+    char msg[TC_MSG_LENGTH];
+    unsigned int got = ~0U;
+
+    memset(msg, 0, sizeof(msg));
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+    TC_CHECK(tc_intact(msg, TC_MSG_LENGTH, &got) && got == seq);
+}
+
+/* wait for a child, which must have ended as told */
+static void tc_wait(pid_t pid, int killed) {
+    int status = 0;
+
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    if (killed)
+        TC_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+    else
+        TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* the queue recovered holds <msgNum> messages and no slot is lost */
+static void tc_depth(MSG_Q_ID msgQId, int msgNum) {
+    MSG_Q_STAT stat;
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.msgNum == msgNum);
+    TC_CHECK((stat.options & MSG_Q_DURABLE) != 0);
+}
+
+/* the messages and their levels outlive the handles */
+static void tc_reopen(void) {
+    MSG_Q_ID msgQId = NULL;
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_DURABLE,
+        tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    TC_CHECK(msgQSetSync(msgQId, 1) == 0);
+    TC_CHECK(tc_send(msgQId, 1, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(tc_send(msgQId, 2, MSG_PRI_LEVEL(5)) == 0);
+    TC_CHECK(tc_send(msgQId, 3, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(tc_send(msgQId, 4, MSG_PRI_URGENT) == 0);
+    TC_CHECK(tc_send(msgQId, 5, MSG_PRI_LEVEL(5)) == 0);
+    TC_CHECK(msgQSync(msgQId) == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+
+    /* msgQDelete leaves the file, the urgent message and level 5 go first */
+    TC_CHECK(access(tc_path, F_OK) == 0);
+    msgQId = msgQOpen(tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    tc_depth(msgQId, 5);
+    tc_receive(msgQId, 4);
+    tc_receive(msgQId, 2);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+
+    msgQId = msgQOpen(tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    tc_depth(msgQId, 3);
+    tc_receive(msgQId, 5);
+    tc_receive(msgQId, 1);
+    tc_receive(msgQId, 3);
+    tc_depth(msgQId, 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* a process dies holding a peeked message and a reserved slot */
+static void tc_crash(void) {
+    MSG_Q_ID msgQId = NULL;
+    const char * pBuffer = NULL;
+    char * pSlot = NULL;
+    UINT nBytes = 0;
+    unsigned int seq = 0;
+    int index = 0;
+    pid_t pid = 0;
+
+    pid = fork();
+    if (pid == 0) {
+        msgQId = msgQOpen(tc_path);
+        if (msgQId == NULL)
+            exit(1);
+
+        for (seq = 10; seq < 20; seq++) {
+            if (tc_send(msgQId, seq, MSG_PRI_NORMAL) != 0)
+                exit(1);
+        }
+
+        /* 10 and 11 are received, 12 is peeked */
+        if (msgQReceivePeek(msgQId, &pBuffer, &nBytes, 0) != 0 ||
+            msgQReceiveRelease(msgQId, pBuffer) != 0 ||
+            msgQReceivePeek(msgQId, &pBuffer, &nBytes, 0) != 0 ||
+            msgQReceiveRelease(msgQId, pBuffer) != 0 ||
+            msgQReceivePeek(msgQId, &pBuffer, &nBytes, 0) != 0)
+            exit(1);
+
+        /* a message built in a reserved slot is never sent */
+        if (msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pSlot) != 0)
+            exit(1);
+        tc_fill(pSlot, 99);
+
+        kill(getpid(), SIGKILL);
+        exit(1);
+    }
+
+    tc_wait(pid, 1);
+
+    msgQId = msgQOpen(tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* the peeked message is kept, the reserved one is dropped */
+    tc_depth(msgQId, 8);
+    for (seq = 12; seq < 20; seq++)
+        tc_receive(msgQId, seq);
+    tc_depth(msgQId, 0);
+
+    /* the slots of the peeked and the reserved message are free again */
+    for (index = 0; index < TC_MAX_MSGS; index++)
+        TC_CHECK(tc_send(msgQId, (unsigned int)index, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(tc_send(msgQId, 0, MSG_PRI_NORMAL) == -1);
+    for (index = 0; index < TC_MAX_MSGS; index++)
+        tc_receive(msgQId, (unsigned int)index);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* find the bytes of a message in the file */
+static char * tc_find(char * pFile, size_t size, const char * msg) {
+    size_t offset = 0;
+
+    for (offset = 0; offset + TC_MSG_LENGTH <= size; offset++) {
+        if (memcmp(pFile + offset, msg, TC_MSG_LENGTH) == 0)
+            return pFile + offset;
+    }
+
+    return NULL;
+}
+
+/* a message torn in the file is dropped, the others are kept */
+static void tc_torn(void) {
+    MSG_Q_ID msgQId = NULL;
+    char msg[TC_MSG_LENGTH];
+    char * pFile = NULL;
+    char * pFound = NULL;
+    struct stat st;
+    unsigned int seq = 0;
+    int fd = -1;
+
+    msgQId = msgQOpen(tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    for (seq = 1000; seq < 1003; seq++)
+        TC_CHECK(tc_send(msgQId, seq, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+
+    /* flip the last byte of the data of message 1001, sent only once */
+    tc_fill(msg, 1001);
+    fd = open(tc_path, O_RDWR);
+    TC_CHECK(fd >= 0 && fstat(fd, &st) == 0);
+    if (fd < 0)
+        return;
+
+    pFile = (char*)malloc((size_t)st.st_size);
+    TC_CHECK(pFile != NULL &&
+        pread(fd, pFile, (size_t)st.st_size, 0) == st.st_size);
+    if (pFile != NULL) {
+        pFound = tc_find(pFile, (size_t)st.st_size, msg);
+        TC_CHECK(pFound != NULL);
+        if (pFound != NULL) {
+            msg[TC_MSG_LENGTH - 1] ^= 0x5a;
+            TC_CHECK(pwrite(fd, msg, sizeof(msg), pFound - pFile) ==
+                (ssize_t)sizeof(msg));
+        }
+        free(pFile);
+    }
+    close(fd);
+
+    msgQId = msgQOpen(tc_path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    tc_depth(msgQId, 2);
+    tc_receive(msgQId, 1000);
+    tc_receive(msgQId, 1002);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* send and receive in a loop until killed */
+static void tc_worker(unsigned int seed, unsigned int seq) {
+    char msgs[TC_BATCH][TC_MSG_LENGTH];
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    char buffer[TC_BATCH * TC_MSG_LENGTH];
+    MSG_Q_ID msgQId = NULL;
+    int count = 0;
+    int index = 0;
+
+    msgQId = msgQOpen(tc_path);
+    if (msgQId == NULL)
+        exit(1);
+
+    for (;;) {
+        switch (rand_r(&seed) % 4) {
+        case 0:
+            if (tc_send(msgQId, seq, MSG_PRI_NORMAL) == 0)
+                seq++;
+            break;
+        case 1:
+            for (index = 0; index < TC_BATCH; index++) {
+                tc_fill(msgs[index], seq + (unsigned int)index);
+                buffers[index] = msgs[index];
+                lengths[index] = TC_MSG_LENGTH;
+            }
+            count = msgQSendBatch(msgQId, buffers, lengths, TC_BATCH, 0,
+                MSG_PRI_NORMAL);
+            if (count > 0)
+                seq += (unsigned int)count;
+            break;
+        case 2:
+            msgQReceive(msgQId, buffer, TC_MSG_LENGTH, 0);
+            break;
+        default:
+            msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+                TC_BATCH, 0);
+            break;
+        }
+    }
+}
+
+/* kill a sending and receiving process at random, the file recovers */
+static void tc_rounds(void) {
+    MSG_Q_ID msgQId = NULL;
+    char msg[TC_MSG_LENGTH];
+    unsigned int seed = 1;
+    unsigned int seq = 0;
+    unsigned int last = 0;
+    int round = 0;
+    int count = 0;
+    int index = 0;
+    int failures = tc_failures;
+    pid_t pid = 0;
+
+    for (round = 0; round < TC_ROUNDS; round++) {
+        pid = fork();
+        if (pid == 0)
+            tc_worker(rand_r(&seed), (unsigned int)round << 20);
+
+        usleep(rand_r(&seed) % 20000);
+        kill(pid, SIGKILL);
+        tc_wait(pid, 1);
+
+        msgQId = msgQOpen(tc_path);
+        TC_CHECK(msgQId != NULL);
+        if (msgQId == NULL)
+            return;
+
+        /* the messages left are a run of the last ones sent, in order */
+        count = 0;
+        while (msgQReceive(msgQId, msg, sizeof(msg), 0) == 0) {
+            if (!tc_intact(msg, TC_MSG_LENGTH, &seq) ||
+                (seq >> 20) != (unsigned int)round ||
+                (count > 0 && seq != last + 1)) {
+                TC_CHECK(0);
+                break;
+            }
+            last = seq;
+            count++;
+        }
+        TC_CHECK(count <= TC_MAX_MSGS);
+        tc_depth(msgQId, 0);
+
+        tc_fill(msg, 0);
+        for (index = 0; index < TC_MAX_MSGS; index++) {
+            TC_CHECK(msgQSend(msgQId, msg, TC_MSG_LENGTH, 0,
+                MSG_PRI_NORMAL) == 0);
+        }
+        TC_CHECK(msgQSend(msgQId, msg, TC_MSG_LENGTH, 0,
+            MSG_PRI_NORMAL) == -1);
+        for (index = 0; index < TC_MAX_MSGS; index++)
+            TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+
+        TC_CHECK(msgQDelete(msgQId) == 0);
+
+        if (tc_failures != failures) {
+            printf("  round %d failed\n", round);
+            failures = tc_failures;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    sprintf(tc_path, "/tmp/tc.durable.%d", (int)getpid());
+    unlink(tc_path);
+
+    tc_reopen();
+    tc_crash();
+    tc_torn();
+    tc_rounds();
+
+    unlink(tc_path);
+
+    return tc_report("Durable");
+}
@@ -0,0 +1,184 @@
+/**
+ * testHugePage.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the named message queues backed by huge pages on Linux.
+ *
+ * A name must refer to a single queue however its creators ask for the
+ * pages: a process which creates a name with MSG_Q_HUGEPAGE after another
+ * has created it with the regular pages must attach to that queue, and the
+ * other way round, also when several processes create the name at once
+ * with and without the option. The queue gets the huge pages only where a
+ * hugetlbfs is mounted with free pages, otherwise it falls back, which the
+ * checks allow for.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     64
+#define TC_MSG_LENGTH   64
+#define TC_CREATORS     8
+
+/* wait for a child and count its failures */
+static void tc_wait(pid_t pid) {
+    int status = 0;
+
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+static const char * tc_self = NULL;
+
+/* create the name with other options, it must find the message */
+static int tc_second(const char * name, int options, UINT pageSize) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    char buf[TC_MSG_LENGTH];
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, options, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId != NULL) {
+        TC_CHECK(msgQStat(msgQId, &stat) == 0);
+        TC_CHECK(stat.msgNum == 1 && stat.pageSize == pageSize);
+        TC_CHECK(msgQReceive(msgQId, buf, sizeof(buf), 0) == 0);
+        TC_CHECK(strcmp(buf, "first") == 0);
+        TC_CHECK(msgQSend(msgQId, "second", 7, 0, MSG_PRI_NORMAL) == 0);
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    return tc_failures == 0 ? 0 : 1;
+}
+
+/* run tc_second in a new process, which has no handle of the name cached */
+static void tc_spawn(const char * name, int options, UINT pageSize) {
+    char strOptions[16];
+    char strPageSize[16];
+    pid_t pid = 0;
+
+    sprintf(strOptions, "%d", options);
+    sprintf(strPageSize, "%u", pageSize);
+
+    pid = fork();
+    if (pid == 0) {
+        execl(tc_self, tc_self, "second", name, strOptions, strPageSize,
+            (char*)NULL);
+        exit(1);
+    }
+
+    tc_wait(pid);
+}
+
+/* a name created first with <first> and then with <second> */
+static void tc_order(const char * name, int first, int second) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID opened = NULL;
+    MSG_Q_STAT stat;
+    char buf[TC_MSG_LENGTH];
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, first, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    TC_CHECK(msgQSend(msgQId, "first", 6, 0, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    printf("%s: %u bytes pages\n", name, stat.pageSize);
+    if ((first & MSG_Q_HUGEPAGE) == 0)
+        TC_CHECK(stat.pageSize == (UINT)sysconf(_SC_PAGESIZE));
+
+    tc_spawn(name, second, stat.pageSize);
+
+    /* the message of the child was sent to the same queue */
+    TC_CHECK(msgQReceive(msgQId, buf, sizeof(buf), 0) == 0);
+    TC_CHECK(strcmp(buf, "second") == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+
+    /* the last handle has removed the name */
+    opened = msgQOpen(name);
+    TC_CHECK(opened == NULL);
+    if (opened != NULL)
+        msgQDelete(opened);
+}
+
+/* several processes create a name at once, with and without huge pages */
+static void tc_race(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    pid_t pids[TC_CREATORS];
+    int ready[2];
+    int leave[2];
+    char c = 0;
+    int index = 0;
+
+    TC_CHECK(pipe(ready) == 0 && pipe(leave) == 0);
+
+    for (index = 0; index < TC_CREATORS; index++) {
+        pids[index] = fork();
+        if (pids[index] == 0) {
+            /* the children hold the queue until the parent has counted */
+            msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH,
+                (index & 1) ? MSG_Q_HUGEPAGE : MSG_Q_FIFO, name);
+            if (msgQId == NULL ||
+                msgQSend(msgQId, "race", 5, 0, MSG_PRI_NORMAL) != 0)
+                exit(1);
+            if (write(ready[1], "r", 1) != 1 || read(leave[0], &c, 1) != 1)
+                exit(1);
+            msgQDelete(msgQId);
+            exit(0);
+        }
+    }
+
+    for (index = 0; index < TC_CREATORS; index++)
+        TC_CHECK(read(ready[0], &c, 1) == 1);
+
+    /* every creator has sent to the one queue of the name */
+    msgQId = msgQOpen(name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId != NULL) {
+        TC_CHECK(msgQStat(msgQId, &stat) == 0);
+        TC_CHECK(stat.msgNum == TC_CREATORS);
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    for (index = 0; index < TC_CREATORS; index++)
+        TC_CHECK(write(leave[1], "l", 1) == 1);
+    for (index = 0; index < TC_CREATORS; index++)
+        tc_wait(pids[index]);
+
+    close(ready[0]);
+    close(ready[1]);
+    close(leave[0]);
+    close(leave[1]);
+}
+
+int main(int argc, char **argv) {
+    int round = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_self = argv[0];
+    if (argc == 5 && strcmp(argv[1], "second") == 0)
+        return tc_second(argv[2], atoi(argv[3]), (UINT)atoi(argv[4]));
+
+    tc_order("tc.huge.plain", MSG_Q_FIFO, MSG_Q_HUGEPAGE);
+    tc_order("tc.huge.huge", MSG_Q_HUGEPAGE, MSG_Q_FIFO);
+    tc_order("tc.huge.both", MSG_Q_HUGEPAGE, MSG_Q_HUGEPAGE);
+
+    for (round = 0; round < 20; round++)
+        tc_race("tc.huge.race");
+
+    return tc_report("HugePage");
+}
@@ -0,0 +1,298 @@
+/**
+ * testLazyInit.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the lazy set up of the nodes of a queue on Linux.
+ *
+ * A queue of a million slots must be created about as fast as a queue of a
+ * few, in each mode, and hold no more resident pages than a few slots need
+ * until its messages touch them; all of its slots are still usable. The
+ * nodes of the FIFO and PRIORITY modes are handed out first below a mark and
+ * recycled after, so sends, receives, reservations and peeks interleaved
+ * across the mark must keep every message and the capacity of the queue,
+ * also when another process opens a named queue again.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_SMALL_MSGS   16
+#define TC_LARGE_MSGS   (1 << 20)
+#define TC_MSG_LENGTH   16
+#define TC_MAX_MSGS     4
+#define TC_TIMES        5
+
+/* the microseconds of the monotonic clock */
+static long long tc_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the resident bytes of the process */
+static long long tc_resident(void) {
+    FILE * fp = NULL;
+    long long size = 0;
+    long long resident = 0;
+
+    fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL)
+        return -1;
+    if (fscanf(fp, "%lld %lld", &size, &resident) != 2)
+        resident = -1;
+    fclose(fp);
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* the shortest time to create and delete a queue of some slots */
+static long long tc_create_time(int maxMsgs, int options) {
+    MSG_Q_ID msgQId = NULL;
+    long long best = -1;
+    long long start = 0;
+    int index = 0;
+
+    for (index = 0; index < TC_TIMES; index++) {
+        start = tc_now();
+        msgQId = msgQCreate(maxMsgs, TC_MSG_LENGTH, options);
+        if (msgQId == NULL)
+            return -1;
+        if (best == -1 || tc_now() - start < best)
+            best = tc_now() - start;
+        msgQDelete(msgQId);
+    }
+
+    return best;
+}
+
+/* send a message carrying its sequence */
+static int tc_send(MSG_Q_ID msgQId, int seq) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, seq & 0xff, sizeof(msg));
+    memcpy(msg, &seq, sizeof(seq));
+    return msgQSend(msgQId, msg, sizeof(msg), 0, MSG_PRI_NORMAL);
+}
+
+/* check a message sent by tc_send */
+static int tc_intact(const char * msg, int seq) {
+    int index = 0;
+
+    if (memcmp(msg, &seq, sizeof(seq)) != 0)
+        return 0;
+    for (index = sizeof(seq); index < TC_MSG_LENGTH; index++) {
+        if ((unsigned char)msg[index] != (seq & 0xff))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* receive the message of a sequence */
+static int tc_receive(MSG_Q_ID msgQId, int seq) {
+    char msg[TC_MSG_LENGTH];
+
+    return msgQReceive(msgQId, msg, sizeof(msg), 0) == 0 &&
+        tc_intact(msg, seq);
+}
+
+/* a queue of a million slots is created fast and stays small */
+static void tc_large(int options) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    long long small = 0;
+    long long large = 0;
+    long long resident = 0;
+    long long bytes = (long long)TC_LARGE_MSGS * TC_MSG_LENGTH;
+    int maxMsgs = (options & MSG_Q_VARLEN) ? (int)bytes : TC_LARGE_MSGS;
+    int seq = 0;
+    int bad = 0;
+
+    /* the set up doesn't depend on the number of slots */
+    small = tc_create_time((options & MSG_Q_VARLEN) ?
+        TC_SMALL_MSGS * TC_MSG_LENGTH : TC_SMALL_MSGS, options);
+    large = tc_create_time(maxMsgs, options);
+    TC_CHECK(small >= 0 && large >= 0);
+    TC_CHECK(large < 10 * small + 1000);
+
+    /* the slots take no pages until they are used */
+    resident = tc_resident();
+    msgQId = msgQCreate(maxMsgs, TC_MSG_LENGTH, options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(tc_resident() - resident < bytes / 16);
+
+    /* a message at a time keeps to the same few slots */
+    for (seq = 0; seq < TC_SMALL_MSGS * 64; seq++) {
+        if (tc_send(msgQId, seq) != 0 || !tc_receive(msgQId, seq))
+            bad++;
+    }
+    TC_CHECK(bad == 0);
+    TC_CHECK(tc_resident() - resident < bytes / 16);
+
+    /* every slot can hold a message, up to the last one */
+    if ((options & MSG_Q_VARLEN) == 0) {
+        for (seq = 0; seq < TC_LARGE_MSGS; seq++) {
+            if (tc_send(msgQId, seq) != 0)
+                bad++;
+        }
+        TC_CHECK(tc_send(msgQId, seq) == -1);
+        TC_CHECK(msgQStat(msgQId, &stat) == 0);
+        TC_CHECK(stat.msgNum == TC_LARGE_MSGS);
+        for (seq = 0; seq < TC_LARGE_MSGS; seq++) {
+            if (!tc_receive(msgQId, seq))
+                bad++;
+        }
+        TC_CHECK(bad == 0);
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* the nodes handed out below the mark and recycled keep the capacity */
+static void tc_mark(MSG_Q_ID msgQId, int * pSeq, int * pNext) {
+    char msg[TC_MSG_LENGTH];
+    char * pBuffer = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int index = 0;
+
+    /* a reserved node and a sent one are taken from the mark */
+    TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pBuffer) == 0);
+    TC_CHECK(tc_send(msgQId, (*pSeq)++) == 0);
+
+    /* the peeked node is held until it is released */
+    TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+    TC_CHECK(pMsg != NULL && tc_intact(pMsg, (*pNext)++));
+
+    /* the reserved node is committed, the others are taken from the mark */
+    if (pBuffer != NULL) {
+        memset(pBuffer, *pSeq & 0xff, TC_MSG_LENGTH);
+        memcpy(pBuffer, pSeq, sizeof(*pSeq));
+        (*pSeq)++;
+        TC_CHECK(msgQSendCommit(msgQId, pBuffer, TC_MSG_LENGTH,
+            MSG_PRI_NORMAL) == 0);
+    }
+    for (index = 2; index < TC_MAX_MSGS; index++)
+        TC_CHECK(tc_send(msgQId, (*pSeq)++) == 0);
+
+    /* the peeked node still holds a slot */
+    TC_CHECK(tc_send(msgQId, *pSeq) == -1);
+    TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+
+    /* the released node is recycled, then a received one */
+    TC_CHECK(tc_send(msgQId, (*pSeq)++) == 0);
+    TC_CHECK(tc_send(msgQId, *pSeq) == -1);
+    TC_CHECK(tc_receive(msgQId, (*pNext)++));
+    TC_CHECK(tc_send(msgQId, (*pSeq)++) == 0);
+    TC_CHECK(tc_send(msgQId, *pSeq) == -1);
+
+    /* the queue drains in order */
+    while (*pNext < *pSeq)
+        TC_CHECK(tc_receive(msgQId, (*pNext)++));
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == -1);
+}
+
+/* the nodes of an inter-thread queue across the mark */
+static void tc_nodes(int options) {
+    MSG_Q_ID msgQId = NULL;
+    int seq = 0;
+    int next = 0;
+    int round = 0;
+
+    msgQId = msgQCreate(TC_MAX_MSGS, TC_MSG_LENGTH, options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* the first round hands the nodes out, the next ones recycle them */
+    for (round = 0; round < 3; round++)
+        tc_mark(msgQId, &seq, &next);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* a named queue opened again by another process keeps its nodes */
+static void tc_reopen(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID other = NULL;
+    pid_t pid = 0;
+    int status = 0;
+    int seq = 0;
+    int next = 0;
+    int filled = 0;
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* some nodes are recycled, some are below the mark, some above it */
+    TC_CHECK(tc_send(msgQId, seq++) == 0);
+    TC_CHECK(tc_send(msgQId, seq++) == 0);
+    TC_CHECK(tc_receive(msgQId, next++));
+
+    /* the creator's name opened again must not set the queue up again */
+    other = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(other == msgQId);
+    if (other != NULL)
+        TC_CHECK(msgQDelete(other) == 0);
+
+    /* another process fills the queue */
+    pid = fork();
+    if (pid == 0) {
+        other = msgQOpen(name);
+        if (other == NULL)
+            exit(1);
+        while (tc_send(other, seq) == 0)
+            seq++;
+        msgQDelete(other);
+        exit(seq == TC_MAX_MSGS + 1 ? 0 : 2);
+    }
+
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* and another round across the mark from here */
+    while (tc_receive(msgQId, next))
+        next++, filled++;
+    TC_CHECK(next == TC_MAX_MSGS + 1 && filled == TC_MAX_MSGS);
+    seq = next;
+    tc_mark(msgQId, &seq, &next);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+        tc_large(tc_modes[index].options);
+        /* the rings and the byte ring don't take nodes from a mark */
+        if ((tc_modes[index].options &
+            (MSG_Q_SPSC | MSG_Q_MPMC | MSG_Q_VARLEN)) == 0)
+            tc_nodes(tc_modes[index].options);
+    }
+
+    tc_reopen("tc.lazy.reopen");
+
+    return tc_report("LazyInit");
+}
@@ -0,0 +1,225 @@
+/**
+ * testOwnerDeath.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the repair of a named message queue after the death of
+ * its tasks on Linux.
+ *
+ * Producer and consumer processes send and receive on a named queue of 64
+ * slots, one message or a batch at a time, with and without a timeout, and
+ * are killed with SIGKILL at random points, in the mutex, in the wait list or
+ * anywhere between. After each round the queue must hold as many messages as
+ * it counts, each one intact, and take as many messages as it has slots: no
+ * semaphore unit may be lost with a dead task.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     64
+#define TC_MSG_LENGTH   16
+#define TC_PRODUCERS    2
+#define TC_CONSUMERS    2
+#define TC_TASKS        (TC_PRODUCERS + TC_CONSUMERS)
+#define TC_ROUNDS       40
+#define TC_KILLS        8
+#define TC_BATCH        4
+
+/* fill a message with its sequence, so a torn message shows */
+static void tc_fill(char * msg, unsigned int seq) {
+    memcpy(msg, &seq, sizeof(seq));
+    memset(msg + sizeof(seq), (int)(seq & 0xff), TC_MSG_LENGTH - sizeof(seq));
+}
+
+/* check a message filled by tc_fill */
+static int tc_intact(const char * msg, UINT nBytes) {
+    unsigned int seq = 0;
+    UINT index = 0;
+
+    if (nBytes != TC_MSG_LENGTH)
+        return 0;
+
+    memcpy(&seq, msg, sizeof(seq));
+    for (index = sizeof(seq); index < TC_MSG_LENGTH; index++) {
+        if ((unsigned char)msg[index] != (seq & 0xff))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* send until killed */
+static void tc_producer(MSG_Q_ID msgQId, unsigned int seed) {
+    char msgs[TC_BATCH][TC_MSG_LENGTH];
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    unsigned int seq = seed << 16;
+    int index = 0;
+
+    for (;;) {
+        int timeout = (rand_r(&seed) & 1) ? WAIT_FOREVER : 5;
+
+        if (rand_r(&seed) & 1) {
+            tc_fill(msgs[0], seq++);
+            msgQSend(msgQId, msgs[0], TC_MSG_LENGTH, timeout,
+                MSG_PRI_NORMAL);
+            continue;
+        }
+
+        for (index = 0; index < TC_BATCH; index++) {
+            tc_fill(msgs[index], seq++);
+            buffers[index] = msgs[index];
+            lengths[index] = TC_MSG_LENGTH;
+        }
+        msgQSendBatch(msgQId, buffers, lengths, TC_BATCH, timeout,
+            MSG_PRI_NORMAL);
+    }
+}
+
+/* receive until killed, a torn message ends the task with an error */
+static void tc_consumer(MSG_Q_ID msgQId, unsigned int seed) {
+    char buffer[TC_BATCH * TC_MSG_LENGTH];
+    UINT lengths[TC_BATCH];
+    UINT bufSize = 0;
+    int count = 0;
+    int index = 0;
+
+    for (;;) {
+        int timeout = (rand_r(&seed) & 1) ? WAIT_FOREVER : 5;
+
+        if (rand_r(&seed) & 1) {
+            if (msgQReceive(msgQId, buffer, TC_MSG_LENGTH, timeout) == 0 &&
+                !tc_intact(buffer, TC_MSG_LENGTH))
+                exit(1);
+            continue;
+        }
+
+        /* a buffer short of the batch gives the messages left back */
+        bufSize = (rand_r(&seed) & 1) ? sizeof(buffer) :
+            sizeof(buffer) - TC_MSG_LENGTH;
+        count = msgQReceiveBatch(msgQId, buffer, bufSize, lengths,
+            TC_BATCH, timeout);
+        for (index = 0; index < count; index++) {
+            if (!tc_intact(buffer + index * TC_MSG_LENGTH, lengths[index]))
+                exit(1);
+        }
+    }
+}
+
+/* start a producer or a consumer */
+static pid_t tc_start(MSG_Q_ID msgQId, int task, unsigned int seed) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        if (task < TC_PRODUCERS)
+            tc_producer(msgQId, seed);
+        else
+            tc_consumer(msgQId, seed);
+        exit(0);
+    }
+
+    TC_CHECK(pid > 0);
+    return pid;
+}
+
+/* kill a task, which must not have ended by itself */
+static void tc_kill(pid_t pid) {
+    int status = 0;
+
+    kill(pid, SIGKILL);
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+}
+
+/* the queue holds what it counts and takes as many messages as it has slots */
+static void tc_settle(MSG_Q_ID msgQId) {
+    char buffer[TC_MSG_LENGTH];
+    MSG_Q_STAT stat;
+    int count = 0;
+    int index = 0;
+
+    /* the first receive repairs the queue, the counts are read after it */
+    while (msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0) {
+        TC_CHECK(tc_intact(buffer, TC_MSG_LENGTH));
+        count++;
+    }
+    TC_CHECK(count <= TC_MAX_MSGS);
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.msgNum == 0);
+
+    tc_fill(buffer, 0);
+    for (index = 0; index < TC_MAX_MSGS; index++) {
+        TC_CHECK(msgQSend(msgQId, buffer, TC_MSG_LENGTH, 0,
+            MSG_PRI_NORMAL) == 0);
+    }
+    TC_CHECK(msgQSend(msgQId, buffer, TC_MSG_LENGTH, 0,
+        MSG_PRI_NORMAL) == -1);
+
+    for (index = 0; index < TC_MAX_MSGS; index++) {
+        TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0);
+    }
+    TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == -1);
+}
+
+/* kill the producers and the consumers of a queue at random for the rounds */
+static void tc_rounds(const char * name, int options) {
+    MSG_Q_ID msgQId = NULL;
+    pid_t pids[TC_TASKS];
+    unsigned int seed = (unsigned int)options + 1;
+    int round = 0;
+    int kills = 0;
+    int task = 0;
+    int failures = tc_failures;
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, options, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    for (round = 0; round < TC_ROUNDS; round++) {
+        for (task = 0; task < TC_TASKS; task++)
+            pids[task] = tc_start(msgQId, task, rand_r(&seed));
+
+        for (kills = 0; kills < TC_KILLS; kills++) {
+            usleep(rand_r(&seed) % 5000);
+            task = rand_r(&seed) % TC_TASKS;
+            tc_kill(pids[task]);
+            pids[task] = tc_start(msgQId, task, rand_r(&seed));
+        }
+
+        usleep(rand_r(&seed) % 5000);
+        for (task = 0; task < TC_TASKS; task++)
+            tc_kill(pids[task]);
+
+        tc_settle(msgQId);
+
+        if (tc_failures != failures) {
+            printf("  %s: round %d failed\n", name, round);
+            failures = tc_failures;
+        }
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_rounds("tc.death.fifo", MSG_Q_FIFO);
+    tc_rounds("tc.death.priority", MSG_Q_PRIORITY);
+
+    return tc_report("OwnerDeath");
+}
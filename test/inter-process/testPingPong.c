@@ -0,0 +1,408 @@
+/**
+ * testPingPong.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Round-trip latency benchmark of the message queue between two processes.
+ *
+ *     PingPong.exe [ping|pong] [-n iterations] [-w warmup] [-s size]
+ *                  [-q depth] [-m fifo|spsc|mpmc|varlen]
+ *                  [-c cpu] [-C cpu] [-H]
+ *
+ * The ping process sends a message stamped with the time and its sequence to
+ * the named queue "pingpong.req", the pong process sends it back unchanged to
+ * "pingpong.rsp", and the ping takes the time of the round trip when it comes
+ * back. After the warmup iterations, every round trip is kept and the full
+ * distribution is printed: the mean and the percentiles up to p99.99 and, with
+ * -H, the round trips counted by powers of two of nanoseconds.
+ *
+ * Without a role, the program starts the pong process itself with the same
+ * options; run "pong" and "ping" by hand to place the processes otherwise.
+ * -c pins the ping process to a CPU, -C the pong process, and -m selects the
+ * mode of the queues, so each path through the shared memory can be timed.
+ *
+ * NOTE: The message queue manipulation functions in this file are similar
+ * with the Wind River VxWorks kernel message queue interfaces.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
+#endif
+#include "msgQueue.h"
+
+#define PP_REQUEST      "pingpong.req"  /* queue from the ping to the pong */
+#define PP_RESPONSE     "pingpong.rsp"  /* queue from the pong to the ping */
+#define PP_OPEN_WAIT    5000            /* milliseconds to find the queues */
+#define PP_QUIT         -1              /* sequence stopping the pong */
+
+/* the head of a message, the rest up to the size is padding */
+typedef struct tagPP_MSG {
+    long long stamp;
+    int seq;
+    int pad;
+}PP_MSG;
+
+/* the options of both processes */
+typedef struct tagPP_OPTIONS {
+    int iterations;
+    int warmup;
+    int size;
+    int depth;
+    int options;
+    int pingCpu;
+    int pongCpu;
+    int histogram;
+}PP_OPTIONS;
+
+/* nanoseconds since an arbitrary point, the same for all the processes */
+static long long pp_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (long long)(count.QuadPart / freq.QuadPart) * 1000000000LL +
+        (long long)(count.QuadPart % freq.QuadPart) * 1000000000LL /
+        freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+/* sleep some milliseconds */
+static void pp_sleep(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+/* pin the calling process to a CPU, if one is given */
+static void pp_pin(int cpu) {
+#ifdef _WIN32
+    if (cpu >= 0)
+        SetProcessAffinityMask(GetCurrentProcess(), (DWORD_PTR)1 << cpu);
+#else
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        printf("pin to CPU %d failed in %s.\n", cpu, __func__);
+#endif
+}
+
+/* open a queue of the other process, or create it if it is the first */
+static MSG_Q_ID pp_queue(const char * name, PP_OPTIONS * pOptions) {
+    MSG_Q_ID msgQId = msgQOpen(name);
+    int maxMsgs = pOptions->depth;
+
+    if (msgQId != NULL)
+        return msgQId;
+
+    /* the depth of a byte ring is in messages with their headers */
+    if (pOptions->options & MSG_Q_VARLEN)
+        maxMsgs = pOptions->depth * (pOptions->size + 16);
+
+    msgQId = msgQCreateEx(maxMsgs, pOptions->size, pOptions->options, name);
+    if (msgQId == NULL)
+        msgQId = msgQOpen(name);
+
+    return msgQId;
+}
+
+/* sort the round trips */
+static int pp_compare(const void * p1, const void * p2) {
+    long long t1 = *(const long long*)p1;
+    long long t2 = *(const long long*)p2;
+
+    return t1 < t2 ? -1 : t1 > t2;
+}
+
+/* print the distribution of the round trips */
+static void pp_report(long long * trips, int count, PP_OPTIONS * pOptions) {
+    static const int permyriad[] = {0, 1000, 5000, 9000, 9900, 9990, 9999};
+    static const char * names[] = {"min", "p10", "p50", "p90", "p99",
+        "p99.9", "p99.99"};
+    double sum = 0.0;
+    long long low = 0;
+    int bucket = 0;
+    int index = 0;
+    int start = 0;
+    int end = 0;
+
+    qsort(trips, count, sizeof(long long), pp_compare);
+    for (index = 0; index < count; index++)
+        sum += (double)trips[index];
+
+    printf("round trips: %d of %d bytes, %d warmup\n", count,
+        pOptions->size, pOptions->warmup);
+    printf("mean         %12.0f ns\n", sum / count);
+    for (index = 0; index < (int)(sizeof(permyriad) / sizeof(int)); index++) {
+        printf("%-12s %12lld ns\n", names[index],
+            trips[(int)((long long)(count - 1) * permyriad[index] / 10000)]);
+    }
+    printf("max          %12lld ns\n", trips[count - 1]);
+
+    if (!pOptions->histogram)
+        return;
+
+    /* the round trips counted by powers of two of nanoseconds */
+    printf("\n%12s %12s %12s %8s\n", "from_ns", "to_ns", "count", "percent");
+    for (bucket = 0, start = 0; start < count; bucket++) {
+        low = bucket == 0 ? 0 : 1LL << bucket;
+        for (end = start; end < count && trips[end] < (2LL << bucket); end++)
+            ;
+        if (end > start) {
+            printf("%12lld %12lld %12d %7.3f%%\n", low, (2LL << bucket) - 1,
+                end - start, 100.0 * (end - start) / count);
+        }
+        start = end;
+    }
+}
+
+/* send the messages back until the quit */
+static int pp_pong(PP_OPTIONS * pOptions) {
+    MSG_Q_ID request = NULL;
+    MSG_Q_ID response = NULL;
+    PP_MSG * pMsg = NULL;
+    long long start = pp_now();
+    int result = 0;
+
+    pp_pin(pOptions->pongCpu);
+
+    /* the ping may not have created the queues yet */
+    while ((request = pp_queue(PP_REQUEST, pOptions)) == NULL ||
+        (response = pp_queue(PP_RESPONSE, pOptions)) == NULL) {
+        if (request != NULL)
+            msgQDelete(request);
+        if (pp_now() - start > PP_OPEN_WAIT * 1000000LL) {
+            printf("open message queues failed in %s.\n", __func__);
+            return -1;
+        }
+        pp_sleep(10);
+    }
+
+    pMsg = (PP_MSG*)calloc(1, pOptions->size);
+    if (pMsg == NULL) {
+        printf("allocate memory failed in %s.\n", __func__);
+        result = -1;
+    }
+
+    while (pMsg != NULL) {
+        if (msgQReceive(request, (char*)pMsg, pOptions->size,
+            WAIT_FOREVER) != 0) {
+            printf("receive message failed in %s.\n", __func__);
+            result = -1;
+            break;
+        }
+        if (pMsg->seq == PP_QUIT)
+            break;
+        if (msgQSend(response, (char*)pMsg, pOptions->size, WAIT_FOREVER,
+            MSG_PRI_NORMAL) != 0) {
+            printf("send message failed in %s.\n", __func__);
+            result = -1;
+            break;
+        }
+    }
+
+    free(pMsg);
+    msgQDelete(response);
+    msgQDelete(request);
+
+    return result;
+}
+
+/* bounce the messages and time the round trips */
+static int pp_ping(PP_OPTIONS * pOptions) {
+    MSG_Q_ID request = NULL;
+    MSG_Q_ID response = NULL;
+    PP_MSG * pMsg = NULL;
+    long long * trips = NULL;
+    int total = pOptions->warmup + pOptions->iterations;
+    int result = 0;
+    int i = 0;
+
+    pp_pin(pOptions->pingCpu);
+
+    request = pp_queue(PP_REQUEST, pOptions);
+    response = pp_queue(PP_RESPONSE, pOptions);
+    pMsg = (PP_MSG*)calloc(1, pOptions->size);
+    trips = (long long*)malloc(sizeof(long long) * pOptions->iterations);
+    if (request == NULL || response == NULL || pMsg == NULL ||
+        trips == NULL) {
+        printf("prepare message queues failed in %s.\n", __func__);
+        result = -1;
+        goto Exit;
+    }
+
+    for (i = 0; i < total; i++) {
+        pMsg->seq = i;
+        pMsg->stamp = pp_now();
+        if (msgQSend(request, (char*)pMsg, pOptions->size, WAIT_FOREVER,
+            MSG_PRI_NORMAL) != 0 ||
+            msgQReceive(response, (char*)pMsg, pOptions->size,
+            WAIT_FOREVER) != 0) {
+            printf("round trip %d failed in %s.\n", i, __func__);
+            result = -1;
+            break;
+        }
+        if (pMsg->seq != i) {
+            printf("round trip %d got %d in %s.\n", i, pMsg->seq, __func__);
+            result = -1;
+            break;
+        }
+        if (i >= pOptions->warmup)
+            trips[i - pOptions->warmup] = pp_now() - pMsg->stamp;
+    }
+
+    /* stop the pong */
+    pMsg->seq = PP_QUIT;
+    msgQSend(request, (char*)pMsg, pOptions->size, WAIT_FOREVER,
+        MSG_PRI_NORMAL);
+
+    if (result == 0)
+        pp_report(trips, pOptions->iterations, pOptions);
+
+Exit:
+    free(trips);
+    free(pMsg);
+    if (response != NULL)
+        msgQDelete(response);
+    if (request != NULL)
+        msgQDelete(request);
+
+    return result;
+}
+
+static void pp_usage(void) {
+    fprintf(stderr, "usage: PingPong.exe [ping|pong] [-n iterations] "
+        "[-w warmup] [-s size]\n"
+        "                    [-q depth] [-m fifo|spsc|mpmc|varlen] "
+        "[-c cpu] [-C cpu] [-H]\n");
+}
+
+int main(int argc, char **argv) {
+    PP_OPTIONS options = {1000000, 10000, 64, 16, MSG_Q_FIFO, -1, -1, 0};
+    const char * role = NULL;
+    int index = 1;
+    int result = 0;
+#ifdef _WIN32
+    intptr_t pong = 0;
+    char ** pongArgv = NULL;
+#else
+    pid_t pong = 0;
+    int status = 0;
+#endif
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    if (index < argc && argv[index][0] != '-')
+        role = argv[index++];
+
+    for (; index < argc; index++) {
+        if (strcmp(argv[index], "-H") == 0) {
+            options.histogram = 1;
+            continue;
+        }
+        if (index + 1 == argc || argv[index][0] != '-' ||
+            argv[index][2] != '\0') {
+            pp_usage();
+            return 1;
+        }
+        switch (argv[index++][1]) {
+        case 'n': options.iterations = atoi(argv[index]); break;
+        case 'w': options.warmup = atoi(argv[index]); break;
+        case 's': options.size = atoi(argv[index]); break;
+        case 'q': options.depth = atoi(argv[index]); break;
+        case 'c': options.pingCpu = atoi(argv[index]); break;
+        case 'C': options.pongCpu = atoi(argv[index]); break;
+        case 'm':
+            if (strcmp(argv[index], "fifo") == 0)
+                options.options = MSG_Q_FIFO;
+            else if (strcmp(argv[index], "spsc") == 0)
+                options.options = MSG_Q_SPSC;
+            else if (strcmp(argv[index], "mpmc") == 0)
+                options.options = MSG_Q_MPMC;
+            else if (strcmp(argv[index], "varlen") == 0)
+                options.options = MSG_Q_VARLEN;
+            else {
+                pp_usage();
+                return 1;
+            }
+            break;
+        default: pp_usage(); return 1;
+        }
+    }
+
+    if (options.iterations <= 0 || options.warmup < 0 ||
+        options.depth <= 0 || options.size < (int)sizeof(PP_MSG) ||
+        (role != NULL && strcmp(role, "ping") != 0 &&
+        strcmp(role, "pong") != 0)) {
+        pp_usage();
+        return 1;
+    }
+
+    if (role != NULL && strcmp(role, "pong") == 0)
+        return pp_pong(&options) == 0 ? 0 : 1;
+
+    if (role != NULL)
+        return pp_ping(&options) == 0 ? 0 : 1;
+
+    /* start the pong with the same options */
+#ifdef _WIN32
+    pongArgv = (char**)malloc(sizeof(char*) * (argc + 2));
+    if (pongArgv == NULL)
+        return 1;
+    pongArgv[0] = argv[0];
+    pongArgv[1] = "pong";
+    memcpy(&pongArgv[2], &argv[1], sizeof(char*) * argc);
+    pong = _spawnv(_P_NOWAIT, argv[0], (const char * const *)pongArgv);
+    free(pongArgv);
+    if (pong == -1) {
+        printf("start the pong process failed in %s.\n", __func__);
+        return 1;
+    }
+    result = pp_ping(&options);
+    _cwait(NULL, pong, 0);
+#else
+    pong = fork();
+    if (pong == -1) {
+        printf("start the pong process failed in %s.\n", __func__);
+        return 1;
+    }
+    if (pong == 0)
+        return pp_pong(&options) == 0 ? 0 : 1;
+    result = pp_ping(&options);
+    waitpid(pong, &status, 0);
+#endif
+
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/**
+ * testPoll.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the pollable descriptor of msgQGetFd on Linux.
+ *
+ * The descriptor must be readable as long as the queue has a message and only
+ * then, whatever the mode of the queue and however the messages come and go:
+ * one at a time, in batches, or peeked and released. A task pended in poll
+ * must wake when a thread sends to an inter-thread queue, or a process to a
+ * named one, and the descriptor of a name created again must not be left
+ * ready by the queue which had the name before.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+#define TC_BATCH        3
+
+/* the readiness of a descriptor, waiting up to <timeout> milliseconds */
+static int tc_ready(int fd, int timeout) {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (poll(&pfd, 1, timeout) != 1)
+        return 0;
+
+    return (pfd.revents & POLLIN) != 0;
+}
+
+/* send a message of the letter <c> */
+static int tc_send(MSG_Q_ID msgQId, char c) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, c, sizeof(msg));
+    return msgQSend(msgQId, msg, sizeof(msg), 0, MSG_PRI_NORMAL);
+}
+
+/* receive a message, which must be of the letter <c> */
+static void tc_receive(MSG_Q_ID msgQId, char c, int timeout) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, 0, sizeof(msg));
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), timeout) == 0);
+    TC_CHECK(msg[0] == c && msg[TC_MSG_LENGTH - 1] == c);
+}
+
+/* the descriptor follows the messages coming and going */
+static void tc_level(MSG_Q_ID msgQId, int options) {
+    char msgs[TC_BATCH][TC_MSG_LENGTH];
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    char buffer[TC_BATCH * TC_MSG_LENGTH];
+    const char * pBuffer = NULL;
+    UINT nBytes = 0;
+    int fd = -1;
+    int index = 0;
+
+    fd = msgQGetFd(msgQId);
+    TC_CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+
+    /* the same handle gets the same descriptor */
+    TC_CHECK(msgQGetFd(msgQId) == fd);
+    TC_CHECK(!tc_ready(fd, 0));
+
+    /* one message at a time, the level stays up until the last one */
+    TC_CHECK(tc_send(msgQId, 'a') == 0);
+    TC_CHECK(tc_ready(fd, 0));
+    TC_CHECK(tc_send(msgQId, 'b') == 0);
+    tc_receive(msgQId, 'a', 0);
+    TC_CHECK(tc_ready(fd, 0));
+    tc_receive(msgQId, 'b', 0);
+    TC_CHECK(!tc_ready(fd, 0));
+
+    /* a receive which finds nothing leaves the descriptor alone */
+    TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == -1);
+    TC_CHECK(!tc_ready(fd, 0));
+
+    /* a batch sets the level once, and a batch received to the end drops it */
+    for (index = 0; index < TC_BATCH; index++) {
+        memset(msgs[index], 'c' + index, TC_MSG_LENGTH);
+        buffers[index] = msgs[index];
+        lengths[index] = TC_MSG_LENGTH;
+    }
+    TC_CHECK(msgQSendBatch(msgQId, buffers, lengths, TC_BATCH, 0,
+        MSG_PRI_NORMAL) == TC_BATCH);
+    TC_CHECK(tc_ready(fd, 0));
+    TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+        TC_BATCH - 1, 0) == TC_BATCH - 1);
+    TC_CHECK(tc_ready(fd, 0));
+    TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+        TC_BATCH, 0) == 1);
+    TC_CHECK(buffer[0] == 'c' + TC_BATCH - 1);
+    TC_CHECK(!tc_ready(fd, 0));
+
+    /*
+     * a peeked message is off the queue, except in MSG_Q_SPSC where it stays
+     * in the slot of the consumer until it is released
+     */
+    if ((options & MSG_Q_VARLEN) == 0) {
+        TC_CHECK(tc_send(msgQId, 'p') == 0);
+        TC_CHECK(tc_ready(fd, 0));
+        TC_CHECK(msgQReceivePeek(msgQId, &pBuffer, &nBytes, 0) == 0);
+        TC_CHECK(tc_ready(fd, 0) == ((options & MSG_Q_SPSC) != 0));
+        TC_CHECK(pBuffer != NULL && pBuffer[0] == 'p');
+        TC_CHECK(msgQReceiveRelease(msgQId, pBuffer) == 0);
+        TC_CHECK(!tc_ready(fd, 0));
+    }
+
+    /* a full queue is ready until it is drained */
+    for (index = 0; index < TC_MAX_MSGS; index++)
+        TC_CHECK(tc_send(msgQId, 'f') == 0);
+    TC_CHECK(tc_send(msgQId, 'f') == -1);
+    TC_CHECK(tc_ready(fd, 0));
+    for (index = 0; index < TC_MAX_MSGS; index++) {
+        TC_CHECK(tc_ready(fd, 0));
+        tc_receive(msgQId, 'f', 0);
+    }
+    TC_CHECK(!tc_ready(fd, 0));
+}
+
+/* send a message after a while, for a task pended in poll */
+static void * tc_late(void * param) {
+    usleep(20000);
+    tc_send((MSG_Q_ID)param, 'l');
+    return NULL;
+}
+
+/* the descriptor of each mode of an inter-thread queue */
+static void tc_modes_thread(void) {
+    MSG_Q_ID msgQId = NULL;
+    pthread_t thread;
+    int index = 0;
+    int maxMsgs = 0;
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+
+        /* a VARLEN ring of TC_MAX_MSGS messages and their headers */
+        maxMsgs = (tc_modes[index].options & MSG_Q_VARLEN) ?
+            TC_MAX_MSGS * (TC_MSG_LENGTH + 8) : TC_MAX_MSGS;
+        msgQId = msgQCreate(maxMsgs, TC_MSG_LENGTH, tc_modes[index].options);
+        TC_CHECK(msgQId != NULL);
+        if (msgQId == NULL)
+            continue;
+
+        tc_level(msgQId, tc_modes[index].options);
+
+        /*
+         * poll wakes when a thread sends; the queue is ready a little before
+         * the message can be taken, so the receive may wait for it
+         */
+        TC_CHECK(pthread_create(&thread, NULL, tc_late, msgQId) == 0);
+        TC_CHECK(tc_ready(msgQGetFd(msgQId), 5000));
+        tc_receive(msgQId, 'l', 1000);
+        pthread_join(thread, NULL);
+
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+}
+
+/* the descriptor of a named queue, sent to by another process */
+static void tc_named(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID other = NULL;
+    pid_t pid = 0;
+    int status = 0;
+    int fd = -1;
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    tc_level(msgQId, MSG_Q_FIFO);
+
+    fd = msgQGetFd(msgQId);
+    pid = fork();
+    if (pid == 0) {
+        usleep(20000);
+        other = msgQOpen(name);
+        if (other == NULL || tc_send(other, 'o') != 0)
+            exit(1);
+        msgQDelete(other);
+        exit(0);
+    }
+
+    /* poll wakes when the other process sends */
+    TC_CHECK(tc_ready(fd, 5000));
+    tc_receive(msgQId, 'o', 1000);
+    TC_CHECK(!tc_ready(fd, 0));
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* a queue left with a message and ready when its name goes */
+    TC_CHECK(tc_send(msgQId, 'g') == 0);
+    TC_CHECK(tc_ready(fd, 0));
+    TC_CHECK(msgQDelete(msgQId) == 0);
+
+    /* the name created again is empty, so its descriptor isn't ready */
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    fd = msgQGetFd(msgQId);
+    TC_CHECK(fd >= 0);
+    TC_CHECK(!tc_ready(fd, 0));
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_modes_thread();
+    tc_named("tc.poll.named");
+
+    return tc_report("Poll");
+}
@@ -0,0 +1,309 @@
+/**
+ * testReceiveAny.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of msgQReceiveAny on Linux.
+ *
+ * A receiver waits on a set of queues of every mode, inter-thread and named,
+ * and must get each message sent to any of them once, intact, with the
+ * position of its queue, and the messages of a queue in their order. The
+ * queues are served in turn, so a busy queue can't starve a quiet one, a
+ * task pended on the set wakes for a message sent by a thread or by another
+ * process, and an empty set times out.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_QUEUES       6
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+#define TC_MESSAGES     5000
+#define TC_BUSY         100
+
+/* the queues of the set, one of each mode and a named one */
+static const struct {
+    const char * name;
+    int options;
+} tc_queues[TC_QUEUES] = {
+    {NULL, MSG_Q_FIFO},
+    {NULL, MSG_Q_PRIORITY},
+    {NULL, MSG_Q_SPSC},
+    {NULL, MSG_Q_MPMC},
+    {NULL, MSG_Q_VARLEN},
+    {"tc.any.named", MSG_Q_FIFO}
+};
+
+/* a message carries its queue and its order of sending */
+typedef struct tagTC_MSG {
+    int queue;
+    int seq;
+    char fill[TC_MSG_LENGTH - 2 * sizeof(int)];
+}TC_MSG;
+
+/* a producer of the stream */
+typedef struct tagTC_TASK {
+    MSG_Q_ID msgQId;
+    int queue;
+    int count;
+}TC_TASK;
+
+/* the milliseconds of the monotonic clock */
+static long tc_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* fill a message, so a torn message shows */
+static void tc_fill(TC_MSG * msg, int queue, int seq) {
+    msg->queue = queue;
+    msg->seq = seq;
+    memset(msg->fill, seq & 0xff, sizeof(msg->fill));
+}
+
+/* check a message filled by tc_fill */
+static int tc_intact(const TC_MSG * msg) {
+    UINT index = 0;
+
+    for (index = 0; index < sizeof(msg->fill); index++) {
+        if ((unsigned char)msg->fill[index] != (msg->seq & 0xff))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* send a message of a queue */
+static int tc_send(MSG_Q_ID msgQId, int queue, int seq, int timeout) {
+    TC_MSG msg;
+
+    tc_fill(&msg, queue, seq);
+    return msgQSend(msgQId, (char*)&msg, sizeof(msg), timeout,
+        MSG_PRI_NORMAL);
+}
+
+/* create the set of queues, one of each mode */
+static int tc_create(MSG_Q_ID ids[]) {
+    int maxMsgs = 0;
+    int index = 0;
+
+    for (index = 0; index < TC_QUEUES; index++) {
+        /* a VARLEN ring of TC_MAX_MSGS messages and their headers */
+        maxMsgs = (tc_queues[index].options & MSG_Q_VARLEN) ?
+            TC_MAX_MSGS * (TC_MSG_LENGTH + 8) : TC_MAX_MSGS;
+        ids[index] = msgQCreateEx(maxMsgs, TC_MSG_LENGTH,
+            tc_queues[index].options, tc_queues[index].name);
+        TC_CHECK(ids[index] != NULL);
+        if (ids[index] == NULL)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* delete the set of queues */
+static void tc_delete(MSG_Q_ID ids[]) {
+    int index = 0;
+
+    for (index = 0; index < TC_QUEUES; index++)
+        TC_CHECK(msgQDelete(ids[index]) == 0);
+}
+
+/* the calls which can't wait on the set fail */
+static void tc_invalid(MSG_Q_ID ids[]) {
+    TC_MSG msg;
+    int pos = -1;
+
+    TC_CHECK(msgQReceiveAny(ids, 0, (char*)&msg, sizeof(msg), 0, &pos) == -1);
+    TC_CHECK(msgQReceiveAny(ids, MSG_Q_ANY_MAX + 1, (char*)&msg, sizeof(msg),
+        0, &pos) == -1);
+    TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, NULL, sizeof(msg), 0, &pos) == -1);
+    TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+        NULL) == -1);
+    TC_CHECK(pos == -1);
+}
+
+/* each queue of the set in turn, and an empty set times out */
+static void tc_single(MSG_Q_ID ids[]) {
+    TC_MSG msg;
+    long start = 0;
+    int index = 0;
+    int pos = -1;
+
+    for (index = 0; index < TC_QUEUES; index++) {
+        TC_CHECK(tc_send(ids[index], index, index, 0) == 0);
+        TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+            &pos) == 0);
+        TC_CHECK(pos == index && msg.queue == index && msg.seq == index);
+        TC_CHECK(tc_intact(&msg));
+    }
+
+    TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+        &pos) == -1);
+
+    start = tc_now();
+    TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 50,
+        &pos) == -1);
+    TC_CHECK(tc_now() - start >= 45);
+}
+
+/* two busy queues share the receiver with a quiet one */
+static void tc_fair(MSG_Q_ID ids[]) {
+    TC_MSG msg;
+    int counts[TC_QUEUES];
+    int index = 0;
+    int pos = -1;
+
+    /* the FIFO and PRIORITY queues are full, the SPSC ring holds one */
+    for (index = 0; index < TC_MAX_MSGS; index++) {
+        TC_CHECK(tc_send(ids[0], 0, index, 0) == 0);
+        TC_CHECK(tc_send(ids[1], 1, index, 0) == 0);
+    }
+    TC_CHECK(tc_send(ids[2], 2, 0, 0) == 0);
+
+    /* the rotating turn serves the quiet queue within a round of the set */
+    memset(counts, 0, sizeof(counts));
+    for (index = 0; index < TC_QUEUES; index++) {
+        TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+            &pos) == 0);
+        if (pos >= 0 && pos < TC_QUEUES)
+            counts[pos]++;
+    }
+    TC_CHECK(counts[2] == 1);
+
+    /* the busy queues are refilled as they drain, neither one starves */
+    for (index = 0; index < TC_BUSY; index++) {
+        TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+            &pos) == 0);
+        if (pos == 0 || pos == 1) {
+            counts[pos]++;
+            TC_CHECK(tc_send(ids[pos], pos, index, 0) == 0);
+        }
+    }
+    TC_CHECK(counts[0] >= TC_BUSY / TC_QUEUES &&
+        counts[1] >= TC_BUSY / TC_QUEUES);
+    TC_CHECK(counts[3] == 0 && counts[4] == 0 && counts[5] == 0);
+
+    /* drain the set */
+    while (msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 0,
+        &pos) == 0)
+        ;
+}
+
+/* send the stream of a queue */
+static void * tc_producer(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    int seq = 0;
+
+    for (seq = 0; seq < TC_MESSAGES; seq++) {
+        if (tc_send(task->msgQId, task->queue, seq, WAIT_FOREVER) != 0)
+            break;
+    }
+
+    task->count = seq;
+    return NULL;
+}
+
+/* a producer thread per queue, one receiver of all the queues */
+static void tc_stream(MSG_Q_ID ids[]) {
+    pthread_t threads[TC_QUEUES];
+    TC_TASK tasks[TC_QUEUES];
+    int next[TC_QUEUES];
+    TC_MSG msg;
+    int received = 0;
+    int bad = 0;
+    int index = 0;
+    int pos = -1;
+
+    for (index = 0; index < TC_QUEUES; index++) {
+        next[index] = 0;
+        tasks[index].msgQId = ids[index];
+        tasks[index].queue = index;
+        tasks[index].count = 0;
+        TC_CHECK(pthread_create(&threads[index], NULL, tc_producer,
+            &tasks[index]) == 0);
+    }
+
+    while (received < TC_QUEUES * TC_MESSAGES) {
+        if (msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg),
+            WAIT_FOREVER, &pos) != 0) {
+            TC_CHECK(0);
+            break;
+        }
+
+        /* the message comes from its queue and in its order */
+        if (pos < 0 || pos >= TC_QUEUES || msg.queue != pos ||
+            msg.seq != next[pos] || !tc_intact(&msg))
+            bad++;
+        else
+            next[pos]++;
+        received++;
+    }
+
+    for (index = 0; index < TC_QUEUES; index++) {
+        pthread_join(threads[index], NULL);
+        TC_CHECK(tasks[index].count == TC_MESSAGES);
+        TC_CHECK(next[index] == TC_MESSAGES);
+    }
+    TC_CHECK(bad == 0);
+}
+
+/* a task pended on the set wakes for a message of another process */
+static void tc_wake(MSG_Q_ID ids[]) {
+    MSG_Q_ID other = NULL;
+    TC_MSG msg;
+    pid_t pid = 0;
+    int status = 0;
+    int pos = -1;
+
+    pid = fork();
+    if (pid == 0) {
+        usleep(20000);
+        other = msgQOpen(tc_queues[TC_QUEUES - 1].name);
+        if (other == NULL || tc_send(other, TC_QUEUES - 1, 7, 0) != 0)
+            exit(1);
+        msgQDelete(other);
+        exit(0);
+    }
+
+    TC_CHECK(msgQReceiveAny(ids, TC_QUEUES, (char*)&msg, sizeof(msg), 5000,
+        &pos) == 0);
+    TC_CHECK(pos == TC_QUEUES - 1 && msg.seq == 7 && tc_intact(&msg));
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(int argc, char **argv) {
+    MSG_Q_ID ids[TC_QUEUES];
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    if (tc_create(ids) != 0)
+        return tc_report("ReceiveAny");
+
+    tc_invalid(ids);
+    tc_single(ids);
+    tc_fair(ids);
+    tc_stream(ids);
+    tc_wake(ids);
+
+    tc_delete(ids);
+
+    return tc_report("ReceiveAny");
+}
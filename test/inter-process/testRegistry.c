@@ -0,0 +1,226 @@
+/**
+ * testRegistry.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the registry of the named message queues on Linux.
+ *
+ * msgQList must list a named queue once, with its attributes and the process
+ * which created it, from its creation until the last handle of any process
+ * is deleted, however many times the name is opened; a durable queue is
+ * listed by its path again when it is recovered. An inter-thread queue, and
+ * a name too long to be kept, are never listed. The registry is shared by all
+ * the processes of the host, so the queues of the test are looked up by their
+ * names among any others.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_INFO     1024
+
+static MSG_Q_INFO tc_info[TC_MAX_INFO];
+
+/* count the entries of a name, and copy the last one into <pInfo> */
+static int tc_listed(const char * name, MSG_Q_INFO * pInfo) {
+    int count = 0;
+    int found = 0;
+    int index = 0;
+
+    count = msgQList(tc_info, TC_MAX_INFO);
+    TC_CHECK(count >= 0 && count <= TC_MAX_INFO);
+    if (count < 0 || count > TC_MAX_INFO)
+        return 0;
+
+    for (index = 0; index < count; index++) {
+        if (strcmp(tc_info[index].name, name) == 0) {
+            if (pInfo != NULL)
+                *pInfo = tc_info[index];
+            found++;
+        }
+    }
+
+    return found;
+}
+
+/* wait for a child, which must have exited without failures */
+static void tc_wait(pid_t pid) {
+    int status = 0;
+
+    TC_CHECK(waitpid(pid, &status, 0) == pid);
+    TC_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+/* a queue is listed with its attributes until its last handle goes */
+static void tc_lifetime(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID opened = NULL;
+    MSG_Q_INFO info;
+
+    TC_CHECK(tc_listed(name, NULL) == 0);
+
+    msgQId = msgQCreateEx(16, 40, MSG_Q_PRIORITY, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    memset(&info, 0, sizeof(info));
+    TC_CHECK(tc_listed(name, &info) == 1);
+    TC_CHECK(info.maxMsgs == 16 && info.maxMsgLength == 40);
+    TC_CHECK(info.options == MSG_Q_PRIORITY);
+    TC_CHECK(info.pid == (int)getpid());
+    TC_CHECK(info.memSize > 0);
+
+    /* the name opened again is the same queue, listed once */
+    opened = msgQOpen(name);
+    TC_CHECK(opened == msgQId);
+    TC_CHECK(tc_listed(name, NULL) == 1);
+    TC_CHECK(msgQDelete(opened) == 0);
+    TC_CHECK(tc_listed(name, NULL) == 1);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(tc_listed(name, NULL) == 0);
+}
+
+/* a queue created by a process stays listed while another holds it */
+static void tc_processes(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_INFO info;
+    int ready[2];
+    int leave[2];
+    char c = 0;
+    pid_t pid = 0;
+
+    TC_CHECK(pipe(ready) == 0 && pipe(leave) == 0);
+
+    pid = fork();
+    if (pid == 0) {
+        msgQId = msgQCreateEx(8, 64, MSG_Q_FIFO, name);
+        if (msgQId == NULL || write(ready[1], "r", 1) != 1 ||
+            read(leave[0], &c, 1) != 1)
+            exit(1);
+        msgQDelete(msgQId);
+        exit(0);
+    }
+
+    TC_CHECK(read(ready[0], &c, 1) == 1);
+
+    /* the creator is the child */
+    memset(&info, 0, sizeof(info));
+    TC_CHECK(tc_listed(name, &info) == 1);
+    TC_CHECK(info.pid == (int)pid && info.maxMsgs == 8);
+
+    msgQId = msgQOpen(name);
+    TC_CHECK(msgQId != NULL);
+
+    /* the creator leaves, the queue is still held by this process */
+    TC_CHECK(write(leave[1], "l", 1) == 1);
+    tc_wait(pid);
+    TC_CHECK(tc_listed(name, NULL) == 1);
+
+    if (msgQId != NULL)
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(tc_listed(name, NULL) == 0);
+
+    close(ready[0]);
+    close(ready[1]);
+    close(leave[0]);
+    close(leave[1]);
+}
+
+/* a durable queue is listed by its path, again when it is recovered */
+static void tc_durable(void) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_INFO info;
+    char path[64];
+
+    sprintf(path, "/tmp/tc.registry.%d", (int)getpid());
+    unlink(path);
+
+    msgQId = msgQCreateEx(4, 16, MSG_Q_DURABLE, path);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    memset(&info, 0, sizeof(info));
+    TC_CHECK(tc_listed(path, &info) == 1);
+    TC_CHECK((info.options & MSG_Q_DURABLE) != 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(tc_listed(path, NULL) == 0);
+
+    msgQId = msgQOpen(path);
+    TC_CHECK(msgQId != NULL);
+    TC_CHECK(tc_listed(path, NULL) == 1);
+    if (msgQId != NULL)
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(tc_listed(path, NULL) == 0);
+
+    unlink(path);
+}
+
+/* the queues never listed, and the copy limited to <maxInfo> */
+static void tc_limits(void) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID ids[3] = {NULL, NULL, NULL};
+    MSG_Q_INFO info[2];
+    char name[MSG_Q_NAME_MAX + 8];
+    int count = 0;
+    int index = 0;
+
+    TC_CHECK(msgQList(NULL, 1) == -1);
+
+    /* a name of MSG_Q_NAME_MAX characters doesn't fit with its terminator */
+    memset(name, 'n', MSG_Q_NAME_MAX);
+    name[MSG_Q_NAME_MAX] = '\0';
+    count = msgQList(NULL, 0);
+    msgQId = msgQCreateEx(4, 16, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    TC_CHECK(msgQList(NULL, 0) == count);
+    if (msgQId != NULL)
+        TC_CHECK(msgQDelete(msgQId) == 0);
+
+    msgQId = msgQCreate(4, 16, MSG_Q_FIFO);
+    TC_CHECK(msgQId != NULL);
+    TC_CHECK(msgQList(NULL, 0) == count);
+    if (msgQId != NULL)
+        TC_CHECK(msgQDelete(msgQId) == 0);
+
+    /* the number listed counts the queues not copied */
+    for (index = 0; index < 3; index++) {
+        sprintf(name, "tc.reg.limit%d", index);
+        ids[index] = msgQCreateEx(4, 16, MSG_Q_FIFO, name);
+        TC_CHECK(ids[index] != NULL);
+    }
+
+    memset(info, 0x5a, sizeof(info));
+    TC_CHECK(msgQList(info, 1) >= count + 3);
+    TC_CHECK(info[1].maxMsgs == 0x5a5a5a5a);
+
+    for (index = 0; index < 3; index++) {
+        if (ids[index] != NULL)
+            TC_CHECK(msgQDelete(ids[index]) == 0);
+    }
+    TC_CHECK(msgQList(NULL, 0) == count);
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_lifetime("tc.reg.lifetime");
+    tc_processes("tc.reg.processes");
+    tc_durable();
+    tc_limits();
+
+    return tc_report("Registry");
+}
@@ -0,0 +1,234 @@
+/**
+ * testSpin.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of msgQSetSpin on Linux.
+ *
+ * msgQSetSpin must refuse a budget out of its range and a handle of
+ * msgQWatch. Without a budget, a receiver of each mode must pend in the
+ * kernel at once, so it gives the CPU up and burns little of it while it
+ * waits. With a budget, a receiver which finds the queue empty must get a
+ * message sent while it spins without pending, which the voluntary context
+ * switches of its thread show; this needs a second CPU for the sender.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+#define TC_DELAY_MS     20
+#define TC_ATTEMPTS     200
+
+/* a receiver and what its thread went through */
+typedef struct tagTC_TASK {
+    MSG_Q_ID msgQId;
+    int timeout;
+    int status;
+    long switches;
+    long long cpu;
+}TC_TASK;
+
+/* the voluntary context switches of the calling thread */
+static long tc_switches(void) {
+    FILE * fp = NULL;
+    char line[128];
+    long switches = -1;
+
+    fp = fopen("/proc/thread-self/status", "r");
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "voluntary_ctxt_switches: %ld", &switches) == 1)
+            break;
+    }
+    fclose(fp);
+
+    return switches;
+}
+
+/* the CPU microseconds of the calling thread */
+static long long tc_cpu(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* receive a message, counting the switches and the CPU time it takes */
+static void * tc_receiver(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    char msg[TC_MSG_LENGTH];
+    long switches = 0;
+    long long cpu = 0;
+
+    switches = tc_switches();
+    cpu = tc_cpu();
+    task->status = msgQReceive(task->msgQId, msg, sizeof(msg),
+        task->timeout);
+    task->cpu = tc_cpu() - cpu;
+    task->switches = tc_switches() - switches;
+    return NULL;
+}
+
+/* send a message */
+static int tc_send(MSG_Q_ID msgQId) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, 's', sizeof(msg));
+    return msgQSend(msgQId, msg, sizeof(msg), 0, MSG_PRI_NORMAL);
+}
+
+/* the receives of a queue which found it empty so far */
+static unsigned long long tc_empty(MSG_Q_ID msgQId) {
+    MSG_Q_STAT stat;
+
+    if (msgQStat(msgQId, &stat) != 0)
+        return 0;
+    return stat.receiveEmpty;
+}
+
+/* create a queue of a mode, a VARLEN ring of TC_MAX_MSGS messages */
+static MSG_Q_ID tc_create(int options) {
+    return msgQCreate((options & MSG_Q_VARLEN) ?
+        TC_MAX_MSGS * (TC_MSG_LENGTH + 8) : TC_MAX_MSGS, TC_MSG_LENGTH,
+        options);
+}
+
+/* the budgets and the handles msgQSetSpin refuses */
+static void tc_limits(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID watch = NULL;
+
+    TC_CHECK(msgQSetSpin(NULL, 0) == -1);
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    TC_CHECK(msgQSetSpin(msgQId, -1) == -1);
+    TC_CHECK(msgQSetSpin(msgQId, MSG_Q_SPIN_MAX + 1) == -1);
+    TC_CHECK(msgQSetSpin(msgQId, MSG_Q_SPIN_MAX) == 0);
+    TC_CHECK(msgQSetSpin(msgQId, 1) == 0);
+    TC_CHECK(msgQSetSpin(msgQId, 0) == 0);
+
+    /* a watching handle can't change the queue */
+    watch = msgQWatch(name);
+    TC_CHECK(watch != NULL);
+    if (watch != NULL) {
+        TC_CHECK(msgQSetSpin(watch, 0) == -1);
+        TC_CHECK(msgQSetSpin(watch, 1000) == -1);
+        TC_CHECK(msgQDelete(watch) == 0);
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* without a budget a receiver pends at once */
+static void tc_pend(int options) {
+    MSG_Q_ID msgQId = NULL;
+    TC_TASK task;
+    pthread_t thread;
+
+    msgQId = tc_create(options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(msgQSetSpin(msgQId, 0) == 0);
+
+    /* the message comes later, the receiver sleeps until then */
+    memset(&task, 0, sizeof(task));
+    task.msgQId = msgQId;
+    task.timeout = 1000;
+    TC_CHECK(pthread_create(&thread, NULL, tc_receiver, &task) == 0);
+    usleep(TC_DELAY_MS * 1000);
+    TC_CHECK(tc_send(msgQId) == 0);
+    pthread_join(thread, NULL);
+    TC_CHECK(task.status == 0);
+    TC_CHECK(task.switches >= 1);
+    TC_CHECK(task.cpu < TC_DELAY_MS * 1000 / 4);
+
+    /* no message comes, the receiver sleeps until the timeout */
+    memset(&task, 0, sizeof(task));
+    task.msgQId = msgQId;
+    task.timeout = TC_DELAY_MS;
+    tc_receiver(&task);
+    TC_CHECK(task.status == -1);
+    TC_CHECK(task.switches >= 1);
+    TC_CHECK(task.cpu < TC_DELAY_MS * 1000 / 4);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* with a budget a receiver gets a message sent while it spins */
+static void tc_spin(int options) {
+    MSG_Q_ID msgQId = NULL;
+    TC_TASK task;
+    pthread_t thread;
+    unsigned long long empty = 0;
+    int spun = 0;
+    int attempt = 0;
+
+    msgQId = tc_create(options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(msgQSetSpin(msgQId, MSG_Q_SPIN_MAX) == 0);
+
+    for (attempt = 0; attempt < TC_ATTEMPTS && spun == 0; attempt++) {
+        memset(&task, 0, sizeof(task));
+        task.msgQId = msgQId;
+        task.timeout = 1000;
+        empty = tc_empty(msgQId);
+        TC_CHECK(pthread_create(&thread, NULL, tc_receiver, &task) == 0);
+
+        /* send as soon as the receiver has found the queue empty */
+        while (tc_empty(msgQId) == empty)
+            ;
+        TC_CHECK(tc_send(msgQId) == 0);
+        pthread_join(thread, NULL);
+        TC_CHECK(task.status == 0);
+
+        if (task.switches == 0)
+            spun++;
+    }
+    TC_CHECK(spun > 0);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_limits("tc.spin.limits");
+
+    /* the sender can't run while the receiver spins on the only CPU */
+    if (cpus < 2)
+        printf("one CPU, the spinning receiver is not checked.\n");
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+        tc_pend(tc_modes[index].options);
+        if (cpus >= 2)
+            tc_spin(tc_modes[index].options);
+    }
+
+    return tc_report("Spin");
+}
@@ -0,0 +1,197 @@
+/**
+ * testWakeOrder.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the order the tasks pended on a MSG_Q_PRIORITY queue
+ * are served in on Linux.
+ *
+ * Threads of different nice values, some of them equal, pend one after the
+ * other to receive from an empty queue, or to send to a full one. The queue
+ * is then given one message, or one free slot, at a time, and the tasks must
+ * be served from the highest priority, the lowest nice value, down, and in
+ * the order they pended within the same priority. An inter-thread queue
+ * hands each unit over to a task, a named queue calls the task to take it
+ * under the mutex, and both are checked.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_TASKS        6
+#define TC_PEND_MS      30
+#define TC_WAIT_MS      5000
+
+/* the nice values of the tasks in the order they pend */
+static const int tc_nice[TC_TASKS] = {5, 0, 5, 12, 0, 19};
+
+/* the tasks in the order they must be served */
+static const int tc_served[TC_TASKS] = {1, 4, 0, 2, 3, 5};
+
+/* a task pended on the queue */
+typedef struct tagTC_TASK {
+    MSG_Q_ID msgQId;
+    int index;
+    volatile int ready;
+}TC_TASK;
+
+/* the tasks in the order they got a message */
+static int tc_order[TC_TASKS];
+static int tc_done = 0;
+
+/* sleep for some milliseconds */
+static void tc_sleep(int ms) {
+    usleep(ms * 1000);
+}
+
+/* lower the priority of the calling thread to its nice value */
+static int tc_renice(int index) {
+    return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid),
+        tc_nice[index]);
+}
+
+/* pend for a message and record the order it came in */
+static void * tc_receiver(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    int msg = -1;
+
+    if (tc_renice(task->index) != 0)
+        return NULL;
+
+    task->ready = 1;
+    if (msgQReceive(task->msgQId, (char*)&msg, sizeof(msg),
+        TC_WAIT_MS) != 0)
+        return NULL;
+
+    tc_order[__atomic_fetch_add(&tc_done, 1, __ATOMIC_SEQ_CST)] =
+        task->index;
+    return NULL;
+}
+
+/* pend for a free slot and send the index of the task */
+static void * tc_sender(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+
+    if (tc_renice(task->index) != 0)
+        return NULL;
+
+    task->ready = 1;
+    msgQSend(task->msgQId, (char*)&task->index, sizeof(task->index),
+        TC_WAIT_MS, MSG_PRI_NORMAL);
+    return NULL;
+}
+
+/* start the tasks one after the other, each one pended before the next */
+static void tc_pend(MSG_Q_ID msgQId, void * (*entry)(void *),
+    TC_TASK tasks[], pthread_t threads[]) {
+    int index = 0;
+    int ms = 0;
+
+    for (index = 0; index < TC_TASKS; index++) {
+        tasks[index].msgQId = msgQId;
+        tasks[index].index = index;
+        tasks[index].ready = 0;
+        TC_CHECK(pthread_create(&threads[index], NULL, entry,
+            &tasks[index]) == 0);
+
+        for (ms = 0; !tasks[index].ready && ms < TC_WAIT_MS; ms++)
+            tc_sleep(1);
+        TC_CHECK(tasks[index].ready);
+
+        /* the task has no spin budget, it pends at once */
+        tc_sleep(TC_PEND_MS);
+    }
+}
+
+/* the receivers pended on an empty queue get one message at a time */
+static void tc_receivers(MSG_Q_ID msgQId) {
+    pthread_t threads[TC_TASKS];
+    TC_TASK tasks[TC_TASKS];
+    int index = 0;
+    int ms = 0;
+
+    tc_done = 0;
+    memset(tc_order, 0xff, sizeof(tc_order));
+    tc_pend(msgQId, tc_receiver, tasks, threads);
+
+    for (index = 0; index < TC_TASKS; index++) {
+        TC_CHECK(msgQSend(msgQId, (char*)&index, sizeof(index), 0,
+            MSG_PRI_NORMAL) == 0);
+
+        /* the next message is sent after this one is received */
+        for (ms = 0; __atomic_load_n(&tc_done, __ATOMIC_SEQ_CST) <= index &&
+            ms < TC_WAIT_MS; ms++)
+            tc_sleep(1);
+    }
+
+    for (index = 0; index < TC_TASKS; index++) {
+        pthread_join(threads[index], NULL);
+        TC_CHECK(tc_order[index] == tc_served[index]);
+    }
+}
+
+/* the senders pended on a full queue get one free slot at a time */
+static void tc_senders(MSG_Q_ID msgQId) {
+    pthread_t threads[TC_TASKS];
+    TC_TASK tasks[TC_TASKS];
+    int msg = -1;
+    int index = 0;
+
+    /* the queue of one slot is full */
+    TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+        MSG_PRI_NORMAL) == 0);
+    tc_pend(msgQId, tc_sender, tasks, threads);
+
+    /* each receive frees the slot for the next sender to fill */
+    TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == 0);
+    TC_CHECK(msg == -1);
+    for (index = 0; index < TC_TASKS; index++) {
+        msg = -1;
+        TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg),
+            TC_WAIT_MS) == 0);
+        TC_CHECK(msg == tc_served[index]);
+    }
+
+    for (index = 0; index < TC_TASKS; index++)
+        pthread_join(threads[index], NULL);
+}
+
+/* the order of the receivers and of the senders of a queue */
+static void tc_queue(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+
+    printf("%s:\n", name == NULL ? "inter-thread" : name);
+
+    msgQId = msgQCreateEx(1, sizeof(int), MSG_Q_PRIORITY, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    TC_CHECK(msgQSetSpin(msgQId, 0) == 0);
+    tc_receivers(msgQId);
+    tc_senders(msgQId);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_queue(NULL);
+    tc_queue("tc.wake.order");
+
+    return tc_report("WakeOrder");
+}
@@ -0,0 +1,257 @@
+/**
+ * testWatch.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of msgQWatch and of the msgqtop monitor on Linux.
+ *
+ * A handle of msgQWatch must see the live status of a named queue, and every
+ * call which would change the queue must refuse it and leave the queue as it
+ * is. The handle doesn't count as a handle of the queue: deleting it never
+ * destroys the queue, and the queue goes with its last real handle while it
+ * is still watched. msgqtop, which watches the queues this way, must show a
+ * live queue in one refresh and leave it as it is.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+#define TC_MAX_INFO     1024
+#define TC_OUTPUT       8192
+
+static MSG_Q_INFO tc_info[TC_MAX_INFO];
+
+/* the registry lists a name */
+static int tc_listed(const char * name) {
+    int count = 0;
+    int index = 0;
+
+    count = msgQList(tc_info, TC_MAX_INFO);
+    for (index = 0; index < count && index < TC_MAX_INFO; index++) {
+        if (strcmp(tc_info[index].name, name) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* send a message */
+static int tc_send(MSG_Q_ID msgQId, int timeout) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, 'w', sizeof(msg));
+    return msgQSend(msgQId, msg, sizeof(msg), timeout, MSG_PRI_NORMAL);
+}
+
+/* the counts of the status which any change of the queue moves */
+static int tc_same(const MSG_Q_STAT * a, const MSG_Q_STAT * b) {
+    return a->msgNum == b->msgNum && a->sends == b->sends &&
+        a->receives == b->receives && a->sendFull == b->sendFull &&
+        a->receiveEmpty == b->receiveEmpty;
+}
+
+/* the calls which would change the queue refuse a watching handle */
+static void tc_refuse(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID watch = NULL;
+    MSG_Q_ID ids[2];
+    MSG_Q_STAT before;
+    MSG_Q_STAT stat;
+    MSG_Q_LAT_STAT lat;
+    char msg[TC_MSG_LENGTH];
+    const char * buffers[1] = {msg};
+    UINT lengths[1] = {TC_MSG_LENGTH};
+    char * pBuffer = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int pos = -1;
+
+    TC_CHECK(msgQWatch(NULL) == NULL);
+    TC_CHECK(msgQWatch(name) == NULL);
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH,
+        MSG_Q_FIFO | MSG_Q_LATENCY, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    watch = msgQWatch(name);
+    TC_CHECK(watch != NULL && watch != msgQId);
+    if (watch == NULL) {
+        msgQDelete(msgQId);
+        return;
+    }
+
+    /* the status is read live through the watching handle */
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+    TC_CHECK(msgQStat(watch, &stat) == 0);
+    TC_CHECK(stat.msgNum == 1 && stat.sends == 2 && stat.receives == 1);
+    TC_CHECK(msgQLatency(watch, &lat) == 0 && lat.count == 1);
+    TC_CHECK(msgQShow(watch) == 0);
+    TC_CHECK(msgQStat(msgQId, &before) == 0);
+
+    /* nothing can be sent or received through it */
+    TC_CHECK(tc_send(watch, 0) == -1);
+    TC_CHECK(tc_send(watch, 10) == -1);
+    TC_CHECK(msgQSendBatch(watch, buffers, lengths, 1, 0,
+        MSG_PRI_NORMAL) == -1);
+    TC_CHECK(msgQSendReserve(watch, TC_MSG_LENGTH, 0, &pBuffer) == -1);
+    TC_CHECK(pBuffer == NULL);
+    TC_CHECK(msgQReceive(watch, msg, sizeof(msg), 0) == -1);
+    TC_CHECK(msgQReceive(watch, msg, sizeof(msg), 10) == -1);
+    TC_CHECK(msgQReceiveBatch(watch, msg, sizeof(msg), lengths, 1,
+        0) == -1);
+    TC_CHECK(msgQReceivePeek(watch, &pMsg, &nBytes, 0) == -1);
+    TC_CHECK(pMsg == NULL);
+
+    /* a set with a watching handle in it is refused too */
+    ids[0] = msgQId;
+    ids[1] = watch;
+    TC_CHECK(msgQReceiveAny(ids, 2, msg, sizeof(msg), 0, &pos) == -1);
+
+    /* nor can the settings of the queue be changed through it */
+    TC_CHECK(msgQGetFd(watch) == -1);
+    TC_CHECK(msgQSetSpin(watch, 0) == -1);
+    TC_CHECK(msgQSetSync(watch, 1) == -1);
+    TC_CHECK(msgQSync(watch) == -1);
+
+    /* the queue is as it was, the message is still there */
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(tc_same(&before, &stat));
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+
+    TC_CHECK(msgQDelete(watch) == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* the watching handles don't hold the queue */
+static void tc_refs(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_ID watch = NULL;
+    MSG_Q_STAT stat;
+    char msg[TC_MSG_LENGTH];
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+
+    /* deleting the watching handles leaves the queue alone */
+    watch = msgQWatch(name);
+    TC_CHECK(watch != NULL);
+    if (watch != NULL)
+        TC_CHECK(msgQDelete(watch) == 0);
+    watch = msgQWatch(name);
+    TC_CHECK(watch != NULL);
+    if (watch != NULL)
+        TC_CHECK(msgQDelete(watch) == 0);
+
+    TC_CHECK(tc_listed(name));
+    TC_CHECK(msgQStat(msgQId, &stat) == 0 && stat.msgNum == 1);
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+
+    /* the last real handle destroys the queue while it is watched */
+    watch = msgQWatch(name);
+    TC_CHECK(watch != NULL);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(!tc_listed(name));
+    TC_CHECK(msgQOpen(name) == NULL);
+    TC_CHECK(msgQWatch(name) == NULL);
+    if (watch != NULL)
+        TC_CHECK(msgQDelete(watch) == 0);
+
+    /* so the name is created anew */
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.msgNum == 0 && stat.sends == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(!tc_listed(name));
+}
+
+/* run msgqtop once and keep its output */
+static int tc_top(const char * args, char * output, int size) {
+    FILE * fp = NULL;
+    char command[128];
+    int length = 0;
+    int nBytes = 0;
+
+    sprintf(command, "./msgqtop -n 1 %s", args);
+    fp = popen(command, "r");
+    if (fp == NULL)
+        return -1;
+
+    while (length < size - 1 &&
+        (nBytes = (int)fread(output + length, 1, size - 1 - length, fp)) > 0)
+        length += nBytes;
+    output[length] = '\0';
+
+    return pclose(fp);
+}
+
+/* msgqtop shows a live queue and leaves it as it is */
+static void tc_msgqtop(const char * name) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT before;
+    MSG_Q_STAT stat;
+    char output[TC_OUTPUT];
+    char line[128];
+
+    msgQId = msgQCreateEx(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO, name);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(tc_send(msgQId, 0) == 0);
+    TC_CHECK(msgQStat(msgQId, &before) == 0);
+
+    /* the queue named, and the queues of the registry */
+    TC_CHECK(tc_top(name, output, sizeof(output)) == 0);
+    TC_CHECK(strstr(output, "1 queue(s)") != NULL);
+    TC_CHECK(strstr(output, "NAME") != NULL);
+    sprintf(line, "\n%s ", name);
+    TC_CHECK(strstr(output, line) != NULL);
+
+    TC_CHECK(tc_top("", output, sizeof(output)) == 0);
+    TC_CHECK(strstr(output, line) != NULL);
+
+    /* a name which doesn't exist is no failure */
+    TC_CHECK(tc_top("tc.watch.none", output, sizeof(output)) == 0);
+    TC_CHECK(strstr(output, "NAME") != NULL);
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(tc_same(&before, &stat));
+
+    /* the monitor held no handle, the queue goes with this one */
+    TC_CHECK(msgQDelete(msgQId) == 0);
+    TC_CHECK(!tc_listed(name));
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_refuse("tc.watch.refuse");
+    tc_refs("tc.watch.refs");
+    tc_msgqtop("tc.watch.top");
+
+    return tc_report("Watch");
+}
@@ -0,0 +1,156 @@
+/**
+ * testBatch.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the batch calls of the message queue module.
+ *
+ * A batch is sent with msgQSendBatch at each priority behind two queued
+ * messages, one normal and one of the priority of the batch, and received
+ * with msgQReceiveBatch, on a queue of each mode. The list modes must deliver
+ * an urgent batch ahead of the queue, a batch of a priority level after the
+ * messages of its level, and the batch itself always in its own order; the
+ * rings and the byte ring deliver everything in FIFO order. A batch larger
+ * than the free slots is sent in part.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   16
+#define TC_BATCH        4
+
+/* the priorities and the order the list modes deliver them */
+static const struct {
+    const char * name;
+    int priority;
+    const char * order;
+} tc_priorities[] = {
+    {"normal", MSG_PRI_NORMAL, "xyabcd"},
+    {"urgent", MSG_PRI_URGENT, "abcdyx"},
+    {"level 0", MSG_PRI_LEVEL(0), "xyabcd"},
+    {"level 3", MSG_PRI_LEVEL(3), "yabcdx"},
+    {"level 31", MSG_PRI_LEVEL(31), "yabcdx"}
+};
+
+/* receive all the queued messages, their first letters into <order> */
+static int tc_drain(MSG_Q_ID msgQId, char * order) {
+    char buffer[TC_MAX_MSGS * TC_MSG_LENGTH];
+    UINT lengths[TC_MAX_MSGS];
+    UINT offset = 0;
+    int count = 0;
+    int index = 0;
+
+    count = msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+        TC_MAX_MSGS, 0);
+    if (count <= 0)
+        return count;
+
+    /* the messages are back to back, each a letter and its length */
+    for (index = 0; index < count; index++) {
+        order[index] = buffer[offset];
+        TC_CHECK(lengths[index] == (UINT)(buffer[offset] - 'a' + 2) ||
+            lengths[index] == 1);
+        offset += lengths[index];
+    }
+    order[count] = '\0';
+
+    return count;
+}
+
+/* send a batch behind two queued messages and check the order */
+static void tc_order(MSG_Q_ID msgQId, int options, int p) {
+    static char msgs[TC_BATCH][TC_MSG_LENGTH] = {"ab", "bcc", "cddd", "deeee"};
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    char order[TC_MAX_MSGS + 1] = "";
+    int priority = tc_priorities[p].priority;
+    int index = 0;
+
+    for (index = 0; index < TC_BATCH; index++) {
+        buffers[index] = msgs[index];
+        lengths[index] = (UINT)strlen(msgs[index]);
+    }
+
+    TC_CHECK(msgQSend(msgQId, "x", 1, 0, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(msgQSend(msgQId, "y", 1, 0, priority) == 0);
+    TC_CHECK(msgQSendBatch(msgQId, buffers, lengths, TC_BATCH, 0,
+        priority) == TC_BATCH);
+
+    TC_CHECK(tc_drain(msgQId, order) == TC_BATCH + 2);
+    if (options & (MSG_Q_SPSC | MSG_Q_MPMC | MSG_Q_VARLEN))
+        TC_CHECK(strcmp(order, "xyabcd") == 0);
+    else
+        TC_CHECK(strcmp(order, tc_priorities[p].order) == 0);
+
+    if (tc_failures != 0)
+        printf("  %s: received %s\n", tc_priorities[p].name, order);
+}
+
+/* a batch larger than the free slots is sent in part */
+static void tc_room(MSG_Q_ID msgQId) {
+    static char msg[TC_MSG_LENGTH] = "ab";
+    const char * buffers[TC_MAX_MSGS + 2];
+    UINT lengths[TC_MAX_MSGS + 2];
+    char order[TC_MAX_MSGS + 1] = "";
+    int index = 0;
+
+    for (index = 0; index < TC_MAX_MSGS + 2; index++) {
+        buffers[index] = msg;
+        lengths[index] = 2;
+    }
+
+    TC_CHECK(msgQSend(msgQId, "x", 1, 0, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(msgQSendBatch(msgQId, buffers, lengths, TC_MAX_MSGS + 2, 0,
+        MSG_PRI_NORMAL) == TC_MAX_MSGS - 1);
+    TC_CHECK(msgQSendBatch(msgQId, buffers, lengths, 1, 0,
+        MSG_PRI_NORMAL) == -1);
+
+    TC_CHECK(tc_drain(msgQId, order) == TC_MAX_MSGS);
+    TC_CHECK(strcmp(order, "xaaaaaaa") == 0);
+}
+
+int main(int argc, char **argv) {
+    MSG_Q_ID msgQId = NULL;
+    int index = 0;
+    UINT p = 0;
+    int round = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+
+        /* the byte ring holds TC_MAX_MSGS messages and more */
+        msgQId = msgQCreate((tc_modes[index].options & MSG_Q_VARLEN) ?
+            TC_MAX_MSGS * TC_MSG_LENGTH * 4 : TC_MAX_MSGS,
+            TC_MSG_LENGTH, tc_modes[index].options);
+        TC_CHECK(msgQId != NULL);
+        if (msgQId == NULL)
+            continue;
+
+        /* a few rounds, so the rings wrap around */
+        for (round = 0; round < 3; round++) {
+            for (p = 0; p < sizeof(tc_priorities) /
+                sizeof(tc_priorities[0]); p++)
+                tc_order(msgQId, tc_modes[index].options, p);
+        }
+
+        if ((tc_modes[index].options & MSG_Q_VARLEN) == 0)
+            tc_room(msgQId);
+
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    return tc_report("Batch");
+}
@@ -0,0 +1,185 @@
+/**
+ * testCacheLine.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Benchmark of the cache line traffic of the message queue module on Linux.
+ *
+ * A sender and a receiver thread, pinned to different CPUs when there are
+ * more than one, pass messages through a queue of each mode, while the
+ * hardware performance counters of the process count the cache misses. The
+ * misses per message approximate the cache lines moved between the CPUs for
+ * each message; the counters read n/a where the kernel exposes no PMU.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "msgQueue.h"
+
+#define TC_COUNTERS 2
+
+typedef struct tagMSG_Q_TEST {
+    MSG_Q_ID msgQId;
+    int count;
+    int cpu;
+}MSG_Q_TEST;
+
+/* counters of the cache traffic, all the threads of the process */
+static const struct {
+    const char * name;
+    UINT type;
+    unsigned long long config;
+} tc_counters[TC_COUNTERS] = {
+    {"L1D misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}
+};
+
+/* nanoseconds since an arbitrary point */
+static long long tc_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* open a counter which the threads created later inherit, -1 if no PMU */
+static int tc_counter_open(int index) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = tc_counters[index].type;
+    attr.config = tc_counters[index].config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* pin the calling thread to a CPU, if there is more than one */
+static void tc_pin(int cpu) {
+    cpu_set_t set;
+
+    if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void * msgQSender(void *param) {
+    MSG_Q_TEST * msgQTest = (MSG_Q_TEST*)param;
+    char buf[64] = {0};
+    int i = 0;
+
+    tc_pin(msgQTest->cpu);
+    for (i = 0; i < msgQTest->count; i++) {
+        memcpy(buf, &i, sizeof(i));
+        if (msgQSend(msgQTest->msgQId, buf, sizeof(buf), WAIT_FOREVER,
+            MSG_PRI_NORMAL) != 0) {
+            printf("send message failed in %s.\n", __func__);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int tc_cache_line(const char * name, int options, int tests) {
+    pthread_t hSender;
+    MSG_Q_TEST msgQTest = {0};
+    char buf[64] = {0};
+    int fds[TC_COUNTERS];
+    long long values[TC_COUNTERS];
+    long long slice = 0;
+    int i = 0;
+    int result = 0;
+
+    /* the byte ring of MSG_Q_VARLEN holds 64 messages and their headers */
+    msgQTest.msgQId = msgQCreate((options & MSG_Q_VARLEN) ?
+        64 * (sizeof(buf) + 8) : 64, sizeof(buf), options);
+    if(msgQTest.msgQId == NULL) {
+        printf("create message queue failed in %s.\n", __func__);
+        return -1;
+    }
+    msgQTest.count = tests;
+    msgQTest.cpu = 1;
+
+    for (i = 0; i < TC_COUNTERS; i++) {
+        fds[i] = tc_counter_open(i);
+        values[i] = 0;
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    tc_pin(0);
+    slice = tc_now();
+    pthread_create(&hSender, NULL, msgQSender, &msgQTest);
+
+    for (i = 0; i < tests; i++) {
+        if (msgQReceive(msgQTest.msgQId, buf, sizeof(buf),
+            WAIT_FOREVER) != 0) {
+            printf("receive message failed in %s.\n", __func__);
+            result = -1;
+            break;
+        }
+    }
+
+    pthread_join(hSender, NULL);
+    slice = tc_now() - slice;
+
+    printf("%-6s %7.1f ns/msg", name, (double)slice / tests);
+    for (i = 0; i < TC_COUNTERS; i++) {
+        if (fds[i] < 0) {
+            printf(", %s n/a", tc_counters[i].name);
+            continue;
+        }
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+            values[i] = 0;
+        close(fds[i]);
+        printf(", %s %.2f/msg", tc_counters[i].name,
+            (double)values[i] / tests);
+    }
+    printf("\n");
+
+    msgQDelete(msgQTest.msgQId);
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int tests = 1000000;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    if (argc > 1)
+        tests = atoi(argv[1]);
+
+    tc_cache_line("fifo", MSG_Q_FIFO, tests);
+    tc_cache_line("spsc", MSG_Q_SPSC, tests);
+    tc_cache_line("mpmc", MSG_Q_MPMC, tests);
+    tc_cache_line("varlen", MSG_Q_VARLEN, tests);
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * testLatency.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the latency histogram of the MSG_Q_LATENCY option.
+ *
+ * Most messages of a timed queue are received at once and a few are held for
+ * a known delay, by msgQReceive, msgQReceiveBatch and msgQReceivePeek, in
+ * each mode of the queue. msgQLatency must count every message received, put
+ * the median below the delay and the tail percentiles at the delay at least,
+ * and keep the percentiles in order up to the max. A queue without the option
+ * has no histogram.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+#define TC_AT_ONCE      196
+#define TC_DELAYED      4
+#define TC_DELAY_MS     20
+
+/* sleep for some milliseconds */
+static void tc_sleep(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+/* send a message */
+static int tc_send(MSG_Q_ID msgQId) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, 'l', sizeof(msg));
+    return msgQSend(msgQId, msg, sizeof(msg), 0, MSG_PRI_NORMAL);
+}
+
+/* the percentiles are in order, and the max holds the delay */
+static void tc_order(MSG_Q_ID msgQId, unsigned long long count) {
+    MSG_Q_LAT_STAT lat;
+    unsigned long long delay = (unsigned long long)TC_DELAY_MS * 1000000;
+
+    memset(&lat, 0xff, sizeof(lat));
+    TC_CHECK(msgQLatency(msgQId, &lat) == 0);
+    TC_CHECK(lat.count == count);
+    TC_CHECK(lat.p50 <= lat.p99 && lat.p99 <= lat.p999 &&
+        lat.p999 <= lat.max);
+    TC_CHECK(lat.max >= delay);
+
+    /* 2 messages in 100 are delayed, at the 98th percentile */
+    TC_CHECK(lat.p50 < delay);
+    TC_CHECK(lat.p99 >= delay);
+}
+
+/* time the messages of a queue of a mode */
+static void tc_mode(int options) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_LAT_STAT lat;
+    char buffer[TC_DELAYED * TC_MSG_LENGTH];
+    UINT lengths[TC_DELAYED];
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int index = 0;
+
+    /* a VARLEN ring of TC_MAX_MSGS messages and their headers and stamps */
+    msgQId = msgQCreate((options & MSG_Q_VARLEN) ?
+        TC_MAX_MSGS * (TC_MSG_LENGTH + 16) : TC_MAX_MSGS, TC_MSG_LENGTH,
+        options | MSG_Q_LATENCY);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* nothing is timed before the first message is received */
+    memset(&lat, 0xff, sizeof(lat));
+    TC_CHECK(msgQLatency(msgQId, &lat) == 0);
+    TC_CHECK(lat.count == 0 && lat.p50 == 0 && lat.max == 0);
+
+    /* a message sent is not timed until it is received */
+    TC_CHECK(tc_send(msgQId) == 0);
+    TC_CHECK(msgQLatency(msgQId, &lat) == 0 && lat.count == 0);
+    TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0);
+
+    for (index = 1; index < TC_AT_ONCE / 2; index++) {
+        TC_CHECK(tc_send(msgQId) == 0);
+        TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0);
+    }
+
+    /* two messages held for the delay, received one at a time */
+    TC_CHECK(tc_send(msgQId) == 0);
+    TC_CHECK(tc_send(msgQId) == 0);
+    tc_sleep(TC_DELAY_MS);
+    TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0);
+    TC_CHECK(msgQReceive(msgQId, buffer, sizeof(buffer), 0) == 0);
+    tc_order(msgQId, TC_AT_ONCE / 2 + 2);
+
+    /* a batch at once, then two more held and received by a batch */
+    for (index = 0; index < TC_AT_ONCE / 2; index++) {
+        TC_CHECK(tc_send(msgQId) == 0);
+        TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+            TC_DELAYED, 0) == 1);
+    }
+    TC_CHECK(tc_send(msgQId) == 0);
+    TC_CHECK(tc_send(msgQId) == 0);
+    tc_sleep(TC_DELAY_MS);
+    TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+        TC_DELAYED, 0) == 2);
+    tc_order(msgQId, TC_AT_ONCE + TC_DELAYED);
+
+    /* a peeked message is timed when it is peeked, not when released */
+    if ((options & MSG_Q_VARLEN) == 0) {
+        TC_CHECK(tc_send(msgQId) == 0);
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+        TC_CHECK(msgQLatency(msgQId, &lat) == 0);
+        TC_CHECK(lat.count == TC_AT_ONCE + TC_DELAYED + 1);
+        TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+        TC_CHECK(msgQLatency(msgQId, &lat) == 0);
+        TC_CHECK(lat.count == TC_AT_ONCE + TC_DELAYED + 1);
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_LAT_STAT lat;
+    char msg[TC_MSG_LENGTH];
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+        tc_mode(tc_modes[index].options);
+    }
+
+    /* a queue without the option has no histogram */
+    msgQId = msgQCreate(TC_MAX_MSGS, TC_MSG_LENGTH, MSG_Q_FIFO);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId != NULL) {
+        TC_CHECK(tc_send(msgQId) == 0);
+        TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+        TC_CHECK(msgQLatency(msgQId, &lat) == -1);
+        TC_CHECK(msgQShow(msgQId) == 0);
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    return tc_report("Latency");
+}
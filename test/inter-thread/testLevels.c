@@ -0,0 +1,123 @@
+/**
+ * testLevels.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the 32 message priority levels of the message queue
+ * module.
+ *
+ * Messages are sent at pseudo-random levels to a list mode queue and must be
+ * received from the highest level down, and in FIFO order within a level. A
+ * normal message goes to level 0 with those of MSG_PRI_LEVEL(0), an urgent
+ * one ahead of all the messages of level 31, and a priority which is none of
+ * these is refused.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     256
+
+/* a message carries its level and its order of sending */
+typedef struct tagTC_MSG {
+    int level;
+    int seq;
+}TC_MSG;
+
+/* send the messages at pseudo-random levels and receive them */
+static void tc_levels(MSG_Q_ID msgQId) {
+    TC_MSG msg;
+    int last[MSG_PRI_LEVELS];
+    int level = MSG_PRI_LEVELS;
+    int seed = 1;
+    int i = 0;
+
+    for (i = 0; i < TC_MAX_MSGS; i++) {
+        seed = seed * 1103515245 + 12345;
+        msg.level = (seed >> 16) & (MSG_PRI_LEVELS - 1);
+        msg.seq = i;
+        TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+            MSG_PRI_LEVEL(msg.level)) == 0);
+    }
+
+    for (i = 0; i < MSG_PRI_LEVELS; i++)
+        last[i] = -1;
+
+    for (i = 0; i < TC_MAX_MSGS; i++) {
+        TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == 0);
+        TC_CHECK(msg.level <= level);
+        TC_CHECK(msg.seq > last[msg.level]);
+        level = msg.level;
+        last[msg.level] = msg.seq;
+    }
+
+    TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == -1);
+}
+
+/* the normal and urgent messages are at the ends of the levels */
+static void tc_ends(MSG_Q_ID msgQId) {
+    static const struct {
+        int priority;
+        int seq;
+    } sends[] = {
+        {MSG_PRI_LEVEL(0), 0},
+        {MSG_PRI_NORMAL, 1},
+        {MSG_PRI_LEVEL(31), 2},
+        {MSG_PRI_URGENT, 3},
+        {MSG_PRI_URGENT, 4},
+        {MSG_PRI_LEVEL(16), 5}
+    };
+    static const int order[] = {4, 3, 2, 5, 0, 1};
+    TC_MSG msg;
+    UINT i = 0;
+
+    for (i = 0; i < sizeof(sends) / sizeof(sends[0]); i++) {
+        msg.level = 0;
+        msg.seq = sends[i].seq;
+        TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+            sends[i].priority) == 0);
+    }
+
+    for (i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+        TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == 0);
+        TC_CHECK(msg.seq == order[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    static const int options[] = {MSG_Q_FIFO, MSG_Q_PRIORITY};
+    MSG_Q_ID msgQId = NULL;
+    TC_MSG msg = {0, 0};
+    UINT index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < sizeof(options) / sizeof(options[0]); index++) {
+        msgQId = msgQCreate(TC_MAX_MSGS, sizeof(TC_MSG), options[index]);
+        TC_CHECK(msgQId != NULL);
+        if (msgQId == NULL)
+            continue;
+
+        tc_levels(msgQId);
+        tc_ends(msgQId);
+
+        /* only the normal, urgent and level priorities are valid */
+        TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0, 2) == -1);
+        TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0, 0x200) == -1);
+        TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+            MSG_PRI_LEVEL(0) | 0x40) == -1);
+
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    return tc_report("Levels");
+}
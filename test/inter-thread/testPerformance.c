@@ -1,10 +1,27 @@
 /**
- * test.cpp
+ * testPerformance.c
  * This file has no copyright assigned and is placed in the Public Domain.
  * This file is a part of the virtual operating system package.
  * No warranty is given; refer to the file DISCLAIMER within the package.
  *
- * Test cases and examples for the message queue module.
+ * Benchmark suite of msgQSend and msgQReceive.
+ *
+ *     Performance.exe [-n messages] [-q depth] [-s size] [-p producers]
+ *                     [-c consumers] [-m thread|named] [-w block|poll]
+ *
+ * Each case runs producers and consumers threads on a queue, inter-thread or
+ * named, calling either with WAIT_FOREVER or with the timeout 0 and retrying
+ * until the call succeeds. The matrix covers the message sizes from 8 bytes
+ * to 64KB and from 1 to 32 producers and consumers; an option restricts a
+ * dimension to one value. Every message carries the time it was sent, and the
+ * consumer records the time from before msgQSend to after msgQReceive in a
+ * log-linear histogram. The results are printed in CSV on stdout, one line
+ * per case, the progress on stderr:
+ *
+ *     queue,wait,size,producers,consumers,messages,seconds,msgs_per_sec,
+ *     mb_per_sec,p50_ns,p99_ns,p999_ns,max_ns,retries
+ *
+ * where retries counts the calls with the timeout 0 which failed.
  *
  * NOTE: The message queue manipulation functions in this file are similar
  * with the Wind River VxWorks kernel message queue interfaces.
@@ -15,303 +32,420 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#ifdef _WIN32
 #include <windows.h>
 #include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "msgQueue.h"
 
-typedef struct tagMSG_Q_TEST {
+#define BENCH_NAME          "bench"     /* name of the named queue */
+#define BENCH_MESSAGES      100000      /* messages of a case */
+#define BENCH_BYTES         (1 << 30)   /* bytes of a case at most */
+#define BENCH_DEPTH         64          /* messages of the queue */
+#define BENCH_THREADS       32          /* producers or consumers at most */
+#define BENCH_SUB_BITS      4           /* buckets of a power of two, log2 */
+#define BENCH_BUCKETS       (64 << BENCH_SUB_BITS)
+
+#ifdef _WIN32
+typedef HANDLE TEST_THREAD;
+#else
+typedef pthread_t TEST_THREAD;
+#endif
+
+/* the latency histogram of a consumer */
+typedef struct tagBENCH_HIST {
+    unsigned long long bucket[BENCH_BUCKETS];
+    unsigned long long max;
+}BENCH_HIST;
+
+/* a case of the matrix */
+typedef struct tagBENCH_CASE {
+    int named;
+    int poll;
+    int size;
+    int producers;
+    int consumers;
+    int messages;
+}BENCH_CASE;
+
+/* the parameters and the results of a thread */
+typedef struct tagBENCH_TASK {
     MSG_Q_ID msgQId;
-    MSG_Q_ID send;
-    MSG_Q_ID recv;
+    volatile int * pStart;
+    int size;
+    int poll;
     int count;
-}MSG_Q_TEST;
+    unsigned long long retries;
+    BENCH_HIST * pHist;
+}BENCH_TASK;
+
+/* the dimensions of the matrix */
+static int bench_sizes[] = {8, 64, 512, 4096, 65536};
+static int bench_threads[][2] = {
+    {1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4}, {8, 8}, {16, 16}, {32, 32}
+};
+
+/* nanoseconds since an arbitrary point, the same for all the threads */
+static long long bench_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (long long)(count.QuadPart / freq.QuadPart) * 1000000000LL +
+        (long long)(count.QuadPart % freq.QuadPart) * 1000000000LL /
+        freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
 
-typedef struct tagMSG_Q_RESULT {
-    int count;
-    int time;
-}MSG_Q_RESULT;
+/* give the processor to another thread */
+static void bench_yield(void) {
+#ifdef _WIN32
+    Sleep(0);
+#else
+    sched_yield();
+#endif
+}
 
-int tc_create_delete(void) {
-    int i = 0;
-    int rc = 0;
-    MSG_Q_ID * msgQId = NULL;
-    int count = 10000;
-    int slice = 0;
-    int result = 0;
+/* spawn a test thread running entry(param) */
+static TEST_THREAD testThreadSpawn(unsigned int (*entry)(void *), void *param) {
+#ifdef _WIN32
+    unsigned int tid = 0;
+
+    return (HANDLE)CreateThread(NULL, 0,
+            (LPTHREAD_START_ROUTINE)entry, param, 0, (DWORD*)&tid);
+#else
+    pthread_t tid;
 
-    printf("start of test %s.\n", __func__);
+    pthread_create(&tid, NULL, (void *(*)(void *))entry, param);
+    return tid;
+#endif
+}
 
-    /* allocate memory for MSG_Q_ID */
-    msgQId = (MSG_Q_ID*)malloc(sizeof(MSG_Q_ID) * count);
-    memset(msgQId, 0, sizeof(MSG_Q_ID) * count);
+/* wait for a test thread to exit and release it */
+static void testThreadClose(TEST_THREAD thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
 
-    /* test for msgQCreate */
-    slice = GetTickCount();
-    for(i = 0; i < count; i++) {
-        msgQId[i] = msgQCreate(100, 100, MSG_Q_FIFO);
-        if(msgQId[i] == NULL) {
-            printf("%s: create message queue failed in loop %d.\n", __func__, i);
-            result = -1;
-            break;
-        }
-    }
-    slice = GetTickCount() - slice;
-    printf("finish msgQCreate(...) in %d times with %d ms.\n", i, slice);
-
-    /* test for msgQDelete */
-    slice = GetTickCount();
-    for(i = 0; i < count; i++) {
-        if (msgQId[i] != NULL)
-        rc = msgQDelete(msgQId[i]);
-        if(rc != 0) {
-            printf("%s: delete message queue failed in loop %d.\n", __func__, i);
-            result = -1;
-            break;
-        }
-    }
-    slice = GetTickCount() - slice;
-    printf("finish msgQDelete(...) in %d times with %d ms.\n", i, slice);
+/* get the bucket of a time, each power of two has 2^BENCH_SUB_BITS buckets */
+static int bench_bucket(unsigned long long ns) {
+    int exp = 0;
 
-    free(msgQId);
-    printf("end of testing %s.\n", __func__);
+    if (ns < (1 << BENCH_SUB_BITS))
+        return (int)ns;
 
-    return result;
+    while ((ns >> exp) >= (2 << BENCH_SUB_BITS))
+        exp++;
+
+    return (exp + 1) * (1 << BENCH_SUB_BITS) + (int)(ns >> exp) -
+        (1 << BENCH_SUB_BITS);
 }
 
-int tc_create_delete_ex(void) {
-    int i = 0;
-    int rc = 0;
-    MSG_Q_ID * msgQId = NULL;
-    int count = 10000;
-    int slice = 0;
-    int result = 0;
-    char buf[64] = {0};
-
-    printf("start of test %s.\n", __func__);
-
-    /* allocate memory for MSG_Q_ID */
-    msgQId = (MSG_Q_ID*)malloc(sizeof(MSG_Q_ID) * count);
-    memset(msgQId, 0, sizeof(MSG_Q_ID) * count);
-
-    /* test for msgQCreateEx */
-    slice = GetTickCount();
-    for(i = 0; i < count; i++) {
-        sprintf(buf, "test_%d", i);
-        msgQId[i] = msgQCreateEx(100, 100, MSG_Q_FIFO, buf);
-        if(msgQId[i] == NULL) {
-            printf("%s: create message queue failed in loop %d.\n", __func__, i);
-            result = -1;
-            break;
-        }
-    }
-    slice = GetTickCount() - slice;
-    printf("finish msgQCreateEx(...) in %d times with %d ms.\n", i, slice);
-
-    /* test for msgQDelete */
-    slice = GetTickCount();
-    for(i = 0; i < count; i++) {
-        if (msgQId[i] != NULL)
-        rc = msgQDelete(msgQId[i]);
-        if(rc != 0) {
-            printf("%s: delete message queue failed in loop %d.\n", __func__, i);
-            result = -1;
+/* get the highest time of a bucket */
+static unsigned long long bench_top(int bucket) {
+    int sub = 1 << BENCH_SUB_BITS;
+
+    if (bucket < sub)
+        return (unsigned long long)bucket;
+
+    return ((unsigned long long)(sub + bucket % sub + 1) <<
+        (bucket / sub - 1)) - 1;
+}
+
+/* get the time at a percentile, in tenths of a percent */
+static unsigned long long bench_percentile(BENCH_HIST * pHist, int permille) {
+    unsigned long long total = 0;
+    unsigned long long rank = 0;
+    unsigned long long seen = 0;
+    unsigned long long top = 0;
+    int bucket = 0;
+
+    for (bucket = 0; bucket < BENCH_BUCKETS; bucket++)
+        total += pHist->bucket[bucket];
+
+    if (total == 0)
+        return 0;
+
+    rank = (total * permille + 999) / 1000;
+    for (bucket = 0; bucket < BENCH_BUCKETS; bucket++) {
+        seen += pHist->bucket[bucket];
+        if (seen >= rank)
             break;
-        }
     }
-    slice = GetTickCount() - slice;
-    printf("finish msgQDelete(...) in %d times with %d ms.\n", i, slice);
 
-    free(msgQId);
-    printf("end of testing %s.\n", __func__);
-
-    return result;
+    top = bench_top(bucket);
+    return top > pHist->max ? pHist->max : top;
 }
 
-unsigned int msgQSender(void *param) {
+unsigned int bench_producer(void *param) {
+    BENCH_TASK * pTask = (BENCH_TASK*)param;
+    char * buf = (char*)calloc(1, pTask->size);
+    long long stamp = 0;
     int i = 0;
-    int priority = 0;
-    int rc = 0;
-    MSG_Q_TEST * msgQTest = (MSG_Q_TEST*)param;
-    MSG_Q_ID msgQId = msgQTest->msgQId;
-    MSG_Q_ID send = msgQTest->send;
-    int count = msgQTest->count;
-    int slice = 0;
-    MSG_Q_RESULT ret = {0};
-
-    slice = GetTickCount();
-    for (i = 0; i < count; i++) {
-        char buf[64] = {0};
-        sprintf(buf, "%s-%08d", "ab", i);
-        srand((unsigned)time(NULL));
-        if(0 == (rand() % 2))
-            priority = MSG_PRI_NORMAL;
-        else priority = MSG_PRI_URGENT;
-        rc = msgQSend(msgQId, buf, strlen(buf), WAIT_FOREVER, priority);
-        if(rc != 0) {
+
+    if (buf == NULL) {
+        printf("allocate memory failed in %s.\n", __func__);
+        return -1;
+    }
+
+    while (!*pTask->pStart)
+        bench_yield();
+
+    for (i = 0; i < pTask->count; i++) {
+        stamp = bench_now();
+        memcpy(buf, &stamp, sizeof(stamp));
+        if (pTask->poll) {
+            while (msgQSend(pTask->msgQId, buf, pTask->size, 0,
+                MSG_PRI_NORMAL) != 0) {
+                pTask->retries++;
+                bench_yield();
+            }
+        }
+        else if (msgQSend(pTask->msgQId, buf, pTask->size, WAIT_FOREVER,
+            MSG_PRI_NORMAL) != 0) {
             printf("send message failed in %s.\n", __func__);
             break;
         }
     }
-    slice = GetTickCount() - slice;
-
-    ret.count = i;
-    ret.time = slice;
-    rc = msgQSend(send, (char*)&ret, sizeof(ret), WAIT_FOREVER, MSG_PRI_NORMAL);
-    if(rc != 0) {
-        printf("send message failed in %s.\n", __func__);
-        return -1;
-    }
 
+    free(buf);
     return 0;
 }
 
-unsigned int msgQReceiver(void *param) {
-    char buf[64] = {0};
+unsigned int bench_consumer(void *param) {
+    BENCH_TASK * pTask = (BENCH_TASK*)param;
+    BENCH_HIST * pHist = pTask->pHist;
+    char * buf = (char*)calloc(1, pTask->size);
+    long long stamp = 0;
+    unsigned long long ns = 0;
     int i = 0;
-    int rc = 0;
-    MSG_Q_TEST * msgQTest = (MSG_Q_TEST*)param;
-    MSG_Q_ID msgQId = msgQTest->msgQId;
-    MSG_Q_ID recv = msgQTest->recv;
-    int count = msgQTest->count;
-    int slice = 0;
-    MSG_Q_RESULT ret = {0};
-
-    slice = GetTickCount();
-    for (i = 0; i < count; i++) {
-        memset(buf, 0, sizeof(buf));
-        rc = msgQReceive(msgQId, buf, sizeof(buf), WAIT_FOREVER);
-        if(rc != 0) {
+
+    if (buf == NULL) {
+        printf("allocate memory failed in %s.\n", __func__);
+        return -1;
+    }
+
+    while (!*pTask->pStart)
+        bench_yield();
+
+    for (i = 0; i < pTask->count; i++) {
+        if (pTask->poll) {
+            while (msgQReceive(pTask->msgQId, buf, pTask->size, 0) != 0) {
+                pTask->retries++;
+                bench_yield();
+            }
+        }
+        else if (msgQReceive(pTask->msgQId, buf, pTask->size,
+            WAIT_FOREVER) != 0) {
             printf("receive message failed in %s.\n", __func__);
             break;
         }
-    }
-    slice = GetTickCount() - slice;
 
-    ret.count = i;
-    ret.time = slice;
-    rc = msgQSend(recv, (char*)&ret, sizeof(ret), WAIT_FOREVER, MSG_PRI_NORMAL);
-    if(rc != 0) {
-        printf("send message failed in %s.\n", __func__);
-        return -1;
+        memcpy(&stamp, buf, sizeof(stamp));
+        ns = (unsigned long long)(bench_now() - stamp);
+        pHist->bucket[bench_bucket(ns)]++;
+        if (ns > pHist->max)
+            pHist->max = ns;
     }
 
+    free(buf);
     return 0;
 }
 
-int tc_send_recv(int buffer, int tests, int ext) {
-    HANDLE hSender = NULL;
-    HANDLE hReceiver = NULL;
-    unsigned int tSender = 0;
-    unsigned int tReceiver = 0;
+/* run a case and print its line */
+int bench_run(BENCH_CASE * pCase, int depth) {
+    TEST_THREAD threads[BENCH_THREADS * 2];
+    BENCH_TASK tasks[BENCH_THREADS * 2];
+    BENCH_HIST * pHists = NULL;
+    BENCH_HIST hist;
     MSG_Q_ID msgQId = NULL;
-    MSG_Q_ID send = NULL;
-    MSG_Q_ID recv = NULL;
-    MSG_Q_TEST msgQTest = {0};
-    MSG_Q_RESULT ret = {0};
-    int rc = 0;
-
-    if (ext) {
-        msgQId = msgQCreateEx(buffer, 100, MSG_Q_FIFO, "self");
-    }
-    else {
-        msgQId = msgQCreate(buffer, 100, MSG_Q_FIFO);
-    }
-    if(msgQId == NULL) {
-        printf("create message queue failed in %s.\n", __func__);
-        exit(1);
-    }
-
-    send = msgQCreate(4, 100, MSG_Q_FIFO);
-    if(send == NULL) {
+    volatile int start = 0;
+    unsigned long long retries = 0;
+    long long slice = 0;
+    double seconds = 0.0;
+    int threadNum = pCase->producers + pCase->consumers;
+    int messages = 0;
+    int index = 0;
+    int bucket = 0;
+
+    if (pCase->named)
+        msgQId = msgQCreateEx(depth, pCase->size, MSG_Q_FIFO, BENCH_NAME);
+    else
+        msgQId = msgQCreate(depth, pCase->size, MSG_Q_FIFO);
+    if (msgQId == NULL) {
         printf("create message queue failed in %s.\n", __func__);
-        exit(1);
-    }
-
-    recv = msgQCreate(4, 100, MSG_Q_FIFO);
-    if(recv == NULL) {
-        printf("create message queue failed in %s.\n", __func__);
-        exit(1);
+        return -1;
     }
 
-    /* test structure */
-    msgQTest.msgQId = msgQId;
-    msgQTest.send = send;
-    msgQTest.recv = recv;
-    msgQTest.count = tests;
-
-    hSender = (HANDLE)CreateThread(NULL, 0,
-            (LPTHREAD_START_ROUTINE)msgQSender,
-    		&msgQTest, 0, (DWORD*)&tSender);
-
-    hReceiver = (HANDLE)CreateThread(NULL, 0,
-            (LPTHREAD_START_ROUTINE)msgQReceiver,
-    		&msgQTest, 0, (DWORD*)&tReceiver);
-
-    /* wait for result */
-    rc = msgQReceive(send, (char*)&ret, sizeof(ret), WAIT_FOREVER);
-    if(rc != 0) {
-        printf("receive message failed in %s.\n", __func__);
+    pHists = (BENCH_HIST*)calloc(pCase->consumers, sizeof(BENCH_HIST));
+    if (pHists == NULL) {
+        printf("allocate memory failed in %s.\n", __func__);
+        msgQDelete(msgQId);
         return -1;
     }
-    printf("finish msgQSend(...) in %d times with %d ms.\n", ret.count, ret.time);
 
-    rc = msgQReceive(recv, (char*)&ret, sizeof(ret), WAIT_FOREVER);
-    if(rc != 0) {
-        printf("receive message failed in %s.\n", __func__);
-        return -1;
+    /* the producers share the messages, the consumers take them all */
+    memset(tasks, 0, sizeof(tasks));
+    messages = pCase->messages / pCase->producers * pCase->producers;
+    for (index = 0; index < threadNum; index++) {
+        tasks[index].msgQId = msgQId;
+        tasks[index].pStart = &start;
+        tasks[index].size = pCase->size;
+        tasks[index].poll = pCase->poll;
+        if (index < pCase->producers) {
+            tasks[index].count = messages / pCase->producers;
+        }
+        else {
+            tasks[index].count = messages / pCase->consumers;
+            if (index == pCase->producers)
+                tasks[index].count += messages % pCase->consumers;
+            tasks[index].pHist = &pHists[index - pCase->producers];
+        }
+        threads[index] = testThreadSpawn(index < pCase->producers ?
+            bench_producer : bench_consumer, &tasks[index]);
     }
-    printf("finish msgQReceive(...) in %d times with %d ms.\n", ret.count, ret.time);
 
-    CloseHandle(hReceiver);
-    CloseHandle(hSender);
+    slice = bench_now();
+    start = 1;
+    for (index = 0; index < threadNum; index++)
+        testThreadClose(threads[index]);
+    slice = bench_now() - slice;
 
-    msgQDelete(send);
-    msgQDelete(recv);
     msgQDelete(msgQId);
 
-    return 0;
-}
+    /* merge the histograms of the consumers */
+    memset(&hist, 0, sizeof(hist));
+    for (index = 0; index < pCase->consumers; index++) {
+        for (bucket = 0; bucket < BENCH_BUCKETS; bucket++)
+            hist.bucket[bucket] += pHists[index].bucket[bucket];
+        if (pHists[index].max > hist.max)
+            hist.max = pHists[index].max;
+    }
+    free(pHists);
 
-int tc_msgQSend_msgQReveive(int maxMsgs, int tests){
-    int rc = 0;
+    for (index = 0; index < threadNum; index++)
+        retries += tasks[index].retries;
 
-    printf("start of test %s with buffer %d.\n", __func__, maxMsgs);
-    rc = tc_send_recv(maxMsgs, tests, 0);
-    printf("end of testing %s with buffer %d.\n", __func__, maxMsgs);
+    seconds = slice / 1e9;
+    printf("%s,%s,%d,%d,%d,%d,%.6f,%.0f,%.2f,%llu,%llu,%llu,%llu,%llu\n",
+        pCase->named ? "named" : "thread", pCase->poll ? "poll" : "block",
+        pCase->size, pCase->producers, pCase->consumers, messages, seconds,
+        messages / seconds, (double)messages * pCase->size / seconds / 1e6,
+        bench_percentile(&hist, 500), bench_percentile(&hist, 990),
+        bench_percentile(&hist, 999), hist.max, retries);
 
-    return rc;
+    return 0;
 }
 
-int tc_msgQSend_msgQReveive_Ex(int maxMsgs, int tests){
-    int rc = 0;
-
-    printf("start of test %s with buffer %d.\n", __func__, maxMsgs);
-    rc = tc_send_recv(maxMsgs, tests, 1);
-    printf("end of testing %s with buffer %d.\n", __func__, maxMsgs);
-
-    return rc;
+static void bench_usage(void) {
+    fprintf(stderr, "usage: Performance.exe [-n messages] [-q depth] "
+        "[-s size] [-p producers]\n"
+        "                       [-c consumers] [-m thread|named] "
+        "[-w block|poll]\n");
 }
 
 int main(int argc, char **argv) {
-    int tests = 1000000;
-    int buffer[] = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
-    unsigned int index = 0;
+    BENCH_CASE benchCase;
+    int messages = BENCH_MESSAGES;
+    int depth = BENCH_DEPTH;
+    int size = 0;
+    int producers = 0;
+    int consumers = 0;
+    int named = -1;
+    int poll = -1;
+    int index = 0;
+    unsigned int sizeIndex = 0;
+    unsigned int threadIndex = 0;
+    int result = 0;
 
-    /* Fix the eclipse CDT output issue */
-    setbuf(stdout, NULL);
-    setbuf(stderr, NULL);
+    for (index = 1; index < argc; index++) {
+        if (index + 1 == argc || argv[index][0] != '-' ||
+            argv[index][2] != '\0') {
+            bench_usage();
+            return 1;
+        }
+        switch (argv[index++][1]) {
+        case 'n': messages = atoi(argv[index]); break;
+        case 'q': depth = atoi(argv[index]); break;
+        case 's': size = atoi(argv[index]); break;
+        case 'p': producers = atoi(argv[index]); break;
+        case 'c': consumers = atoi(argv[index]); break;
+        case 'm': named = strcmp(argv[index], "named") == 0; break;
+        case 'w': poll = strcmp(argv[index], "poll") == 0; break;
+        default: bench_usage(); return 1;
+        }
+    }
 
-    tc_create_delete();
-    tc_create_delete_ex();
+    if (messages <= 0 || depth <= 0 || size < 0 ||
+        producers < 0 || producers > BENCH_THREADS ||
+        consumers < 0 || consumers > BENCH_THREADS ||
+        (size != 0 && size < (int)sizeof(long long))) {
+        bench_usage();
+        return 1;
+    }
 
-    for (index = 0; index < sizeof(buffer)/sizeof(int); index++) {
-        tc_msgQSend_msgQReveive(buffer[index], tests);
+    /* a dimension given on the command line has only the value given */
+    if (size != 0) {
+        bench_sizes[0] = size;
+    }
+    if (producers != 0 || consumers != 0) {
+        bench_threads[0][0] = producers != 0 ? producers : 1;
+        bench_threads[0][1] = consumers != 0 ? consumers : 1;
     }
 
-    for (index = 0; index < sizeof(buffer)/sizeof(int); index++) {
-        tc_msgQSend_msgQReveive_Ex(buffer[index], tests);
+    printf("queue,wait,size,producers,consumers,messages,seconds,"
+        "msgs_per_sec,mb_per_sec,p50_ns,p99_ns,p999_ns,max_ns,retries\n");
+    fflush(stdout);
+
+    for (benchCase.named = 0; benchCase.named < 2; benchCase.named++) {
+        if (named != -1 && named != benchCase.named)
+            continue;
+        for (benchCase.poll = 0; benchCase.poll < 2; benchCase.poll++) {
+            if (poll != -1 && poll != benchCase.poll)
+                continue;
+            for (sizeIndex = 0; sizeIndex < (size != 0 ? 1 :
+                sizeof(bench_sizes) / sizeof(bench_sizes[0])); sizeIndex++) {
+                for (threadIndex = 0; threadIndex <
+                    (producers != 0 || consumers != 0 ? 1 :
+                    sizeof(bench_threads) / sizeof(bench_threads[0]));
+                    threadIndex++) {
+                    benchCase.size = bench_sizes[sizeIndex];
+                    benchCase.producers = bench_threads[threadIndex][0];
+                    benchCase.consumers = bench_threads[threadIndex][1];
+
+                    /* the large messages are fewer, not to take too long */
+                    benchCase.messages = messages;
+                    if ((long long)messages * benchCase.size > BENCH_BYTES)
+                        benchCase.messages = BENCH_BYTES / benchCase.size;
+
+                    fprintf(stderr, "%s %s %d bytes %dx%d...\n",
+                        benchCase.named ? "named" : "thread",
+                        benchCase.poll ? "poll" : "block", benchCase.size,
+                        benchCase.producers, benchCase.consumers);
+                    if (bench_run(&benchCase, depth) != 0)
+                        result = 1;
+                    fflush(stdout);
+                }
+            }
+        }
     }
 
-	return 0;
+    return result;
 }
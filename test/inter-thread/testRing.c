@@ -0,0 +1,320 @@
+/**
+ * testRing.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the lock-free ring modes of the message queue module.
+ *
+ * A ring has a power of two number of slots, and must still hold no more than
+ * <maxMsgs> messages, and deliver them in order, lap after lap, wherever the
+ * wrap-around of the slots falls in a run of messages. A stream of messages
+ * is then passed by threads, single messages and batches, through a ring of
+ * a few slots: one producer and one consumer for MSG_Q_SPSC, several of each
+ * for MSG_Q_MPMC. Each message must be received once, intact, and each
+ * consumer must get the messages of a producer in their order of sending.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MSG_LENGTH   32
+#define TC_MESSAGES     20000
+#define TC_THREADS      4
+#define TC_BATCH        3
+
+#ifdef _WIN32
+typedef HANDLE TC_THREAD;
+#else
+typedef pthread_t TC_THREAD;
+#endif
+
+/* a message carries its sender and its order of sending */
+typedef struct tagTC_MSG {
+    int producer;
+    int seq;
+    char fill[TC_MSG_LENGTH - 2 * sizeof(int)];
+}TC_MSG;
+
+/* a thread of the stream */
+typedef struct tagTC_TASK {
+    MSG_Q_ID msgQId;
+    int index;
+    int count;
+}TC_TASK;
+
+/* times each message of the stream has been received */
+static int tc_received[TC_THREADS][TC_MESSAGES];
+static int tc_stream_failures = 0;
+
+/* spawn a thread running entry(param) */
+static TC_THREAD tc_spawn(unsigned int (*entry)(void *), void *param) {
+#ifdef _WIN32
+    unsigned int tid = 0;
+
+    return (HANDLE)CreateThread(NULL, 0,
+            (LPTHREAD_START_ROUTINE)entry, param, 0, (DWORD*)&tid);
+#else
+    pthread_t tid;
+
+    pthread_create(&tid, NULL, (void *(*)(void *))entry, param);
+    return tid;
+#endif
+}
+
+/* wait for a thread to exit and release it */
+static void tc_join(TC_THREAD thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* fill a message, so a torn message shows */
+static void tc_fill(TC_MSG * msg, int producer, int seq) {
+    msg->producer = producer;
+    msg->seq = seq;
+    memset(msg->fill, seq & 0xff, sizeof(msg->fill));
+}
+
+/* check a message filled by tc_fill */
+static int tc_intact(const TC_MSG * msg) {
+    UINT index = 0;
+
+    if (msg->producer < 0 || msg->producer >= TC_THREADS ||
+        msg->seq < 0 || msg->seq >= TC_MESSAGES)
+        return 0;
+
+    for (index = 0; index < sizeof(msg->fill); index++) {
+        if ((unsigned char)msg->fill[index] != (msg->seq & 0xff))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* the ring holds <maxMsgs> messages and passes them in order, lap by lap */
+static void tc_laps(int options, int maxMsgs) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    TC_MSG msg;
+    int sent = 0;
+    int received = 0;
+    int run = 0;
+    int i = 0;
+
+    msgQId = msgQCreate(maxMsgs, sizeof(TC_MSG), options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* the runs of 1 to maxMsgs messages move the wrap-around in the run */
+    for (run = 1; run <= maxMsgs * 4; run++) {
+        int count = run % maxMsgs + 1;
+
+        for (i = 0; i < count; i++) {
+            tc_fill(&msg, 0, sent % TC_MESSAGES);
+            TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+                MSG_PRI_NORMAL) == 0);
+            sent++;
+        }
+
+        /* a full ring refuses a message, however many slots it has */
+        if (count == maxMsgs) {
+            TC_CHECK(msgQSend(msgQId, (char*)&msg, sizeof(msg), 0,
+                MSG_PRI_NORMAL) == -1);
+        }
+
+        TC_CHECK(msgQStat(msgQId, &stat) == 0);
+        TC_CHECK(stat.msgNum == count);
+
+        for (i = 0; i < count; i++) {
+            TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == 0);
+            TC_CHECK(tc_intact(&msg) && msg.seq == received % TC_MESSAGES);
+            received++;
+        }
+        TC_CHECK(msgQReceive(msgQId, (char*)&msg, sizeof(msg), 0) == -1);
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* send the messages of a producer, alone and in batches */
+static unsigned int tc_producer(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    TC_MSG msgs[TC_BATCH];
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    int seq = 0;
+    int count = 0;
+    int index = 0;
+
+    while (seq < TC_MESSAGES) {
+        if (seq % 7 != 0) {
+            tc_fill(&msgs[0], task->index, seq);
+            if (msgQSend(task->msgQId, (char*)&msgs[0], sizeof(TC_MSG),
+                WAIT_FOREVER, MSG_PRI_NORMAL) != 0)
+                break;
+            seq++;
+            continue;
+        }
+
+        count = (TC_MESSAGES - seq < TC_BATCH) ? TC_MESSAGES - seq : TC_BATCH;
+        for (index = 0; index < count; index++) {
+            tc_fill(&msgs[index], task->index, seq + index);
+            buffers[index] = (const char*)&msgs[index];
+            lengths[index] = sizeof(TC_MSG);
+        }
+
+        /* a batch is sent in part if the ring is short of slots */
+        count = msgQSendBatch(task->msgQId, buffers, lengths, count,
+            WAIT_FOREVER, MSG_PRI_NORMAL);
+        if (count <= 0)
+            break;
+        seq += count;
+    }
+
+    task->count = seq;
+    return 0;
+}
+
+/* receive the messages of a consumer, alone and in batches */
+static unsigned int tc_consumer(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    TC_MSG msgs[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    int last[TC_THREADS];
+    int count = 0;
+    int index = 0;
+    int round = 0;
+
+    for (index = 0; index < TC_THREADS; index++)
+        last[index] = -1;
+
+    while (task->count > 0) {
+        if (round++ % 5 != 0) {
+            count = (msgQReceive(task->msgQId, (char*)&msgs[0],
+                sizeof(TC_MSG), WAIT_FOREVER) == 0) ? 1 : -1;
+            lengths[0] = sizeof(TC_MSG);
+        }
+        else {
+            count = msgQReceiveBatch(task->msgQId, (char*)msgs, sizeof(msgs),
+                lengths, (task->count < TC_BATCH) ? task->count : TC_BATCH,
+                WAIT_FOREVER);
+        }
+
+        if (count <= 0) {
+            __atomic_fetch_add(&tc_stream_failures, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        /* the messages of a producer come in their order of sending */
+        for (index = 0; index < count; index++) {
+            TC_MSG * msg = &msgs[index];
+
+            if (lengths[index] != sizeof(TC_MSG) || !tc_intact(msg) ||
+                msg->seq <= last[msg->producer]) {
+                __atomic_fetch_add(&tc_stream_failures, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            last[msg->producer] = msg->seq;
+            __atomic_fetch_add(&tc_received[msg->producer][msg->seq], 1,
+                __ATOMIC_RELAXED);
+        }
+
+        task->count -= count;
+    }
+
+    return 0;
+}
+
+/* pass a stream of messages between threads through a ring of a few slots */
+static void tc_stream(int options, int maxMsgs, int producers,
+    int consumers) {
+    MSG_Q_ID msgQId = NULL;
+    TC_THREAD threads[TC_THREADS * 2];
+    TC_TASK tasks[TC_THREADS * 2];
+    int total = producers * TC_MESSAGES;
+    int index = 0;
+    int seq = 0;
+
+    msgQId = msgQCreate(maxMsgs, sizeof(TC_MSG), options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    memset(tc_received, 0, sizeof(tc_received));
+    tc_stream_failures = 0;
+
+    /* the consumers share the messages, the last one takes the rest */
+    for (index = 0; index < consumers; index++) {
+        tasks[index].msgQId = msgQId;
+        tasks[index].index = index;
+        tasks[index].count = (index == consumers - 1) ?
+            total - (consumers - 1) * (total / consumers) : total / consumers;
+        threads[index] = tc_spawn(tc_consumer, &tasks[index]);
+    }
+    for (index = 0; index < producers; index++) {
+        tasks[consumers + index].msgQId = msgQId;
+        tasks[consumers + index].index = index;
+        threads[consumers + index] = tc_spawn(tc_producer,
+            &tasks[consumers + index]);
+    }
+
+    for (index = 0; index < producers + consumers; index++)
+        tc_join(threads[index]);
+
+    TC_CHECK(tc_stream_failures == 0);
+    for (index = 0; index < producers; index++) {
+        TC_CHECK(tasks[consumers + index].count == TC_MESSAGES);
+        for (seq = 0; seq < TC_MESSAGES; seq++) {
+            if (tc_received[index][seq] != 1) {
+                TC_CHECK(tc_received[index][seq] == 1);
+                break;
+            }
+        }
+    }
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    int producers = 0;
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    /* one producer and one consumer of MSG_Q_SPSC, several of MSG_Q_MPMC */
+    for (index = 0; index < TC_MODES; index++) {
+        if ((tc_modes[index].options & (MSG_Q_SPSC | MSG_Q_MPMC)) == 0)
+            continue;
+
+        printf("%s:\n", tc_modes[index].name);
+        producers = (tc_modes[index].options & MSG_Q_MPMC) ? TC_THREADS : 1;
+
+        /* a power of two and a ring of more slots than messages */
+        tc_laps(tc_modes[index].options, 8);
+        tc_laps(tc_modes[index].options, 5);
+
+        tc_stream(tc_modes[index].options, 4, producers, producers);
+        tc_stream(tc_modes[index].options, 3, producers, producers);
+    }
+
+    return tc_report("Ring");
+}
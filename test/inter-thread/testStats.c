@@ -0,0 +1,266 @@
+/**
+ * testStats.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the statistics of msgQStat.
+ *
+ * A scripted sequence of sends and receives, which finds the queue empty and
+ * full with and without a timeout, runs in each mode of the queue, and every
+ * counter of MSG_Q_STAT must match it exactly. Then several threads stream
+ * messages of their own lengths through the queue, so the counters are kept
+ * in several shards, and their sums must match the stream.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     4
+#define TC_MSG_LENGTH   32
+#define TC_TIMEOUT      10
+#define TC_BATCH        3
+#define TC_MESSAGES     2000
+#define TC_THREADS      4
+
+#ifdef _WIN32
+typedef HANDLE TC_THREAD;
+#else
+typedef pthread_t TC_THREAD;
+#endif
+
+/* a thread of the stream */
+typedef struct tagTC_TASK {
+    MSG_Q_ID msgQId;
+    int index;
+    int count;
+}TC_TASK;
+
+/* spawn a thread running entry(param) */
+static TC_THREAD tc_spawn(unsigned int (*entry)(void *), void *param) {
+#ifdef _WIN32
+    unsigned int tid = 0;
+
+    return (HANDLE)CreateThread(NULL, 0,
+            (LPTHREAD_START_ROUTINE)entry, param, 0, (DWORD*)&tid);
+#else
+    pthread_t tid;
+
+    pthread_create(&tid, NULL, (void *(*)(void *))entry, param);
+    return tid;
+#endif
+}
+
+/* wait for a thread to exit and release it */
+static void tc_join(TC_THREAD thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* create a queue of a mode, a VARLEN ring of TC_MAX_MSGS messages at most */
+static MSG_Q_ID tc_create(int options) {
+    return msgQCreate((options & MSG_Q_VARLEN) ?
+        TC_MAX_MSGS * (TC_MSG_LENGTH + 8) : TC_MAX_MSGS, TC_MSG_LENGTH,
+        options);
+}
+
+/* the length of the messages of a producer of the stream */
+static UINT tc_length(int index) {
+    return (UINT)(TC_MSG_LENGTH - index);
+}
+
+/* a scripted sequence counts exactly */
+static void tc_script(int options) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    char msg[TC_MSG_LENGTH];
+    char buffer[TC_BATCH * TC_MSG_LENGTH];
+    const char * buffers[TC_BATCH] = {msg, msg, msg};
+    UINT lengths[TC_BATCH] = {5, 6, 7};
+    unsigned long long bytes = 0;
+    int filled = 0;
+    int index = 0;
+
+    msgQId = tc_create(options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    memset(&stat, 0xff, sizeof(stat));
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.sends == 0 && stat.receives == 0);
+    TC_CHECK(stat.bytesSent == 0 && stat.bytesReceived == 0);
+    TC_CHECK(stat.sendFull == 0 && stat.receiveEmpty == 0);
+    TC_CHECK(stat.sendTimeouts == 0 && stat.receiveTimeouts == 0);
+    TC_CHECK(stat.peakDepth == 0);
+
+    /* an empty queue, without and with a timeout */
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == -1);
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), TC_TIMEOUT) == -1);
+
+    /* fill the queue with messages of different lengths */
+    memset(msg, 's', sizeof(msg));
+    while (filled < TC_MAX_MSGS * TC_MSG_LENGTH &&
+        msgQSend(msgQId, msg, 1 + filled % TC_MSG_LENGTH, 0,
+        MSG_PRI_NORMAL) == 0) {
+        bytes += 1 + filled % TC_MSG_LENGTH;
+        filled++;
+    }
+    if ((options & MSG_Q_VARLEN) == 0)
+        TC_CHECK(filled == TC_MAX_MSGS);
+    TC_CHECK(filled >= TC_MAX_MSGS);
+
+    /* a full queue, without and with a timeout */
+    TC_CHECK(msgQSend(msgQId, msg, 1, TC_TIMEOUT, MSG_PRI_NORMAL) == -1);
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.sends == (unsigned long long)filled);
+    TC_CHECK(stat.sendTimes == filled);
+    TC_CHECK(stat.bytesSent == bytes);
+    TC_CHECK(stat.receives == 0 && stat.bytesReceived == 0);
+    TC_CHECK(stat.sendFull == 2 && stat.sendTimeouts == 1);
+    TC_CHECK(stat.receiveEmpty == 2 && stat.receiveTimeouts == 1);
+    TC_CHECK(stat.msgNum == filled);
+    TC_CHECK(stat.peakDepth == filled);
+
+    /* drain it, no receive finds it empty */
+    for (index = 0; index < filled; index++)
+        TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.receives == (unsigned long long)filled);
+    TC_CHECK(stat.recvTimes == filled);
+    TC_CHECK(stat.bytesReceived == bytes);
+    TC_CHECK(stat.receiveEmpty == 2 && stat.receiveTimeouts == 1);
+    TC_CHECK(stat.msgNum == 0);
+
+    /* a batch counts each of its messages */
+    TC_CHECK(msgQSendBatch(msgQId, buffers, lengths, TC_BATCH, 0,
+        MSG_PRI_NORMAL) == TC_BATCH);
+    TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+        TC_BATCH, 0) == TC_BATCH);
+    bytes += 5 + 6 + 7;
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.sends == (unsigned long long)filled + TC_BATCH);
+    TC_CHECK(stat.receives == (unsigned long long)filled + TC_BATCH);
+    TC_CHECK(stat.bytesSent == bytes && stat.bytesReceived == bytes);
+    TC_CHECK(stat.sendFull == 2 && stat.sendTimeouts == 1);
+    TC_CHECK(stat.receiveEmpty == 2 && stat.receiveTimeouts == 1);
+    TC_CHECK(stat.peakDepth == filled);
+
+    TC_CHECK(msgQShow(msgQId) == 0);
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* send the messages of a producer, all of its own length */
+static unsigned int tc_producer(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    char msg[TC_MSG_LENGTH];
+    int seq = 0;
+
+    memset(msg, 'p', sizeof(msg));
+    for (seq = 0; seq < TC_MESSAGES; seq++) {
+        if (msgQSend(task->msgQId, msg, tc_length(task->index),
+            WAIT_FOREVER, MSG_PRI_NORMAL) != 0)
+            break;
+    }
+
+    task->count = seq;
+    return 0;
+}
+
+/* receive as many messages as a producer sends */
+static unsigned int tc_consumer(void * param) {
+    TC_TASK * task = (TC_TASK*)param;
+    char msg[TC_MSG_LENGTH];
+    int seq = 0;
+
+    for (seq = 0; seq < TC_MESSAGES; seq++) {
+        if (msgQReceive(task->msgQId, msg, sizeof(msg), WAIT_FOREVER) != 0)
+            break;
+    }
+
+    task->count = seq;
+    return 0;
+}
+
+/* the shards of the threads of a stream sum up */
+static void tc_stream(int options) {
+    MSG_Q_ID msgQId = NULL;
+    MSG_Q_STAT stat;
+    TC_THREAD threads[2 * TC_THREADS];
+    TC_TASK tasks[2 * TC_THREADS];
+    unsigned long long bytes = 0;
+    int threadNum = (options & MSG_Q_SPSC) ? 1 : TC_THREADS;
+    int index = 0;
+
+    msgQId = tc_create(options);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    for (index = 0; index < 2 * threadNum; index++) {
+        tasks[index].msgQId = msgQId;
+        tasks[index].index = index % threadNum;
+        tasks[index].count = 0;
+        threads[index] = tc_spawn(index < threadNum ? tc_consumer :
+            tc_producer, &tasks[index]);
+    }
+
+    for (index = 0; index < 2 * threadNum; index++)
+        tc_join(threads[index]);
+
+    for (index = 0; index < threadNum; index++) {
+        TC_CHECK(tasks[index].count == TC_MESSAGES);
+        TC_CHECK(tasks[threadNum + index].count == TC_MESSAGES);
+        bytes += (unsigned long long)TC_MESSAGES * tc_length(index);
+    }
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.sends == (unsigned long long)threadNum * TC_MESSAGES);
+    TC_CHECK(stat.receives == (unsigned long long)threadNum * TC_MESSAGES);
+    TC_CHECK(stat.bytesSent == bytes && stat.bytesReceived == bytes);
+
+    /* each call finds the queue full, or empty, once at most */
+    TC_CHECK(stat.sendFull <= stat.sends);
+    TC_CHECK(stat.receiveEmpty <= stat.receives);
+    TC_CHECK(stat.sendTimeouts == 0 && stat.receiveTimeouts == 0);
+    TC_CHECK(stat.peakDepth >= 1);
+    if ((options & MSG_Q_VARLEN) == 0)
+        TC_CHECK(stat.peakDepth <= TC_MAX_MSGS);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    for (index = 0; index < TC_MODES; index++) {
+        printf("%s:\n", tc_modes[index].name);
+        tc_script(tc_modes[index].options);
+        tc_stream(tc_modes[index].options);
+    }
+
+    return tc_report("Stats");
+}
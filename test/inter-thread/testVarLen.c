@@ -0,0 +1,325 @@
+/**
+ * testVarLen.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the byte ring of the MSG_Q_VARLEN option.
+ *
+ * A record which doesn't fit into the bytes left at the end of the ring is
+ * written at its beginning, behind a wrap marker which counts as taken until
+ * the receiver skips it. The test lays out the ring so that a record needs
+ * the marker and checks when it fits, and that the receivers skip it one at
+ * a time and in a batch. Messages of pseudo-random lengths are then passed
+ * for many laps of the ring, by one task and by two threads, and must come
+ * back intact and in order.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#endif
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_RING_BYTES   64
+#define TC_MSG_LENGTH   40
+#define TC_STREAM_BYTES 1000
+#define TC_STREAM_MAX   200
+#define TC_MESSAGES     20000
+#define TC_BATCH        4
+
+#ifdef _WIN32
+typedef HANDLE TC_THREAD;
+#else
+typedef pthread_t TC_THREAD;
+#endif
+
+static int tc_stream_failures = 0;
+
+/* spawn a thread running entry(param) */
+static TC_THREAD tc_spawn(unsigned int (*entry)(void *), void *param) {
+#ifdef _WIN32
+    unsigned int tid = 0;
+
+    return (HANDLE)CreateThread(NULL, 0,
+            (LPTHREAD_START_ROUTINE)entry, param, 0, (DWORD*)&tid);
+#else
+    pthread_t tid;
+
+    pthread_create(&tid, NULL, (void *(*)(void *))entry, param);
+    return tid;
+#endif
+}
+
+/* wait for a thread to exit and release it */
+static void tc_join(TC_THREAD thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* the length of the message of a sequence, 0 to TC_STREAM_MAX bytes */
+static UINT tc_length(int seq) {
+    unsigned int hash = (unsigned int)seq * 2654435761U;
+
+    return (hash >> 8) % (TC_STREAM_MAX + 1);
+}
+
+/* fill the message of a sequence */
+static void tc_fill(char * msg, int seq, UINT nBytes) {
+    UINT index = 0;
+
+    for (index = 0; index < nBytes; index++)
+        msg[index] = (char)(seq + index);
+}
+
+/* check the message of a sequence */
+static int tc_intact(const char * msg, int seq, UINT nBytes) {
+    UINT index = 0;
+
+    if (nBytes != tc_length(seq))
+        return 0;
+
+    for (index = 0; index < nBytes; index++) {
+        if (msg[index] != (char)(seq + index))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* send a message of the letter <c> */
+static int tc_send(MSG_Q_ID msgQId, char c, UINT nBytes) {
+    char msg[TC_MSG_LENGTH];
+
+    memset(msg, c, nBytes);
+    return msgQSend(msgQId, msg, nBytes, 0, MSG_PRI_NORMAL);
+}
+
+/* receive a message, which must be of the letter <c> */
+static void tc_receive(MSG_Q_ID msgQId, char c, UINT nBytes) {
+    char msg[TC_MSG_LENGTH];
+    UINT index = 0;
+
+    memset(msg, 0, sizeof(msg));
+    TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+    for (index = 0; index < nBytes; index++) {
+        if (msg[index] != c) {
+            TC_CHECK(msg[index] == c);
+            break;
+        }
+    }
+}
+
+/* check the messages queued */
+static void tc_depth(MSG_Q_ID msgQId, int msgNum) {
+    MSG_Q_STAT stat;
+
+    TC_CHECK(msgQStat(msgQId, &stat) == 0);
+    TC_CHECK(stat.msgNum == msgNum);
+}
+
+/*
+ * a record which doesn't fit at the end goes behind a wrap marker: a record
+ * takes a header of 8 bytes and its data padded to 8 bytes, so the messages
+ * a, b and c of 8 bytes take 16 bytes each, and d of 16 bytes takes 24.
+ */
+static void tc_marker(int batch) {
+    MSG_Q_ID msgQId = NULL;
+    char buffer[TC_BATCH * TC_MSG_LENGTH];
+    UINT lengths[TC_BATCH];
+    UINT index = 0;
+
+    msgQId = msgQCreate(TC_RING_BYTES, TC_MSG_LENGTH, MSG_Q_VARLEN);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    /* a, b and c take the bytes 0 to 48, and a is received */
+    TC_CHECK(tc_send(msgQId, 'a', 8) == 0);
+    TC_CHECK(tc_send(msgQId, 'b', 8) == 0);
+    TC_CHECK(tc_send(msgQId, 'c', 8) == 0);
+    tc_receive(msgQId, 'a', 8);
+
+    /* d needs the 16 bytes left at the end for the marker, and 24 more */
+    TC_CHECK(tc_send(msgQId, 'd', 16) == -1);
+    tc_receive(msgQId, 'b', 8);
+    TC_CHECK(tc_send(msgQId, 'd', 16) == 0);
+    tc_depth(msgQId, 2);
+
+    /* c, the marker and d leave 8 bytes, too few for any record */
+    TC_CHECK(tc_send(msgQId, 'e', 1) == -1);
+
+    if (batch) {
+        /* the receiver skips the marker between c and d */
+        TC_CHECK(msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+            TC_BATCH, 0) == 2);
+        TC_CHECK(lengths[0] == 8 && lengths[1] == 16);
+        for (index = 0; index < 8; index++)
+            TC_CHECK(buffer[index] == 'c');
+        for (index = 8; index < 24; index++)
+            TC_CHECK(buffer[index] == 'd');
+    }
+    else {
+        tc_receive(msgQId, 'c', 8);
+        tc_depth(msgQId, 1);
+
+        /* the marker is taken until d is received, 24 bytes are left */
+        TC_CHECK(tc_send(msgQId, 'e', 17) == -1);
+        TC_CHECK(tc_send(msgQId, 'e', 16) == 0);
+        tc_receive(msgQId, 'd', 16);
+        tc_receive(msgQId, 'e', 16);
+    }
+    tc_depth(msgQId, 0);
+
+    /* the empty ring takes the largest message again */
+    TC_CHECK(tc_send(msgQId, 'f', TC_MSG_LENGTH) == 0);
+    tc_receive(msgQId, 'f', TC_MSG_LENGTH);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* fill the ring and drain it in turns, the records wrap around many times */
+static void tc_laps(void) {
+    MSG_Q_ID msgQId = NULL;
+    char msg[TC_STREAM_MAX];
+    UINT nBytes = 0;
+    UINT bytes = 0;
+    int sent = 0;
+    int received = 0;
+    int turn = 0;
+
+    msgQId = msgQCreate(TC_STREAM_BYTES, TC_STREAM_MAX, MSG_Q_VARLEN);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    for (turn = 0; turn < 200; turn++) {
+        /* send until the ring refuses, then drain some of it */
+        for (;;) {
+            nBytes = tc_length(sent);
+            tc_fill(msg, sent, nBytes);
+            if (msgQSend(msgQId, msg, nBytes, 0, MSG_PRI_NORMAL) != 0)
+                break;
+            bytes += nBytes;
+            sent++;
+        }
+        TC_CHECK(sent > received);
+
+        while (received < sent - turn % 3) {
+            memset(msg, 0, sizeof(msg));
+            TC_CHECK(msgQReceive(msgQId, msg, sizeof(msg), 0) == 0);
+            TC_CHECK(tc_intact(msg, received, tc_length(received)));
+            received++;
+        }
+    }
+
+    /* the records have gone around the ring many times */
+    TC_CHECK(bytes > 50 * TC_STREAM_BYTES);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+/* send the stream, alone and in batches, pending for room */
+static unsigned int tc_producer(void * param) {
+    MSG_Q_ID msgQId = (MSG_Q_ID)param;
+    char msgs[TC_BATCH][TC_STREAM_MAX];
+    const char * buffers[TC_BATCH];
+    UINT lengths[TC_BATCH];
+    int seq = 0;
+    int count = 0;
+    int index = 0;
+
+    while (seq < TC_MESSAGES) {
+        count = (seq % 5 == 0) ? TC_BATCH : 1;
+        count = (TC_MESSAGES - seq < count) ? TC_MESSAGES - seq : count;
+
+        for (index = 0; index < count; index++) {
+            lengths[index] = tc_length(seq + index);
+            tc_fill(msgs[index], seq + index, lengths[index]);
+            buffers[index] = msgs[index];
+        }
+
+        /* a batch is sent in part if the ring is short of bytes */
+        count = msgQSendBatch(msgQId, buffers, lengths, count, WAIT_FOREVER,
+            MSG_PRI_NORMAL);
+        if (count <= 0) {
+            __atomic_fetch_add(&tc_stream_failures, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        seq += count;
+    }
+
+    return 0;
+}
+
+/* pass the stream between two threads */
+static void tc_stream(void) {
+    MSG_Q_ID msgQId = NULL;
+    TC_THREAD thread;
+    char buffer[TC_BATCH * TC_STREAM_MAX];
+    UINT lengths[TC_BATCH];
+    UINT offset = 0;
+    int received = 0;
+    int count = 0;
+    int index = 0;
+    int bad = 0;
+
+    msgQId = msgQCreate(TC_STREAM_BYTES, TC_STREAM_MAX, MSG_Q_VARLEN);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId == NULL)
+        return;
+
+    tc_stream_failures = 0;
+    thread = tc_spawn(tc_producer, msgQId);
+
+    while (received < TC_MESSAGES) {
+        count = msgQReceiveBatch(msgQId, buffer, sizeof(buffer), lengths,
+            (received % 3 == 0) ? 1 : TC_BATCH, WAIT_FOREVER);
+        if (count <= 0) {
+            TC_CHECK(count > 0);
+            break;
+        }
+
+        offset = 0;
+        for (index = 0; index < count; index++) {
+            if (!tc_intact(buffer + offset, received, lengths[index]))
+                bad++;
+            offset += lengths[index];
+            received++;
+        }
+    }
+
+    tc_join(thread);
+
+    TC_CHECK(bad == 0);
+    TC_CHECK(tc_stream_failures == 0);
+    tc_depth(msgQId, 0);
+
+    TC_CHECK(msgQDelete(msgQId) == 0);
+}
+
+int main(int argc, char **argv) {
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    tc_marker(0);
+    tc_marker(1);
+    tc_laps();
+    tc_stream();
+
+    return tc_report("VarLen");
+}
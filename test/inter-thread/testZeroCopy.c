@@ -0,0 +1,153 @@
+/**
+ * testZeroCopy.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Functional test of the zero-copy calls of the message queue module.
+ *
+ * A message is built in place with msgQSendReserve and msgQSendCommit, and
+ * read in place with msgQReceivePeek and msgQReceiveRelease, on a queue of
+ * each mode, for several laps of the slots. A reserved slot must count as a
+ * queued message for the senders, a MSG_Q_SPSC queue must refuse a second
+ * reservation before the commit, and the calls must refuse a slot which was
+ * not handed out.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msgQueue.h"
+#include "../tcCheck.h"
+
+#define TC_MAX_MSGS     8
+#define TC_MSG_LENGTH   32
+
+/* pass messages in place for a few laps of the slots */
+static void tc_laps(MSG_Q_ID msgQId) {
+    char * pSlot = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int i = 0;
+
+    for (i = 0; i < TC_MAX_MSGS * 3; i++) {
+        TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pSlot) == 0);
+        sprintf(pSlot, "msg-%04d", i);
+        TC_CHECK(msgQSendCommit(msgQId, pSlot, 9, MSG_PRI_NORMAL) == 0);
+
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+        TC_CHECK(nBytes == 9 && atoi(pMsg + 4) == i);
+        TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+    }
+}
+
+/* a reserved slot counts as a message for the senders */
+static void tc_reserve_full(MSG_Q_ID msgQId) {
+    char buf[TC_MSG_LENGTH] = "message";
+    char * pSlot = NULL;
+    char * pMore = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int i = 0;
+
+    for (i = 0; i < TC_MAX_MSGS - 1; i++)
+        TC_CHECK(msgQSend(msgQId, buf, 8, 0, MSG_PRI_NORMAL) == 0);
+
+    TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pSlot) == 0);
+    TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pMore) == -1);
+    TC_CHECK(msgQSend(msgQId, buf, 8, 0, MSG_PRI_NORMAL) == -1);
+
+    strcpy(pSlot, "last");
+    TC_CHECK(msgQSendCommit(msgQId, pSlot, 5, MSG_PRI_NORMAL) == 0);
+
+    /* the reserved message comes out last */
+    for (i = 0; i < TC_MAX_MSGS; i++) {
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+        if (i == TC_MAX_MSGS - 1)
+            TC_CHECK(nBytes == 5 && strcmp(pMsg, "last") == 0);
+        TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+    }
+    TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == -1);
+}
+
+/* the slots which were not handed out are refused */
+static void tc_refuse(MSG_Q_ID msgQId, int options) {
+    char buf[TC_MSG_LENGTH] = "message";
+    char * pSlot = NULL;
+    char * pMore = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+
+    TC_CHECK(msgQSendCommit(msgQId, buf, 8, MSG_PRI_NORMAL) == -1);
+    TC_CHECK(msgQReceiveRelease(msgQId, buf) == -1);
+
+    /* a MSG_Q_SPSC queue has one reservation at a time */
+    if (options & MSG_Q_SPSC) {
+        TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pSlot) == 0);
+        TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pMore) == -1);
+        strcpy(pSlot, "first");
+        TC_CHECK(msgQSendCommit(msgQId, pSlot, 6, MSG_PRI_NORMAL) == 0);
+        TC_CHECK(msgQSendCommit(msgQId, pSlot, 6, MSG_PRI_NORMAL) == -1);
+
+        TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pMore) == 0);
+        strcpy(pMore, "second");
+        TC_CHECK(msgQSendCommit(msgQId, pMore, 7, MSG_PRI_NORMAL) == 0);
+
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+        TC_CHECK(strcmp(pMsg, "first") == 0);
+        TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+        TC_CHECK(strcmp(pMsg, "second") == 0);
+        TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+    }
+
+    /* a message is released once */
+    TC_CHECK(msgQSend(msgQId, buf, 8, 0, MSG_PRI_NORMAL) == 0);
+    TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == 0);
+    TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == 0);
+    TC_CHECK(msgQReceiveRelease(msgQId, pMsg) == -1);
+}
+
+int main(int argc, char **argv) {
+    MSG_Q_ID msgQId = NULL;
+    char * pSlot = NULL;
+    const char * pMsg = NULL;
+    UINT nBytes = 0;
+    int index = 0;
+
+    /* Fix the eclipse CDT output issue */
+    setbuf(stdout, NULL);
+    setbuf(stderr, NULL);
+
+    /* the byte ring is checked apart below */
+    for (index = 0; index < TC_MODES; index++) {
+        if (tc_modes[index].options & MSG_Q_VARLEN)
+            continue;
+
+        printf("%s:\n", tc_modes[index].name);
+        msgQId = msgQCreate(TC_MAX_MSGS, TC_MSG_LENGTH,
+            tc_modes[index].options);
+        TC_CHECK(msgQId != NULL);
+        if (msgQId == NULL)
+            continue;
+
+        tc_laps(msgQId);
+        tc_reserve_full(msgQId);
+        tc_refuse(msgQId, tc_modes[index].options);
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    /* the byte ring has no slot to hand out */
+    msgQId = msgQCreate(256, TC_MSG_LENGTH, MSG_Q_VARLEN);
+    TC_CHECK(msgQId != NULL);
+    if (msgQId != NULL) {
+        TC_CHECK(msgQSendReserve(msgQId, TC_MSG_LENGTH, 0, &pSlot) == -1);
+        TC_CHECK(msgQReceivePeek(msgQId, &pMsg, &nBytes, 0) == -1);
+        TC_CHECK(msgQDelete(msgQId) == 0);
+    }
+
+    return tc_report("ZeroCopy");
+}
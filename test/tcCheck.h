@@ -0,0 +1,65 @@
+/**
+ * tcCheck.h
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Checks of the functional tests of the message queue module.
+ *
+ * A test counts its checks with TC_CHECK, which prints the line and the
+ * condition of a check which fails and goes on, and returns tc_report() from
+ * main, so make check stops at the first test with a failed check. The tests
+ * which run through the modes of a queue take them from tc_modes, skipping
+ * the modes they don't apply to.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#ifndef _TC_CHECK_H_
+#define _TC_CHECK_H_
+
+#include <stdio.h>
+#include "msgQueue.h"
+
+/* a mode of a queue */
+typedef struct tagTC_MODE {
+    const char * name;
+    int options;
+}TC_MODE;
+
+/* the modes of a queue, by the options which select them */
+static const TC_MODE tc_modes[] = {
+    {"fifo", MSG_Q_FIFO},
+    {"priority", MSG_Q_PRIORITY},
+    {"spsc", MSG_Q_SPSC},
+    {"mpmc", MSG_Q_MPMC},
+    {"varlen", MSG_Q_VARLEN}
+};
+
+/* number of modes in tc_modes */
+#define TC_MODES    ((int)(sizeof(tc_modes) / sizeof(tc_modes[0])))
+
+static int tc_checks = 0;
+static int tc_failures = 0;
+
+/* count a check, print it if it fails */
+#define TC_CHECK(cond)                                                      \
+    do {                                                                    \
+        tc_checks++;                                                        \
+        if (!(cond)) {                                                      \
+            tc_failures++;                                                  \
+            printf("check failed - %s@%d: %s\n", __func__, __LINE__, #cond); \
+        }                                                                   \
+    } while (0)
+
+/* print the result of the test, the exit status of main */
+static int tc_report(const char * name) {
+    /* a test which runs through no mode uses the table here */
+    (void)tc_modes;
+
+    printf("%s: %d checks, %d failed.\n", name, tc_checks, tc_failures);
+    return tc_failures == 0 ? 0 : 1;
+}
+
+#endif /* _TC_CHECK_H_ */
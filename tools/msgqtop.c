@@ -0,0 +1,283 @@
+/**
+ * msgqtop.c
+ * This file has no copyright assigned and is placed in the Public Domain.
+ * This file is a part of the virtual operating system package.
+ * No warranty is given; refer to the file DISCLAIMER within the package.
+ *
+ * Live monitor of the named message queues on Linux.
+ *
+ *     msgqtop [-d seconds] [-n count] [name ...]
+ *
+ * Each queue is opened with msgQWatch, which maps its shared memory read-only,
+ * so the monitor never takes the mutex of a queue, touches its semaphores or
+ * counts in its references, and can't disturb the tasks using it. Once every
+ * interval the statistics of the queues are read and the rates are worked out
+ * from the counts of the previous refresh. Without a name, the queues listed
+ * by msgQList are watched, looked up again at each refresh.
+ *
+ * If you meet some problem with this module, please feel free to contact
+ * me via e-mail: gushengyuan2002@163.com
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "msgQueue.h"
+
+#define MT_NAME_WIDTH   20
+
+/* a watched queue and its counts at the previous refresh */
+typedef struct tagMT_QUEUE {
+    char * name;
+    MSG_Q_ID msgQId;
+    MSG_Q_STAT last;
+    int seen;       /* found at the refresh, else dropped */
+    int fresh;      /* no previous counts yet */
+}MT_QUEUE;
+
+static MT_QUEUE * mt_queues = NULL;
+static int mt_count = 0;
+static int mt_size = 0;
+
+/* nanoseconds since an arbitrary point */
+static long long mt_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* find a watched queue by its name */
+static MT_QUEUE * mt_find(const char * name) {
+    int index;
+
+    for (index = 0; index < mt_count; index++) {
+        if (strcmp(mt_queues[index].name, name) == 0)
+            return &mt_queues[index];
+    }
+
+    return NULL;
+}
+
+/* mark a queue as seen, watching it if it is new */
+static void mt_watch(const char * name) {
+    MT_QUEUE * pQueue = mt_find(name);
+    MT_QUEUE * pQueues = NULL;
+
+    if (pQueue != NULL) {
+        pQueue->seen = 1;
+        return;
+    }
+
+    if (mt_count == mt_size) {
+        pQueues = (MT_QUEUE*)realloc(mt_queues,
+            (mt_size + 16) * sizeof(MT_QUEUE));
+        if (pQueues == NULL)
+            return;
+        mt_queues = pQueues;
+        mt_size += 16;
+    }
+
+    pQueue = &mt_queues[mt_count];
+    memset(pQueue, 0, sizeof(MT_QUEUE));
+    pQueue->name = strdup(name);
+    if (pQueue->name == NULL)
+        return;
+    pQueue->seen = 1;
+    pQueue->fresh = 1;
+    mt_count++;
+}
+
+/* look up the queues in the registry */
+static void mt_scan(void) {
+    MSG_Q_INFO * pInfo = NULL;
+    int count = msgQList(NULL, 0);
+    int index = 0;
+
+    /* a queue created meanwhile is found at the next refresh */
+    if (count <= 0)
+        return;
+
+    pInfo = (MSG_Q_INFO*)malloc(count * sizeof(MSG_Q_INFO));
+    if (pInfo == NULL)
+        return;
+
+    count = msgQList(pInfo, count);
+    for (index = 0; index < count; index++)
+        mt_watch(pInfo[index].name);
+
+    free(pInfo);
+}
+
+/* close and forget the queues which have gone */
+static void mt_prune(void) {
+    int index = 0;
+    int keep = 0;
+
+    for (index = 0; index < mt_count; index++) {
+        if (!mt_queues[index].seen) {
+            if (mt_queues[index].msgQId != NULL)
+                msgQDelete(mt_queues[index].msgQId);
+            free(mt_queues[index].name);
+            continue;
+        }
+        mt_queues[keep++] = mt_queues[index];
+    }
+
+    mt_count = keep;
+}
+
+/* format a time in nanoseconds with a unit */
+static const char * mt_time(char * buf, unsigned long long ns) {
+    if (ns < 1000ULL)
+        sprintf(buf, "%lluns", ns);
+    else if (ns < 1000000ULL)
+        sprintf(buf, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000ULL)
+        sprintf(buf, "%.1fms", ns / 1e6);
+    else
+        sprintf(buf, "%.1fs", ns / 1e9);
+
+    return buf;
+}
+
+/* format a count per second with a suffix */
+static const char * mt_rate(char * buf, double rate) {
+    if (rate < 10000.0)
+        sprintf(buf, "%.0f", rate);
+    else if (rate < 10000000.0)
+        sprintf(buf, "%.1fK", rate / 1e3);
+    else
+        sprintf(buf, "%.1fM", rate / 1e6);
+
+    return buf;
+}
+
+/* print a line of a queue */
+static void mt_show(MT_QUEUE * pQueue, double seconds) {
+    MSG_Q_STAT stat;
+    MSG_Q_LAT_STAT lat;
+    MSG_Q_STAT * pLast = &pQueue->last;
+    char buf[8][16];
+
+    if (pQueue->msgQId == NULL)
+        pQueue->msgQId = msgQWatch(pQueue->name);
+
+    if (pQueue->msgQId == NULL || msgQStat(pQueue->msgQId, &stat) == -1) {
+        printf("%-*.*s  unavailable\n", MT_NAME_WIDTH, MT_NAME_WIDTH,
+            pQueue->name);
+        return;
+    }
+
+    /* the first refresh of a queue has no rates */
+    if (pQueue->fresh || seconds <= 0.0) {
+        *pLast = stat;
+        seconds = 0.0;
+    }
+
+    printf("%-*.*s %6d %6d %6d %8s %8s %8s %7s %7s %8llu",
+        MT_NAME_WIDTH, MT_NAME_WIDTH, pQueue->name,
+        stat.msgNum, stat.peakDepth, stat.maxMsgs,
+        seconds <= 0.0 ? "-" : mt_rate(buf[0],
+            (stat.sends - pLast->sends) / seconds),
+        seconds <= 0.0 ? "-" : mt_rate(buf[1],
+            (stat.receives - pLast->receives) / seconds),
+        seconds <= 0.0 ? "-" : mt_rate(buf[2],
+            (stat.bytesReceived - pLast->bytesReceived) / seconds),
+        seconds <= 0.0 ? "-" : mt_rate(buf[3],
+            (stat.sendFull - pLast->sendFull) / seconds),
+        seconds <= 0.0 ? "-" : mt_rate(buf[4],
+            (stat.receiveEmpty - pLast->receiveEmpty) / seconds),
+        stat.sendTimeouts + stat.receiveTimeouts);
+
+    /* the latency of the queue lifetime, if it is timed */
+    if ((stat.options & MSG_Q_LATENCY) &&
+        msgQLatency(pQueue->msgQId, &lat) == 0 && lat.count != 0)
+        printf(" %8s %8s %8s\n", mt_time(buf[5], lat.p50),
+            mt_time(buf[6], lat.p99), mt_time(buf[7], lat.max));
+    else
+        printf(" %8s %8s %8s\n", "-", "-", "-");
+
+    pQueue->last = stat;
+    pQueue->fresh = 0;
+}
+
+static void mt_usage(void) {
+    fprintf(stderr, "usage: msgqtop [-d seconds] [-n count] [name ...]\n");
+}
+
+int main(int argc, char * argv[]) {
+    double delay = 1.0;
+    double seconds = 0.0;
+    long long last = 0;
+    long long now = 0;
+    int count = 0;
+    int round = 0;
+    int index = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "d:n:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            delay = atof(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        default:
+            mt_usage();
+            return 1;
+        }
+    }
+
+    if (delay <= 0.0) {
+        mt_usage();
+        return 1;
+    }
+
+    for (index = optind; index < argc; index++)
+        mt_watch(argv[index]);
+
+    for (round = 0; count == 0 || round < count; round++) {
+        if (round != 0)
+            usleep((useconds_t)(delay * 1e6));
+
+        /* the queues of the registry come and go */
+        if (optind == argc) {
+            for (index = 0; index < mt_count; index++)
+                mt_queues[index].seen = 0;
+            mt_scan();
+            mt_prune();
+        }
+
+        now = mt_now();
+        seconds = round == 0 ? 0.0 : (now - last) / 1e9;
+        last = now;
+
+        /* clear the screen of a terminal, a pipe gets the plain lines */
+        if (isatty(STDOUT_FILENO))
+            printf("\033[H\033[2J");
+
+        printf("msgqtop - %d queue(s), every %.1fs\n\n", mt_count, delay);
+        printf("%-*s %6s %6s %6s %8s %8s %8s %7s %7s %8s %8s %8s %8s\n",
+            MT_NAME_WIDTH, "NAME", "DEPTH", "PEAK", "MAX", "SEND/s",
+            "RECV/s", "BYTES/s", "FULL/s", "EMPTY/s", "TIMEOUTS",
+            "P50", "P99", "LATMAX");
+
+        for (index = 0; index < mt_count; index++)
+            mt_show(&mt_queues[index], seconds);
+
+        fflush(stdout);
+    }
+
+    for (index = 0; index < mt_count; index++) {
+        if (mt_queues[index].msgQId != NULL)
+            msgQDelete(mt_queues[index].msgQId);
+        free(mt_queues[index].name);
+    }
+    free(mt_queues);
+
+    return 0;
+}